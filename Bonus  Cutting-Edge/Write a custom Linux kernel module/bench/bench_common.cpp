@@ -0,0 +1,459 @@
+/*
+ * bench_common.cpp - Shared helpers for the SimpleChar benchmark tools
+ *
+ * License: MIT
+ */
+
+#include "bench_common.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+namespace simplechar::bench {
+
+void throw_errno(const std::string &what)
+{
+    throw bench_error(what + ": " + std::strerror(errno));
+}
+
+void unique_fd::reset(int fd)
+{
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    fd_ = fd;
+}
+
+aligned_buffer alloc_aligned(size_t size)
+{
+    aligned_buffer buf(static_cast<char *>(std::aligned_alloc(4096,
+                           std::max<size_t>((size + 4095) / 4096 * 4096, 4096))),
+                       &std::free);
+
+    if (!buf) {
+        throw bench_error("cannot allocate a " + format_size(size) + " buffer");
+    }
+    return buf;
+}
+
+void wait_until(uint64_t deadline)
+{
+    /* Sleep longer waits, spin the last stretch for an accurate wakeup */
+    constexpr uint64_t spin_threshold_ns = 50000;
+    uint64_t now = now_ns();
+
+    if (deadline > now + spin_threshold_ns) {
+        uint64_t sleep_ns = deadline - now - spin_threshold_ns;
+        struct timespec ts = {
+            time_t(sleep_ns / 1000000000ULL),
+            long(sleep_ns % 1000000000ULL),
+        };
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, nullptr);
+    }
+    while (now_ns() < deadline) {
+        /* spin */
+    }
+}
+
+bool pin_to_cpu(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+int online_cpus()
+{
+    cpu_set_t set;
+
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        return CPU_COUNT(&set);
+    }
+    return 1;
+}
+
+std::vector<std::string> split(const std::string &text, char sep)
+{
+    std::vector<std::string> parts;
+    std::string part;
+    std::istringstream in(text);
+
+    while (std::getline(in, part, sep)) {
+        if (!part.empty()) {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+uint64_t parse_size(const std::string &text)
+{
+    char *end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    std::string suffix(end);
+    uint64_t scale = 1;
+
+    if (end == text.c_str() || value < 0) {
+        throw bench_error("invalid size: " + text);
+    }
+    if (suffix == "K" || suffix == "k" || suffix == "KiB") {
+        scale = 1ULL << 10;
+    } else if (suffix == "M" || suffix == "m" || suffix == "MiB") {
+        scale = 1ULL << 20;
+    } else if (suffix == "G" || suffix == "g" || suffix == "GiB") {
+        scale = 1ULL << 30;
+    } else if (!suffix.empty() && suffix != "B") {
+        throw bench_error("invalid size suffix: " + text);
+    }
+    return uint64_t(value * double(scale));
+}
+
+std::vector<uint64_t> parse_size_list(const std::string &text)
+{
+    std::vector<uint64_t> sizes;
+
+    for (const auto &part : split(text, ',')) {
+        sizes.push_back(parse_size(part));
+    }
+    if (sizes.empty()) {
+        throw bench_error("empty size list");
+    }
+    return sizes;
+}
+
+std::vector<int> parse_int_list(const std::string &text)
+{
+    std::vector<int> values;
+
+    for (const auto &part : split(text, ',')) {
+        try {
+            values.push_back(std::stoi(part));
+        } catch (const std::exception &) {
+            throw bench_error("invalid number: " + part);
+        }
+    }
+    if (values.empty()) {
+        throw bench_error("empty number list");
+    }
+    return values;
+}
+
+uint64_t parse_duration(const std::string &text)
+{
+    char *end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    std::string suffix(end);
+
+    if (end == text.c_str() || value < 0) {
+        throw bench_error("invalid duration: " + text);
+    }
+    if (suffix.empty() || suffix == "s") {
+        return uint64_t(value * 1e9);
+    }
+    if (suffix == "ms") {
+        return uint64_t(value * 1e6);
+    }
+    if (suffix == "us") {
+        return uint64_t(value * 1e3);
+    }
+    if (suffix == "ns") {
+        return uint64_t(value);
+    }
+    throw bench_error("invalid duration suffix: " + text);
+}
+
+double parse_rate(const std::string &text)
+{
+    char *end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    std::string suffix(end);
+
+    if (end == text.c_str() || value <= 0) {
+        throw bench_error("invalid rate: " + text);
+    }
+    if (suffix == "k" || suffix == "K") {
+        return value * 1e3;
+    }
+    if (suffix == "m" || suffix == "M") {
+        return value * 1e6;
+    }
+    if (!suffix.empty()) {
+        throw bench_error("invalid rate suffix: " + text);
+    }
+    return value;
+}
+
+int parse_mix(const std::string &text)
+{
+    auto parts = split(text, ':');
+    int reads, writes;
+
+    if (parts.size() != 2) {
+        throw bench_error("invalid read:write mix: " + text);
+    }
+    try {
+        reads = std::stoi(parts[0]);
+        writes = std::stoi(parts[1]);
+    } catch (const std::exception &) {
+        throw bench_error("invalid read:write mix: " + text);
+    }
+    if (reads < 0 || writes < 0 || reads + writes == 0) {
+        throw bench_error("invalid read:write mix: " + text);
+    }
+    return reads * 100 / (reads + writes);
+}
+
+std::string format_size(uint64_t bytes)
+{
+    static const char *units[] = {"B", "K", "M", "G"};
+    char buf[32];
+    int unit = 0;
+
+    while (bytes >= 1024 && bytes % 1024 == 0 && unit < 3) {
+        bytes /= 1024;
+        unit++;
+    }
+    std::snprintf(buf, sizeof(buf), "%llu%s", (unsigned long long)bytes,
+                  units[unit]);
+    return buf;
+}
+
+std::string format_ns(double ns)
+{
+    char buf[32];
+
+    if (ns < 1e3) {
+        std::snprintf(buf, sizeof(buf), "%.0fns", ns);
+    } else if (ns < 1e6) {
+        std::snprintf(buf, sizeof(buf), "%.1fus", ns / 1e3);
+    } else if (ns < 1e9) {
+        std::snprintf(buf, sizeof(buf), "%.1fms", ns / 1e6);
+    } else {
+        std::snprintf(buf, sizeof(buf), "%.2fs", ns / 1e9);
+    }
+    return buf;
+}
+
+latency_samples::latency_samples(size_t capacity) : capacity_(capacity)
+{
+    samples_.reserve(std::min<size_t>(capacity, 1 << 16));
+}
+
+void latency_samples::add(uint64_t ns)
+{
+    seen_++;
+    sum_ += ns;
+    max_ = std::max(max_, ns);
+    sorted_ = false;
+
+    if (samples_.size() < capacity_) {
+        samples_.push_back(ns);
+        return;
+    }
+
+    /* Reservoir sampling: keep each new sample with probability cap/seen */
+    uint64_t slot = rng_.next() % seen_;
+    if (slot < capacity_) {
+        samples_[slot] = ns;
+    }
+}
+
+/*
+ * Merge another set into this one
+ * A full reservoir stands for more operations than it holds, so the
+ * merged reservoir draws from each side in proportion to the operations
+ * it saw, not to the samples it kept.
+ */
+void latency_samples::merge(const latency_samples &other)
+{
+    size_t total = samples_.size() + other.samples_.size();
+    uint64_t seen = seen_ + other.seen_;
+
+    if (total <= capacity_) {
+        samples_.insert(samples_.end(), other.samples_.begin(), other.samples_.end());
+    } else {
+        std::vector<uint64_t> theirs(other.samples_);
+        std::vector<uint64_t> merged;
+        size_t i = 0, j = 0;
+
+        /* Shuffled, any prefix is a uniform subsample of its side */
+        shuffle(samples_);
+        shuffle(theirs);
+        merged.reserve(capacity_);
+        while (merged.size() < capacity_) {
+            bool ours = j == theirs.size() ||
+                        (i < samples_.size() && rng_.next() % seen < seen_);
+            merged.push_back(ours ? samples_[i++] : theirs[j++]);
+        }
+        samples_.swap(merged);
+    }
+    seen_ = seen;
+    sum_ += other.sum_;
+    max_ = std::max(max_, other.max_);
+    sorted_ = false;
+}
+
+void latency_samples::shuffle(std::vector<uint64_t> &v)
+{
+    for (size_t i = v.size(); i > 1; i--) {
+        std::swap(v[i - 1], v[rng_.next() % i]);
+    }
+}
+
+uint64_t latency_samples::percentile(double p)
+{
+    if (samples_.empty()) {
+        return 0;
+    }
+    if (!sorted_) {
+        std::sort(samples_.begin(), samples_.end());
+        sorted_ = true;
+    }
+
+    size_t rank = size_t(std::ceil(p / 100.0 * double(samples_.size())));
+    rank = std::clamp<size_t>(rank, 1, samples_.size());
+    return samples_[rank - 1];
+}
+
+void json_writer::separator()
+{
+    if (after_key_) {
+        after_key_ = false;
+        return;
+    }
+    if (!first_.empty()) {
+        if (!first_.back()) {
+            out_ << ",";
+        }
+        first_.back() = false;
+        out_ << "\n" << std::string(first_.size() * 2, ' ');
+    }
+}
+
+json_writer &json_writer::begin_object()
+{
+    separator();
+    out_ << "{";
+    first_.push_back(true);
+    return *this;
+}
+
+json_writer &json_writer::end_object()
+{
+    bool empty = first_.back();
+
+    first_.pop_back();
+    if (!empty) {
+        out_ << "\n" << std::string(first_.size() * 2, ' ');
+    }
+    out_ << "}";
+    if (first_.empty()) {
+        out_ << "\n";
+    }
+    return *this;
+}
+
+json_writer &json_writer::begin_array()
+{
+    separator();
+    out_ << "[";
+    first_.push_back(true);
+    return *this;
+}
+
+json_writer &json_writer::end_array()
+{
+    bool empty = first_.back();
+
+    first_.pop_back();
+    if (!empty) {
+        out_ << "\n" << std::string(first_.size() * 2, ' ');
+    }
+    out_ << "]";
+    return *this;
+}
+
+json_writer &json_writer::key(const std::string &name)
+{
+    value(name);
+    out_ << ": ";
+    after_key_ = true;
+    return *this;
+}
+
+json_writer &json_writer::value(const std::string &v)
+{
+    separator();
+    out_ << '"';
+    for (char c : v) {
+        switch (c) {
+        case '"':
+            out_ << "\\\"";
+            break;
+        case '\\':
+            out_ << "\\\\";
+            break;
+        case '\n':
+            out_ << "\\n";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out_ << buf;
+            } else {
+                out_ << c;
+            }
+        }
+    }
+    out_ << '"';
+    return *this;
+}
+
+json_writer &json_writer::value(double v)
+{
+    char buf[64];
+
+    separator();
+    if (!std::isfinite(v)) {
+        out_ << "null";
+        return *this;
+    }
+    std::snprintf(buf, sizeof(buf), "%.10g", v);
+    out_ << buf;
+    return *this;
+}
+
+json_writer &json_writer::value(uint64_t v)
+{
+    separator();
+    out_ << v;
+    return *this;
+}
+
+json_writer &json_writer::value(int64_t v)
+{
+    separator();
+    out_ << v;
+    return *this;
+}
+
+json_writer &json_writer::value(bool v)
+{
+    separator();
+    out_ << (v ? "true" : "false");
+    return *this;
+}
+
+} /* namespace simplechar::bench */
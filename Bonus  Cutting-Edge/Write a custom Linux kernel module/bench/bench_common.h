@@ -0,0 +1,208 @@
+/*
+ * bench_common.h - Shared helpers for the SimpleChar benchmark tools
+ *
+ * Timing, thread placement, argument parsing, latency statistics and a
+ * small JSON writer used by simplechar-bench and its companions.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_BENCH_COMMON_H
+#define SIMPLECHAR_BENCH_COMMON_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace simplechar::bench {
+
+/* Monotonic clock in nanoseconds */
+inline uint64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + uint64_t(ts.tv_nsec);
+}
+
+/*
+ * Wait for a now_ns() deadline: sleep through most of it, then spin the
+ * last stretch so the caller wakes within about a microsecond
+ */
+void wait_until(uint64_t deadline);
+
+/* Busy-wait hint for spin loops */
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+/* Error raised for bad arguments or failed setup, carries errno text */
+class bench_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/* Throw bench_error with the current errno appended */
+[[noreturn]] void throw_errno(const std::string &what);
+
+/* Owns a file descriptor and closes it on destruction */
+class unique_fd {
+public:
+    unique_fd() = default;
+    explicit unique_fd(int fd) : fd_(fd) {}
+    ~unique_fd() { reset(); }
+
+    unique_fd(unique_fd &&other) noexcept : fd_(other.release()) {}
+    unique_fd &operator=(unique_fd &&other) noexcept
+    {
+        if (this != &other) {
+            reset(other.release());
+        }
+        return *this;
+    }
+    unique_fd(const unique_fd &) = delete;
+    unique_fd &operator=(const unique_fd &) = delete;
+
+    int get() const { return fd_; }
+    int release()
+    {
+        int fd = fd_;
+        fd_ = -1;
+        return fd;
+    }
+    void reset(int fd = -1);
+
+private:
+    int fd_ = -1;
+};
+
+/* Page-aligned I/O buffer of at least size bytes, freed on destruction */
+using aligned_buffer = std::unique_ptr<char, decltype(&std::free)>;
+
+/* Throws bench_error if the buffer cannot be allocated */
+aligned_buffer alloc_aligned(size_t size);
+
+/* Pin the calling thread to one CPU; returns false if that is not allowed */
+bool pin_to_cpu(int cpu);
+
+/* Number of CPUs the process may run on */
+int online_cpus();
+
+/* "64", "4K", "1M" ... to bytes */
+uint64_t parse_size(const std::string &text);
+
+/* "1,4K,1M" to a list of byte counts */
+std::vector<uint64_t> parse_size_list(const std::string &text);
+
+/* "1,2,4" to a list of integers */
+std::vector<int> parse_int_list(const std::string &text);
+
+/* "0.5", "2s", "250ms" to nanoseconds */
+uint64_t parse_duration(const std::string &text);
+
+/* "500", "10k", "1.5M" to ops/s */
+double parse_rate(const std::string &text);
+
+/* "70:30" to a read percentage */
+int parse_mix(const std::string &text);
+
+std::vector<std::string> split(const std::string &text, char sep);
+
+/* Human readable byte count and latency */
+std::string format_size(uint64_t bytes);
+std::string format_ns(double ns);
+
+/* Fast per-thread pseudo random numbers */
+struct xorshift64 {
+    uint64_t state;
+
+    explicit xorshift64(uint64_t seed) : state(seed ? seed : 0x9e3779b97f4a7c15ULL) {}
+
+    uint64_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    /* Uniform in [0, 1) */
+    double uniform() { return double(next() >> 11) * 0x1.0p-53; }
+};
+
+/*
+ * Latency samples with exact percentiles
+ * Keeps every sample up to capacity, then switches to reservoir sampling
+ * so long runs stay bounded in memory without biasing the distribution.
+ */
+class latency_samples {
+public:
+    explicit latency_samples(size_t capacity = 1 << 20);
+
+    void add(uint64_t ns);
+    void merge(const latency_samples &other);
+
+    /* p in [0, 100] */
+    uint64_t percentile(double p);
+    uint64_t count() const { return seen_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return seen_ ? double(sum_) / double(seen_) : 0.0; }
+
+private:
+    void shuffle(std::vector<uint64_t> &v);
+
+    std::vector<uint64_t> samples_;
+    size_t capacity_;
+    uint64_t seen_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+    xorshift64 rng_{0x5eed};
+    bool sorted_ = false;
+};
+
+/* Minimal streaming JSON writer, enough for flat benchmark reports */
+class json_writer {
+public:
+    explicit json_writer(std::ostream &out) : out_(out) {}
+
+    json_writer &begin_object();
+    json_writer &end_object();
+    json_writer &begin_array();
+    json_writer &end_array();
+    json_writer &key(const std::string &name);
+    json_writer &value(const std::string &v);
+    json_writer &value(const char *v) { return value(std::string(v)); }
+    json_writer &value(double v);
+    json_writer &value(uint64_t v);
+    json_writer &value(int64_t v);
+    json_writer &value(int v) { return value(int64_t(v)); }
+    json_writer &value(bool v);
+
+    template <typename T>
+    json_writer &field(const std::string &name, const T &v)
+    {
+        key(name);
+        return value(v);
+    }
+
+private:
+    void separator();
+
+    std::ostream &out_;
+    std::vector<bool> first_;
+    bool after_key_ = false;
+};
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_BENCH_COMMON_H */
@@ -0,0 +1,253 @@
+/*
+ * closed_loop.cpp - Closed-loop load generator for SimpleChar devices
+ *
+ * License: MIT
+ */
+
+#include "closed_loop.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace simplechar::bench {
+
+double closed_loop_result::ops_per_sec() const
+{
+    return elapsed_ns ? double(ops) * 1e9 / double(elapsed_ns) : 0.0;
+}
+
+double closed_loop_result::gb_per_sec() const
+{
+    return elapsed_ns ? double(bytes) / double(elapsed_ns) : 0.0;
+}
+
+int open_device(const std::string &path, int flags)
+{
+    int fd = ::open(path.c_str(), flags | O_CLOEXEC);
+
+    if (fd < 0) {
+        throw_errno("cannot open " + path);
+    }
+    return fd;
+}
+
+bool read_lock_stats(int fd, simplechar_lock_info &info)
+{
+    return ::ioctl(fd, SIMPLECHAR_IOC_GET_LOCK_STATS, &info) == 0;
+}
+
+namespace {
+
+struct worker_state {
+    unique_fd fd;
+    aligned_buffer buf{nullptr, &std::free};
+    uint64_t ops = 0;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+    latency_samples latency;
+    counter_values counters;
+};
+
+/* Shared start line: workers spin until the window is published */
+struct start_line {
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    uint64_t measure_start = 0;
+    uint64_t measure_end = 0;
+};
+
+void worker(const closed_loop_params &params, int index,
+            worker_state &state, start_line &line)
+{
+    char *buf = state.buf.get();
+    xorshift64 rng(0x1234567ULL * uint64_t(index + 1));
+    std::unique_ptr<perf_group> counters;
+    bool counting = false;
+
+    std::memset(buf, 'a' + index % 26, params.block_size);
+
+    if (params.pin) {
+        pin_to_cpu(params.cpus.empty() ? index % online_cpus()
+                                       : params.cpus[index % params.cpus.size()]);
+    }
+    if (params.counters) {
+        counters = std::make_unique<perf_group>();
+    }
+
+    line.ready.fetch_add(1, std::memory_order_release);
+    while (!line.go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+
+    const uint64_t start = line.measure_start;
+    const uint64_t end = line.measure_end;
+    const uint64_t read_threshold = uint64_t(params.read_pct);
+
+    for (;;) {
+        bool is_read = read_threshold >= 100 ||
+                       (read_threshold && rng.next() % 100 < read_threshold);
+        uint64_t t0 = now_ns();
+        if (t0 >= end) {
+            break;
+        }
+        if (counters && !counting && t0 >= start) {
+            counters->start();
+            counting = true;
+        }
+
+        ssize_t n = is_read ? ::pread(state.fd.get(), buf, params.block_size, 0)
+                            : ::pwrite(state.fd.get(), buf, params.block_size, 0);
+        uint64_t t1 = now_ns();
+
+        if (t0 < start) {
+            continue;
+        }
+        if (n < 0) {
+            state.errors++;
+            continue;
+        }
+        state.ops++;
+        state.bytes += uint64_t(n);
+        state.latency.add(t1 - t0);
+    }
+
+    if (counting) {
+        counters->stop();
+        state.counters = counters->read();
+    }
+}
+
+/* Sleep until an absolute CLOCK_MONOTONIC time */
+void sleep_until(uint64_t deadline)
+{
+    struct timespec ts = {
+        time_t(deadline / 1000000000ULL),
+        long(deadline % 1000000000ULL),
+    };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+        /* retry */
+    }
+}
+
+/* Sum the I/O lock counters of every instance, false if one has none */
+bool sample_lock_stats(const std::vector<int> &fds, simplechar_lock_stats &sum)
+{
+    sum = simplechar_lock_stats{};
+    for (int fd : fds) {
+        simplechar_lock_info info;
+
+        if (!read_lock_stats(fd, info)) {
+            return false;
+        }
+        sum.acquisitions += info.io.acquisitions;
+        sum.contended += info.io.contended;
+        sum.wait_ns += info.io.wait_ns;
+        sum.max_wait_ns = std::max(sum.max_wait_ns, info.io.max_wait_ns);
+        sum.hold_ns += info.io.hold_ns;
+    }
+    return true;
+}
+
+} /* namespace */
+
+closed_loop_result run_closed_loop(const closed_loop_params &params)
+{
+    std::vector<worker_state> states(params.threads);
+    std::vector<std::thread> threads;
+    std::vector<int> sample_fds(params.devices.size(), -1);
+    simplechar_lock_stats before, after;
+    bool lock_stats;
+    start_line line;
+    closed_loop_result result;
+
+    if (params.devices.empty() || params.threads <= 0) {
+        throw bench_error("closed loop needs at least one device and thread");
+    }
+
+    for (int i = 0; i < params.threads; i++) {
+        size_t dev = params.device_map.empty()
+                         ? i % params.devices.size()
+                         : size_t(params.device_map[i % params.device_map.size()]);
+
+        if (dev >= params.devices.size()) {
+            throw bench_error("device map refers to a missing instance");
+        }
+        /* Owned by the state, so a failed open closes the earlier ones */
+        states[i].fd = unique_fd(open_device(params.devices[dev], O_RDWR));
+        states[i].buf = alloc_aligned(params.block_size);
+        if (sample_fds[dev] < 0) {
+            sample_fds[dev] = states[i].fd.get();
+        }
+    }
+    sample_fds.erase(std::remove(sample_fds.begin(), sample_fds.end(), -1),
+                     sample_fds.end());
+
+    for (int i = 0; i < params.threads; i++) {
+        threads.emplace_back(worker, std::cref(params), i, std::ref(states[i]),
+                             std::ref(line));
+    }
+    while (line.ready.load(std::memory_order_acquire) < params.threads) {
+        std::this_thread::yield();
+    }
+
+    line.measure_start = now_ns() + params.warmup_ns;
+    line.measure_end = line.measure_start + params.duration_ns;
+    line.go.store(true, std::memory_order_release);
+
+    /* Bracket the measured window with lock samples from this thread */
+    sleep_until(line.measure_start);
+    lock_stats = sample_lock_stats(sample_fds, before);
+    sleep_until(line.measure_end);
+    lock_stats = lock_stats && sample_lock_stats(sample_fds, after);
+
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    if (lock_stats) {
+        result.has_lock_stats = true;
+        result.io_lock.acquisitions = after.acquisitions - before.acquisitions;
+        result.io_lock.contended = after.contended - before.contended;
+        result.io_lock.wait_ns = after.wait_ns - before.wait_ns;
+        result.io_lock.max_wait_ns = after.max_wait_ns;
+        result.io_lock.hold_ns = after.hold_ns - before.hold_ns;
+    }
+    result.elapsed_ns = params.duration_ns;
+    for (auto &state : states) {
+        result.ops += state.ops;
+        result.bytes += state.bytes;
+        result.errors += state.errors;
+        result.latency.merge(state.latency);
+        result.counters += state.counters;
+    }
+    return result;
+}
+
+closed_loop_result run_closed_loop_trials(const closed_loop_params &params,
+                                          int trials, trial_set &out)
+{
+    std::vector<closed_loop_result> runs;
+
+    for (int i = 0; i < std::max(trials, 1); i++) {
+        runs.push_back(run_closed_loop(params));
+
+        auto &r = runs.back();
+        out.add("ops_per_sec", r.ops_per_sec());
+        out.add("gb_per_sec", r.gb_per_sec());
+        out.add("p50_ns", double(r.latency.percentile(50)));
+        out.add("p99_ns", double(r.latency.percentile(99)));
+    }
+    return std::move(runs[out.median_trial("ops_per_sec")]);
+}
+
+} /* namespace simplechar::bench */
@@ -0,0 +1,73 @@
+/*
+ * closed_loop.h - Closed-loop load generator for SimpleChar devices
+ *
+ * Each worker thread owns one open file and issues pread()/pwrite() at
+ * offset 0 back to back, timing every call. Workers are spread over the
+ * given instances round-robin unless an explicit mapping is given. When
+ * the instances answer SIMPLECHAR_IOC_GET_LOCK_STATS, the I/O lock
+ * counters are sampled around the measured window.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_CLOSED_LOOP_H
+#define SIMPLECHAR_CLOSED_LOOP_H
+
+#include "bench_common.h"
+#include "perf_counters.h"
+#include "results.h"
+#include "simplechar_ioctl.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace simplechar::bench {
+
+struct closed_loop_params {
+    std::vector<std::string> devices;  /* One path per instance */
+    uint64_t block_size = 4096;        /* Bytes per read or write */
+    int threads = 1;
+    int read_pct = 50;                 /* Share of reads, 0-100 */
+    uint64_t duration_ns = 1000000000ULL;
+    uint64_t warmup_ns = 100000000ULL;
+    bool pin = false;                  /* Pin worker i to cpus[i] */
+    std::vector<int> cpus;             /* Placement, default 0..N-1 */
+    std::vector<int> device_map;       /* Instance of worker i, default i % N */
+    bool counters = false;             /* Count perf events in the window */
+};
+
+struct closed_loop_result {
+    uint64_t ops = 0;                  /* Completed calls in the window */
+    uint64_t bytes = 0;                /* Bytes actually transferred */
+    uint64_t errors = 0;               /* Calls that returned -1 */
+    uint64_t elapsed_ns = 0;           /* Length of the measured window */
+    latency_samples latency;
+    counter_values counters;           /* Summed over workers, if requested */
+    bool has_lock_stats = false;       /* All instances reported lock stats */
+    simplechar_lock_stats io_lock{};   /* I/O gate deltas summed over instances,
+                                          max_wait_ns is since load */
+
+    double ops_per_sec() const;
+    double gb_per_sec() const;
+};
+
+/* Open a device for benchmarking, throws bench_error on failure */
+int open_device(const std::string &path, int flags);
+
+/* Lock counters of the instance behind fd; false if it has none */
+bool read_lock_stats(int fd, simplechar_lock_info &info);
+
+closed_loop_result run_closed_loop(const closed_loop_params &params);
+
+/*
+ * Run the same point several times, recording ops_per_sec, gb_per_sec,
+ * p50_ns and p99_ns of each trial; returns the trial with the median
+ * throughput
+ */
+closed_loop_result run_closed_loop_trials(const closed_loop_params &params,
+                                          int trials, trial_set &out);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_CLOSED_LOOP_H */
@@ -0,0 +1,356 @@
+/*
+ * combine.cpp - Write-combining benchmark for SimpleChar
+ *
+ * License: MIT
+ */
+
+#include "combine.h"
+#include "bench_common.h"
+#include "results.h"
+#include "topology.h"
+
+#include "combiner.h"
+#include "simplechar_ioctl.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace simplechar::bench {
+
+namespace {
+
+enum class method {
+    direct,     /* One pwrite() per message */
+    combined,   /* write_combiner */
+};
+
+const char *method_name(method m)
+{
+    return m == method::direct ? "direct" : "combined";
+}
+
+struct combine_config {
+    std::vector<int> threads{1, 2, 4, 8};
+    std::vector<uint64_t> sizes{32, 64, 128};
+    std::vector<int> cpus;              /* Producer placement, in order */
+    std::string device = "/dev/simplechar";
+    uint64_t duration_ns = 1000000000ULL;
+    uint64_t flush_bytes = 0;           /* 0: half a stage */
+    uint64_t flush_interval_us = 1000;
+    std::string json_path;
+};
+
+struct combine_result {
+    method how;
+    int threads;
+    uint64_t msg_size;
+    uint64_t messages = 0;
+    uint64_t syscalls = 0;
+    uint64_t dropped = 0;
+    uint64_t elapsed_ns = 0;
+
+    double msgs_per_sec() const
+    {
+        return elapsed_ns ? double(messages) * 1e9 / double(elapsed_ns) : 0.0;
+    }
+
+    double syscalls_per_msg() const
+    {
+        return messages ? double(syscalls) / double(messages) : 0.0;
+    }
+};
+
+void usage(FILE *out)
+{
+    std::fprintf(out,
+        "Usage: simplechar-bench combine [options]\n"
+        "\n"
+        "Has each thread count emit small messages as fast as it can, first\n"
+        "with one pwrite() per message, then through write_combiner, and\n"
+        "compares messages/s and system calls per message. Writes wrap\n"
+        "around at the device size.\n"
+        "\n"
+        "Options:\n"
+        "  -t, --threads LIST       Producer thread counts (default: 1,2,4,8)\n"
+        "  -s, --sizes LIST         Message sizes (default: 32,64,128)\n"
+        "  -c, --cpus LIST          Producer CPUs in order (default: compact\n"
+        "                           topology order)\n"
+        "  -d, --device PATH        SimpleChar device (default: /dev/simplechar)\n"
+        "  -D, --duration TIME      Measured time per point (default: 1s)\n"
+        "  -b, --flush-bytes SIZE   Staged bytes that trigger a flush\n"
+        "                           (default: half a stage)\n"
+        "  -i, --flush-interval US  Flush deadline in microseconds (default: 1000)\n"
+        "  -j, --json FILE          Write results as JSON ('-' for stdout)\n"
+        "  -h, --help               Show this help message\n");
+}
+
+combine_config parse_args(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"threads", required_argument, nullptr, 't'},
+        {"sizes", required_argument, nullptr, 's'},
+        {"cpus", required_argument, nullptr, 'c'},
+        {"device", required_argument, nullptr, 'd'},
+        {"duration", required_argument, nullptr, 'D'},
+        {"flush-bytes", required_argument, nullptr, 'b'},
+        {"flush-interval", required_argument, nullptr, 'i'},
+        {"json", required_argument, nullptr, 'j'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    combine_config cfg;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "t:s:c:d:D:b:i:j:h", options,
+                              nullptr)) != -1) {
+        switch (opt) {
+        case 't':
+            cfg.threads = parse_int_list(optarg);
+            break;
+        case 's':
+            cfg.sizes = parse_size_list(optarg);
+            break;
+        case 'c':
+            cfg.cpus = parse_cpu_list(optarg);
+            break;
+        case 'd':
+            cfg.device = optarg;
+            break;
+        case 'D':
+            cfg.duration_ns = parse_duration(optarg);
+            break;
+        case 'b':
+            cfg.flush_bytes = parse_size(optarg);
+            break;
+        case 'i':
+            cfg.flush_interval_us = std::stoull(optarg);
+            break;
+        case 'j':
+            cfg.json_path = optarg;
+            break;
+        case 'h':
+            usage(stdout);
+            std::exit(0);
+        default:
+            usage(stderr);
+            std::exit(2);
+        }
+    }
+
+    for (int n : cfg.threads) {
+        if (n <= 0) {
+            throw bench_error("thread counts must be positive");
+        }
+    }
+    if (cfg.cpus.empty()) {
+        cfg.cpus = placement_order(cpu_topology(), placement_policy::compact);
+    }
+    return cfg;
+}
+
+/* Bytes the device can hold; plain files used as stand-ins get 64M */
+uint64_t device_capacity(int fd)
+{
+    simplechar_autosize_info info;
+
+    if (::ioctl(fd, SIMPLECHAR_IOC_GET_AUTOSIZE, &info) == 0) {
+        return info.enabled ? info.max_size : info.size;
+    }
+    return 64 << 20;
+}
+
+/* Largest power of two no bigger than n */
+uint64_t floor_pow2(uint64_t n)
+{
+    uint64_t p = 1;
+
+    while (p * 2 <= n) {
+        p *= 2;
+    }
+    return p;
+}
+
+void run_point(const combine_config &cfg, combine_result &result)
+{
+    device dev = device::open(cfg.device);
+    const uint64_t size = result.msg_size;
+    const uint64_t slots = device_capacity(dev.fd()) / size;
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false}, stop{false};
+    std::atomic<uint64_t> cursor{0}, messages{0}, syscalls{0};
+    std::unique_ptr<write_combiner> wc;
+    std::vector<std::thread> threads;
+
+    if (!slots) {
+        throw bench_error("messages do not fit in the device");
+    }
+    if (result.how == method::combined) {
+        combiner_options opts;
+
+        opts.wrap_at = slots * size;
+        opts.stage_size = std::min<uint64_t>(64 * 1024, floor_pow2(opts.wrap_at));
+        opts.flush_bytes = cfg.flush_bytes ? cfg.flush_bytes : opts.stage_size / 2;
+        opts.flush_interval = std::chrono::microseconds(cfg.flush_interval_us);
+        wc = std::make_unique<write_combiner>(dev, opts);
+    }
+
+    for (int t = 0; t < result.threads; t++) {
+        int cpu = cfg.cpus[size_t(t) % cfg.cpus.size()];
+
+        threads.emplace_back([&, cpu] {
+            std::vector<char> msg(size, 'm');
+            uint64_t sent = 0;
+
+            pin_to_cpu(cpu);
+            ready.fetch_add(1, std::memory_order_release);
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (wc) {
+                    wc->write(msg);
+                } else {
+                    /* Same wrap-around placement the combiner uses */
+                    uint64_t slot = cursor.fetch_add(1, std::memory_order_relaxed);
+                    dev.write(msg, (slot % slots) * size);
+                }
+                sent++;
+            }
+            messages.fetch_add(sent, std::memory_order_relaxed);
+        });
+    }
+
+    while (ready.load(std::memory_order_acquire) < result.threads) {
+        std::this_thread::yield();
+    }
+    uint64_t start = now_ns();
+    go.store(true, std::memory_order_release);
+    wait_until(start + cfg.duration_ns);
+    stop.store(true, std::memory_order_relaxed);
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    /* Staged messages count once they reach the device */
+    if (wc) {
+        wc->flush();
+        combiner_stats st = wc->stats();
+        result.syscalls = st.syscalls;
+        result.dropped = st.dropped;
+    } else {
+        result.syscalls = messages.load();
+    }
+    result.elapsed_ns = now_ns() - start;
+    result.messages = messages.load();
+}
+
+void print_header()
+{
+    std::printf("%7s %7s %-9s %12s %10s %11s %8s\n", "threads", "size",
+                "method", "msgs/s", "MB/s", "syscall/msg", "speedup");
+}
+
+void print_pair(const combine_result &direct, const combine_result &combined)
+{
+    for (const combine_result *r : {&direct, &combined}) {
+        char speedup[16] = "-";
+
+        if (r == &combined && direct.msgs_per_sec() > 0) {
+            std::snprintf(speedup, sizeof(speedup), "%.2fx",
+                          combined.msgs_per_sec() / direct.msgs_per_sec());
+        }
+        std::printf("%7d %7s %-9s %12.0f %10.1f %11.4f %8s\n", r->threads,
+                    format_size(r->msg_size).c_str(), method_name(r->how),
+                    r->msgs_per_sec(),
+                    r->msgs_per_sec() * double(r->msg_size) / 1e6,
+                    r->syscalls_per_msg(), speedup);
+    }
+    if (combined.dropped) {
+        std::printf("  combined dropped %s after write errors\n",
+                    format_size(combined.dropped).c_str());
+    }
+    std::fflush(stdout);
+}
+
+void write_json(std::ostream &out, const combine_config &cfg,
+                const std::vector<combine_result> &results)
+{
+    json_writer json(out);
+
+    json.begin_object();
+    json.field("tool", "simplechar-bench");
+    json.field("mode", "combine");
+    write_run_info(json);
+    json.field("duration_s", double(cfg.duration_ns) / 1e9);
+    json.field("flush_interval_us", cfg.flush_interval_us);
+    json.key("results").begin_array();
+    for (const auto &r : results) {
+        json.begin_object();
+        json.field("method", method_name(r.how));
+        json.field("threads", r.threads);
+        json.field("msg_size", r.msg_size);
+        json.field("messages", r.messages);
+        json.field("syscalls", r.syscalls);
+        json.field("dropped", r.dropped);
+        json.field("msgs_per_sec", r.msgs_per_sec());
+        json.field("syscalls_per_msg", r.syscalls_per_msg());
+        json.end_object();
+    }
+    json.end_array();
+    json.end_object();
+}
+
+} /* namespace */
+
+int run_combine(int argc, char **argv)
+{
+    combine_config cfg = parse_args(argc, argv);
+    std::vector<combine_result> results;
+    bool json_stdout = cfg.json_path == "-";
+
+    if (!json_stdout) {
+        print_header();
+    }
+    for (uint64_t size : cfg.sizes) {
+        for (int threads : cfg.threads) {
+            combine_result pair[2];
+
+            for (method how : {method::direct, method::combined}) {
+                combine_result &r = pair[how == method::combined];
+
+                r.how = how;
+                r.threads = threads;
+                r.msg_size = size;
+                run_point(cfg, r);
+                results.push_back(r);
+            }
+            if (!json_stdout) {
+                print_pair(pair[0], pair[1]);
+            }
+        }
+    }
+
+    if (json_stdout) {
+        write_json(std::cout, cfg, results);
+    } else if (!cfg.json_path.empty()) {
+        std::ofstream out(cfg.json_path);
+        if (!out) {
+            throw bench_error("cannot write " + cfg.json_path);
+        }
+        write_json(out, cfg, results);
+    }
+    return 0;
+}
+
+} /* namespace simplechar::bench */
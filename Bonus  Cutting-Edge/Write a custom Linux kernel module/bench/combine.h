@@ -0,0 +1,21 @@
+/*
+ * combine.h - Write-combining benchmark for SimpleChar
+ *
+ * Has N threads emit small messages to the device, once with a write()
+ * per message and once through libsimplechar's write_combiner, and
+ * reports messages per second and system calls per message for both.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_COMBINE_H
+#define SIMPLECHAR_COMBINE_H
+
+namespace simplechar::bench {
+
+/* Entry point of "simplechar-bench combine" */
+int run_combine(int argc, char **argv);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_COMBINE_H */
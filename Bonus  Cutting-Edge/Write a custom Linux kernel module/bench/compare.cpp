@@ -0,0 +1,300 @@
+/*
+ * compare.cpp - Regression check between two benchmark reports
+ *
+ * License: MIT
+ */
+
+#include "compare.h"
+#include "bench_common.h"
+#include "json_reader.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+namespace simplechar::bench {
+
+namespace {
+
+/* Exit status when a significant regression was found */
+constexpr int exit_regression = 3;
+
+/* Fields that identify a point rather than measure it */
+const char *const identity_fields[] = {
+    "placement", "pattern", "transport", "instances", "threads",
+    "block_size", "msg_size", "read_pct",
+};
+
+struct compare_config {
+    std::string base_path;
+    std::string new_path;
+    double alpha = 0.05;
+    double min_change = 0.02;      /* Smallest relative change worth flagging */
+};
+
+void usage(FILE *out)
+{
+    std::fprintf(out,
+        "Usage: simplechar-bench compare [options] BASE.json NEW.json\n"
+        "\n"
+        "Compares two reports of the same mode (sweep, scale or ipc) point by\n"
+        "point. Metrics need several values per point: run both sides with\n"
+        "--trials 5 or more. Exits with status %d on a significant regression.\n"
+        "\n"
+        "Options:\n"
+        "  -a, --alpha P            Significance level (default: 0.05)\n"
+        "  -m, --min-change PCT     Ignore changes smaller than this, in\n"
+        "                           percent (default: 2)\n"
+        "  -h, --help               Show this help message\n",
+        exit_regression);
+}
+
+compare_config parse_args(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"alpha", required_argument, nullptr, 'a'},
+        {"min-change", required_argument, nullptr, 'm'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    compare_config cfg;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "a:m:h", options, nullptr)) != -1) {
+        switch (opt) {
+        case 'a':
+            cfg.alpha = std::stod(optarg);
+            break;
+        case 'm':
+            cfg.min_change = std::stod(optarg) / 100;
+            break;
+        case 'h':
+            usage(stdout);
+            std::exit(0);
+        default:
+            usage(stderr);
+            std::exit(2);
+        }
+    }
+
+    if (argc - optind != 2) {
+        usage(stderr);
+        std::exit(2);
+    }
+    cfg.base_path = argv[optind];
+    cfg.new_path = argv[optind + 1];
+    return cfg;
+}
+
+/* "threads=4 block_size=4K" from the identity fields of a point */
+std::string point_key(const json_value &point)
+{
+    std::string key;
+
+    for (const char *field : identity_fields) {
+        const json_value *v = point.find(field);
+        std::string text;
+
+        if (!v) {
+            continue;
+        }
+        if (v->is_string()) {
+            text = v->string;
+        } else if (std::strcmp(field, "block_size") == 0 ||
+                   std::strcmp(field, "msg_size") == 0) {
+            text = format_size(uint64_t(v->number));
+        } else {
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%g", v->number);
+            text = buf;
+        }
+        key += (key.empty() ? "" : " ") + std::string(field) + "=" + text;
+    }
+    return key;
+}
+
+std::vector<double> numbers(const json_value &array)
+{
+    std::vector<double> out;
+
+    for (const auto &v : array.array) {
+        if (v.is_number()) {
+            out.push_back(v.number);
+        }
+    }
+    return out;
+}
+
+/* Lower is better for latencies, higher for rates */
+bool lower_is_better(const std::string &metric)
+{
+    return metric.size() > 3 && metric.compare(metric.size() - 3, 3, "_ns") == 0;
+}
+
+/* Point out differences in setup that make a comparison suspect */
+void compare_context(const json_value &base, const json_value &next)
+{
+    const json_value *b = base.find("run");
+    const json_value *n = next.find("run");
+
+    if (!b || !n) {
+        std::printf("note: a report has no run metadata\n");
+        return;
+    }
+
+    auto check = [&](const char *section, const char *field) {
+        const json_value *bs = b->find(section);
+        const json_value *ns = n->find(section);
+        std::string bv = bs ? bs->get_string(field) : "";
+        std::string nv = ns ? ns->get_string(field) : "";
+
+        if (bv != nv) {
+            std::printf("note: %s %s differs: %s -> %s\n", section, field,
+                        bv.c_str(), nv.c_str());
+        }
+    };
+    check("host", "name");
+    check("host", "cpu_model");
+    check("kernel", "release");
+
+    const json_value *bm = b->find("module");
+    const json_value *nm = n->find("module");
+    std::string bh = bm ? bm->get_string("git_hash", "not loaded") : "?";
+    std::string nh = nm ? nm->get_string("git_hash", "not loaded") : "?";
+    std::printf("module: %s -> %s\n", bh.c_str(), nh.c_str());
+
+    const json_value *bp = bm ? bm->find("parameters") : nullptr;
+    const json_value *np = nm ? nm->find("parameters") : nullptr;
+    if (bp && np) {
+        for (const auto &param : np->object) {
+            std::string before = bp->get_string(param.first, "?");
+
+            if (param.second.is_string() && before != param.second.string) {
+                std::printf("note: module parameter %s differs: %s -> %s\n",
+                            param.first.c_str(), before.c_str(),
+                            param.second.string.c_str());
+            }
+        }
+    }
+}
+
+std::string format_metric(const std::string &metric, double v)
+{
+    char buf[32];
+
+    if (lower_is_better(metric)) {
+        return format_ns(v);
+    }
+    std::snprintf(buf, sizeof(buf), "%.4g", v);
+    return buf;
+}
+
+} /* namespace */
+
+int run_compare(int argc, char **argv)
+{
+    compare_config cfg = parse_args(argc, argv);
+    json_value base = load_json(cfg.base_path);
+    json_value next = load_json(cfg.new_path);
+    std::string mode = next.get_string("mode");
+    int regressions = 0, improvements = 0, untested = 0;
+
+    if (base.get_string("mode") != mode) {
+        throw bench_error("reports are of different modes: " +
+                          base.get_string("mode") + " and " + mode);
+    }
+    const json_value *base_points = base.find("results");
+    const json_value *next_points = next.find("results");
+    if (!base_points || !next_points || !base_points->is_array() ||
+        !next_points->is_array()) {
+        throw bench_error("compare supports sweep, scale and ipc reports, "
+                          "not '" + mode + "'");
+    }
+
+    /* Keys are long, size the column to the widest and print each once */
+    int width = 5;
+    for (const auto &np : next_points->array) {
+        width = std::max(width, int(point_key(np).size()));
+    }
+
+    compare_context(base, next);
+    std::printf("\n%-*s %-13s %10s %10s %8s %18s %7s  %s\n", width, "point",
+                "metric", "base", "new", "change", "95% CI", "p", "verdict");
+
+    for (const auto &np : next_points->array) {
+        std::string key = point_key(np);
+        const json_value *bp = nullptr;
+
+        for (const auto &candidate : base_points->array) {
+            if (point_key(candidate) == key) {
+                bp = &candidate;
+                break;
+            }
+        }
+        const json_value *nt = np.find("trials");
+        const json_value *bt = bp ? bp->find("trials") : nullptr;
+        if (!nt || !bt) {
+            if (!bp) {
+                std::printf("%-*s (not in base)\n", width, key.c_str());
+            }
+            continue;
+        }
+
+        for (const auto &metric : nt->object) {
+            const json_value *bm = bt->find(metric.first);
+            if (!bm) {
+                continue;
+            }
+
+            std::vector<double> a = numbers(*bm), b = numbers(metric.second);
+            double ma = median(a), mb = median(b);
+            double change = ma != 0 ? mb / ma - 1 : 0;
+            bool worse = lower_is_better(metric.first) ? change > 0 : change < 0;
+            const char *verdict = "";
+            char ci_text[32] = "-", p_text[16] = "-";
+
+            if (a.size() >= 2 && b.size() >= 2) {
+                interval ci = bootstrap_change_ci(a, b);
+                double p = mann_whitney_p(a, b);
+
+                std::snprintf(ci_text, sizeof(ci_text), "[%+.1f%%, %+.1f%%]",
+                              ci.low * 100, ci.high * 100);
+                std::snprintf(p_text, sizeof(p_text), "%.3f", p);
+                if (p < cfg.alpha && std::fabs(change) >= cfg.min_change) {
+                    verdict = worse ? "REGRESSION" : "improved";
+                    (worse ? regressions : improvements)++;
+                }
+            } else {
+                verdict = "(needs --trials >= 2)";
+                untested++;
+            }
+
+            std::printf("%-*s %-13s %10s %10s %+7.1f%% %18s %7s  %s\n",
+                        width, key.c_str(), metric.first.c_str(),
+                        format_metric(metric.first, ma).c_str(),
+                        format_metric(metric.first, mb).c_str(),
+                        change * 100, ci_text, p_text, verdict);
+            key.assign(key.size(), ' ');
+        }
+    }
+
+    std::printf("\n%d significant regression%s, %d improvement%s",
+                regressions, regressions == 1 ? "" : "s",
+                improvements, improvements == 1 ? "" : "s");
+    if (untested) {
+        std::printf(", %d metric%s without enough trials", untested,
+                    untested == 1 ? "" : "s");
+    }
+    std::printf(" (alpha %.3g, min change %.1f%%)\n", cfg.alpha,
+                cfg.min_change * 100);
+    return regressions ? exit_regression : 0;
+}
+
+} /* namespace simplechar::bench */
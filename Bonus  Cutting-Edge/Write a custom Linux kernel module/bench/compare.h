@@ -0,0 +1,22 @@
+/*
+ * compare.h - Regression check between two benchmark reports
+ *
+ * Matches the points of two JSON reports of the same mode, tests every
+ * metric with per-trial values for a significant difference (Mann-Whitney
+ * U) and puts a bootstrap confidence interval on the change of the
+ * median. Exits with status 3 when any metric regressed significantly.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_COMPARE_H
+#define SIMPLECHAR_COMPARE_H
+
+namespace simplechar::bench {
+
+/* Entry point of "simplechar-bench compare" */
+int run_compare(int argc, char **argv);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_COMPARE_H */
@@ -0,0 +1,90 @@
+#!/bin/bash
+#
+# cuse_vs_kernel.sh - Benchmark simplechar-cuse against the kernel driver
+#
+# Starts simplechar-cuse as /dev/simplechar-cuse with the parameters of
+# the loaded module, runs the same simplechar-bench sweep against both
+# devices and compares the two reports with the kernel driver as the
+# base. Options are passed on to both sweeps.
+#
+# Usage: cuse_vs_kernel.sh [sweep options]
+#        RESULTS=DIR cuse_vs_kernel.sh -b 64,4K -t 1,2
+#
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_DIR="$(dirname "$SCRIPT_DIR")"
+BENCH="$SCRIPT_DIR/simplechar-bench"
+CUSE="$PROJECT_DIR/cuse/simplechar-cuse"
+PARAMS="/sys/module/simplechar/parameters"
+KERNEL_DEV="/dev/simplechar"
+CUSE_NAME="simplechar-cuse"
+CUSE_DEV="/dev/$CUSE_NAME"
+RESULTS="${RESULTS:-$SCRIPT_DIR/results}"
+
+for bin in "$BENCH" "$CUSE"; do
+    if [ ! -x "$bin" ]; then
+        echo "Error: $bin is not built, run 'make bench cuse'" >&2
+        exit 1
+    fi
+done
+if [ ! -d "$PARAMS" ]; then
+    echo "Error: the simplechar module is not loaded, run 'make load'" >&2
+    exit 1
+fi
+if [ ! -r "$KERNEL_DEV" ] || [ ! -w "$KERNEL_DEV" ]; then
+    echo "Error: no read-write access to $KERNEL_DEV" >&2
+    exit 1
+fi
+if [ -e "$CUSE_DEV" ]; then
+    echo "Error: $CUSE_DEV already exists" >&2
+    exit 1
+fi
+
+param() {
+    cat "$PARAMS/$1"
+}
+
+# Serve the user space device with the store the module was loaded with.
+# Offset 0 for every call, as the sweep issues pread()/pwrite() at 0.
+CUSE_ARGS=(--name "$CUSE_NAME" --position zero --debug 0
+           --buffer-size "$(param buffer_size)"
+           --max-opens "$(param max_opens)"
+           --uid-quota "$(param uid_quota)"
+           --autosize-max "$(param autosize_max)"
+           --autosize-interval "$(param autosize_interval_ms)")
+if [ "$(param autosize)" = "Y" ]; then
+    CUSE_ARGS+=(--autosize)
+fi
+
+"$CUSE" "${CUSE_ARGS[@]}" &
+CUSE_PID=$!
+trap 'kill $CUSE_PID 2>/dev/null; wait $CUSE_PID 2>/dev/null || true' EXIT
+
+# udev may take a moment to create the node and apply its rules
+for _ in $(seq 50); do
+    if [ -r "$CUSE_DEV" ] && [ -w "$CUSE_DEV" ]; then
+        break
+    fi
+    if ! kill -0 $CUSE_PID 2>/dev/null; then
+        echo "Error: simplechar-cuse exited" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+if [ ! -r "$CUSE_DEV" ] || [ ! -w "$CUSE_DEV" ]; then
+    echo "Error: no read-write access to $CUSE_DEV" >&2
+    exit 1
+fi
+
+# compare needs several trials per point; later options override these
+mkdir -p "$RESULTS"
+echo "Sweeping $KERNEL_DEV..."
+"$BENCH" sweep -d "$KERNEL_DEV" --trials 5 "$@" -j "$RESULTS/kernel.json"
+echo "Sweeping $CUSE_DEV..."
+"$BENCH" sweep -d "$CUSE_DEV" --trials 5 "$@" -j "$RESULTS/cuse.json"
+
+# Status 3 only means the CUSE device is slower, which is expected
+echo
+"$BENCH" compare "$RESULTS/kernel.json" "$RESULTS/cuse.json" || [ $? -eq 3 ]
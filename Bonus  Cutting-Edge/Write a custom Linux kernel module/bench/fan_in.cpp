@@ -0,0 +1,435 @@
+/*
+ * fan_in.cpp - Fan-in reader benchmark for SimpleChar
+ *
+ * License: MIT
+ */
+
+#include "fan_in.h"
+#include "bench_common.h"
+#include "mmap_ring.h"
+#include "results.h"
+#include "topology.h"
+
+#include "fanin.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+
+namespace simplechar::bench {
+
+namespace {
+
+struct fanin_config {
+    std::vector<int> instances{1, 16, 256};
+    std::vector<int> budgets{16, 256};  /* Records per instance per turn */
+    std::vector<std::string> devices;   /* Empty: regular-file stand-ins */
+    std::vector<int> cpus;              /* Reader first, then producers */
+    uint64_t msg_size = 64;
+    int producers = 2;
+    int hot = 1;                        /* Instance 0 gets hot times the records */
+    uint64_t ring_size = 64 << 10;      /* For regular-file stand-ins */
+    uint64_t duration_ns = 1000000000ULL;
+    std::string json_path;
+};
+
+struct fanin_result {
+    int instances;
+    int budget;
+    uint64_t records = 0;
+    uint64_t out_of_order = 0;      /* Records with an unexpected sequence */
+    uint64_t elapsed_ns = 0;
+    fanin_stats reader;
+    double mean_fill = 0;           /* Mean over instances of the worst lag */
+    double max_fill = 0;
+    double min_share = 0;           /* Least served instance over the mean */
+    double max_share = 0;           /* Most served, leaving out the hot one */
+
+    double records_per_sec() const
+    {
+        return elapsed_ns ? double(records) * 1e9 / double(elapsed_ns) : 0.0;
+    }
+
+    double waits_per_record() const
+    {
+        return records ? double(reader.waits) / double(records) : 0.0;
+    }
+};
+
+void usage(FILE *out)
+{
+    std::fprintf(out,
+        "Usage: simplechar-bench fanin [options]\n"
+        "\n"
+        "Has producer threads stream records into the rings of many instances\n"
+        "while one thread reads them all through fanin_reader, and reports\n"
+        "records/s, epoll waits per record, the spread of records between\n"
+        "instances and the reader's worst lag as a share of each ring.\n"
+        "Without --device, regular files in a temporary directory stand in\n"
+        "for the instances; they cannot be polled, so the reader rescans them\n"
+        "every millisecond instead of sleeping.\n"
+        "\n"
+        "Options:\n"
+        "  -n, --instances LIST     Stand-in instance counts (default: 1,16,256)\n"
+        "  -b, --budgets LIST       Records per instance per turn (default: 16,256)\n"
+        "  -d, --device PATH        Read this device; repeat for more instances,\n"
+        "                           which replaces --instances\n"
+        "  -s, --size SIZE          Payload size, at least 8 (default: 64)\n"
+        "  -p, --producers N        Producer threads (default: 2)\n"
+        "  -H, --hot N              Instance 0 gets N times the records of the\n"
+        "                           others (default: 1)\n"
+        "  -c, --cpus LIST          Reader CPU, then producer CPUs (default:\n"
+        "                           compact topology order)\n"
+        "  -r, --ring-size SIZE     Ring size of stand-ins (default: 64K)\n"
+        "  -D, --duration TIME      Measured time per point (default: 1s)\n"
+        "  -j, --json FILE          Write results as JSON ('-' for stdout)\n"
+        "  -h, --help               Show this help message\n");
+}
+
+fanin_config parse_args(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"instances", required_argument, nullptr, 'n'},
+        {"budgets", required_argument, nullptr, 'b'},
+        {"device", required_argument, nullptr, 'd'},
+        {"size", required_argument, nullptr, 's'},
+        {"producers", required_argument, nullptr, 'p'},
+        {"hot", required_argument, nullptr, 'H'},
+        {"cpus", required_argument, nullptr, 'c'},
+        {"ring-size", required_argument, nullptr, 'r'},
+        {"duration", required_argument, nullptr, 'D'},
+        {"json", required_argument, nullptr, 'j'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    fanin_config cfg;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "n:b:d:s:p:H:c:r:D:j:h", options,
+                              nullptr)) != -1) {
+        switch (opt) {
+        case 'n':
+            cfg.instances = parse_int_list(optarg);
+            break;
+        case 'b':
+            cfg.budgets = parse_int_list(optarg);
+            break;
+        case 'd':
+            cfg.devices.push_back(optarg);
+            break;
+        case 's':
+            cfg.msg_size = parse_size(optarg);
+            break;
+        case 'p':
+            cfg.producers = std::atoi(optarg);
+            break;
+        case 'H':
+            cfg.hot = std::atoi(optarg);
+            break;
+        case 'c':
+            cfg.cpus = parse_cpu_list(optarg);
+            break;
+        case 'r':
+            cfg.ring_size = parse_size(optarg);
+            break;
+        case 'D':
+            cfg.duration_ns = parse_duration(optarg);
+            break;
+        case 'j':
+            cfg.json_path = optarg;
+            break;
+        case 'h':
+            usage(stdout);
+            std::exit(0);
+        default:
+            usage(stderr);
+            std::exit(2);
+        }
+    }
+
+    if (!cfg.devices.empty()) {
+        cfg.instances = {int(cfg.devices.size())};
+    }
+    for (int n : cfg.instances) {
+        if (n <= 0) {
+            throw bench_error("instance counts must be positive");
+        }
+    }
+    for (int n : cfg.budgets) {
+        if (n <= 0) {
+            throw bench_error("budgets must be positive");
+        }
+    }
+    if (cfg.msg_size < sizeof(uint64_t)) {
+        throw bench_error("payloads carry a sequence number, 8 bytes at least");
+    }
+    if (cfg.producers <= 0 || cfg.hot <= 0) {
+        throw bench_error("--producers and --hot must be positive");
+    }
+    if (cfg.cpus.empty()) {
+        cfg.cpus = placement_order(cpu_topology(), placement_policy::compact);
+    }
+    return cfg;
+}
+
+/* A temporary directory of ring-formatted files, removed on destruction */
+class stand_ins {
+public:
+    stand_ins(int count, uint64_t ring_size)
+    {
+        char dir[] = "/tmp/simplechar-fanin.XXXXXX";
+
+        if (!::mkdtemp(dir)) {
+            throw_errno("cannot create a directory for stand-ins");
+        }
+        dir_ = dir;
+        for (int i = 0; i < count; i++) {
+            std::string path = dir_ + "/ring" + std::to_string(i);
+            int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+
+            if (fd < 0) {
+                throw_errno("cannot create " + path);
+            }
+            ::close(fd);
+            paths_.push_back(path);
+            format_stand_in(path, ring_size);
+        }
+    }
+
+    ~stand_ins()
+    {
+        for (const auto &path : paths_) {
+            ::unlink(path.c_str());
+        }
+        ::rmdir(dir_.c_str());
+    }
+
+    const std::vector<std::string> &paths() const { return paths_; }
+
+private:
+    std::string dir_;
+    std::vector<std::string> paths_;
+};
+
+void run_point(const fanin_config &cfg, const std::vector<std::string> &paths,
+               fanin_result &result)
+{
+    const size_t n = paths.size();
+    std::vector<device> devs;
+    fanin_options opts;
+    std::vector<uint64_t> next_seq(n, 0);
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false}, stop{false};
+    std::vector<std::thread> threads;
+
+    for (const auto &path : paths) {
+        devs.push_back(device::open(path));
+    }
+    /* Every point starts from empty rings, so sequences start from 0 */
+    for (auto &dev : devs) {
+        ring_consumer drain(dev);
+
+        while (drain.consume([](const_buffer) {})) {
+        }
+    }
+    opts.batch_budget = size_t(result.budget);
+    fanin_reader reader(opts);
+    for (auto &dev : devs) {
+        reader.add(dev);
+    }
+
+    for (int t = 0; t < cfg.producers; t++) {
+        int cpu = cfg.cpus[size_t(t + 1) % cfg.cpus.size()];
+
+        threads.emplace_back([&, t, cpu] {
+            std::vector<std::unique_ptr<ring_producer>> mine;
+            std::vector<uint64_t> seqs;
+            std::vector<char> msg(cfg.msg_size, 'f');
+
+            for (size_t i = size_t(t); i < n; i += size_t(cfg.producers)) {
+                mine.push_back(std::make_unique<ring_producer>(devs[i]));
+                seqs.push_back(0);
+            }
+            pin_to_cpu(cpu);
+            ready.fetch_add(1, std::memory_order_release);
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            while (!stop.load(std::memory_order_relaxed)) {
+                /* A burst per instance; full rings are skipped, not waited on */
+                for (size_t k = 0; k < mine.size(); k++) {
+                    bool hot = t == 0 && k == 0;
+                    int burst = 8 * (hot ? cfg.hot : 1);
+
+                    for (int b = 0; b < burst; b++) {
+                        std::memcpy(msg.data(), &seqs[k], sizeof(seqs[k]));
+                        if (!mine[k]->try_push(msg)) {
+                            break;
+                        }
+                        seqs[k]++;
+                    }
+                    mine[k]->publish();
+                }
+            }
+        });
+    }
+
+    while (ready.load(std::memory_order_acquire) < cfg.producers) {
+        std::this_thread::yield();
+    }
+    pin_to_cpu(cfg.cpus[0]);
+
+    auto check = [&](size_t instance, const_buffer rec) {
+        uint64_t seq;
+
+        std::memcpy(&seq, rec.data(), sizeof(seq));
+        if (seq != next_seq[instance]) {
+            result.out_of_order++;
+        }
+        next_seq[instance] = seq + 1;
+    };
+
+    uint64_t start = now_ns();
+    uint64_t end = start + cfg.duration_ns;
+    uint64_t now;
+
+    go.store(true, std::memory_order_release);
+    do {
+        result.records += reader.poll(check, std::chrono::milliseconds(1));
+        now = now_ns();
+    } while (now < end);
+    result.elapsed_ns = now - start;
+    stop.store(true, std::memory_order_relaxed);
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    result.reader = reader.stats();
+    double mean = double(result.records) / double(n);
+    result.min_share = n ? 1e300 : 0;
+    for (size_t i = 0; i < n; i++) {
+        fanin_lag lag = reader.lag(i);
+        double fill = lag.capacity ? double(lag.max_backlog) / double(lag.capacity) : 0;
+        double share = mean > 0 ? double(lag.records) / mean : 0;
+
+        result.mean_fill += fill / double(n);
+        result.max_fill = std::max(result.max_fill, fill);
+        result.min_share = std::min(result.min_share, share);
+        if (i != 0 || cfg.hot == 1 || n == 1) {
+            result.max_share = std::max(result.max_share, share);
+        }
+    }
+}
+
+void print_header()
+{
+    std::printf("%9s %6s %12s %10s %9s %9s %9s %9s %6s\n", "instances",
+                "budget", "records/s", "wait/rec", "mean lag", "max lag",
+                "min share", "max share", "order");
+}
+
+void print_result(const fanin_result &r)
+{
+    std::printf("%9d %6d %12.0f %10.6f %8.1f%% %8.1f%% %9.2f %9.2f %6s\n",
+                r.instances, r.budget, r.records_per_sec(), r.waits_per_record(),
+                100.0 * r.mean_fill, 100.0 * r.max_fill, r.min_share,
+                r.max_share, r.out_of_order ? "BAD" : "ok");
+    std::fflush(stdout);
+}
+
+void write_json(std::ostream &out, const fanin_config &cfg,
+                const std::vector<fanin_result> &results)
+{
+    json_writer json(out);
+
+    json.begin_object();
+    json.field("tool", "simplechar-bench");
+    json.field("mode", "fanin");
+    write_run_info(json);
+    json.field("duration_s", double(cfg.duration_ns) / 1e9);
+    json.field("msg_size", cfg.msg_size);
+    json.field("producers", cfg.producers);
+    json.field("hot", cfg.hot);
+    json.field("stand_ins", cfg.devices.empty());
+    json.key("results").begin_array();
+    for (const auto &r : results) {
+        json.begin_object();
+        json.field("instances", r.instances);
+        json.field("budget", r.budget);
+        json.field("records", r.records);
+        json.field("out_of_order", r.out_of_order);
+        json.field("records_per_sec", r.records_per_sec());
+        json.field("turns", r.reader.turns);
+        json.field("scans", r.reader.scans);
+        json.field("waits", r.reader.waits);
+        json.field("waits_per_record", r.waits_per_record());
+        json.field("mean_lag_fill", r.mean_fill);
+        json.field("max_lag_fill", r.max_fill);
+        json.field("min_share", r.min_share);
+        json.field("max_share", r.max_share);
+        json.end_object();
+    }
+    json.end_array();
+    json.end_object();
+}
+
+} /* namespace */
+
+int run_fanin(int argc, char **argv)
+{
+    fanin_config cfg = parse_args(argc, argv);
+    std::vector<fanin_result> results;
+    bool json_stdout = cfg.json_path == "-";
+
+    if (!json_stdout) {
+        std::printf("%d producers, %s records, %s\n", cfg.producers,
+                    format_size(cfg.msg_size).c_str(),
+                    cfg.devices.empty() ? "regular-file stand-ins" : "devices");
+        print_header();
+    }
+    for (int count : cfg.instances) {
+        for (int budget : cfg.budgets) {
+            std::unique_ptr<stand_ins> files;
+            const std::vector<std::string> *paths = &cfg.devices;
+            fanin_result r;
+
+            if (cfg.devices.empty()) {
+                files = std::make_unique<stand_ins>(count, cfg.ring_size);
+                paths = &files->paths();
+            }
+
+            r.instances = count;
+            r.budget = budget;
+            run_point(cfg, *paths, r);
+            results.push_back(r);
+            if (!json_stdout) {
+                print_result(r);
+            }
+        }
+    }
+
+    if (json_stdout) {
+        write_json(std::cout, cfg, results);
+    } else if (!cfg.json_path.empty()) {
+        std::ofstream out(cfg.json_path);
+        if (!out) {
+            throw bench_error("cannot write " + cfg.json_path);
+        }
+        write_json(out, cfg, results);
+    }
+    return 0;
+}
+
+} /* namespace simplechar::bench */
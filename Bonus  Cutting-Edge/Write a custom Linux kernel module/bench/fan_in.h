@@ -0,0 +1,22 @@
+/*
+ * fan_in.h - Fan-in reader benchmark for SimpleChar
+ *
+ * Has producer threads stream records into the rings of many instances
+ * while one thread reads them all through libsimplechar's fanin_reader,
+ * and reports records per second, epoll waits per record, how evenly
+ * the instances were served and how far the reader fell behind.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_FAN_IN_H
+#define SIMPLECHAR_FAN_IN_H
+
+namespace simplechar::bench {
+
+/* Entry point of "simplechar-bench fanin" */
+int run_fanin(int argc, char **argv);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_FAN_IN_H */
@@ -0,0 +1,283 @@
+/*
+ * frame_scan.cpp - Frame scanner benchmark for SimpleChar
+ *
+ * License: MIT
+ */
+
+#include "frame_scan.h"
+#include "bench_common.h"
+#include "results.h"
+
+#include "frame.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+namespace simplechar::bench {
+
+namespace {
+
+using isa = frame_scanner::isa;
+
+struct frames_config {
+    std::vector<uint64_t> sizes{64, 1024, 65536};  /* Payload sizes */
+    uint64_t buffer_size = 16 << 20;
+    uint64_t duration_ns = 500000000ULL;
+    std::string json_path;
+};
+
+struct frames_result {
+    const char *path;               /* Scanner path, or "memcpy" */
+    uint64_t payload_size;
+    uint64_t bytes = 0;             /* Scanned or copied */
+    uint64_t frames = 0;
+    uint64_t elapsed_ns = 0;
+
+    double gb_per_sec() const
+    {
+        return elapsed_ns ? double(bytes) / double(elapsed_ns) : 0.0;
+    }
+
+    double frames_per_sec() const
+    {
+        return elapsed_ns ? double(frames) * 1e9 / double(elapsed_ns) : 0.0;
+    }
+};
+
+void usage(FILE *out)
+{
+    std::fprintf(out,
+        "Usage: simplechar-bench frames [options]\n"
+        "\n"
+        "Fills a buffer with length-prefixed, CRC32C-checked frames and scans\n"
+        "it over and over with each frame scanner path this CPU supports,\n"
+        "indexing boundaries and verifying every checksum. memcpy() of the\n"
+        "same buffer is shown as the memory bandwidth to aim for. Needs no\n"
+        "device.\n"
+        "\n"
+        "Options:\n"
+        "  -s, --sizes LIST         Payload sizes (default: 64,1K,64K)\n"
+        "  -b, --buffer SIZE        Bytes scanned per pass (default: 16M)\n"
+        "  -D, --duration TIME      Measured time per point (default: 500ms)\n"
+        "  -j, --json FILE          Write results as JSON ('-' for stdout)\n"
+        "  -h, --help               Show this help message\n");
+}
+
+frames_config parse_args(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"sizes", required_argument, nullptr, 's'},
+        {"buffer", required_argument, nullptr, 'b'},
+        {"duration", required_argument, nullptr, 'D'},
+        {"json", required_argument, nullptr, 'j'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    frames_config cfg;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "s:b:D:j:h", options,
+                              nullptr)) != -1) {
+        switch (opt) {
+        case 's':
+            cfg.sizes = parse_size_list(optarg);
+            break;
+        case 'b':
+            cfg.buffer_size = parse_size(optarg);
+            break;
+        case 'D':
+            cfg.duration_ns = parse_duration(optarg);
+            break;
+        case 'j':
+            cfg.json_path = optarg;
+            break;
+        case 'h':
+            usage(stdout);
+            std::exit(0);
+        default:
+            usage(stderr);
+            std::exit(2);
+        }
+    }
+
+    for (uint64_t size : cfg.sizes) {
+        if (size + sizeof(frame_header) > cfg.buffer_size) {
+            throw bench_error("frames of " + format_size(size) +
+                              " do not fit in the buffer");
+        }
+    }
+    return cfg;
+}
+
+/* Frames of size bytes of random payload, as many as fit */
+std::vector<char> make_stream(const frames_config &cfg, uint64_t size,
+                              uint64_t &frames)
+{
+    std::vector<char> stream(cfg.buffer_size);
+    std::vector<char> payload(size);
+    std::mt19937_64 rng(size);
+    size_t at = 0;
+
+    frames = 0;
+    for (;;) {
+        for (char &c : payload) {
+            c = char(rng());
+        }
+        size_t n = frame_encode(mutable_buffer(stream.data() + at,
+                                               stream.size() - at), payload);
+        if (!n) {
+            break;
+        }
+        at += n;
+        frames++;
+    }
+    stream.resize(at);
+    return stream;
+}
+
+void run_scan(const frames_config &cfg, const std::vector<char> &stream,
+              uint64_t expect, frames_result &result, isa path)
+{
+    frame_scanner scanner(path);
+    std::vector<frame_ref> index(expect);
+    uint64_t start = now_ns();
+    uint64_t end = start + cfg.duration_ns;
+    uint64_t now;
+
+    do {
+        scan_result r = scanner.scan(stream, index.data(), index.size());
+        if (r.frames != expect || r.bad || r.consumed != stream.size()) {
+            throw bench_error(std::string(frame_scanner::name(path)) +
+                              " scanner disagrees with the encoder");
+        }
+        result.bytes += stream.size();
+        result.frames += r.frames;
+        now = now_ns();
+    } while (now < end);
+    result.elapsed_ns = now - start;
+}
+
+void run_memcpy(const frames_config &cfg, const std::vector<char> &stream,
+                frames_result &result)
+{
+    std::vector<char> copy(stream.size());
+    uint64_t start = now_ns();
+    uint64_t end = start + cfg.duration_ns;
+    uint64_t now;
+
+    do {
+        std::memcpy(copy.data(), stream.data(), stream.size());
+        /* Keep the copy from being optimized away */
+        asm volatile("" : : "r"(copy.data()) : "memory");
+        result.bytes += stream.size();
+        now = now_ns();
+    } while (now < end);
+    result.elapsed_ns = now - start;
+}
+
+void print_header()
+{
+    std::printf("%8s %-10s %10s %14s %9s\n", "payload", "path", "GB/s",
+                "frames/s", "vs memcpy");
+}
+
+void print_result(const frames_result &r, const frames_result &copy)
+{
+    char ratio[16] = "-";
+
+    if (&r != &copy && copy.gb_per_sec() > 0) {
+        std::snprintf(ratio, sizeof(ratio), "%.2fx",
+                      r.gb_per_sec() / copy.gb_per_sec());
+    }
+    std::printf("%8s %-10s %10.2f %14.0f %9s\n",
+                format_size(r.payload_size).c_str(), r.path, r.gb_per_sec(),
+                r.frames_per_sec(), ratio);
+    std::fflush(stdout);
+}
+
+void write_json(std::ostream &out, const frames_config &cfg,
+                const std::vector<frames_result> &results)
+{
+    json_writer json(out);
+
+    json.begin_object();
+    json.field("tool", "simplechar-bench");
+    json.field("mode", "frames");
+    write_run_info(json);
+    json.field("duration_s", double(cfg.duration_ns) / 1e9);
+    json.field("buffer_size", cfg.buffer_size);
+    json.field("best_path", frame_scanner::name(frame_scanner::best()));
+    json.key("results").begin_array();
+    for (const auto &r : results) {
+        json.begin_object();
+        json.field("path", r.path);
+        json.field("payload_size", r.payload_size);
+        json.field("bytes", r.bytes);
+        json.field("frames", r.frames);
+        json.field("gb_per_sec", r.gb_per_sec());
+        json.field("frames_per_sec", r.frames_per_sec());
+        json.end_object();
+    }
+    json.end_array();
+    json.end_object();
+}
+
+} /* namespace */
+
+int run_frames(int argc, char **argv)
+{
+    frames_config cfg = parse_args(argc, argv);
+    std::vector<frames_result> results;
+    bool json_stdout = cfg.json_path == "-";
+
+    if (!json_stdout) {
+        std::printf("%s buffer, best path %s\n",
+                    format_size(cfg.buffer_size).c_str(),
+                    frame_scanner::name(frame_scanner::best()));
+        print_header();
+    }
+    for (uint64_t size : cfg.sizes) {
+        uint64_t frames;
+        std::vector<char> stream = make_stream(cfg, size, frames);
+        frames_result copy{"memcpy", size};
+
+        run_memcpy(cfg, stream, copy);
+        results.push_back(copy);
+        if (!json_stdout) {
+            print_result(copy, copy);
+        }
+        for (isa path : {isa::scalar, isa::sse42, isa::armv8_crc}) {
+            if (!frame_scanner::supported(path)) {
+                continue;
+            }
+            frames_result r{frame_scanner::name(path), size};
+
+            run_scan(cfg, stream, frames, r, path);
+            results.push_back(r);
+            if (!json_stdout) {
+                print_result(r, copy);
+            }
+        }
+    }
+
+    if (json_stdout) {
+        write_json(std::cout, cfg, results);
+    } else if (!cfg.json_path.empty()) {
+        std::ofstream out(cfg.json_path);
+        if (!out) {
+            throw bench_error("cannot write " + cfg.json_path);
+        }
+        write_json(out, cfg, results);
+    }
+    return 0;
+}
+
+} /* namespace simplechar::bench */
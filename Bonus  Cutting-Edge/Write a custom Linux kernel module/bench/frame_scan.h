@@ -0,0 +1,21 @@
+/*
+ * frame_scan.h - Frame scanner benchmark for SimpleChar
+ *
+ * Scans a large buffer of length-prefixed, CRC32C-checked frames, as a
+ * consumer gets from one big read(), with every scanner path the CPU
+ * supports, and sets the rates against a plain memcpy() of the buffer.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_FRAME_SCAN_H
+#define SIMPLECHAR_FRAME_SCAN_H
+
+namespace simplechar::bench {
+
+/* Entry point of "simplechar-bench frames" */
+int run_frames(int argc, char **argv);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_FRAME_SCAN_H */
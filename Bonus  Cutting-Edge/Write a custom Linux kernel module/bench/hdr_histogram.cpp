@@ -0,0 +1,121 @@
+/*
+ * hdr_histogram.cpp - High dynamic range latency histogram
+ *
+ * License: MIT
+ */
+
+#include "hdr_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace simplechar::bench {
+
+hdr_histogram::hdr_histogram(int precision_bits, int max_bits)
+    : precision_bits_(precision_bits),
+      sub_count_(1ULL << precision_bits),
+      half_count_(1ULL << (precision_bits - 1)),
+      max_value_((1ULL << max_bits) - 1)
+{
+    /* Linear part, then half_count_ buckets for each shift 1..top */
+    size_t shifts = size_t(max_bits - precision_bits + 1);
+
+    counts_.assign(sub_count_ + shifts * half_count_, 0);
+}
+
+size_t hdr_histogram::index_of(uint64_t value) const
+{
+    if (value < sub_count_) {
+        return size_t(value);
+    }
+
+    /* Keep precision_bits significant bits: value >> shift in [half, sub) */
+    int shift = 63 - __builtin_clzll(value) - (precision_bits_ - 1);
+    uint64_t sub = value >> shift;
+
+    return size_t(sub_count_ + uint64_t(shift - 1) * half_count_ +
+                  (sub - half_count_));
+}
+
+uint64_t hdr_histogram::highest_equivalent(size_t index) const
+{
+    if (index < sub_count_) {
+        return index;
+    }
+
+    uint64_t k = index - sub_count_;
+    int shift = int(k / half_count_) + 1;
+    uint64_t sub = k % half_count_ + half_count_;
+
+    return (sub << shift) + (1ULL << shift) - 1;
+}
+
+void hdr_histogram::record(uint64_t value, uint64_t count)
+{
+    value = std::min(value, max_value_);
+    counts_[index_of(value)] += count;
+    total_ += count;
+    sum_ += double(value) * double(count);
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+}
+
+void hdr_histogram::record_corrected(uint64_t value, uint64_t expected_interval)
+{
+    record(value);
+    if (!expected_interval) {
+        return;
+    }
+    for (uint64_t missed = value > expected_interval ? value - expected_interval : 0;
+         missed >= expected_interval; missed -= expected_interval) {
+        record(missed);
+    }
+}
+
+void hdr_histogram::merge(const hdr_histogram &other)
+{
+    size_t n = std::min(counts_.size(), other.counts_.size());
+
+    for (size_t i = 0; i < n; i++) {
+        counts_[i] += other.counts_[i];
+    }
+    total_ += other.total_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+}
+
+void hdr_histogram::reset()
+{
+    std::fill(counts_.begin(), counts_.end(), 0);
+    total_ = 0;
+    sum_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+}
+
+uint64_t hdr_histogram::percentile(double p) const
+{
+    if (!total_) {
+        return 0;
+    }
+
+    uint64_t rank = uint64_t(std::ceil(p / 100.0 * double(total_)));
+    uint64_t seen = 0;
+
+    rank = std::clamp<uint64_t>(rank, 1, total_);
+    for (size_t i = 0; i < counts_.size(); i++) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return std::min(highest_equivalent(i), max_);
+        }
+    }
+    return max_;
+}
+
+double hdr_histogram::mean() const
+{
+    return total_ ? sum_ / double(total_) : 0.0;
+}
+
+} /* namespace simplechar::bench */
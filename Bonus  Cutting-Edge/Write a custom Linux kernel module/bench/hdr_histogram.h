@@ -0,0 +1,67 @@
+/*
+ * hdr_histogram.h - High dynamic range latency histogram
+ *
+ * Log-linear buckets in the style of HdrHistogram: values below
+ * 2^precision_bits are counted exactly, larger values keep the same
+ * number of significant bits, so the relative error stays below
+ * 2^-(precision_bits - 1) from nanoseconds up to the tracked maximum.
+ * Recording is a couple of shifts and an increment, cheap enough for
+ * every operation of an open-loop run.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_HDR_HISTOGRAM_H
+#define SIMPLECHAR_HDR_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace simplechar::bench {
+
+class hdr_histogram {
+public:
+    /*
+     * precision_bits 11 gives 3 significant decimal digits, max_bits 40
+     * covers about 18 minutes in nanoseconds
+     */
+    explicit hdr_histogram(int precision_bits = 11, int max_bits = 40);
+
+    void record(uint64_t value, uint64_t count = 1);
+
+    /*
+     * Record a value measured by a closed loop that expected one sample
+     * every expected_interval; backfills the samples a stalled loop could
+     * not take (coordinated-omission correction).
+     */
+    void record_corrected(uint64_t value, uint64_t expected_interval);
+
+    void merge(const hdr_histogram &other);
+    void reset();
+
+    /* p in [0, 100]; returns the highest value equivalent to the bucket */
+    uint64_t percentile(double p) const;
+    uint64_t count() const { return total_; }
+    uint64_t min() const { return total_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const;
+
+private:
+    size_t index_of(uint64_t value) const;
+    uint64_t highest_equivalent(size_t index) const;
+
+    int precision_bits_;
+    uint64_t sub_count_;     /* Linear buckets below the first exponent */
+    uint64_t half_count_;    /* Buckets per power of two above that */
+    uint64_t max_value_;
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+    double sum_ = 0;
+};
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_HDR_HISTOGRAM_H */
@@ -0,0 +1,511 @@
+/*
+ * ipc.cpp - IPC baseline comparison for SimpleChar
+ *
+ * License: MIT
+ */
+
+#include "ipc.h"
+#include "bench_common.h"
+#include "hdr_histogram.h"
+#include "ipc_transports.h"
+#include "results.h"
+#include "topology.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+
+namespace simplechar::bench {
+
+namespace {
+
+enum class pattern {
+    stream,     /* Producer sends as fast as the channel accepts */
+    pingpong,   /* One message in flight, echoed back */
+};
+
+const char *pattern_name(pattern p)
+{
+    return p == pattern::stream ? "stream" : "pingpong";
+}
+
+/* Every message starts with this; the rest is payload */
+struct message_header {
+    uint64_t seq;
+    uint64_t send_ns;
+};
+
+constexpr uint64_t stop_seq = UINT64_MAX;
+
+struct ipc_config {
+    std::vector<transport> transports = all_transports();
+    std::vector<pattern> patterns{pattern::stream, pattern::pingpong};
+    std::vector<uint64_t> sizes{64, 1024, 4096, 65536};
+    std::vector<int> cpus;              /* Producer, consumer */
+    uint64_t capacity = 64 * 1024;
+    std::string device = "/dev/simplechar";
+    uint64_t duration_ns = 1000000000ULL;
+    uint64_t warmup_ns = 100000000ULL;
+    int trials = 1;
+    std::string json_path;
+};
+
+struct ipc_result {
+    transport via;
+    pattern kind;
+    uint64_t msg_size;
+    size_t slots = 0;
+    uint64_t messages = 0;              /* Delivered (stream) or round trips */
+    uint64_t elapsed_ns = 0;
+    hdr_histogram latency;              /* One-way (stream) or round trip */
+    std::string skipped;                /* Why the transport did not run */
+    trial_set trials;
+
+    double msgs_per_sec() const
+    {
+        return elapsed_ns ? double(messages) * 1e9 / double(elapsed_ns) : 0.0;
+    }
+
+    double mb_per_sec() const
+    {
+        return msgs_per_sec() * double(msg_size) / 1e6;
+    }
+};
+
+void usage(FILE *out)
+{
+    std::fprintf(out,
+        "Usage: simplechar-bench ipc [options]\n"
+        "\n"
+        "Moves fixed-size messages between two pinned threads over each\n"
+        "transport with the same code, sizes, buffering and placement:\n"
+        "pipe, unix-stream, unix-seqpacket, shm-futex, eventfd, simplechar.\n"
+        "\n"
+        "Options:\n"
+        "  -T, --transports LIST    Transports to run (default: all)\n"
+        "  -p, --patterns LIST      stream,pingpong (default: both)\n"
+        "  -s, --sizes LIST         Message sizes, at least 16 bytes\n"
+        "                           (default: 64,1K,4K,64K)\n"
+        "  -c, --cpus A,B           Producer and consumer CPUs (default: the\n"
+        "                           first two in topology order)\n"
+        "  -C, --capacity SIZE      Buffering per direction (default: 64K)\n"
+        "  -d, --device PATH        SimpleChar device (default: /dev/simplechar)\n"
+        "  -D, --duration TIME      Measured time per point (default: 1s)\n"
+        "  -w, --warmup TIME        Unmeasured warmup per point (default: 100ms)\n"
+        "  -n, --trials N           Repeat every point, report the median\n"
+        "  -j, --json FILE          Write results as JSON ('-' for stdout)\n"
+        "  -h, --help               Show this help message\n");
+}
+
+ipc_config parse_args(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"transports", required_argument, nullptr, 'T'},
+        {"patterns", required_argument, nullptr, 'p'},
+        {"sizes", required_argument, nullptr, 's'},
+        {"cpus", required_argument, nullptr, 'c'},
+        {"capacity", required_argument, nullptr, 'C'},
+        {"device", required_argument, nullptr, 'd'},
+        {"duration", required_argument, nullptr, 'D'},
+        {"warmup", required_argument, nullptr, 'w'},
+        {"trials", required_argument, nullptr, 'n'},
+        {"json", required_argument, nullptr, 'j'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    ipc_config cfg;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "T:p:s:c:C:d:D:w:n:j:h", options,
+                              nullptr)) != -1) {
+        switch (opt) {
+        case 'T':
+            cfg.transports.clear();
+            for (const auto &name : split(optarg, ',')) {
+                cfg.transports.push_back(parse_transport(name));
+            }
+            break;
+        case 'p':
+            cfg.patterns.clear();
+            for (const auto &name : split(optarg, ',')) {
+                if (name == "stream") {
+                    cfg.patterns.push_back(pattern::stream);
+                } else if (name == "pingpong") {
+                    cfg.patterns.push_back(pattern::pingpong);
+                } else {
+                    throw bench_error("unknown pattern: " + name);
+                }
+            }
+            break;
+        case 's':
+            cfg.sizes = parse_size_list(optarg);
+            break;
+        case 'c':
+            cfg.cpus = parse_cpu_list(optarg);
+            break;
+        case 'C':
+            cfg.capacity = parse_size(optarg);
+            break;
+        case 'd':
+            cfg.device = optarg;
+            break;
+        case 'D':
+            cfg.duration_ns = parse_duration(optarg);
+            break;
+        case 'w':
+            cfg.warmup_ns = parse_duration(optarg);
+            break;
+        case 'n':
+            cfg.trials = std::stoi(optarg);
+            break;
+        case 'j':
+            cfg.json_path = optarg;
+            break;
+        case 'h':
+            usage(stdout);
+            std::exit(0);
+        default:
+            usage(stderr);
+            std::exit(2);
+        }
+    }
+
+    if (cfg.trials <= 0) {
+        throw bench_error("trial count must be positive");
+    }
+    for (uint64_t size : cfg.sizes) {
+        if (size < sizeof(message_header)) {
+            throw bench_error("messages must be at least " +
+                              std::to_string(sizeof(message_header)) + " bytes");
+        }
+    }
+    if (cfg.cpus.empty()) {
+        cfg.cpus = placement_order(cpu_topology(), placement_policy::compact);
+    }
+    if (cfg.cpus.size() == 1) {
+        cfg.cpus.push_back(cfg.cpus[0]);
+    }
+    cfg.cpus.resize(2);
+    return cfg;
+}
+
+struct start_line {
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    uint64_t measure_start = 0;
+    uint64_t measure_end = 0;
+
+    void wait()
+    {
+        ready.fetch_add(1, std::memory_order_release);
+        while (!go.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+};
+
+/*
+ * Run body on a pinned thread; a failure on one side would leave the
+ * other blocked in its channel, so it ends the program instead
+ */
+std::thread pinned_thread(int cpu, std::function<void()> body)
+{
+    return std::thread([cpu, body = std::move(body)] {
+        pin_to_cpu(cpu);
+        try {
+            body();
+        } catch (const std::exception &e) {
+            std::fprintf(stderr, "simplechar-bench: %s\n", e.what());
+            std::exit(1);
+        }
+    });
+}
+
+void run_stream(const ipc_config &cfg, channel_pair &ch, ipc_result &result)
+{
+    start_line line;
+    const size_t size = result.msg_size;
+
+    std::thread producer = pinned_thread(cfg.cpus[0], [&] {
+        std::vector<char> buf(size, 'p');
+        message_header hdr;
+
+        line.wait();
+        for (hdr.seq = 0;; hdr.seq++) {
+            hdr.send_ns = now_ns();
+            if (hdr.send_ns >= line.measure_end) {
+                break;
+            }
+            std::memcpy(buf.data(), &hdr, sizeof(hdr));
+            ch.forward->send(buf.data(), size);
+        }
+        hdr.seq = stop_seq;
+        std::memcpy(buf.data(), &hdr, sizeof(hdr));
+        ch.forward->send(buf.data(), size);
+    });
+
+    std::thread consumer = pinned_thread(cfg.cpus[1], [&] {
+        std::vector<char> buf(size);
+        message_header hdr;
+
+        line.wait();
+        for (;;) {
+            ch.forward->recv(buf.data(), size);
+            uint64_t now = now_ns();
+
+            std::memcpy(&hdr, buf.data(), sizeof(hdr));
+            if (hdr.seq == stop_seq) {
+                break;
+            }
+            if (hdr.send_ns >= line.measure_start) {
+                result.messages++;
+                result.latency.record(now - hdr.send_ns);
+            }
+        }
+    });
+
+    while (line.ready.load(std::memory_order_acquire) < 2) {
+        std::this_thread::yield();
+    }
+    line.measure_start = now_ns() + cfg.warmup_ns;
+    line.measure_end = line.measure_start + cfg.duration_ns;
+    line.go.store(true, std::memory_order_release);
+
+    producer.join();
+    consumer.join();
+    result.elapsed_ns = cfg.duration_ns;
+}
+
+void run_pingpong(const ipc_config &cfg, channel_pair &ch, ipc_result &result)
+{
+    start_line line;
+    const size_t size = result.msg_size;
+
+    std::thread client = pinned_thread(cfg.cpus[0], [&] {
+        std::vector<char> buf(size, 'c');
+        message_header hdr;
+
+        line.wait();
+        for (hdr.seq = 0;; hdr.seq++) {
+            uint64_t t0 = now_ns();
+
+            if (t0 >= line.measure_end) {
+                break;
+            }
+            hdr.send_ns = t0;
+            std::memcpy(buf.data(), &hdr, sizeof(hdr));
+            ch.forward->send(buf.data(), size);
+            ch.backward->recv(buf.data(), size);
+            uint64_t t1 = now_ns();
+
+            if (t0 >= line.measure_start) {
+                result.messages++;
+                result.latency.record(t1 - t0);
+            }
+        }
+        hdr.seq = stop_seq;
+        std::memcpy(buf.data(), &hdr, sizeof(hdr));
+        ch.forward->send(buf.data(), size);
+    });
+
+    std::thread server = pinned_thread(cfg.cpus[1], [&] {
+        std::vector<char> buf(size);
+        message_header hdr;
+
+        line.wait();
+        for (;;) {
+            ch.forward->recv(buf.data(), size);
+            std::memcpy(&hdr, buf.data(), sizeof(hdr));
+            if (hdr.seq == stop_seq) {
+                break;
+            }
+            ch.backward->send(buf.data(), size);
+        }
+    });
+
+    while (line.ready.load(std::memory_order_acquire) < 2) {
+        std::this_thread::yield();
+    }
+    line.measure_start = now_ns() + cfg.warmup_ns;
+    line.measure_end = line.measure_start + cfg.duration_ns;
+    line.go.store(true, std::memory_order_release);
+
+    client.join();
+    server.join();
+    result.elapsed_ns = cfg.duration_ns;
+}
+
+void print_header()
+{
+    std::printf("%-9s %7s %-15s %6s %12s %10s %9s %9s %9s %8s\n",
+                "pattern", "size", "transport", "slots", "msgs/s", "MB/s",
+                "p50", "p99", "p99.9", "vs-sc");
+}
+
+/* One block per pattern and size, relative to the simplechar row */
+void print_group(const std::vector<ipc_result> &group)
+{
+    double sc = 0;
+
+    for (const auto &r : group) {
+        if (r.via == transport::simplechar && r.skipped.empty()) {
+            sc = r.msgs_per_sec();
+        }
+    }
+    for (const auto &r : group) {
+        if (!r.skipped.empty()) {
+            std::printf("%-9s %7s %-15s skipped: %s\n", pattern_name(r.kind),
+                        format_size(r.msg_size).c_str(), transport_name(r.via),
+                        r.skipped.c_str());
+            continue;
+        }
+
+        char rel[16] = "-";
+        if (sc > 0) {
+            std::snprintf(rel, sizeof(rel), "%.2fx", r.msgs_per_sec() / sc);
+        }
+        std::printf("%-9s %7s %-15s %6zu %12.0f %10.1f %9s %9s %9s %8s\n",
+                    pattern_name(r.kind), format_size(r.msg_size).c_str(),
+                    transport_name(r.via), r.slots, r.msgs_per_sec(),
+                    r.mb_per_sec(),
+                    format_ns(double(r.latency.percentile(50))).c_str(),
+                    format_ns(double(r.latency.percentile(99))).c_str(),
+                    format_ns(double(r.latency.percentile(99.9))).c_str(), rel);
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+}
+
+void write_json(std::ostream &out, const ipc_config &cfg,
+                const std::vector<ipc_result> &results)
+{
+    json_writer json(out);
+
+    json.begin_object();
+    json.field("tool", "simplechar-bench");
+    json.field("mode", "ipc");
+    write_run_info(json);
+    json.field("trials", cfg.trials);
+    json.field("duration_s", double(cfg.duration_ns) / 1e9);
+    json.field("capacity", cfg.capacity);
+    json.key("cpus").begin_array();
+    for (int cpu : cfg.cpus) {
+        json.value(cpu);
+    }
+    json.end_array();
+    json.key("results").begin_array();
+    for (const auto &r : results) {
+        json.begin_object();
+        json.field("pattern", pattern_name(r.kind));
+        json.field("transport", transport_name(r.via));
+        json.field("msg_size", r.msg_size);
+        if (!r.skipped.empty()) {
+            json.field("skipped", r.skipped);
+            json.end_object();
+            continue;
+        }
+        json.field("slots", uint64_t(r.slots));
+        json.field("messages", r.messages);
+        json.field("msgs_per_sec", r.msgs_per_sec());
+        json.field("mb_per_sec", r.mb_per_sec());
+        json.key("latency_ns").begin_object();
+        json.field("mean", r.latency.mean());
+        json.field("p50", r.latency.percentile(50));
+        json.field("p99", r.latency.percentile(99));
+        json.field("p999", r.latency.percentile(99.9));
+        json.field("max", r.latency.max());
+        json.end_object();
+        r.trials.write(json);
+        json.end_object();
+    }
+    json.end_array();
+    json.end_object();
+}
+
+} /* namespace */
+
+int run_ipc(int argc, char **argv)
+{
+    ipc_config cfg = parse_args(argc, argv);
+    std::vector<ipc_result> results;
+    bool json_stdout = cfg.json_path == "-";
+
+    if (!json_stdout) {
+        std::printf("producer on CPU %d, consumer on CPU %d, %s per direction\n"
+                    "stream latency is one-way, pingpong latency a round trip\n\n",
+                    cfg.cpus[0], cfg.cpus[1], format_size(cfg.capacity).c_str());
+        print_header();
+    }
+
+    for (pattern kind : cfg.patterns) {
+        for (uint64_t size : cfg.sizes) {
+            std::vector<ipc_result> group;
+
+            for (transport via : cfg.transports) {
+                std::vector<ipc_result> runs;
+                trial_set trials;
+
+                /* Fresh channels per trial so no state carries over */
+                for (int trial = 0; trial < cfg.trials; trial++) {
+                    ipc_result r;
+                    channel_pair ch;
+
+                    r.via = via;
+                    r.kind = kind;
+                    r.msg_size = size;
+                    try {
+                        ch = make_channels(via, size, cfg.capacity, cfg.device);
+                    } catch (const bench_error &e) {
+                        r.skipped = e.what();
+                        runs.push_back(std::move(r));
+                        break;
+                    }
+                    r.slots = ch.slots;
+
+                    if (kind == pattern::stream) {
+                        run_stream(cfg, ch, r);
+                    } else {
+                        run_pingpong(cfg, ch, r);
+                    }
+                    trials.add("msgs_per_sec", r.msgs_per_sec());
+                    trials.add("p50_ns", double(r.latency.percentile(50)));
+                    trials.add("p99_ns", double(r.latency.percentile(99)));
+                    runs.push_back(std::move(r));
+                }
+
+                ipc_result &best = runs.back().skipped.empty()
+                                       ? runs[trials.median_trial("msgs_per_sec")]
+                                       : runs.back();
+                best.trials = trials;
+                group.push_back(std::move(best));
+            }
+
+            if (!json_stdout) {
+                print_group(group);
+            }
+            results.insert(results.end(), group.begin(), group.end());
+        }
+    }
+
+    if (json_stdout) {
+        write_json(std::cout, cfg, results);
+    } else if (!cfg.json_path.empty()) {
+        std::ofstream out(cfg.json_path);
+        if (!out) {
+            throw bench_error("cannot write " + cfg.json_path);
+        }
+        write_json(out, cfg, results);
+    }
+    return 0;
+}
+
+} /* namespace simplechar::bench */
@@ -0,0 +1,22 @@
+/*
+ * ipc.h - IPC baseline comparison for SimpleChar
+ *
+ * Runs the same producer/consumer code over pipes, AF_UNIX sockets,
+ * POSIX shared memory rings with futex or eventfd wakeups, and the
+ * SimpleChar device, with identical message sizes, buffering and thread
+ * placement, and prints them side by side in one report.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_IPC_H
+#define SIMPLECHAR_IPC_H
+
+namespace simplechar::bench {
+
+/* Entry point of "simplechar-bench ipc" */
+int run_ipc(int argc, char **argv);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_IPC_H */
@@ -0,0 +1,420 @@
+/*
+ * ipc_transports.cpp - Message channels for the IPC baseline comparison
+ *
+ * License: MIT
+ */
+
+#include "ipc_transports.h"
+#include "bench_common.h"
+#include "closed_loop.h"
+#include "simplechar_ioctl.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace simplechar::bench {
+
+namespace {
+
+/*
+ * Byte stream or packet channel over a pair of file descriptors
+ */
+class fd_channel : public channel {
+public:
+    fd_channel(int write_fd, int read_fd) : write_fd_(write_fd), read_fd_(read_fd) {}
+
+    ~fd_channel() override
+    {
+        ::close(write_fd_);
+        if (read_fd_ != write_fd_) {
+            ::close(read_fd_);
+        }
+    }
+
+    void send(const char *msg, size_t len) override
+    {
+        while (len) {
+            ssize_t n = ::write(write_fd_, msg, len);
+
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw_errno("send");
+            }
+            msg += n;
+            len -= size_t(n);
+        }
+    }
+
+    void recv(char *msg, size_t len) override
+    {
+        while (len) {
+            ssize_t n = ::read(read_fd_, msg, len);
+
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                throw_errno("recv");
+            }
+            msg += n;
+            len -= size_t(n);
+        }
+    }
+
+private:
+    int write_fd_;
+    int read_fd_;
+};
+
+/* Shared control block of a ring, one cache line per writer */
+struct ring_control {
+    alignas(64) std::atomic<uint32_t> head{0};      /* Next slot to fill */
+    alignas(64) std::atomic<uint32_t> tail{0};      /* Next slot to drain */
+    alignas(64) std::atomic<uint32_t> consumer_waiting{0};
+    alignas(64) std::atomic<uint32_t> producer_waiting{0};
+};
+
+long futex(std::atomic<uint32_t> *word, int op, uint32_t val)
+{
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), op, val,
+                   nullptr, nullptr, 0);
+}
+
+/*
+ * Mapping of an unlinked POSIX shared memory object: the same setup two
+ * processes would use, minus the name lookup after creation
+ */
+class shm_region {
+public:
+    explicit shm_region(size_t len) : len_(len)
+    {
+        static std::atomic<int> counter{0};
+        std::string name = "/simplechar-bench-" + std::to_string(getpid()) +
+                           "-" + std::to_string(counter++);
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+        if (fd < 0) {
+            throw_errno("shm_open " + name);
+        }
+        shm_unlink(name.c_str());
+        if (ftruncate(fd, off_t(len)) < 0) {
+            ::close(fd);
+            throw_errno("ftruncate " + name);
+        }
+        addr_ = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr_ == MAP_FAILED) {
+            throw_errno("mmap " + name);
+        }
+    }
+
+    ~shm_region() { munmap(addr_, len_); }
+
+    shm_region(const shm_region &) = delete;
+    shm_region &operator=(const shm_region &) = delete;
+
+    char *data() const { return static_cast<char *>(addr_); }
+
+private:
+    void *addr_;
+    size_t len_;
+};
+
+enum class doorbell {
+    futex,
+    eventfd,
+};
+
+/*
+ * Single-producer single-consumer ring of fixed-size slots
+ * Both sides spin briefly, then sleep on a futex or eventfd after
+ * raising their waiting flag; the other side only makes a wakeup call
+ * when it finds that flag set. Slot storage is either shared memory or
+ * a range of the SimpleChar device.
+ */
+class ring_channel : public channel {
+public:
+    ring_channel(size_t slots, size_t msg_size, doorbell bell, int device_fd,
+                 off_t device_base)
+        : slots_(uint32_t(slots)), msg_size_(msg_size), bell_(bell),
+          device_fd_(device_fd), device_base_(device_base),
+          shm_(sizeof(ring_control) + (device_fd < 0 ? slots * msg_size : 0))
+    {
+        ctl_ = new (shm_.data()) ring_control;
+        storage_ = shm_.data() + sizeof(ring_control);
+        if (bell_ == doorbell::eventfd) {
+            data_fd_ = eventfd(0, EFD_CLOEXEC);
+            space_fd_ = eventfd(0, EFD_CLOEXEC);
+            if (data_fd_ < 0 || space_fd_ < 0) {
+                throw_errno("eventfd");
+            }
+        }
+    }
+
+    ~ring_channel() override
+    {
+        if (data_fd_ >= 0) {
+            ::close(data_fd_);
+        }
+        if (space_fd_ >= 0) {
+            ::close(space_fd_);
+        }
+    }
+
+    void send(const char *msg, size_t len) override
+    {
+        uint32_t head = ctl_->head.load(std::memory_order_relaxed);
+
+        wait_for([&] {
+            return head - ctl_->tail.load(std::memory_order_acquire) < slots_;
+        }, ctl_->producer_waiting, ctl_->tail, space_fd_);
+
+        size_t slot = head % slots_;
+        if (device_fd_ >= 0) {
+            if (::pwrite(device_fd_, msg, len,
+                         device_base_ + off_t(slot * msg_size_)) != ssize_t(len)) {
+                throw_errno("simplechar pwrite");
+            }
+        } else {
+            std::memcpy(storage_ + slot * msg_size_, msg, len);
+        }
+
+        ctl_->head.store(head + 1, std::memory_order_release);
+        wake(ctl_->consumer_waiting, ctl_->head, data_fd_);
+    }
+
+    void recv(char *msg, size_t len) override
+    {
+        uint32_t tail = ctl_->tail.load(std::memory_order_relaxed);
+
+        wait_for([&] {
+            return ctl_->head.load(std::memory_order_acquire) != tail;
+        }, ctl_->consumer_waiting, ctl_->head, data_fd_);
+
+        size_t slot = tail % slots_;
+        if (device_fd_ >= 0) {
+            if (::pread(device_fd_, msg, len,
+                        device_base_ + off_t(slot * msg_size_)) != ssize_t(len)) {
+                throw_errno("simplechar pread");
+            }
+        } else {
+            std::memcpy(msg, storage_ + slot * msg_size_, len);
+        }
+
+        ctl_->tail.store(tail + 1, std::memory_order_release);
+        wake(ctl_->producer_waiting, ctl_->tail, space_fd_);
+    }
+
+private:
+    static constexpr int spin_tries = 200;
+
+    template <typename Ready>
+    void wait_for(Ready ready, std::atomic<uint32_t> &waiting,
+                  std::atomic<uint32_t> &word, int fd)
+    {
+        for (int i = 0; i < spin_tries; i++) {
+            if (ready()) {
+                return;
+            }
+            cpu_relax();
+        }
+
+        for (;;) {
+            uint32_t observed = word.load(std::memory_order_acquire);
+
+            waiting.store(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ready()) {
+                waiting.store(0, std::memory_order_relaxed);
+                return;
+            }
+            if (bell_ == doorbell::futex) {
+                futex(&word, FUTEX_WAIT, observed);
+            } else {
+                uint64_t count;
+                if (::read(fd, &count, sizeof(count)) < 0 && errno != EINTR) {
+                    throw_errno("eventfd read");
+                }
+            }
+        }
+    }
+
+    void wake(std::atomic<uint32_t> &waiting, std::atomic<uint32_t> &word,
+              int fd)
+    {
+        if (!waiting.exchange(0, std::memory_order_seq_cst)) {
+            return;
+        }
+        if (bell_ == doorbell::futex) {
+            futex(&word, FUTEX_WAKE, INT_MAX);
+        } else {
+            uint64_t one = 1;
+            if (::write(fd, &one, sizeof(one)) < 0) {
+                throw_errno("eventfd write");
+            }
+        }
+    }
+
+    uint32_t slots_;
+    size_t msg_size_;
+    doorbell bell_;
+    int device_fd_;
+    off_t device_base_;
+    shm_region shm_;
+    ring_control *ctl_;
+    char *storage_;
+    int data_fd_ = -1;
+    int space_fd_ = -1;
+};
+
+/*
+ * The simplechar transport keeps the device open for both directions
+ */
+class device_channel : public ring_channel {
+public:
+    device_channel(std::shared_ptr<int> fd, size_t slots, size_t msg_size,
+                   off_t base)
+        : ring_channel(slots, msg_size, doorbell::futex, *fd, base),
+          fd_(std::move(fd)) {}
+
+private:
+    std::shared_ptr<int> fd_;
+};
+
+/* Bytes the device can hold: its buffer size, or unlimited for plain files */
+size_t device_capacity(int fd)
+{
+    simplechar_autosize_info info;
+
+    if (::ioctl(fd, SIMPLECHAR_IOC_GET_AUTOSIZE, &info) == 0) {
+        return info.enabled ? info.max_size : info.size;
+    }
+    return SIZE_MAX;
+}
+
+channel_pair make_fd_pair(transport t, size_t capacity)
+{
+    channel_pair pair;
+    int fds[2][2];
+
+    for (auto &fd : fds) {
+        if (t == transport::pipe) {
+            if (pipe2(fd, O_CLOEXEC) < 0) {
+                throw_errno("pipe2");
+            }
+            /* Rounded up to a page by the kernel; may be capped for users */
+            fcntl(fd[1], F_SETPIPE_SZ, int(capacity));
+        } else {
+            int type = t == transport::unix_stream ? SOCK_STREAM : SOCK_SEQPACKET;
+            int buf = int(capacity);
+
+            if (socketpair(AF_UNIX, type | SOCK_CLOEXEC, 0, fd) < 0) {
+                throw_errno("socketpair");
+            }
+            setsockopt(fd[0], SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+            setsockopt(fd[1], SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+        }
+    }
+
+    /* Pipes write fd[1] and read fd[0]; sockets work either way round */
+    pair.forward = std::make_unique<fd_channel>(fds[0][1], fds[0][0]);
+    pair.backward = std::make_unique<fd_channel>(fds[1][1], fds[1][0]);
+    return pair;
+}
+
+} /* namespace */
+
+const char *transport_name(transport t)
+{
+    switch (t) {
+    case transport::pipe:
+        return "pipe";
+    case transport::unix_stream:
+        return "unix-stream";
+    case transport::unix_seqpacket:
+        return "unix-seqpacket";
+    case transport::shm_futex:
+        return "shm-futex";
+    case transport::eventfd:
+        return "eventfd";
+    case transport::simplechar:
+        return "simplechar";
+    }
+    return "?";
+}
+
+std::vector<transport> all_transports()
+{
+    return {transport::pipe, transport::unix_stream, transport::unix_seqpacket,
+            transport::shm_futex, transport::eventfd, transport::simplechar};
+}
+
+transport parse_transport(const std::string &name)
+{
+    for (transport t : all_transports()) {
+        if (name == transport_name(t)) {
+            return t;
+        }
+    }
+    throw bench_error("unknown transport: " + name);
+}
+
+channel_pair make_channels(transport t, size_t msg_size, size_t capacity,
+                           const std::string &device)
+{
+    size_t slots = std::max<size_t>(1, capacity / msg_size);
+    channel_pair pair;
+
+    switch (t) {
+    case transport::pipe:
+    case transport::unix_stream:
+    case transport::unix_seqpacket:
+        pair = make_fd_pair(t, capacity);
+        pair.slots = slots;
+        return pair;
+    case transport::shm_futex:
+    case transport::eventfd: {
+        doorbell bell = t == transport::eventfd ? doorbell::eventfd
+                                                : doorbell::futex;
+
+        pair.forward = std::make_unique<ring_channel>(slots, msg_size, bell, -1, 0);
+        pair.backward = std::make_unique<ring_channel>(slots, msg_size, bell, -1, 0);
+        pair.slots = slots;
+        return pair;
+    }
+    case transport::simplechar: {
+        std::shared_ptr<int> fd(new int(open_device(device, O_RDWR)),
+                                [](int *p) { ::close(*p); delete p; });
+        /* Each direction gets half of what the device holds */
+        size_t half = device_capacity(*fd) / 2;
+
+        slots = std::min(slots, half / msg_size);
+        if (!slots) {
+            throw bench_error("messages of " + format_size(msg_size) +
+                              " do not fit twice in " + device);
+        }
+        pair.forward = std::make_unique<device_channel>(fd, slots, msg_size, 0);
+        pair.backward = std::make_unique<device_channel>(
+            fd, slots, msg_size, off_t(slots * msg_size));
+        pair.slots = slots;
+        return pair;
+    }
+    }
+    throw bench_error("unknown transport");
+}
+
+} /* namespace simplechar::bench */
@@ -0,0 +1,73 @@
+/*
+ * ipc_transports.h - Message channels for the IPC baseline comparison
+ *
+ * Every transport is wrapped as a one-way channel carrying fixed-size
+ * messages with blocking send and receive, so the same producer/consumer
+ * code runs over all of them:
+ *
+ *   pipe            pipe2(), one per direction
+ *   unix-stream     AF_UNIX SOCK_STREAM socketpair
+ *   unix-seqpacket  AF_UNIX SOCK_SEQPACKET socketpair
+ *   shm-futex       POSIX shm ring, futex wakeups
+ *   eventfd         POSIX shm ring, eventfd wakeups
+ *   simplechar      ring whose slots live in the device, moved with
+ *                   pwrite()/pread(); the driver has no wakeup of its own
+ *                   yet, so it borrows the futex doorbell of shm-futex
+ *
+ * All of them are sized to the same capacity in bytes where the
+ * transport allows it (pipe size, socket send buffer, ring slots).
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_IPC_TRANSPORTS_H
+#define SIMPLECHAR_IPC_TRANSPORTS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace simplechar::bench {
+
+enum class transport {
+    pipe,
+    unix_stream,
+    unix_seqpacket,
+    shm_futex,
+    eventfd,
+    simplechar,
+};
+
+const char *transport_name(transport t);
+transport parse_transport(const std::string &name);
+std::vector<transport> all_transports();
+
+class channel {
+public:
+    virtual ~channel() = default;
+
+    /* Block until the whole message is queued or received */
+    virtual void send(const char *msg, size_t len) = 0;
+    virtual void recv(char *msg, size_t len) = 0;
+};
+
+struct channel_pair {
+    std::unique_ptr<channel> forward;   /* Producer to consumer */
+    std::unique_ptr<channel> backward;  /* Replies, for ping-pong */
+    size_t slots = 0;                   /* Messages in flight per direction */
+};
+
+/*
+ * Create both directions of a transport for messages of msg_size bytes
+ * with about capacity bytes of buffering each. device is only used by
+ * the simplechar transport. Throws bench_error if the transport cannot
+ * carry such messages here.
+ */
+channel_pair make_channels(transport t, size_t msg_size, size_t capacity,
+                           const std::string &device);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_IPC_TRANSPORTS_H */
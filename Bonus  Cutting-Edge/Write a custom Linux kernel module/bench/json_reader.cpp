@@ -0,0 +1,265 @@
+/*
+ * json_reader.cpp - Minimal JSON parser for benchmark result files
+ *
+ * License: MIT
+ */
+
+#include "json_reader.h"
+#include "bench_common.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace simplechar::bench {
+
+namespace {
+
+class parser {
+public:
+    explicit parser(const std::string &text) : text_(text) {}
+
+    json_value document()
+    {
+        json_value v = value();
+
+        skip_space();
+        if (pos_ != text_.size()) {
+            fail("trailing data");
+        }
+        return v;
+    }
+
+private:
+    [[noreturn]] void fail(const std::string &what)
+    {
+        throw bench_error("JSON: " + what + " at offset " + std::to_string(pos_));
+    }
+
+    void skip_space()
+    {
+        while (pos_ < text_.size() &&
+               (text_[pos_] == ' ' || text_[pos_] == '\t' ||
+                text_[pos_] == '\n' || text_[pos_] == '\r')) {
+            pos_++;
+        }
+    }
+
+    char peek()
+    {
+        skip_space();
+        if (pos_ >= text_.size()) {
+            fail("unexpected end");
+        }
+        return text_[pos_];
+    }
+
+    void expect(char c)
+    {
+        if (peek() != c) {
+            fail(std::string("expected '") + c + "'");
+        }
+        pos_++;
+    }
+
+    bool literal(const char *word)
+    {
+        size_t len = std::char_traits<char>::length(word);
+
+        if (text_.compare(pos_, len, word) == 0) {
+            pos_ += len;
+            return true;
+        }
+        return false;
+    }
+
+    json_value value()
+    {
+        json_value v;
+        char c = peek();
+
+        if (c == '{') {
+            object(v);
+        } else if (c == '[') {
+            array(v);
+        } else if (c == '"') {
+            v.type = json_value::kind::string;
+            v.string = string();
+        } else if (literal("true")) {
+            v.type = json_value::kind::boolean;
+            v.boolean = true;
+        } else if (literal("false")) {
+            v.type = json_value::kind::boolean;
+        } else if (literal("null")) {
+            v.type = json_value::kind::null;
+        } else {
+            v.type = json_value::kind::number;
+            v.number = number();
+        }
+        return v;
+    }
+
+    void object(json_value &v)
+    {
+        v.type = json_value::kind::object;
+        expect('{');
+        if (peek() == '}') {
+            pos_++;
+            return;
+        }
+        for (;;) {
+            if (peek() != '"') {
+                fail("expected member name");
+            }
+            std::string key = string();
+
+            expect(':');
+            v.object.emplace_back(key, value());
+            if (peek() == ',') {
+                pos_++;
+                continue;
+            }
+            expect('}');
+            return;
+        }
+    }
+
+    void array(json_value &v)
+    {
+        v.type = json_value::kind::array;
+        expect('[');
+        if (peek() == ']') {
+            pos_++;
+            return;
+        }
+        for (;;) {
+            v.array.push_back(value());
+            if (peek() == ',') {
+                pos_++;
+                continue;
+            }
+            expect(']');
+            return;
+        }
+    }
+
+    std::string string()
+    {
+        std::string out;
+
+        pos_++;     /* Opening quote */
+        while (pos_ < text_.size() && text_[pos_] != '"') {
+            char c = text_[pos_++];
+
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos_ >= text_.size()) {
+                break;
+            }
+            c = text_[pos_++];
+            switch (c) {
+            case 'n':
+                out += '\n';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'u': {
+                /* Benchmarks only escape control characters; keep ASCII */
+                if (pos_ + 4 > text_.size()) {
+                    fail("bad escape");
+                }
+                unsigned code = unsigned(std::strtoul(text_.substr(pos_, 4).c_str(),
+                                                      nullptr, 16));
+                out += code < 0x80 ? char(code) : '?';
+                pos_ += 4;
+                break;
+            }
+            default:
+                out += c;
+            }
+        }
+        if (pos_ >= text_.size()) {
+            fail("unterminated string");
+        }
+        pos_++;     /* Closing quote */
+        return out;
+    }
+
+    double number()
+    {
+        const char *start = text_.c_str() + pos_;
+        char *end = nullptr;
+        double v = std::strtod(start, &end);
+
+        if (end == start) {
+            fail("unexpected character");
+        }
+        pos_ += size_t(end - start);
+        return v;
+    }
+
+    const std::string &text_;
+    size_t pos_ = 0;
+};
+
+} /* namespace */
+
+const json_value *json_value::find(const std::string &key) const
+{
+    for (const auto &member : object) {
+        if (member.first == key) {
+            return &member.second;
+        }
+    }
+    return nullptr;
+}
+
+std::string json_value::get_string(const std::string &key,
+                                   const std::string &fallback) const
+{
+    const json_value *v = find(key);
+
+    return v && v->is_string() ? v->string : fallback;
+}
+
+double json_value::get_number(const std::string &key, double fallback) const
+{
+    const json_value *v = find(key);
+
+    return v && v->is_number() ? v->number : fallback;
+}
+
+json_value parse_json(const std::string &text)
+{
+    return parser(text).document();
+}
+
+json_value load_json(const std::string &path)
+{
+    std::ifstream in(path);
+    std::stringstream text;
+
+    if (!in) {
+        throw bench_error("cannot read " + path);
+    }
+    text << in.rdbuf();
+    try {
+        return parse_json(text.str());
+    } catch (const bench_error &e) {
+        throw bench_error(path + ": " + e.what());
+    }
+}
+
+} /* namespace simplechar::bench */
@@ -0,0 +1,53 @@
+/*
+ * json_reader.h - Minimal JSON parser for benchmark result files
+ *
+ * Reads back what json_writer produces (and any other plain JSON) into a
+ * small tree so results can be compared. Numbers are doubles, which is
+ * exact for every counter the benchmarks write below 2^53.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_JSON_READER_H
+#define SIMPLECHAR_JSON_READER_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace simplechar::bench {
+
+class json_value {
+public:
+    enum class kind { null, boolean, number, string, array, object };
+
+    kind type = kind::null;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<json_value> array;
+    std::vector<std::pair<std::string, json_value>> object;
+
+    bool is_number() const { return type == kind::number; }
+    bool is_string() const { return type == kind::string; }
+    bool is_array() const { return type == kind::array; }
+    bool is_object() const { return type == kind::object; }
+
+    /* Member of an object, nullptr if absent or not an object */
+    const json_value *find(const std::string &key) const;
+
+    /* Member as text or number, with a fallback when absent */
+    std::string get_string(const std::string &key,
+                           const std::string &fallback = "") const;
+    double get_number(const std::string &key, double fallback = 0) const;
+};
+
+/* Parse a document, throws bench_error with the offset on bad input */
+json_value parse_json(const std::string &text);
+
+/* Read and parse a file */
+json_value load_json(const std::string &path);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_JSON_READER_H */
@@ -0,0 +1,406 @@
+/*
+ * mmap_ring.cpp - Record ring benchmark for SimpleChar
+ *
+ * License: MIT
+ */
+
+#include "mmap_ring.h"
+#include "bench_common.h"
+#include "results.h"
+#include "topology.h"
+
+#include "ring.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace simplechar::bench {
+
+namespace {
+
+struct ring_config {
+    std::vector<uint64_t> sizes{16, 64, 256};
+    std::vector<int> batches{1, 32};    /* Records per publish() */
+    std::vector<int> cpus;              /* Producer, consumer */
+    std::string device = "/dev/simplechar";
+    uint64_t duration_ns = 1000000000ULL;
+    uint64_t ring_size = 1 << 20;       /* For regular-file stand-ins */
+    std::string json_path;
+};
+
+struct ring_result {
+    uint64_t msg_size;
+    int batch;
+    uint64_t messages = 0;
+    uint64_t out_of_order = 0;      /* Records with an unexpected sequence */
+    uint64_t elapsed_ns = 0;
+    uint64_t producer_cpu_ns = 0;
+    uint64_t consumer_cpu_ns = 0;
+    ring_stats producer;
+    ring_stats consumer;
+
+    double msgs_per_sec() const
+    {
+        return elapsed_ns ? double(messages) * 1e9 / double(elapsed_ns) : 0.0;
+    }
+
+    /* Messages per second of CPU time the two threads actually used */
+    double msgs_per_core_sec() const
+    {
+        uint64_t cpu = producer_cpu_ns + consumer_cpu_ns;
+        return cpu ? double(messages) * 1e9 / double(cpu) : 0.0;
+    }
+
+    double syscalls_per_msg() const
+    {
+        uint64_t calls = producer.polls + producer.notifies +
+                         consumer.polls + consumer.notifies;
+        return messages ? double(calls) / double(messages) : 0.0;
+    }
+
+    double records_per_consume() const
+    {
+        return consumer.batches ? double(consumer.records) /
+                                  double(consumer.batches) : 0.0;
+    }
+};
+
+void usage(FILE *out)
+{
+    std::fprintf(out,
+        "Usage: simplechar-bench ring [options]\n"
+        "\n"
+        "Streams records from a producer to a consumer, pinned to two CPUs,\n"
+        "through the mmap()ed record ring of a driver loaded with ring_size=N,\n"
+        "and reports messages/s, messages/s per core of CPU time used and\n"
+        "system calls per message. A regular file given as the device is\n"
+        "formatted as a ring; poll() then never sleeps.\n"
+        "\n"
+        "Options:\n"
+        "  -s, --sizes LIST         Payload sizes, at least 8 (default: 16,64,256)\n"
+        "  -B, --batches LIST       Records per publish (default: 1,32)\n"
+        "  -c, --cpus A,B           Producer and consumer CPUs (default: the\n"
+        "                           first two in compact topology order)\n"
+        "  -d, --device PATH        SimpleChar device (default: /dev/simplechar)\n"
+        "  -D, --duration TIME      Measured time per point (default: 1s)\n"
+        "  -r, --ring-size SIZE     Ring size for a regular file (default: 1M)\n"
+        "  -j, --json FILE          Write results as JSON ('-' for stdout)\n"
+        "  -h, --help               Show this help message\n");
+}
+
+ring_config parse_args(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"sizes", required_argument, nullptr, 's'},
+        {"batches", required_argument, nullptr, 'B'},
+        {"cpus", required_argument, nullptr, 'c'},
+        {"device", required_argument, nullptr, 'd'},
+        {"duration", required_argument, nullptr, 'D'},
+        {"ring-size", required_argument, nullptr, 'r'},
+        {"json", required_argument, nullptr, 'j'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    ring_config cfg;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "s:B:c:d:D:r:j:h", options,
+                              nullptr)) != -1) {
+        switch (opt) {
+        case 's':
+            cfg.sizes = parse_size_list(optarg);
+            break;
+        case 'B':
+            cfg.batches = parse_int_list(optarg);
+            break;
+        case 'c':
+            cfg.cpus = parse_cpu_list(optarg);
+            break;
+        case 'd':
+            cfg.device = optarg;
+            break;
+        case 'D':
+            cfg.duration_ns = parse_duration(optarg);
+            break;
+        case 'r':
+            cfg.ring_size = parse_size(optarg);
+            break;
+        case 'j':
+            cfg.json_path = optarg;
+            break;
+        case 'h':
+            usage(stdout);
+            std::exit(0);
+        default:
+            usage(stderr);
+            std::exit(2);
+        }
+    }
+
+    for (uint64_t size : cfg.sizes) {
+        if (size < sizeof(uint64_t)) {
+            throw bench_error("payloads carry a sequence number, 8 bytes at least");
+        }
+    }
+    for (int n : cfg.batches) {
+        if (n <= 0) {
+            throw bench_error("batches must be positive");
+        }
+    }
+    if (cfg.cpus.empty()) {
+        cfg.cpus = placement_order(cpu_topology(), placement_policy::compact);
+    }
+    if (cfg.cpus.size() == 1) {
+        cfg.cpus.push_back(cfg.cpus[0]);
+    }
+    cfg.cpus.resize(2);
+    return cfg;
+}
+
+uint64_t thread_cpu_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + uint64_t(ts.tv_nsec);
+}
+
+void run_point(const ring_config &cfg, ring_result &result)
+{
+    device dev = device::open(cfg.device);
+    ring_producer producer(dev);
+    ring_consumer consumer(dev);
+    const uint64_t size = result.msg_size;
+    const int batch = result.batch;
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false}, stop{false};
+    std::atomic<uint64_t> produced{UINT64_MAX};
+
+    if (size > producer.max_record()) {
+        throw bench_error("records of " + format_size(size) +
+                          " do not fit in the ring");
+    }
+
+    auto start_line = [&] {
+        ready.fetch_add(1, std::memory_order_release);
+        while (!go.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    };
+
+    std::thread prod([&] {
+        std::vector<char> msg(size, 'r');
+        uint64_t seq = 0;
+        int pending = 0;
+
+        pin_to_cpu(cfg.cpus[0]);
+        start_line();
+        uint64_t cpu = thread_cpu_ns();
+        while (!stop.load(std::memory_order_relaxed)) {
+            std::memcpy(msg.data(), &seq, sizeof(seq));
+            while (!producer.try_push(msg)) {
+                producer.wait(size);
+                pending = 0;
+            }
+            seq++;
+            if (++pending == batch) {
+                producer.publish();
+                pending = 0;
+            }
+        }
+        producer.publish();
+        result.producer_cpu_ns = thread_cpu_ns() - cpu;
+        produced.store(seq, std::memory_order_release);
+    });
+
+    std::thread cons([&] {
+        uint64_t expected = 0;
+        uint64_t out_of_order = 0;
+
+        pin_to_cpu(cfg.cpus[1]);
+        start_line();
+        uint64_t cpu = thread_cpu_ns();
+        for (;;) {
+            size_t n = consumer.consume([&](const_buffer rec) {
+                uint64_t seq;
+
+                std::memcpy(&seq, rec.data(), sizeof(seq));
+                out_of_order += seq != expected;
+                expected = seq + 1;
+            });
+            if (n) {
+                continue;
+            }
+            uint64_t total = produced.load(std::memory_order_acquire);
+            if (consumer.stats().records == total) {
+                break;
+            }
+            /* Timed, since the final publish may find nobody asleep */
+            if (total == UINT64_MAX) {
+                consumer.wait(std::chrono::milliseconds(10));
+            }
+        }
+        result.consumer_cpu_ns = thread_cpu_ns() - cpu;
+        result.out_of_order = out_of_order;
+    });
+
+    while (ready.load(std::memory_order_acquire) < 2) {
+        std::this_thread::yield();
+    }
+    uint64_t start = now_ns();
+    go.store(true, std::memory_order_release);
+    wait_until(start + cfg.duration_ns);
+    stop.store(true, std::memory_order_relaxed);
+    prod.join();
+    cons.join();
+
+    result.elapsed_ns = now_ns() - start;
+    result.producer = producer.stats();
+    result.consumer = consumer.stats();
+    result.messages = result.consumer.records;
+}
+
+void print_header()
+{
+    std::printf("%7s %6s %12s %10s %13s %11s %11s\n", "size", "batch",
+                "msgs/s", "MB/s", "msgs/s/core", "syscall/msg", "recs/consume");
+}
+
+void print_result(const ring_result &r)
+{
+    std::printf("%7s %6d %12.0f %10.1f %13.0f %11.6f %11.1f\n",
+                format_size(r.msg_size).c_str(), r.batch, r.msgs_per_sec(),
+                r.msgs_per_sec() * double(r.msg_size) / 1e6,
+                r.msgs_per_core_sec(), r.syscalls_per_msg(),
+                r.records_per_consume());
+    if (r.out_of_order) {
+        std::printf("  %llu records out of order\n",
+                    (unsigned long long)r.out_of_order);
+    }
+    std::fflush(stdout);
+}
+
+void write_json(std::ostream &out, const ring_config &cfg,
+                const std::vector<ring_result> &results)
+{
+    json_writer json(out);
+
+    json.begin_object();
+    json.field("tool", "simplechar-bench");
+    json.field("mode", "ring");
+    write_run_info(json);
+    json.field("duration_s", double(cfg.duration_ns) / 1e9);
+    json.key("cpus").begin_array();
+    for (int cpu : cfg.cpus) {
+        json.value(cpu);
+    }
+    json.end_array();
+    json.key("results").begin_array();
+    for (const auto &r : results) {
+        json.begin_object();
+        json.field("msg_size", r.msg_size);
+        json.field("batch", r.batch);
+        json.field("messages", r.messages);
+        json.field("out_of_order", r.out_of_order);
+        json.field("producer_cpu_ns", r.producer_cpu_ns);
+        json.field("consumer_cpu_ns", r.consumer_cpu_ns);
+        json.field("producer_polls", r.producer.polls);
+        json.field("producer_notifies", r.producer.notifies);
+        json.field("consumer_polls", r.consumer.polls);
+        json.field("consumer_notifies", r.consumer.notifies);
+        json.field("msgs_per_sec", r.msgs_per_sec());
+        json.field("msgs_per_core_sec", r.msgs_per_core_sec());
+        json.field("syscalls_per_msg", r.syscalls_per_msg());
+        json.field("records_per_consume", r.records_per_consume());
+        json.end_object();
+    }
+    json.end_array();
+    json.end_object();
+}
+
+} /* namespace */
+
+void format_stand_in(const std::string &path, uint64_t ring_size)
+{
+    struct stat st;
+
+    if (::stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode)) {
+        return;
+    }
+
+    uint64_t page = uint64_t(::sysconf(_SC_PAGESIZE));
+    uint64_t size = page;
+    simplechar_ring_header hdr{};
+
+    while (size < ring_size) {
+        size *= 2;
+    }
+    hdr.magic = SIMPLECHAR_RING_MAGIC;
+    hdr.version = SIMPLECHAR_RING_VERSION;
+    hdr.size = size;
+    hdr.data_offset = page;
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        throw_errno("cannot open " + path);
+    }
+    bool ok = ::ftruncate(fd, off_t(page + size)) == 0 &&
+              ::pwrite(fd, &hdr, sizeof(hdr), 0) == ssize_t(sizeof(hdr));
+    ::close(fd);
+    if (!ok) {
+        throw_errno("cannot format " + path);
+    }
+}
+
+int run_ring(int argc, char **argv)
+{
+    ring_config cfg = parse_args(argc, argv);
+    std::vector<ring_result> results;
+    bool json_stdout = cfg.json_path == "-";
+
+    format_stand_in(cfg.device, cfg.ring_size);
+    if (!json_stdout) {
+        std::printf("producer cpu %d, consumer cpu %d\n", cfg.cpus[0],
+                    cfg.cpus[1]);
+        print_header();
+    }
+    for (uint64_t size : cfg.sizes) {
+        for (int batch : cfg.batches) {
+            ring_result r;
+
+            r.msg_size = size;
+            r.batch = batch;
+            run_point(cfg, r);
+            results.push_back(r);
+            if (!json_stdout) {
+                print_result(r);
+            }
+        }
+    }
+
+    if (json_stdout) {
+        write_json(std::cout, cfg, results);
+    } else if (!cfg.json_path.empty()) {
+        std::ofstream out(cfg.json_path);
+        if (!out) {
+            throw bench_error("cannot write " + cfg.json_path);
+        }
+        write_json(out, cfg, results);
+    }
+    return 0;
+}
+
+} /* namespace simplechar::bench */
@@ -0,0 +1,31 @@
+/*
+ * mmap_ring.h - Record ring benchmark for SimpleChar
+ *
+ * Streams records from a pinned producer to a pinned consumer through
+ * the driver's mmap()ed record ring with libsimplechar's ring_producer
+ * and ring_consumer, and reports messages per second, messages per
+ * second per busy core and system calls per message.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_MMAP_RING_H
+#define SIMPLECHAR_MMAP_RING_H
+
+#include <cstdint>
+#include <string>
+
+namespace simplechar::bench {
+
+/*
+ * Lay out path like the driver's ring of at least ring_size bytes, so
+ * it can stand in for a device; does nothing unless it is a regular file
+ */
+void format_stand_in(const std::string &path, uint64_t ring_size);
+
+/* Entry point of "simplechar-bench ring" */
+int run_ring(int argc, char **argv);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_MMAP_RING_H */
@@ -0,0 +1,163 @@
+/*
+ * open_loop.cpp - Open-loop load generator for SimpleChar devices
+ *
+ * License: MIT
+ */
+
+#include "open_loop.h"
+#include "bench_common.h"
+#include "closed_loop.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace simplechar::bench {
+
+double open_loop_result::achieved_rate() const
+{
+    return elapsed_ns ? double(ops) * 1e9 / double(elapsed_ns) : 0.0;
+}
+
+namespace {
+
+struct worker_state {
+    unique_fd fd;
+    aligned_buffer buf{nullptr, &std::free};
+    uint64_t ops = 0;
+    uint64_t errors = 0;
+    uint64_t unsent = 0;
+    hdr_histogram latency;
+    hdr_histogram service;
+};
+
+struct start_line {
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    uint64_t start = 0;
+    uint64_t measure_start = 0;
+    uint64_t measure_end = 0;
+};
+
+void worker(const open_loop_params &params, int index, worker_state &state,
+            start_line &line)
+{
+    char *buf = state.buf.get();
+    xorshift64 rng(0x9e3779b9ULL * uint64_t(index + 1));
+    const double interval = 1e9 * params.threads / params.rate;
+    const uint64_t read_threshold = uint64_t(params.read_pct);
+    int cpu = params.cpus.empty() ? index % online_cpus()
+                                  : params.cpus[index % params.cpus.size()];
+
+    std::memset(buf, 'a' + index % 26, params.block_size);
+    pin_to_cpu(cpu);
+
+    line.ready.fetch_add(1, std::memory_order_release);
+    while (!line.go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+
+    /* Stagger threads so their schedules do not send in lockstep */
+    double intended = double(line.start) + interval * index / params.threads;
+    auto next_send = [&]() {
+        if (params.arrival == arrival_process::poisson) {
+            intended += -std::log(1.0 - rng.uniform()) * interval;
+        } else {
+            intended += interval;
+        }
+        return uint64_t(intended);
+    };
+
+    for (uint64_t send_at = next_send(); send_at < line.measure_end;
+         send_at = next_send()) {
+        /* Never wait for a send that is already late: that is the point */
+        wait_until(send_at);
+
+        uint64_t t0 = now_ns();
+        if (t0 >= line.measure_end) {
+            /*
+             * Out of time with sends still due: each of them has waited at
+             * least until now, which is recorded rather than dropped
+             */
+            for (; send_at < line.measure_end; send_at = next_send()) {
+                if (send_at >= line.measure_start) {
+                    state.unsent++;
+                    state.latency.record(t0 - send_at);
+                }
+            }
+            break;
+        }
+
+        bool is_read = read_threshold >= 100 ||
+                       (read_threshold && rng.next() % 100 < read_threshold);
+        ssize_t n = is_read ? ::pread(state.fd.get(), buf, params.block_size, 0)
+                            : ::pwrite(state.fd.get(), buf, params.block_size, 0);
+        uint64_t t1 = now_ns();
+
+        if (send_at < line.measure_start) {
+            continue;
+        }
+        if (n < 0) {
+            state.errors++;
+            continue;
+        }
+        state.ops++;
+        state.latency.record(t1 - send_at);
+        state.service.record(t1 - t0);
+    }
+}
+
+} /* namespace */
+
+open_loop_result run_open_loop(const open_loop_params &params)
+{
+    std::vector<worker_state> states(params.threads);
+    std::vector<std::thread> threads;
+    start_line line;
+    open_loop_result result;
+
+    if (params.devices.empty() || params.threads <= 0 || params.rate <= 0) {
+        throw bench_error("open loop needs a device, threads and a rate");
+    }
+
+    for (int i = 0; i < params.threads; i++) {
+        states[i].fd = unique_fd(open_device(params.devices[i % params.devices.size()],
+                                             O_RDWR));
+        states[i].buf = alloc_aligned(params.block_size);
+    }
+    for (int i = 0; i < params.threads; i++) {
+        threads.emplace_back(worker, std::cref(params), i, std::ref(states[i]),
+                             std::ref(line));
+    }
+    while (line.ready.load(std::memory_order_acquire) < params.threads) {
+        std::this_thread::yield();
+    }
+
+    line.start = now_ns() + 1000000;
+    line.measure_start = line.start + params.warmup_ns;
+    line.measure_end = line.measure_start + params.duration_ns;
+    line.go.store(true, std::memory_order_release);
+
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    result.offered_rate = params.rate;
+    result.elapsed_ns = params.duration_ns;
+    for (auto &state : states) {
+        result.ops += state.ops;
+        result.errors += state.errors;
+        result.unsent += state.unsent;
+        result.latency.merge(state.latency);
+        result.service.merge(state.service);
+    }
+    return result;
+}
+
+} /* namespace simplechar::bench */
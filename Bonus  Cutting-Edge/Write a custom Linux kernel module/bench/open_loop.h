@@ -0,0 +1,57 @@
+/*
+ * open_loop.h - Open-loop load generator for SimpleChar devices
+ *
+ * Operations are issued on a fixed schedule (constant spacing or Poisson
+ * arrivals) regardless of how long earlier ones took. Latency is measured
+ * from the intended send time, so time spent queued behind a slow call is
+ * counted instead of silently lowering the offered load as it would be in
+ * a closed loop (coordinated omission).
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_OPEN_LOOP_H
+#define SIMPLECHAR_OPEN_LOOP_H
+
+#include "hdr_histogram.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace simplechar::bench {
+
+enum class arrival_process {
+    constant,   /* Evenly spaced sends */
+    poisson,    /* Exponentially distributed gaps */
+};
+
+struct open_loop_params {
+    std::vector<std::string> devices;  /* One path per instance */
+    uint64_t block_size = 4096;
+    int threads = 1;                   /* Always pinned, one per CPU */
+    int read_pct = 50;
+    double rate = 10000;               /* Offered ops/s over all threads */
+    arrival_process arrival = arrival_process::poisson;
+    uint64_t duration_ns = 2000000000ULL;
+    uint64_t warmup_ns = 200000000ULL;
+    std::vector<int> cpus;             /* Placement, default 0..N-1 */
+};
+
+struct open_loop_result {
+    double offered_rate = 0;           /* Requested ops/s */
+    uint64_t ops = 0;                  /* Completed in the measured window */
+    uint64_t errors = 0;
+    uint64_t unsent = 0;               /* Due in the window but never sent */
+    uint64_t elapsed_ns = 0;
+    hdr_histogram latency;             /* From intended send to completion */
+    hdr_histogram service;             /* From actual send to completion */
+
+    double achieved_rate() const;
+};
+
+open_loop_result run_open_loop(const open_loop_params &params);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_OPEN_LOOP_H */
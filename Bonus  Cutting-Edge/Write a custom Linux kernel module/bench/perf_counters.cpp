@@ -0,0 +1,274 @@
+/*
+ * perf_counters.cpp - Per-thread hardware counters via perf_event_open
+ *
+ * License: MIT
+ */
+
+#include "perf_counters.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace simplechar::bench {
+
+namespace {
+
+struct event_spec {
+    counter_id id;
+    uint32_t type;
+    uint64_t config;
+};
+
+/* The first entry of each set leads the group */
+const event_spec hardware_events[] = {
+    {ctr_cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {ctr_instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {ctr_cache_misses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {ctr_context_switches, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {ctr_cpu_migrations, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+    {ctr_page_faults, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    {ctr_task_clock, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+};
+
+const event_spec software_events[] = {
+    {ctr_task_clock, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {ctr_context_switches, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {ctr_cpu_migrations, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+    {ctr_page_faults, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+int open_event(const event_spec &spec, int group_fd, bool kernel)
+{
+    struct perf_event_attr attr;
+
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = spec.type;
+    attr.config = spec.config;
+    attr.disabled = group_fd < 0;       /* Members follow the leader */
+    attr.exclude_kernel = !kernel;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return int(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd,
+                       PERF_FLAG_FD_CLOEXEC));
+}
+
+} /* namespace */
+
+counter_values &counter_values::operator+=(const counter_values &other)
+{
+    if (source == counter_source::none) {
+        source = other.source;
+        kernel = other.kernel;
+    }
+    for (int i = 0; i < nr_counters; i++) {
+        value[i] += other.value[i];
+        present[i] = present[i] || other.present[i];
+    }
+    return *this;
+}
+
+double counter_values::per_op(counter_id id, uint64_t ops) const
+{
+    if (!present[id] || !ops) {
+        return -1.0;
+    }
+    return double(value[id]) / double(ops);
+}
+
+perf_group::perf_group()
+{
+    /*
+     * Prefer kernel-inclusive hardware counters, then user-only ones
+     * (perf_event_paranoid >= 2), then the same for software events
+     */
+    if (open_events(true, true) || open_events(true, false)) {
+        source_ = counter_source::hardware;
+    } else if (open_events(false, true) || open_events(false, false)) {
+        source_ = counter_source::software;
+    }
+}
+
+perf_group::~perf_group()
+{
+    close_events();
+}
+
+bool perf_group::open_events(bool hardware, bool kernel)
+{
+    const event_spec *specs = hardware ? hardware_events : software_events;
+    size_t count = hardware ? std::size(hardware_events)
+                            : std::size(software_events);
+
+    close_events();
+    for (size_t i = 0; i < count; i++) {
+        int fd = open_event(specs[i], fds_.empty() ? -1 : fds_[0], kernel);
+
+        if (fd < 0) {
+            if (i == 0) {
+                return false;
+            }
+            /* A missing member (no cache-miss event, say) is not fatal */
+            continue;
+        }
+        fds_.push_back(fd);
+        ids_.push_back(specs[i].id);
+    }
+    kernel_ = kernel;
+    return true;
+}
+
+void perf_group::close_events()
+{
+    for (int fd : fds_) {
+        ::close(fd);
+    }
+    fds_.clear();
+    ids_.clear();
+}
+
+void perf_group::start()
+{
+    if (fds_.empty()) {
+        return;
+    }
+    ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void perf_group::stop()
+{
+    if (!fds_.empty()) {
+        ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+counter_values perf_group::read() const
+{
+    counter_values v;
+    /* nr, time_enabled, time_running, then one value per event */
+    std::vector<uint64_t> buf(3 + fds_.size());
+
+    if (fds_.empty()) {
+        return v;
+    }
+
+    ssize_t len = ::read(fds_[0], buf.data(), buf.size() * sizeof(uint64_t));
+    if (len < ssize_t(3 * sizeof(uint64_t)) || buf[0] != fds_.size()) {
+        return v;
+    }
+
+    uint64_t enabled = buf[1], running = buf[2];
+    double scale = running && running < enabled ? double(enabled) / double(running)
+                                                : 1.0;
+
+    v.source = source_;
+    v.kernel = kernel_;
+    for (size_t i = 0; i < fds_.size(); i++) {
+        v.value[ids_[i]] = uint64_t(double(buf[3 + i]) * scale);
+        v.present[ids_[i]] = running > 0;
+    }
+    return v;
+}
+
+counter_source probe_counters()
+{
+    perf_group probe;
+
+    return probe.source();
+}
+
+void report_counter_source()
+{
+    switch (probe_counters()) {
+    case counter_source::hardware:
+        break;
+    case counter_source::software:
+        std::fprintf(stderr, "simplechar-bench: no hardware PMU, "
+                     "using software counters only\n");
+        break;
+    case counter_source::none:
+        std::fprintf(stderr, "simplechar-bench: perf_event_open unavailable, "
+                     "counters disabled\n");
+        break;
+    }
+}
+
+std::string counter_header()
+{
+    char buf[96];
+
+    std::snprintf(buf, sizeof(buf), " %8s %8s %5s %8s %7s %8s",
+                  "cyc/op", "ins/op", "IPC", "miss/op", "cs/op", "cpu/op");
+    return buf;
+}
+
+std::string counter_cells(const counter_values &v, uint64_t ops)
+{
+    auto cell = [&](counter_id id, const char *fmt, int width) {
+        char buf[32];
+        double x = v.per_op(id, ops);
+
+        if (x < 0) {
+            std::snprintf(buf, sizeof(buf), "%*s", width, "-");
+        } else {
+            std::snprintf(buf, sizeof(buf), fmt, width, x);
+        }
+        return std::string(buf);
+    };
+    double cycles = v.per_op(ctr_cycles, ops);
+    double instructions = v.per_op(ctr_instructions, ops);
+    char ipc[16];
+
+    if (cycles > 0 && instructions >= 0) {
+        std::snprintf(ipc, sizeof(ipc), "%5.2f", instructions / cycles);
+    } else {
+        std::snprintf(ipc, sizeof(ipc), "%5s", "-");
+    }
+
+    double cpu = v.per_op(ctr_task_clock, ops);
+    char cpu_cell[16];
+
+    std::snprintf(cpu_cell, sizeof(cpu_cell), "%8s",
+                  cpu < 0 ? "-" : format_ns(cpu).c_str());
+
+    return " " + cell(ctr_cycles, "%*.0f", 8) +
+           " " + cell(ctr_instructions, "%*.0f", 8) +
+           " " + ipc +
+           " " + cell(ctr_cache_misses, "%*.2f", 8) +
+           " " + cell(ctr_context_switches, "%*.3f", 7) +
+           " " + cpu_cell;
+}
+
+void write_counters_json(json_writer &json, const counter_values &v,
+                         uint64_t ops)
+{
+    static const char *names[nr_counters] = {
+        "cycles", "instructions", "cache_misses", "context_switches",
+        "cpu_migrations", "page_faults", "task_clock_ns",
+    };
+
+    json.key("counters").begin_object();
+    json.field("source", v.source == counter_source::hardware ? "hardware"
+                         : v.source == counter_source::software ? "software"
+                                                                : "none");
+    json.field("kernel", v.kernel);
+    for (int i = 0; i < nr_counters; i++) {
+        if (v.present[i]) {
+            json.field(names[i], v.value[i]);
+            json.field(std::string(names[i]) + "_per_op",
+                       v.per_op(counter_id(i), ops));
+        }
+    }
+    json.end_object();
+}
+
+} /* namespace simplechar::bench */
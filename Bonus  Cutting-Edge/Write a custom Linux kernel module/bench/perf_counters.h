@@ -0,0 +1,98 @@
+/*
+ * perf_counters.h - Per-thread hardware counters via perf_event_open
+ *
+ * A perf_group counts cycles, instructions, cache misses, context
+ * switches, CPU migrations, page faults and CPU time for the calling
+ * thread, kernel mode included where perf_event_paranoid allows, so the
+ * driver's share of each operation shows up. When no PMU is available,
+ * as in many VMs, the group falls back to software events only and the
+ * hardware columns read as missing.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_PERF_COUNTERS_H
+#define SIMPLECHAR_PERF_COUNTERS_H
+
+#include "bench_common.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace simplechar::bench {
+
+enum counter_id {
+    ctr_cycles,
+    ctr_instructions,
+    ctr_cache_misses,
+    ctr_context_switches,
+    ctr_cpu_migrations,
+    ctr_page_faults,
+    ctr_task_clock,         /* CPU time in nanoseconds */
+    nr_counters,
+};
+
+enum class counter_source {
+    none,       /* perf_event_open is not usable */
+    hardware,   /* PMU counters plus software events */
+    software,   /* Software events only */
+};
+
+struct counter_values {
+    counter_source source = counter_source::none;
+    bool kernel = false;                /* Kernel-mode work is included */
+    uint64_t value[nr_counters] = {};
+    bool present[nr_counters] = {};
+
+    counter_values &operator+=(const counter_values &other);
+
+    /* value / ops, or a negative number when the counter is missing */
+    double per_op(counter_id id, uint64_t ops) const;
+};
+
+class perf_group {
+public:
+    /* Opens a disabled group on the calling thread; check source() */
+    perf_group();
+    ~perf_group();
+
+    perf_group(const perf_group &) = delete;
+    perf_group &operator=(const perf_group &) = delete;
+
+    counter_source source() const { return source_; }
+
+    /* Zero and start counting, then stop; both no-ops without counters */
+    void start();
+    void stop();
+
+    /* Counts since start(), scaled up if the PMU was multiplexed */
+    counter_values read() const;
+
+private:
+    bool open_events(bool hardware, bool kernel);
+    void close_events();
+
+    counter_source source_ = counter_source::none;
+    bool kernel_ = false;
+    std::vector<int> fds_;              /* fds_[0] is the group leader */
+    std::vector<counter_id> ids_;       /* Counter behind each fd */
+};
+
+/* What perf_group would manage to open on this machine */
+counter_source probe_counters();
+
+/* Say once on stderr when the per-op columns fall back or stay empty */
+void report_counter_source();
+
+/* Column titles and per-op cells for the benchmark tables */
+std::string counter_header();
+std::string counter_cells(const counter_values &v, uint64_t ops);
+
+/* "counters" object with totals and per-op values of present counters */
+void write_counters_json(json_writer &json, const counter_values &v,
+                         uint64_t ops);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_PERF_COUNTERS_H */
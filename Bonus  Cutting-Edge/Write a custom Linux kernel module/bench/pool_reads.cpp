@@ -0,0 +1,334 @@
+/*
+ * pool_reads.cpp - Pooled read buffer benchmark for SimpleChar
+ *
+ * License: MIT
+ */
+
+#include "pool_reads.h"
+#include "bench_common.h"
+#include "results.h"
+#include "topology.h"
+
+#include "pool.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+
+namespace simplechar::bench {
+
+namespace {
+
+enum class method {
+    vector,     /* A fresh std::vector per read */
+    pooled,     /* Leases from buffer_pool */
+};
+
+const char *method_name(method m)
+{
+    return m == method::vector ? "vector" : "pooled";
+}
+
+struct pool_config {
+    std::vector<int> threads{1, 2, 4};
+    std::vector<int> cpus;              /* Reader placement, in order */
+    std::string device = "/dev/simplechar";
+    uint64_t read_size = 0;             /* 0: the pool's buffer size */
+    int hold = 4;                       /* Reads each thread keeps alive */
+    uint64_t duration_ns = 1000000000ULL;
+    std::string json_path;
+};
+
+struct pool_result {
+    method how;
+    int threads;
+    uint64_t read_size = 0;
+    uint64_t reads = 0;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+    uint64_t elapsed_ns = 0;
+    pool_stats pool;                    /* Pooled runs only */
+
+    double reads_per_sec() const
+    {
+        return elapsed_ns ? double(reads) * 1e9 / double(elapsed_ns) : 0.0;
+    }
+};
+
+void usage(FILE *out)
+{
+    std::fprintf(out,
+        "Usage: simplechar-bench pool [options]\n"
+        "\n"
+        "Has each thread count read the device from offset 0 as fast as it\n"
+        "can, keeping its last few reads alive, first into a new std::vector\n"
+        "per read, then into buffers leased from buffer_pool, and compares\n"
+        "reads/s. Pooled runs also show the pool's hit rates.\n"
+        "\n"
+        "Options:\n"
+        "  -t, --threads LIST       Reader thread counts (default: 1,2,4)\n"
+        "  -c, --cpus LIST          Reader CPUs in order (default: compact\n"
+        "                           topology order)\n"
+        "  -d, --device PATH        SimpleChar device (default: /dev/simplechar)\n"
+        "  -s, --read-size SIZE     Bytes per read (default: the largest read\n"
+        "                           of the device)\n"
+        "  -H, --hold N             Reads each thread keeps alive (default: 4)\n"
+        "  -D, --duration TIME      Measured time per point (default: 1s)\n"
+        "  -j, --json FILE          Write results as JSON ('-' for stdout)\n"
+        "  -h, --help               Show this help message\n");
+}
+
+pool_config parse_args(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"threads", required_argument, nullptr, 't'},
+        {"cpus", required_argument, nullptr, 'c'},
+        {"device", required_argument, nullptr, 'd'},
+        {"read-size", required_argument, nullptr, 's'},
+        {"hold", required_argument, nullptr, 'H'},
+        {"duration", required_argument, nullptr, 'D'},
+        {"json", required_argument, nullptr, 'j'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    pool_config cfg;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "t:c:d:s:H:D:j:h", options,
+                              nullptr)) != -1) {
+        switch (opt) {
+        case 't':
+            cfg.threads = parse_int_list(optarg);
+            break;
+        case 'c':
+            cfg.cpus = parse_cpu_list(optarg);
+            break;
+        case 'd':
+            cfg.device = optarg;
+            break;
+        case 's':
+            cfg.read_size = parse_size(optarg);
+            break;
+        case 'H':
+            cfg.hold = std::atoi(optarg);
+            break;
+        case 'D':
+            cfg.duration_ns = parse_duration(optarg);
+            break;
+        case 'j':
+            cfg.json_path = optarg;
+            break;
+        case 'h':
+            usage(stdout);
+            std::exit(0);
+        default:
+            usage(stderr);
+            std::exit(2);
+        }
+    }
+
+    for (int n : cfg.threads) {
+        if (n <= 0) {
+            throw bench_error("thread counts must be positive");
+        }
+    }
+    if (cfg.hold <= 0) {
+        throw bench_error("--hold must be positive");
+    }
+    if (cfg.cpus.empty()) {
+        cfg.cpus = placement_order(cpu_topology(), placement_policy::compact);
+    }
+    return cfg;
+}
+
+void run_point(const pool_config &cfg, pool_result &result)
+{
+    device dev = device::open(cfg.device);
+    pool_options opts;
+    std::unique_ptr<buffer_pool> pool;
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false}, stop{false};
+    std::atomic<uint64_t> reads{0}, bytes{0}, errors{0};
+    std::vector<std::thread> threads;
+
+    opts.buffer_size = cfg.read_size;
+    pool = std::make_unique<buffer_pool>(dev, opts);
+    result.read_size = cfg.read_size ? cfg.read_size : pool->buffer_size();
+
+    for (int t = 0; t < result.threads; t++) {
+        int cpu = cfg.cpus[size_t(t) % cfg.cpus.size()];
+
+        threads.emplace_back([&, cpu] {
+            std::vector<std::vector<char>> vectors(size_t(cfg.hold));
+            std::vector<lease> leases(size_t(cfg.hold));
+            uint64_t n = 0, moved = 0, failed = 0;
+
+            pin_to_cpu(cpu);
+            ready.fetch_add(1, std::memory_order_release);
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            while (!stop.load(std::memory_order_relaxed)) {
+                /* The slot's previous read is the oldest one held */
+                size_t slot = n % size_t(cfg.hold);
+                io_result r;
+
+                if (result.how == method::vector) {
+                    std::vector<char> buf(result.read_size);
+                    r = dev.read(buf, 0);
+                    buf.resize(r.bytes);
+                    vectors[slot] = std::move(buf);
+                } else {
+                    leases[slot].release();
+                    r = pool->read(dev, 0, leases[slot]);
+                }
+                moved += r.bytes;
+                failed += !r;
+                n++;
+            }
+            reads.fetch_add(n, std::memory_order_relaxed);
+            bytes.fetch_add(moved, std::memory_order_relaxed);
+            errors.fetch_add(failed, std::memory_order_relaxed);
+        });
+    }
+
+    while (ready.load(std::memory_order_acquire) < result.threads) {
+        std::this_thread::yield();
+    }
+    uint64_t start = now_ns();
+    go.store(true, std::memory_order_release);
+    wait_until(start + cfg.duration_ns);
+    stop.store(true, std::memory_order_relaxed);
+    for (auto &t : threads) {
+        t.join();
+    }
+    result.elapsed_ns = now_ns() - start;
+    result.reads = reads.load();
+    result.bytes = bytes.load();
+    result.errors = errors.load();
+    if (result.how == method::pooled) {
+        result.pool = pool->stats();
+    }
+}
+
+void print_header()
+{
+    std::printf("%7s %7s %-7s %12s %10s %8s %9s %9s %8s\n", "threads", "size",
+                "method", "reads/s", "MB/s", "hit", "local hit", "reserved",
+                "speedup");
+}
+
+void print_pair(const pool_result &vector, const pool_result &pooled)
+{
+    for (const pool_result *r : {&vector, &pooled}) {
+        char speedup[16] = "-";
+        char hit[16] = "-";
+        char local[16] = "-";
+        std::string reserved = "-";
+
+        if (r == &pooled) {
+            if (vector.reads_per_sec() > 0) {
+                std::snprintf(speedup, sizeof(speedup), "%.2fx",
+                              pooled.reads_per_sec() / vector.reads_per_sec());
+            }
+            std::snprintf(hit, sizeof(hit), "%.2f%%", 100.0 * r->pool.hit_rate());
+            std::snprintf(local, sizeof(local), "%.2f%%",
+                          100.0 * r->pool.local_hit_rate());
+            reserved = format_size(r->pool.reserved_bytes);
+        }
+        std::printf("%7d %7s %-7s %12.0f %10.1f %8s %9s %9s %8s\n", r->threads,
+                    format_size(r->read_size).c_str(), method_name(r->how),
+                    r->reads_per_sec(),
+                    r->elapsed_ns ? double(r->bytes) * 1e3 / double(r->elapsed_ns) : 0.0,
+                    hit, local, reserved.c_str(), speedup);
+    }
+    if (vector.errors || pooled.errors) {
+        std::printf("  %lu vector and %lu pooled reads failed\n",
+                    (unsigned long)vector.errors, (unsigned long)pooled.errors);
+    }
+    std::fflush(stdout);
+}
+
+void write_json(std::ostream &out, const pool_config &cfg,
+                const std::vector<pool_result> &results)
+{
+    json_writer json(out);
+
+    json.begin_object();
+    json.field("tool", "simplechar-bench");
+    json.field("mode", "pool");
+    write_run_info(json);
+    json.field("duration_s", double(cfg.duration_ns) / 1e9);
+    json.field("hold", cfg.hold);
+    json.key("results").begin_array();
+    for (const auto &r : results) {
+        json.begin_object();
+        json.field("method", method_name(r.how));
+        json.field("threads", r.threads);
+        json.field("read_size", r.read_size);
+        json.field("reads", r.reads);
+        json.field("bytes", r.bytes);
+        json.field("errors", r.errors);
+        json.field("reads_per_sec", r.reads_per_sec());
+        if (r.how == method::pooled) {
+            json.field("acquires", r.pool.acquires);
+            json.field("local_hits", r.pool.local_hits);
+            json.field("shared_hits", r.pool.shared_hits);
+            json.field("misses", r.pool.misses);
+            json.field("hit_rate", r.pool.hit_rate());
+            json.field("reserved_bytes", uint64_t(r.pool.reserved_bytes));
+        }
+        json.end_object();
+    }
+    json.end_array();
+    json.end_object();
+}
+
+} /* namespace */
+
+int run_pool(int argc, char **argv)
+{
+    pool_config cfg = parse_args(argc, argv);
+    std::vector<pool_result> results;
+    bool json_stdout = cfg.json_path == "-";
+
+    if (!json_stdout) {
+        print_header();
+    }
+    for (int threads : cfg.threads) {
+        pool_result pair[2];
+
+        for (method how : {method::vector, method::pooled}) {
+            pool_result &r = pair[how == method::pooled];
+
+            r.how = how;
+            r.threads = threads;
+            run_point(cfg, r);
+            results.push_back(r);
+        }
+        if (!json_stdout) {
+            print_pair(pair[0], pair[1]);
+        }
+    }
+
+    if (json_stdout) {
+        write_json(std::cout, cfg, results);
+    } else if (!cfg.json_path.empty()) {
+        std::ofstream out(cfg.json_path);
+        if (!out) {
+            throw bench_error("cannot write " + cfg.json_path);
+        }
+        write_json(out, cfg, results);
+    }
+    return 0;
+}
+
+} /* namespace simplechar::bench */
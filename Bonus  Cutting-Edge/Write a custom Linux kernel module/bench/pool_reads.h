@@ -0,0 +1,22 @@
+/*
+ * pool_reads.h - Pooled read buffer benchmark for SimpleChar
+ *
+ * Has N threads read the device in a loop and keep the last few reads
+ * around, as consumers that hand payloads on do, once allocating a
+ * std::vector per read and once leasing buffers from libsimplechar's
+ * buffer_pool, and reports reads per second and the pool's hit rates.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_POOL_READS_H
+#define SIMPLECHAR_POOL_READS_H
+
+namespace simplechar::bench {
+
+/* Entry point of "simplechar-bench pool" */
+int run_pool(int argc, char **argv);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_POOL_READS_H */
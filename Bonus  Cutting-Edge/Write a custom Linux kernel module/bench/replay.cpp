@@ -0,0 +1,246 @@
+/*
+ * replay.cpp - Replay captured SimpleChar operation traces
+ *
+ * License: MIT
+ */
+
+#include "replay.h"
+#include "bench_common.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace simplechar::bench {
+
+namespace {
+
+/* More lanes than this only adds threads competing for one device */
+constexpr int max_lanes = 64;
+
+struct lane {
+    std::vector<const trace_record *> events;
+    std::unordered_map<uint32_t, int> fds;     /* open_id to descriptor */
+    replay_op_stats ops[nr_trace_ops];
+};
+
+struct start_line {
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    uint64_t start = 0;
+};
+
+/*
+ * Highest number of opens alive at once; opens the capture missed count
+ * from their first operation
+ */
+int peak_opens(const std::vector<trace_record> &trace)
+{
+    std::unordered_set<uint32_t> live, closed;
+    size_t peak = 0;
+
+    for (const auto &ev : trace) {
+        if (ev.op == trace_op::close) {
+            live.erase(ev.open_id);
+            closed.insert(ev.open_id);
+        } else if (!closed.count(ev.open_id)) {
+            live.insert(ev.open_id);
+            peak = std::max(peak, live.size());
+        }
+    }
+    return int(peak);
+}
+
+/* Give every open the lane with the fewest live opens when it appears */
+void assign_lanes(const std::vector<trace_record> &trace,
+                  std::vector<lane> &lanes, uint64_t &opens)
+{
+    std::unordered_map<uint32_t, size_t> lane_of;
+    std::vector<int> live(lanes.size(), 0);
+
+    for (const auto &ev : trace) {
+        auto it = lane_of.find(ev.open_id);
+
+        if (it == lane_of.end()) {
+            size_t best = std::min_element(live.begin(), live.end()) -
+                          live.begin();
+            it = lane_of.emplace(ev.open_id, best).first;
+            live[best]++;
+        }
+        lanes[it->second].events.push_back(&ev);
+        if (ev.op == trace_op::close) {
+            live[it->second]--;
+        }
+    }
+    opens = lane_of.size();
+}
+
+int open_for_replay(const replay_params &params, uint16_t flags)
+{
+    int open_flags = O_RDWR;
+
+    if (flags & SIMPLECHAR_TRACE_NONBLOCK) {
+        open_flags |= O_NONBLOCK;
+    }
+    return ::open(params.device.c_str(), open_flags);
+}
+
+/* Descriptor of an open, opened on first use if the capture missed it */
+int lane_fd(const replay_params &params, lane &l, const trace_record &ev)
+{
+    auto it = l.fds.find(ev.open_id);
+
+    if (it != l.fds.end()) {
+        return it->second;
+    }
+    int fd = open_for_replay(params, ev.flags);
+    if (fd >= 0) {
+        l.fds.emplace(ev.open_id, fd);
+    }
+    return fd;
+}
+
+long replay_one(const replay_params &params, lane &l, const trace_record &ev,
+                char *buf)
+{
+    long ret = 0;
+    int fd;
+
+    switch (ev.op) {
+    case trace_op::open:
+        fd = open_for_replay(params, ev.flags);
+        if (fd < 0) {
+            return -errno;
+        }
+        if (l.fds.count(ev.open_id)) {
+            ::close(l.fds[ev.open_id]);
+        }
+        l.fds[ev.open_id] = fd;
+        return 0;
+    case trace_op::close:
+        if (l.fds.count(ev.open_id)) {
+            ::close(l.fds[ev.open_id]);
+            l.fds.erase(ev.open_id);
+        }
+        return 0;
+    case trace_op::read:
+    case trace_op::write:
+        fd = lane_fd(params, l, ev);
+        if (fd < 0) {
+            return -errno;
+        }
+        ret = ev.op == trace_op::read
+                  ? ::pread(fd, buf, ev.size, off_t(ev.offset))
+                  : ::pwrite(fd, buf, ev.size, off_t(ev.offset));
+        return ret < 0 ? -errno : ret;
+    }
+    return -EINVAL;
+}
+
+void worker(const replay_params &params, lane &l, size_t buf_size,
+            start_line &line)
+{
+    std::vector<char> buf(std::max<size_t>(buf_size, 1), 'r');
+
+    line.ready.fetch_add(1, std::memory_order_release);
+    while (!line.go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+
+    for (const trace_record *ev : l.events) {
+        uint64_t due = 0;
+
+        if (!params.fast) {
+            due = line.start + uint64_t(double(ev->time_ns) / params.speed);
+            wait_until(due);
+        }
+
+        uint64_t t0 = now_ns();
+        long ret = replay_one(params, l, *ev, buf.data());
+        uint64_t t1 = now_ns();
+        replay_op_stats &s = l.ops[trace_op_index(ev->op)];
+        bool io = ev->op == trace_op::read || ev->op == trace_op::write;
+
+        s.ops++;
+        s.service.record(t1 - t0);
+        s.latency.record(t1 - (params.fast ? t0 : due));
+        s.recorded.record(ev->duration_ns);
+        if (ret < 0) {
+            s.errors++;
+        }
+        if (io ? ret != ev->result : (ret < 0) != (ev->result < 0)) {
+            s.diverged++;
+        }
+    }
+
+    for (auto &fd : l.fds) {
+        ::close(fd.second);
+    }
+}
+
+} /* namespace */
+
+replay_result run_replay(const std::vector<trace_record> &trace,
+                         const replay_params &params)
+{
+    replay_result result;
+    start_line line;
+    std::vector<std::thread> threads;
+    size_t buf_size = 0;
+
+    if (trace.empty()) {
+        throw bench_error("the trace has no events");
+    }
+    if (!params.fast && params.speed <= 0) {
+        throw bench_error("replay speed must be positive");
+    }
+
+    result.lanes = params.lanes > 0 ? params.lanes
+                                    : std::clamp(peak_opens(trace), 1, max_lanes);
+    std::vector<lane> lanes(result.lanes);
+    assign_lanes(trace, lanes, result.opens);
+
+    for (const auto &ev : trace) {
+        result.trace_ns = std::max(result.trace_ns, ev.time_ns);
+        buf_size = std::max<size_t>(buf_size, ev.size);
+    }
+
+    for (auto &l : lanes) {
+        threads.emplace_back(worker, std::cref(params), std::ref(l), buf_size,
+                             std::ref(line));
+    }
+    while (line.ready.load(std::memory_order_acquire) < result.lanes) {
+        std::this_thread::yield();
+    }
+    line.start = now_ns() + 1000000;
+    line.go.store(true, std::memory_order_release);
+
+    for (auto &t : threads) {
+        t.join();
+    }
+    result.elapsed_ns = now_ns() - line.start;
+
+    for (auto &l : lanes) {
+        for (int i = 0; i < nr_trace_ops; i++) {
+            replay_op_stats &to = result.ops[i];
+            const replay_op_stats &from = l.ops[i];
+
+            to.ops += from.ops;
+            to.errors += from.errors;
+            to.diverged += from.diverged;
+            to.latency.merge(from.latency);
+            to.service.merge(from.service);
+            to.recorded.merge(from.recorded);
+        }
+    }
+    return result;
+}
+
+} /* namespace simplechar::bench */
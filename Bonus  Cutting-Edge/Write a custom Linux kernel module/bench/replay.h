@@ -0,0 +1,56 @@
+/*
+ * replay.h - Replay captured SimpleChar operation traces
+ *
+ * Each open file of the trace becomes a descriptor of its own, and its
+ * operations are issued in their recorded order at their recorded offsets.
+ * Opens are spread over worker lanes so operations that overlapped in the
+ * capture can overlap again. With recorded timing every operation is due
+ * at its original time (optionally scaled), and latency is measured from
+ * then, so a replay that falls behind shows it instead of stretching the
+ * trace; the fast mode drops the timing and issues each lane back to back.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_REPLAY_H
+#define SIMPLECHAR_REPLAY_H
+
+#include "hdr_histogram.h"
+#include "trace_file.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace simplechar::bench {
+
+struct replay_params {
+    std::string device = "/dev/simplechar";
+    double speed = 1.0;         /* Time scale, 2 = twice as fast */
+    bool fast = false;          /* Ignore recorded timing */
+    int lanes = 0;              /* Worker threads, 0 = peak concurrent opens */
+};
+
+struct replay_op_stats {
+    uint64_t ops = 0;
+    uint64_t errors = 0;        /* Failed during the replay */
+    uint64_t diverged = 0;      /* Result differs from the recorded one */
+    hdr_histogram latency;      /* From the due time to completion */
+    hdr_histogram service;      /* Time inside the call */
+    hdr_histogram recorded;     /* Driver time from the trace */
+};
+
+struct replay_result {
+    replay_op_stats ops[nr_trace_ops];
+    uint64_t trace_ns = 0;      /* Span of the trace */
+    uint64_t elapsed_ns = 0;    /* Span of the replay */
+    uint64_t opens = 0;         /* Distinct open files */
+    int lanes = 0;
+};
+
+replay_result run_replay(const std::vector<trace_record> &trace,
+                         const replay_params &params);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_REPLAY_H */
@@ -0,0 +1,203 @@
+/*
+ * results.cpp - Common result metadata and repeated trials
+ *
+ * License: MIT
+ */
+
+#include "results.h"
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <numeric>
+
+#include <dirent.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+/* Set by the Makefile from git describe */
+#ifndef SIMPLECHAR_GIT_HASH
+#define SIMPLECHAR_GIT_HASH "unknown"
+#endif
+
+namespace simplechar::bench {
+
+namespace {
+
+const std::string module_sysfs = "/sys/module/simplechar/";
+
+std::string command_line;
+
+std::string read_line(const std::string &path)
+{
+    std::ifstream in(path);
+    std::string line;
+
+    std::getline(in, line);
+    return line;
+}
+
+/* Value of the first "key: value" line starting with key in a text file */
+std::string find_field(const std::string &path, const std::string &key)
+{
+    std::ifstream in(path);
+    std::string line;
+
+    while (std::getline(in, line)) {
+        size_t start = line.find_first_not_of(" \t");
+
+        if (start == std::string::npos || line.compare(start, key.size(), key) != 0) {
+            continue;
+        }
+        size_t colon = line.find(':', start + key.size());
+        if (colon == std::string::npos) {
+            continue;
+        }
+        size_t value = line.find_first_not_of(" \t", colon + 1);
+        return value == std::string::npos ? "" : line.substr(value);
+    }
+    return "";
+}
+
+void write_module_info(json_writer &json)
+{
+    json.key("module").begin_object();
+    if (access(module_sysfs.c_str(), F_OK) != 0) {
+        json.field("loaded", false);
+        json.end_object();
+        return;
+    }
+
+    json.field("loaded", true);
+    json.field("version", read_line(module_sysfs + "version"));
+    json.field("srcversion", read_line(module_sysfs + "srcversion"));
+    json.field("git_hash", find_field("/proc/simplechar", "Build"));
+
+    json.key("parameters").begin_object();
+    std::string params = module_sysfs + "parameters/";
+    if (DIR *dir = opendir(params.c_str())) {
+        std::vector<std::string> names;
+
+        while (struct dirent *ent = readdir(dir)) {
+            if (ent->d_name[0] != '.') {
+                names.push_back(ent->d_name);
+            }
+        }
+        closedir(dir);
+        std::sort(names.begin(), names.end());
+        for (const auto &name : names) {
+            json.field(name, read_line(params + name));
+        }
+    }
+    json.end_object();
+    json.end_object();
+}
+
+} /* namespace */
+
+void write_histogram_json(json_writer &json, const std::string &name,
+                          const hdr_histogram &h)
+{
+    json.key(name).begin_object();
+    json.field("count", h.count());
+    json.field("mean", h.mean());
+    json.field("min", h.min());
+    json.field("p50", h.percentile(50));
+    json.field("p90", h.percentile(90));
+    json.field("p99", h.percentile(99));
+    json.field("p999", h.percentile(99.9));
+    json.field("p9999", h.percentile(99.99));
+    json.field("max", h.max());
+    json.end_object();
+}
+
+std::string utc_timestamp()
+{
+    char buf[32];
+    time_t now = std::time(nullptr);
+    struct tm tm;
+
+    gmtime_r(&now, &tm);
+    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    return buf;
+}
+
+void set_command_line(int argc, char **argv)
+{
+    command_line.clear();
+    for (int i = 0; i < argc; i++) {
+        if (i) {
+            command_line += ' ';
+        }
+        command_line += argv[i];
+    }
+}
+
+void write_run_info(json_writer &json)
+{
+    struct utsname u;
+    char host[256] = "";
+
+    gethostname(host, sizeof(host) - 1);
+    uname(&u);
+
+    json.key("run").begin_object();
+    json.field("time", utc_timestamp());
+    json.field("command", command_line);
+    json.field("bench_git_hash", SIMPLECHAR_GIT_HASH);
+    json.key("host").begin_object();
+    json.field("name", host);
+    json.field("cpu_model", find_field("/proc/cpuinfo", "model name"));
+    json.field("cpus", online_cpus());
+    json.field("machine", u.machine);
+    json.end_object();
+    json.key("kernel").begin_object();
+    json.field("release", u.release);
+    json.field("version", u.version);
+    json.end_object();
+    write_module_info(json);
+    json.end_object();
+}
+
+void trial_set::add(const std::string &metric, double value)
+{
+    for (auto &m : metrics_) {
+        if (m.first == metric) {
+            m.second.push_back(value);
+            return;
+        }
+    }
+    metrics_.emplace_back(metric, std::vector<double>{value});
+}
+
+size_t trial_set::median_trial(const std::string &metric) const
+{
+    for (const auto &m : metrics_) {
+        if (m.first != metric) {
+            continue;
+        }
+
+        std::vector<size_t> order(m.second.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return m.second[a] < m.second[b];
+        });
+        return order[order.size() / 2];
+    }
+    return 0;
+}
+
+void trial_set::write(json_writer &json) const
+{
+    json.key("trials").begin_object();
+    for (const auto &m : metrics_) {
+        json.key(m.first).begin_array();
+        for (double v : m.second) {
+            json.value(v);
+        }
+        json.end_array();
+    }
+    json.end_object();
+}
+
+} /* namespace simplechar::bench */
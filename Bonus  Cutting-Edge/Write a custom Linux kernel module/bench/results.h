@@ -0,0 +1,58 @@
+/*
+ * results.h - Common result metadata and repeated trials
+ *
+ * Every JSON report carries a "run" object describing where and against
+ * what it was measured: host, CPU, kernel, the loaded module's version,
+ * build hash and parameters, and the benchmark's own build and command
+ * line. Points measured more than once carry a "trials" object with one
+ * value per trial for each metric, which is what the compare command
+ * tests for significance.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_RESULTS_H
+#define SIMPLECHAR_RESULTS_H
+
+#include "bench_common.h"
+#include "hdr_histogram.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace simplechar::bench {
+
+/* Remember argv for the "run" object; call once from main */
+void set_command_line(int argc, char **argv);
+
+/* Write the "run" member of a report */
+void write_run_info(json_writer &json);
+
+/* Write a histogram summary (count, mean, percentiles) as member name */
+void write_histogram_json(json_writer &json, const std::string &name,
+                          const hdr_histogram &h);
+
+/* Current time as 2026-01-31T12:00:00Z */
+std::string utc_timestamp();
+
+/* Per-trial values of each metric at one point */
+class trial_set {
+public:
+    void add(const std::string &metric, double value);
+
+    /* Index of the trial with the median value of metric */
+    size_t median_trial(const std::string &metric) const;
+
+    bool empty() const { return metrics_.empty(); }
+
+    /* Write the "trials" member */
+    void write(json_writer &json) const;
+
+private:
+    std::vector<std::pair<std::string, std::vector<double>>> metrics_;
+};
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_RESULTS_H */
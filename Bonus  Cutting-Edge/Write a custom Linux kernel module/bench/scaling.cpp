@@ -0,0 +1,716 @@
+/*
+ * scaling.cpp - Core-scaling suite for SimpleChar
+ *
+ * License: MIT
+ */
+
+#include "scaling.h"
+#include "bench_common.h"
+#include "closed_loop.h"
+#include "results.h"
+#include "topology.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <sys/utsname.h>
+
+namespace simplechar::bench {
+
+namespace {
+
+enum class placement {
+    shared,     /* Every thread on the first instance */
+    per_thread, /* Thread i on instance i */
+    sharded,    /* Thread on CPU c on instance c % instances */
+};
+
+const char *placement_name(placement p)
+{
+    switch (p) {
+    case placement::shared:
+        return "shared";
+    case placement::per_thread:
+        return "per-thread";
+    case placement::sharded:
+        return "sharded";
+    }
+    return "?";
+}
+
+placement parse_placement(const std::string &text)
+{
+    for (placement p : {placement::shared, placement::per_thread,
+                        placement::sharded}) {
+        if (text == placement_name(p)) {
+            return p;
+        }
+    }
+    throw bench_error("unknown placement: " + text);
+}
+
+struct scale_config {
+    std::vector<std::string> devices{"/dev/simplechar"};
+    std::vector<placement> placements{placement::shared, placement::per_thread,
+                                      placement::sharded};
+    std::vector<int> threads;           /* Default 1, 2, 4 ... N */
+    uint64_t block_size = 4096;
+    int read_pct = 50;
+    placement_policy policy = placement_policy::compact;
+    std::vector<int> cpus;              /* Explicit pinning order */
+    uint64_t duration_ns = 1000000000ULL;
+    uint64_t warmup_ns = 200000000ULL;
+    std::string json_path;
+    std::string plot_path;
+    std::string history_path;
+    std::string label;
+    bool counters = false;
+    int trials = 1;
+};
+
+struct scale_point {
+    placement where;
+    int threads;
+    int instances;
+    int nodes;                          /* NUMA nodes the threads span */
+    closed_loop_result result;          /* The median trial */
+    trial_set trials;
+
+    /* Share of thread time spent queued on the I/O lock */
+    double lock_wait_pct() const
+    {
+        return 100.0 * double(result.io_lock.wait_ns) /
+               (double(threads) * double(result.elapsed_ns));
+    }
+
+    /* Share of time the I/O locks were held, averaged over instances */
+    double lock_busy_pct() const
+    {
+        return 100.0 * double(result.io_lock.hold_ns) /
+               (double(instances) * double(result.elapsed_ns));
+    }
+
+    double contended_pct() const
+    {
+        return result.io_lock.acquisitions
+                   ? 100.0 * double(result.io_lock.contended) /
+                         double(result.io_lock.acquisitions)
+                   : 0.0;
+    }
+};
+
+void usage(FILE *out)
+{
+    std::fprintf(out,
+        "Usage: simplechar-bench scale [options]\n"
+        "\n"
+        "Runs one closed-loop workload at increasing pinned thread counts for\n"
+        "each instance placement and reports throughput, scaling efficiency\n"
+        "and time spent waiting for the driver's I/O lock.\n"
+        "\n"
+        "Options:\n"
+        "  -d, --device PATH        Instance to use, repeat for more; per-thread\n"
+        "                           and sharded runs need more than one\n"
+        "                           (default: /dev/simplechar)\n"
+        "  -P, --placements LIST    shared,per-thread,sharded (default: all)\n"
+        "  -t, --threads LIST       Thread counts (default: 1,2,4 ... CPUs)\n"
+        "  -b, --block-size SIZE    Bytes per operation (default: 4K)\n"
+        "  -m, --mix R:W            Read:write ratio (default: 50:50)\n"
+        "  -s, --spread             Alternate NUMA nodes instead of filling\n"
+        "                           one node's cores first\n"
+        "  -c, --cpus LIST          Explicit pinning order, e.g. 0-3,8-11\n"
+        "  -D, --duration TIME      Measured time per point (default: 1s)\n"
+        "  -w, --warmup TIME        Unmeasured warmup per point (default: 200ms)\n"
+        "  -j, --json FILE          Write results as JSON ('-' for stdout)\n"
+        "  -g, --plot FILE          Write a gnuplot script plotting the curves\n"
+        "  -H, --history FILE       Compare with and append to a history file\n"
+        "  -l, --label TEXT         Tag for this run in the history\n"
+        "  -C, --counters           Add per-op perf counters\n"
+        "  -n, --trials N           Repeat every point, report the median\n"
+        "  -h, --help               Show this help message\n");
+}
+
+/* 1, 2, 4 ... up to and including max */
+std::vector<int> doubling_threads(int max)
+{
+    std::vector<int> counts;
+
+    for (int n = 1; n < max; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(max);
+    return counts;
+}
+
+scale_config parse_args(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"device", required_argument, nullptr, 'd'},
+        {"placements", required_argument, nullptr, 'P'},
+        {"threads", required_argument, nullptr, 't'},
+        {"block-size", required_argument, nullptr, 'b'},
+        {"mix", required_argument, nullptr, 'm'},
+        {"spread", no_argument, nullptr, 's'},
+        {"cpus", required_argument, nullptr, 'c'},
+        {"duration", required_argument, nullptr, 'D'},
+        {"warmup", required_argument, nullptr, 'w'},
+        {"json", required_argument, nullptr, 'j'},
+        {"plot", required_argument, nullptr, 'g'},
+        {"history", required_argument, nullptr, 'H'},
+        {"label", required_argument, nullptr, 'l'},
+        {"counters", no_argument, nullptr, 'C'},
+        {"trials", required_argument, nullptr, 'n'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    scale_config cfg;
+    bool default_devices = true;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "d:P:t:b:m:sc:D:w:j:g:H:l:Cn:h",
+                              options, nullptr)) != -1) {
+        switch (opt) {
+        case 'd':
+            if (default_devices) {
+                cfg.devices.clear();
+                default_devices = false;
+            }
+            cfg.devices.push_back(optarg);
+            break;
+        case 'P':
+            cfg.placements.clear();
+            for (const auto &name : split(optarg, ',')) {
+                cfg.placements.push_back(parse_placement(name));
+            }
+            break;
+        case 't':
+            cfg.threads = parse_int_list(optarg);
+            break;
+        case 'b':
+            cfg.block_size = parse_size(optarg);
+            break;
+        case 'm':
+            cfg.read_pct = parse_mix(optarg);
+            break;
+        case 's':
+            cfg.policy = placement_policy::spread;
+            break;
+        case 'c':
+            cfg.cpus = parse_cpu_list(optarg);
+            break;
+        case 'D':
+            cfg.duration_ns = parse_duration(optarg);
+            break;
+        case 'w':
+            cfg.warmup_ns = parse_duration(optarg);
+            break;
+        case 'j':
+            cfg.json_path = optarg;
+            break;
+        case 'g':
+            cfg.plot_path = optarg;
+            break;
+        case 'H':
+            cfg.history_path = optarg;
+            break;
+        case 'l':
+            cfg.label = optarg;
+            break;
+        case 'C':
+            cfg.counters = true;
+            break;
+        case 'n':
+            cfg.trials = std::stoi(optarg);
+            break;
+        case 'h':
+            usage(stdout);
+            std::exit(0);
+        default:
+            usage(stderr);
+            std::exit(2);
+        }
+    }
+
+    if (cfg.label.find_first_of("\t\n") != std::string::npos) {
+        throw bench_error("label must not contain tabs or newlines");
+    }
+    for (int n : cfg.threads) {
+        if (n <= 0) {
+            throw bench_error("thread counts must be positive");
+        }
+    }
+    if (cfg.trials <= 0) {
+        throw bench_error("trial count must be positive");
+    }
+    return cfg;
+}
+
+/*
+ * Worker-to-instance mapping for one point
+ * Returns false when the placement needs more instances than were given
+ */
+bool map_instances(placement where, int threads, const std::vector<int> &cpus,
+                   size_t nr_devices, std::vector<int> &map, int &instances)
+{
+    std::set<int> used;
+
+    map.clear();
+    for (int i = 0; i < threads; i++) {
+        switch (where) {
+        case placement::shared:
+            map.push_back(0);
+            break;
+        case placement::per_thread:
+            if (size_t(threads) > nr_devices) {
+                return false;
+            }
+            map.push_back(i);
+            break;
+        case placement::sharded:
+            if (nr_devices < 2) {
+                return false;
+            }
+            map.push_back(cpus[i % cpus.size()] % int(nr_devices));
+            break;
+        }
+        used.insert(map.back());
+    }
+    instances = int(used.size());
+    return true;
+}
+
+void print_header(bool counters)
+{
+    std::printf("%-10s %4s %4s %5s %12s %11s %5s %7s %7s %7s %9s%s  %s\n",
+                "placement", "thr", "inst", "nodes", "ops/s", "ops/s/thr",
+                "eff", "l-wait", "l-busy", "contend", "p99",
+                counters ? counter_header().c_str() : "", "throughput");
+}
+
+std::string percent(bool valid, double pct)
+{
+    char buf[16];
+
+    if (!valid) {
+        return "-";
+    }
+    std::snprintf(buf, sizeof(buf), "%.1f%%", pct);
+    return buf;
+}
+
+void print_point(scale_point &p, double base_ops, double max_ops,
+                 bool counters)
+{
+    auto &r = p.result;
+    bool locks = r.has_lock_stats;
+    double eff = base_ops > 0 ? r.ops_per_sec() / (base_ops * p.threads) : 0;
+    int bar = max_ops > 0 ? int(r.ops_per_sec() / max_ops * 30 + 0.5) : 0;
+
+    std::printf("%-10s %4d %4d %5d %12.0f %11.0f %4.0f%% %7s %7s %7s %9s%s  %s\n",
+                placement_name(p.where), p.threads, p.instances, p.nodes,
+                r.ops_per_sec(), r.ops_per_sec() / p.threads, eff * 100,
+                percent(locks, p.lock_wait_pct()).c_str(),
+                percent(locks, p.lock_busy_pct()).c_str(),
+                percent(locks, p.contended_pct()).c_str(),
+                format_ns(double(r.latency.percentile(99))).c_str(),
+                counters ? counter_cells(r.counters, r.ops).c_str() : "",
+                std::string(size_t(std::max(bar, 0)), '#').c_str());
+}
+
+/*
+ * Spell out what the I/O lock costs at the highest shared thread count:
+ * with one exclusive holder, throughput can never exceed one operation
+ * per average hold time, however many threads are added
+ */
+void print_lock_summary(std::vector<scale_point> &points)
+{
+    const scale_point *one = nullptr, *top = nullptr;
+
+    for (const auto &p : points) {
+        if (p.where != placement::shared || !p.result.has_lock_stats) {
+            continue;
+        }
+        if (p.threads == 1) {
+            one = &p;
+        }
+        if (!top || p.threads > top->threads) {
+            top = &p;
+        }
+    }
+    if (!top || !top->result.io_lock.acquisitions) {
+        return;
+    }
+
+    double hold = double(top->result.io_lock.hold_ns) /
+                  double(top->result.io_lock.acquisitions);
+    std::printf("\nI/O lock, shared instance at %d threads: held %s per "
+                "acquisition, ceiling %.0f ops/s;\n", top->threads,
+                format_ns(hold).c_str(), hold > 0 ? 1e9 / hold : 0.0);
+    std::printf("  threads spent %.1f%% of their time queued, lock busy %.1f%%",
+                top->lock_wait_pct(), top->lock_busy_pct());
+    if (one && one != top && one->result.ops_per_sec() > 0) {
+        std::printf(", %.2fx the 1-thread throughput",
+                    top->result.ops_per_sec() / one->result.ops_per_sec());
+    }
+    std::printf("\n");
+}
+
+void write_point_json(json_writer &json, scale_point &p, bool counters)
+{
+    auto &r = p.result;
+
+    json.begin_object();
+    json.field("placement", placement_name(p.where));
+    json.field("threads", p.threads);
+    json.field("instances", p.instances);
+    json.field("nodes", p.nodes);
+    json.field("ops", r.ops);
+    json.field("errors", r.errors);
+    json.field("ops_per_sec", r.ops_per_sec());
+    json.field("gb_per_sec", r.gb_per_sec());
+    json.key("latency_ns").begin_object();
+    json.field("mean", r.latency.mean());
+    json.field("p50", r.latency.percentile(50));
+    json.field("p99", r.latency.percentile(99));
+    json.field("max", r.latency.max());
+    json.end_object();
+    if (r.has_lock_stats) {
+        json.key("io_lock").begin_object();
+        json.field("acquisitions", uint64_t(r.io_lock.acquisitions));
+        json.field("contended", uint64_t(r.io_lock.contended));
+        json.field("wait_ns", uint64_t(r.io_lock.wait_ns));
+        json.field("hold_ns", uint64_t(r.io_lock.hold_ns));
+        json.field("wait_pct", p.lock_wait_pct());
+        json.field("busy_pct", p.lock_busy_pct());
+        json.end_object();
+    }
+    if (counters) {
+        write_counters_json(json, r.counters, r.ops);
+    }
+    p.trials.write(json);
+    json.end_object();
+}
+
+void write_json(std::ostream &out, const scale_config &cfg,
+                std::vector<scale_point> &points)
+{
+    json_writer json(out);
+
+    json.begin_object();
+    json.field("tool", "simplechar-bench");
+    json.field("mode", "scale");
+    write_run_info(json);
+    json.field("trials", cfg.trials);
+    json.field("duration_s", double(cfg.duration_ns) / 1e9);
+    json.field("block_size", cfg.block_size);
+    json.field("read_pct", cfg.read_pct);
+    json.field("policy", cfg.policy == placement_policy::spread ? "spread"
+                                                                : "compact");
+    json.key("results").begin_array();
+    for (auto &p : points) {
+        write_point_json(json, p, cfg.counters);
+    }
+    json.end_array();
+    json.end_object();
+}
+
+/*
+ * gnuplot script with the data inline: throughput and lock wait against
+ * thread count, one line per placement. Run "gnuplot FILE" for FILE.png
+ */
+void write_plot(const std::string &path, const scale_config &cfg,
+                std::vector<scale_point> &points)
+{
+    std::ofstream out(path);
+    std::set<placement> seen;
+
+    if (!out) {
+        throw bench_error("cannot write " + path);
+    }
+    out << std::fixed << std::setprecision(1);
+
+    for (const auto &p : points) {
+        seen.insert(p.where);
+    }
+    for (placement where : seen) {
+        std::string name = placement_name(where);
+
+        std::replace(name.begin(), name.end(), '-', '_');
+        out << "$" << name << " << EOD\n";
+        for (auto &p : points) {
+            if (p.where == where) {
+                out << p.threads << " " << p.result.ops_per_sec() << " "
+                    << (p.result.has_lock_stats ? p.lock_wait_pct() : 0.0)
+                    << "\n";
+            }
+        }
+        out << "EOD\n";
+    }
+
+    out << "set terminal pngcairo size 1200,500\n"
+        << "set output '" << path << ".png'\n"
+        << "set multiplot layout 1,2 title 'simplechar scaling, "
+        << format_size(cfg.block_size) << " blocks, " << cfg.read_pct
+        << "% reads'\n"
+        << "set xlabel 'threads'\n"
+        << "set logscale x 2\n"
+        << "set key top left\n"
+        << "set grid\n"
+        << "set ylabel 'ops/s'\n"
+        << "plot";
+    const char *sep = " ";
+    for (placement where : seen) {
+        std::string name = placement_name(where);
+        std::string var = name;
+
+        std::replace(var.begin(), var.end(), '-', '_');
+        out << sep << "$" << var << " using 1:2 with linespoints title '"
+            << name << "'";
+        sep = ", ";
+    }
+    out << "\nset ylabel 'I/O lock wait, % of thread time'\n"
+        << "set yrange [0:100]\n"
+        << "plot";
+    sep = " ";
+    for (placement where : seen) {
+        std::string name = placement_name(where);
+        std::string var = name;
+
+        std::replace(var.begin(), var.end(), '-', '_');
+        out << sep << "$" << var << " using 1:3 with linespoints title '"
+            << name << "'";
+        sep = ", ";
+    }
+    out << "\nunset multiplot\n";
+}
+
+/*
+ * History file
+ * One tab-separated row per point, so it can be grepped, plotted and
+ * compared against without a JSON parser.
+ */
+const char *history_header =
+    "time\tlabel\tkernel\tblock_size\tread_pct\tplacement\tthreads"
+    "\tops_per_sec\tlock_wait_pct\tlock_busy_pct";
+
+struct history_row {
+    std::string time;
+    std::string label;
+    std::string where;
+    int threads;
+    double ops_per_sec;
+    double lock_wait_pct;
+};
+
+std::string kernel_release()
+{
+    struct utsname u;
+
+    return uname(&u) == 0 ? u.release : "unknown";
+}
+
+/* Rows of the most recent earlier run with the same workload */
+std::vector<history_row> last_run(const std::string &path,
+                                  const scale_config &cfg)
+{
+    std::ifstream in(path);
+    std::vector<history_row> rows;
+    std::string line, latest;
+
+    while (std::getline(in, line)) {
+        std::vector<std::string> f;
+        std::istringstream fields(line);
+        std::string field;
+
+        while (std::getline(fields, field, '\t')) {
+            f.push_back(field);
+        }
+        if (f.size() < 10 || f[0] == "time") {
+            continue;
+        }
+        try {
+            if (std::stoull(f[3]) != cfg.block_size ||
+                std::stoi(f[4]) != cfg.read_pct) {
+                continue;
+            }
+            history_row row{f[0], f[1], f[5], std::stoi(f[6]),
+                            std::stod(f[7]), std::stod(f[8])};
+
+            if (row.time > latest) {
+                latest = row.time;
+                rows.clear();
+            }
+            if (row.time == latest) {
+                rows.push_back(row);
+            }
+        } catch (const std::exception &) {
+            /* Skip damaged rows rather than refusing to run */
+        }
+    }
+    return rows;
+}
+
+void compare_history(const std::vector<history_row> &previous,
+                     std::vector<scale_point> &points)
+{
+    if (previous.empty()) {
+        return;
+    }
+
+    std::printf("\nCompared with %s%s%s:\n", previous.front().time.c_str(),
+                previous.front().label.empty() ? "" : " ",
+                previous.front().label.c_str());
+    for (auto &p : points) {
+        for (const auto &row : previous) {
+            if (row.where != placement_name(p.where) ||
+                row.threads != p.threads || row.ops_per_sec <= 0) {
+                continue;
+            }
+            std::printf("  %-10s %4d threads: %+6.1f%% ops/s",
+                        placement_name(p.where), p.threads,
+                        100.0 * (p.result.ops_per_sec() / row.ops_per_sec - 1));
+            if (p.result.has_lock_stats) {
+                std::printf(", lock wait %.1f%% -> %.1f%%", row.lock_wait_pct,
+                            p.lock_wait_pct());
+            }
+            std::printf("\n");
+        }
+    }
+}
+
+void append_history(const std::string &path, const scale_config &cfg,
+                    std::vector<scale_point> &points)
+{
+    bool fresh = !std::ifstream(path).good();
+    std::ofstream out(path, std::ios::app);
+    std::string time = utc_timestamp();
+    std::string kernel = kernel_release();
+
+    if (!out) {
+        throw bench_error("cannot append to " + path);
+    }
+    if (fresh) {
+        out << history_header << "\n";
+    }
+    out << std::fixed << std::setprecision(1);
+    for (auto &p : points) {
+        out << time << "\t" << cfg.label << "\t" << kernel << "\t"
+            << cfg.block_size << "\t" << cfg.read_pct << "\t"
+            << placement_name(p.where) << "\t" << p.threads << "\t"
+            << p.result.ops_per_sec() << "\t"
+            << (p.result.has_lock_stats ? p.lock_wait_pct() : 0.0) << "\t"
+            << (p.result.has_lock_stats ? p.lock_busy_pct() : 0.0) << "\n";
+    }
+}
+
+} /* namespace */
+
+int run_scale(int argc, char **argv)
+{
+    scale_config cfg = parse_args(argc, argv);
+    std::vector<cpu_info> topology = cpu_topology();
+    std::vector<int> order = cfg.cpus.empty()
+                                 ? placement_order(topology, cfg.policy)
+                                 : cfg.cpus;
+    std::vector<scale_point> points;
+    bool json_stdout = cfg.json_path == "-";
+    double max_ops = 0;
+
+    if (order.empty()) {
+        throw bench_error("no CPUs to run on");
+    }
+    if (cfg.threads.empty()) {
+        cfg.threads = doubling_threads(int(order.size()));
+    }
+    if (cfg.counters) {
+        report_counter_source();
+    }
+
+    for (placement where : cfg.placements) {
+        for (int threads : cfg.threads) {
+            closed_loop_params params;
+            std::set<int> nodes;
+            scale_point point;
+
+            params.cpus.assign(order.begin(),
+                               order.begin() + std::min<size_t>(threads, order.size()));
+            if (!map_instances(where, threads, params.cpus, cfg.devices.size(),
+                               params.device_map, point.instances)) {
+                if (!json_stdout) {
+                    std::fprintf(stderr, "%s: skipping %d threads, needs more "
+                                 "than %zu --device\n", placement_name(where),
+                                 threads, cfg.devices.size());
+                }
+                continue;
+            }
+            for (int cpu : params.cpus) {
+                nodes.insert(node_of(topology, cpu));
+            }
+
+            params.devices = cfg.devices;
+            params.block_size = cfg.block_size;
+            params.threads = threads;
+            params.read_pct = cfg.read_pct;
+            params.duration_ns = cfg.duration_ns;
+            params.warmup_ns = cfg.warmup_ns;
+            params.pin = true;
+            params.counters = cfg.counters;
+
+            point.where = where;
+            point.threads = threads;
+            point.nodes = int(nodes.size());
+            point.result = run_closed_loop_trials(params, cfg.trials,
+                                                  point.trials);
+            max_ops = std::max(max_ops, point.result.ops_per_sec());
+            points.push_back(std::move(point));
+        }
+    }
+
+    if (!json_stdout) {
+        print_header(cfg.counters);
+        for (auto &p : points) {
+            double base = 0;
+
+            for (const auto &q : points) {
+                if (q.where == p.where && q.threads == 1) {
+                    base = q.result.ops_per_sec();
+                }
+            }
+            print_point(p, base, max_ops, cfg.counters);
+        }
+        print_lock_summary(points);
+    }
+
+    if (!cfg.plot_path.empty()) {
+        write_plot(cfg.plot_path, cfg, points);
+    }
+    if (!cfg.history_path.empty()) {
+        if (!json_stdout) {
+            compare_history(last_run(cfg.history_path, cfg), points);
+        }
+        append_history(cfg.history_path, cfg, points);
+    }
+    if (json_stdout) {
+        write_json(std::cout, cfg, points);
+    } else if (!cfg.json_path.empty()) {
+        std::ofstream out(cfg.json_path);
+        if (!out) {
+            throw bench_error("cannot write " + cfg.json_path);
+        }
+        write_json(out, cfg, points);
+    }
+    return 0;
+}
+
+} /* namespace simplechar::bench */
@@ -0,0 +1,24 @@
+/*
+ * scaling.h - Core-scaling suite for SimpleChar
+ *
+ * Runs the same closed-loop workload at 1, 2, 4 ... N pinned threads
+ * against one shared instance, one instance per thread, and instances
+ * sharded by CPU, and sets throughput beside the time threads spent
+ * queued on the driver's I/O lock. Results can be written as JSON, as a
+ * gnuplot script, and appended to a history file to follow the curves
+ * across driver changes.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_SCALING_H
+#define SIMPLECHAR_SCALING_H
+
+namespace simplechar::bench {
+
+/* Entry point of "simplechar-bench scale" */
+int run_scale(int argc, char **argv);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_SCALING_H */
@@ -0,0 +1,659 @@
+/*
+ * simplechar_bench.cpp - Throughput and latency benchmark for SimpleChar
+ *
+ * Drives one or more SimpleChar instances with raw pread()/pwrite() calls
+ * and reports operations per second, bandwidth and latency percentiles,
+ * both as a table and as JSON.
+ *
+ *   sweep     closed loop: tight loops over a parameter matrix (default)
+ *   openloop  fixed-rate schedule, latency from intended send time
+ *   scale     throughput and lock wait against pinned thread count
+ *   ipc       same producer/consumer over pipes, sockets, shm and the device
+ *   compare   significant differences between two JSON reports
+ *   workload  phases of thread groups described in a JSON file
+ *   combine   small messages written directly and through write combining
+ *   ring      records streamed through the mmap()ed record ring
+ *   frames    frame scanner paths against memcpy() bandwidth
+ *   pool      reads into fresh vectors against pooled buffers
+ *   fanin     one thread reading the rings of many instances
+ *
+ * Usage: simplechar-bench [sweep|openloop|scale|ipc|compare|workload|combine|ring|
+ *                         frames|pool|fanin] [options]
+ *
+ * License: MIT
+ */
+
+#include "bench_common.h"
+#include "closed_loop.h"
+#include "combine.h"
+#include "fan_in.h"
+#include "frame_scan.h"
+#include "ipc.h"
+#include "mmap_ring.h"
+#include "open_loop.h"
+#include "pool_reads.h"
+#include "compare.h"
+#include "results.h"
+#include "scaling.h"
+#include "workload.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+using namespace simplechar::bench;
+
+namespace {
+
+struct sweep_config {
+    std::vector<std::string> devices{"/dev/simplechar"};
+    std::vector<uint64_t> block_sizes{1,       4,       16,      64,
+                                      256,     1 << 10, 4 << 10, 16 << 10,
+                                      64 << 10, 256 << 10, 1 << 20, 4 << 20};
+    std::vector<int> threads{1, 2, 4};
+    std::vector<int> read_pcts{100, 50, 0};
+    std::vector<int> instances{1};
+    uint64_t duration_ns = 500000000ULL;
+    uint64_t warmup_ns = 100000000ULL;
+    bool pin = false;
+    bool counters = false;
+    int trials = 1;
+    std::string json_path;
+};
+
+struct sweep_point {
+    int instances;
+    int threads;
+    uint64_t block_size;
+    int read_pct;
+    closed_loop_result result;         /* The median trial */
+    trial_set trials;
+};
+
+void usage(FILE *out)
+{
+    std::fprintf(out,
+        "Usage: simplechar-bench [sweep|openloop|scale|ipc|compare|workload|combine|\n"
+        "                        ring|frames|pool|fanin] [options]\n"
+        "\n"
+        "Sweeps block size, thread count, read:write mix and instance count\n"
+        "against SimpleChar devices using pread()/pwrite() in tight loops.\n"
+        "\n"
+        "Options:\n"
+        "  -d, --device PATH        Device to test, repeat for more instances\n"
+        "                           (default: /dev/simplechar)\n"
+        "  -b, --block-sizes LIST   Block sizes, e.g. 1,4K,1M (default: 1B-4M, x4)\n"
+        "  -t, --threads LIST       Thread counts (default: 1,2,4)\n"
+        "  -m, --mix LIST           Read:write ratios (default: 100:0,50:50,0:100)\n"
+        "  -i, --instances LIST     Instance counts, at most the number of\n"
+        "                           devices given (default: 1)\n"
+        "  -D, --duration TIME      Measured time per point (default: 0.5s)\n"
+        "  -w, --warmup TIME        Unmeasured warmup per point (default: 100ms)\n"
+        "  -p, --pin                Pin worker threads to CPUs\n"
+        "  -C, --counters           Add per-op perf counters (cycles,\n"
+        "                           instructions, cache misses, context\n"
+        "                           switches, CPU time)\n"
+        "  -n, --trials N           Repeat every point, report the median\n"
+        "                           and keep all trials for compare (default: 1)\n"
+        "  -j, --json FILE          Write results as JSON ('-' for stdout)\n"
+        "  -h, --help               Show this help message\n"
+        "\n"
+        "Run 'simplechar-bench MODE --help' for the openloop, scale, ipc,\n"
+        "compare, workload, combine, ring, frames, pool and fanin modes.\n");
+}
+
+sweep_config parse_sweep_args(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"device", required_argument, nullptr, 'd'},
+        {"block-sizes", required_argument, nullptr, 'b'},
+        {"threads", required_argument, nullptr, 't'},
+        {"mix", required_argument, nullptr, 'm'},
+        {"instances", required_argument, nullptr, 'i'},
+        {"duration", required_argument, nullptr, 'D'},
+        {"warmup", required_argument, nullptr, 'w'},
+        {"pin", no_argument, nullptr, 'p'},
+        {"counters", no_argument, nullptr, 'C'},
+        {"trials", required_argument, nullptr, 'n'},
+        {"json", required_argument, nullptr, 'j'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    sweep_config cfg;
+    bool default_devices = true;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "d:b:t:m:i:D:w:pCn:j:h", options,
+                              nullptr)) != -1) {
+        switch (opt) {
+        case 'd':
+            if (default_devices) {
+                cfg.devices.clear();
+                default_devices = false;
+            }
+            cfg.devices.push_back(optarg);
+            break;
+        case 'b':
+            cfg.block_sizes = parse_size_list(optarg);
+            break;
+        case 't':
+            cfg.threads = parse_int_list(optarg);
+            break;
+        case 'm':
+            cfg.read_pcts.clear();
+            for (const auto &mix : split(optarg, ',')) {
+                cfg.read_pcts.push_back(parse_mix(mix));
+            }
+            break;
+        case 'i':
+            cfg.instances = parse_int_list(optarg);
+            break;
+        case 'D':
+            cfg.duration_ns = parse_duration(optarg);
+            break;
+        case 'w':
+            cfg.warmup_ns = parse_duration(optarg);
+            break;
+        case 'p':
+            cfg.pin = true;
+            break;
+        case 'C':
+            cfg.counters = true;
+            break;
+        case 'n':
+            cfg.trials = std::stoi(optarg);
+            break;
+        case 'j':
+            cfg.json_path = optarg;
+            break;
+        case 'h':
+            usage(stdout);
+            std::exit(0);
+        default:
+            usage(stderr);
+            std::exit(2);
+        }
+    }
+
+    if (cfg.trials <= 0) {
+        throw bench_error("trial count must be positive");
+    }
+    for (int n : cfg.instances) {
+        if (n <= 0 || size_t(n) > cfg.devices.size()) {
+            throw bench_error("instance count " + std::to_string(n) +
+                              " needs that many --device paths");
+        }
+    }
+    return cfg;
+}
+
+void print_header(bool counters)
+{
+    std::printf("%4s %4s %7s %7s %12s %9s %9s %9s %9s %9s %6s%s\n",
+                "inst", "thr", "block", "r:w", "ops/s", "GB/s",
+                "p50", "p99", "p99.9", "max", "err",
+                counters ? counter_header().c_str() : "");
+}
+
+void print_point(sweep_point &p, bool counters)
+{
+    auto &r = p.result;
+    char mix[16];
+
+    std::snprintf(mix, sizeof(mix), "%d:%d", p.read_pct, 100 - p.read_pct);
+    std::printf("%4d %4d %7s %7s %12.0f %9.3f %9s %9s %9s %9s %6llu%s\n",
+                p.instances, p.threads, format_size(p.block_size).c_str(), mix,
+                r.ops_per_sec(), r.gb_per_sec(),
+                format_ns(double(r.latency.percentile(50))).c_str(),
+                format_ns(double(r.latency.percentile(99))).c_str(),
+                format_ns(double(r.latency.percentile(99.9))).c_str(),
+                format_ns(double(r.latency.max())).c_str(),
+                (unsigned long long)r.errors,
+                counters ? counter_cells(r.counters, r.ops).c_str() : "");
+    std::fflush(stdout);
+}
+
+void write_json(std::ostream &out, const sweep_config &cfg,
+                std::vector<sweep_point> &points)
+{
+    json_writer json(out);
+
+    json.begin_object();
+    json.field("tool", "simplechar-bench");
+    json.field("mode", "sweep");
+    write_run_info(json);
+    json.field("duration_s", double(cfg.duration_ns) / 1e9);
+    json.field("trials", cfg.trials);
+    json.key("results").begin_array();
+    for (auto &p : points) {
+        auto &r = p.result;
+
+        json.begin_object();
+        json.field("instances", p.instances);
+        json.field("threads", p.threads);
+        json.field("block_size", p.block_size);
+        json.field("read_pct", p.read_pct);
+        json.field("ops", r.ops);
+        json.field("bytes", r.bytes);
+        json.field("errors", r.errors);
+        json.field("ops_per_sec", r.ops_per_sec());
+        json.field("gb_per_sec", r.gb_per_sec());
+        json.key("latency_ns").begin_object();
+        json.field("mean", r.latency.mean());
+        json.field("p50", r.latency.percentile(50));
+        json.field("p90", r.latency.percentile(90));
+        json.field("p99", r.latency.percentile(99));
+        json.field("p999", r.latency.percentile(99.9));
+        json.field("max", r.latency.max());
+        json.end_object();
+        if (cfg.counters) {
+            write_counters_json(json, r.counters, r.ops);
+        }
+        p.trials.write(json);
+        json.end_object();
+    }
+    json.end_array();
+    json.end_object();
+}
+
+int run_sweep(int argc, char **argv)
+{
+    sweep_config cfg = parse_sweep_args(argc, argv);
+    std::vector<sweep_point> points;
+    bool json_stdout = cfg.json_path == "-";
+
+    if (cfg.counters) {
+        report_counter_source();
+    }
+    if (!json_stdout) {
+        print_header(cfg.counters);
+    }
+
+    for (int instances : cfg.instances) {
+        for (int threads : cfg.threads) {
+            for (int read_pct : cfg.read_pcts) {
+                for (uint64_t block_size : cfg.block_sizes) {
+                    closed_loop_params params;
+
+                    params.devices.assign(cfg.devices.begin(),
+                                          cfg.devices.begin() + instances);
+                    params.block_size = block_size;
+                    params.threads = threads;
+                    params.read_pct = read_pct;
+                    params.duration_ns = cfg.duration_ns;
+                    params.warmup_ns = cfg.warmup_ns;
+                    params.pin = cfg.pin;
+                    params.counters = cfg.counters;
+
+                    sweep_point point;
+
+                    point.instances = instances;
+                    point.threads = threads;
+                    point.block_size = block_size;
+                    point.read_pct = read_pct;
+                    point.result = run_closed_loop_trials(params, cfg.trials,
+                                                          point.trials);
+                    points.push_back(std::move(point));
+                    if (!json_stdout) {
+                        print_point(points.back(), cfg.counters);
+                    }
+                }
+            }
+        }
+    }
+
+    if (json_stdout) {
+        write_json(std::cout, cfg, points);
+    } else if (!cfg.json_path.empty()) {
+        std::ofstream out(cfg.json_path);
+        if (!out) {
+            throw bench_error("cannot write " + cfg.json_path);
+        }
+        write_json(out, cfg, points);
+    }
+    return 0;
+}
+
+/*
+ * Open-loop mode
+ */
+
+struct openloop_config {
+    std::vector<std::string> devices{"/dev/simplechar"};
+    std::vector<uint64_t> block_sizes{4096};
+    std::vector<int> read_pcts{50};
+    std::vector<double> rates{1000, 2000, 5000, 10000, 20000, 50000,
+                              100000, 200000, 500000};
+    int threads = 1;
+    arrival_process arrival = arrival_process::poisson;
+    std::vector<int> cpus;
+    uint64_t duration_ns = 2000000000ULL;
+    uint64_t warmup_ns = 200000000ULL;
+    double knee_factor = 10.0;
+    std::string json_path;
+};
+
+struct openloop_series {
+    uint64_t block_size;
+    int read_pct;
+    std::vector<open_loop_result> points;
+    double knee_rate = 0;       /* First offered rate past the knee, 0 = none */
+};
+
+void openloop_usage(FILE *out)
+{
+    std::fprintf(out,
+        "Usage: simplechar-bench openloop [options]\n"
+        "\n"
+        "Issues operations on a fixed schedule from pinned threads and records\n"
+        "latency from the intended send time in an HDR histogram, sweeping\n"
+        "the offered rate to find the knee of the latency/throughput curve.\n"
+        "\n"
+        "Options:\n"
+        "  -d, --device PATH        Device to test, repeat to spread threads\n"
+        "                           over instances (default: /dev/simplechar)\n"
+        "  -b, --block-sizes LIST   Block sizes, one series each (default: 4K)\n"
+        "  -m, --mix LIST           Read:write ratios, one series each\n"
+        "                           (default: 50:50)\n"
+        "  -r, --rates LIST         Offered ops/s over all threads, e.g.\n"
+        "                           1k,10k,100k (default: 1k to 500k)\n"
+        "  -t, --threads N          Sending threads (default: 1)\n"
+        "  -c, --cpus LIST          CPUs to pin threads to (default: 0..N-1)\n"
+        "  -a, --arrival KIND       poisson or constant (default: poisson)\n"
+        "  -k, --knee-factor X      Knee when p99 exceeds X times the p99 at\n"
+        "                           the lowest rate, or throughput falls 5%%\n"
+        "                           short of the offered rate (default: 10)\n"
+        "  -D, --duration TIME      Measured time per rate (default: 2s)\n"
+        "  -w, --warmup TIME        Unmeasured warmup per rate (default: 200ms)\n"
+        "  -j, --json FILE          Write results as JSON ('-' for stdout)\n"
+        "  -h, --help               Show this help message\n");
+}
+
+openloop_config parse_openloop_args(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"device", required_argument, nullptr, 'd'},
+        {"block-sizes", required_argument, nullptr, 'b'},
+        {"mix", required_argument, nullptr, 'm'},
+        {"rates", required_argument, nullptr, 'r'},
+        {"threads", required_argument, nullptr, 't'},
+        {"cpus", required_argument, nullptr, 'c'},
+        {"arrival", required_argument, nullptr, 'a'},
+        {"knee-factor", required_argument, nullptr, 'k'},
+        {"duration", required_argument, nullptr, 'D'},
+        {"warmup", required_argument, nullptr, 'w'},
+        {"json", required_argument, nullptr, 'j'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    openloop_config cfg;
+    bool default_devices = true;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "d:b:m:r:t:c:a:k:D:w:j:h", options,
+                              nullptr)) != -1) {
+        switch (opt) {
+        case 'd':
+            if (default_devices) {
+                cfg.devices.clear();
+                default_devices = false;
+            }
+            cfg.devices.push_back(optarg);
+            break;
+        case 'b':
+            cfg.block_sizes = parse_size_list(optarg);
+            break;
+        case 'm':
+            cfg.read_pcts.clear();
+            for (const auto &mix : split(optarg, ',')) {
+                cfg.read_pcts.push_back(parse_mix(mix));
+            }
+            break;
+        case 'r':
+            cfg.rates.clear();
+            for (const auto &rate : split(optarg, ',')) {
+                cfg.rates.push_back(parse_rate(rate));
+            }
+            break;
+        case 't':
+            cfg.threads = std::stoi(optarg);
+            break;
+        case 'c':
+            cfg.cpus = parse_int_list(optarg);
+            break;
+        case 'a':
+            if (std::strcmp(optarg, "poisson") == 0) {
+                cfg.arrival = arrival_process::poisson;
+            } else if (std::strcmp(optarg, "constant") == 0) {
+                cfg.arrival = arrival_process::constant;
+            } else {
+                throw bench_error(std::string("unknown arrival process: ") +
+                                  optarg);
+            }
+            break;
+        case 'k':
+            cfg.knee_factor = std::stod(optarg);
+            break;
+        case 'D':
+            cfg.duration_ns = parse_duration(optarg);
+            break;
+        case 'w':
+            cfg.warmup_ns = parse_duration(optarg);
+            break;
+        case 'j':
+            cfg.json_path = optarg;
+            break;
+        case 'h':
+            openloop_usage(stdout);
+            std::exit(0);
+        default:
+            openloop_usage(stderr);
+            std::exit(2);
+        }
+    }
+
+    if (cfg.threads <= 0) {
+        throw bench_error("thread count must be positive");
+    }
+    std::sort(cfg.rates.begin(), cfg.rates.end());
+    return cfg;
+}
+
+void print_openloop_header()
+{
+    std::printf("%7s %7s %10s %10s %9s %9s %9s %9s %9s %9s %7s\n",
+                "block", "r:w", "offered", "achieved", "p50", "p99",
+                "p99.9", "p99.99", "max", "svc-p99", "unsent");
+}
+
+void print_openloop_point(const openloop_series &series,
+                          const open_loop_result &r)
+{
+    char mix[16];
+
+    std::snprintf(mix, sizeof(mix), "%d:%d", series.read_pct,
+                  100 - series.read_pct);
+    std::printf("%7s %7s %10.0f %10.0f %9s %9s %9s %9s %9s %9s %7llu\n",
+                format_size(series.block_size).c_str(), mix,
+                r.offered_rate, r.achieved_rate(),
+                format_ns(double(r.latency.percentile(50))).c_str(),
+                format_ns(double(r.latency.percentile(99))).c_str(),
+                format_ns(double(r.latency.percentile(99.9))).c_str(),
+                format_ns(double(r.latency.percentile(99.99))).c_str(),
+                format_ns(double(r.latency.max())).c_str(),
+                format_ns(double(r.service.percentile(99))).c_str(),
+                (unsigned long long)r.unsent);
+    std::fflush(stdout);
+}
+
+/*
+ * The knee is the first offered rate where the tail has blown up
+ * relative to light load, or the device no longer keeps up
+ */
+double find_knee(const std::vector<open_loop_result> &points, double factor)
+{
+    if (points.empty()) {
+        return 0;
+    }
+
+    double base_p99 = double(std::max<uint64_t>(points.front().latency.percentile(99), 1));
+    for (const auto &p : points) {
+        if (double(p.latency.percentile(99)) > factor * base_p99 ||
+            p.achieved_rate() < 0.95 * p.offered_rate) {
+            return p.offered_rate;
+        }
+    }
+    return 0;
+}
+
+void write_openloop_json(std::ostream &out, const openloop_config &cfg,
+                         const std::vector<openloop_series> &all)
+{
+    json_writer json(out);
+
+    json.begin_object();
+    json.field("tool", "simplechar-bench");
+    json.field("mode", "openloop");
+    write_run_info(json);
+    json.field("duration_s", double(cfg.duration_ns) / 1e9);
+    json.field("threads", cfg.threads);
+    json.field("arrival", cfg.arrival == arrival_process::poisson
+                              ? "poisson" : "constant");
+    json.key("series").begin_array();
+    for (const auto &series : all) {
+        json.begin_object();
+        json.field("block_size", series.block_size);
+        json.field("read_pct", series.read_pct);
+        json.field("knee_rate", series.knee_rate);
+        json.key("results").begin_array();
+        for (const auto &r : series.points) {
+            json.begin_object();
+            json.field("offered_rate", r.offered_rate);
+            json.field("achieved_rate", r.achieved_rate());
+            json.field("ops", r.ops);
+            json.field("errors", r.errors);
+            json.field("unsent", r.unsent);
+            write_histogram_json(json, "latency_ns", r.latency);
+            write_histogram_json(json, "service_ns", r.service);
+            json.end_object();
+        }
+        json.end_array();
+        json.end_object();
+    }
+    json.end_array();
+    json.end_object();
+}
+
+int run_openloop(int argc, char **argv)
+{
+    openloop_config cfg = parse_openloop_args(argc, argv);
+    std::vector<openloop_series> all;
+    bool json_stdout = cfg.json_path == "-";
+
+    if (!json_stdout) {
+        print_openloop_header();
+    }
+
+    for (int read_pct : cfg.read_pcts) {
+        for (uint64_t block_size : cfg.block_sizes) {
+            openloop_series series{block_size, read_pct, {}, 0};
+
+            for (double rate : cfg.rates) {
+                open_loop_params params;
+
+                params.devices = cfg.devices;
+                params.block_size = block_size;
+                params.threads = cfg.threads;
+                params.read_pct = read_pct;
+                params.rate = rate;
+                params.arrival = cfg.arrival;
+                params.cpus = cfg.cpus;
+                params.duration_ns = cfg.duration_ns;
+                params.warmup_ns = cfg.warmup_ns;
+
+                series.points.push_back(run_open_loop(params));
+                if (!json_stdout) {
+                    print_openloop_point(series, series.points.back());
+                }
+            }
+
+            series.knee_rate = find_knee(series.points, cfg.knee_factor);
+            if (!json_stdout) {
+                if (series.knee_rate > 0) {
+                    std::printf("knee: %s %d:%d at %.0f ops/s\n",
+                                format_size(block_size).c_str(), read_pct,
+                                100 - read_pct, series.knee_rate);
+                } else {
+                    std::printf("knee: %s %d:%d not reached\n",
+                                format_size(block_size).c_str(), read_pct,
+                                100 - read_pct);
+                }
+            }
+            all.push_back(std::move(series));
+        }
+    }
+
+    if (json_stdout) {
+        write_openloop_json(std::cout, cfg, all);
+    } else if (!cfg.json_path.empty()) {
+        std::ofstream out(cfg.json_path);
+        if (!out) {
+            throw bench_error("cannot write " + cfg.json_path);
+        }
+        write_openloop_json(out, cfg, all);
+    }
+    return 0;
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+    set_command_line(argc, argv);
+    try {
+        /* The subcommand is optional, sweep is the default */
+        if (argc > 1 && std::strcmp(argv[1], "sweep") == 0) {
+            return run_sweep(argc - 1, argv + 1);
+        }
+        if (argc > 1 && std::strcmp(argv[1], "openloop") == 0) {
+            return run_openloop(argc - 1, argv + 1);
+        }
+        if (argc > 1 && std::strcmp(argv[1], "scale") == 0) {
+            return run_scale(argc - 1, argv + 1);
+        }
+        if (argc > 1 && std::strcmp(argv[1], "ipc") == 0) {
+            return run_ipc(argc - 1, argv + 1);
+        }
+        if (argc > 1 && std::strcmp(argv[1], "compare") == 0) {
+            return run_compare(argc - 1, argv + 1);
+        }
+        if (argc > 1 && std::strcmp(argv[1], "workload") == 0) {
+            return run_workload(argc - 1, argv + 1);
+        }
+        if (argc > 1 && std::strcmp(argv[1], "combine") == 0) {
+            return run_combine(argc - 1, argv + 1);
+        }
+        if (argc > 1 && std::strcmp(argv[1], "ring") == 0) {
+            return run_ring(argc - 1, argv + 1);
+        }
+        if (argc > 1 && std::strcmp(argv[1], "frames") == 0) {
+            return run_frames(argc - 1, argv + 1);
+        }
+        if (argc > 1 && std::strcmp(argv[1], "pool") == 0) {
+            return run_pool(argc - 1, argv + 1);
+        }
+        if (argc > 1 && std::strcmp(argv[1], "fanin") == 0) {
+            return run_fanin(argc - 1, argv + 1);
+        }
+        return run_sweep(argc, argv);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "simplechar-bench: %s\n", e.what());
+        return 1;
+    }
+}
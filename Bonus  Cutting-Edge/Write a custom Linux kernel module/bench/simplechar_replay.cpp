@@ -0,0 +1,448 @@
+/*
+ * simplechar_replay.cpp - Capture and replay SimpleChar workloads
+ *
+ * Subcommands:
+ *   capture   drain the driver's operation trace ring into a trace file
+ *   replay    issue a trace against a device and report latencies
+ *
+ * Usage: simplechar-replay capture [options]
+ *        simplechar-replay replay [options] TRACE
+ *
+ * License: MIT
+ */
+
+#include "bench_common.h"
+#include "replay.h"
+#include "results.h"
+#include "trace_file.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace simplechar::bench {
+
+namespace {
+
+constexpr const char *trace_param = "/sys/module/simplechar/parameters/trace";
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void request_stop(int)
+{
+    stop_requested = 1;
+}
+
+/* ---- capture ---- */
+
+struct capture_config {
+    std::string device = "/dev/simplechar";
+    std::string output = "-";
+    uint64_t duration_ns = 0;           /* 0 = until interrupted */
+    uint64_t interval_ns = 100000000ULL;
+    bool all = false;                   /* Start with what the ring holds */
+    bool enable = false;                /* Switch recording on and back off */
+};
+
+void capture_usage(FILE *out)
+{
+    std::fprintf(out,
+        "Usage: simplechar-replay capture [options]\n"
+        "\n"
+        "Drain the driver's operation trace ring into a trace file. Load the\n"
+        "module with trace_events=N (e.g. 65536) and set its trace parameter,\n"
+        "or pass --enable.\n"
+        "\n"
+        "  -d, --device PATH        Device to drain (default: /dev/simplechar)\n"
+        "  -o, --output FILE        Trace file, '-' for stdout (default: -)\n"
+        "  -D, --duration TIME      Stop after TIME (default: until Ctrl-C)\n"
+        "  -i, --interval TIME      Drain period (default: 100ms)\n"
+        "  -a, --all                Include events already in the ring\n"
+        "  -e, --enable             Turn recording on for the capture\n"
+        "  -h, --help               Show this help\n");
+}
+
+capture_config parse_capture_args(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"device", required_argument, nullptr, 'd'},
+        {"output", required_argument, nullptr, 'o'},
+        {"duration", required_argument, nullptr, 'D'},
+        {"interval", required_argument, nullptr, 'i'},
+        {"all", no_argument, nullptr, 'a'},
+        {"enable", no_argument, nullptr, 'e'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    capture_config cfg;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "d:o:D:i:aeh", options, nullptr)) != -1) {
+        switch (opt) {
+        case 'd':
+            cfg.device = optarg;
+            break;
+        case 'o':
+            cfg.output = optarg;
+            break;
+        case 'D':
+            cfg.duration_ns = parse_duration(optarg);
+            break;
+        case 'i':
+            cfg.interval_ns = parse_duration(optarg);
+            break;
+        case 'a':
+            cfg.all = true;
+            break;
+        case 'e':
+            cfg.enable = true;
+            break;
+        case 'h':
+            capture_usage(stdout);
+            std::exit(0);
+        default:
+            capture_usage(stderr);
+            std::exit(2);
+        }
+    }
+    if (optind != argc) {
+        capture_usage(stderr);
+        std::exit(2);
+    }
+    if (!cfg.interval_ns) {
+        throw bench_error("the drain interval must be positive");
+    }
+    return cfg;
+}
+
+/* Set the trace module parameter, returning its previous value */
+std::string set_recording(const std::string &value)
+{
+    std::string old;
+    std::ifstream in(trace_param);
+
+    if (!in || !std::getline(in, old)) {
+        throw bench_error(std::string("cannot read ") + trace_param +
+                          ", is the module loaded?");
+    }
+    std::ofstream out(trace_param);
+    if (!(out << value << std::endl)) {
+        throw_errno(std::string("cannot write ") + trace_param);
+    }
+    return old;
+}
+
+/* Drain every event from seq on; returns the new seq */
+uint64_t drain(int fd, uint64_t seq, trace_writer &writer, uint64_t &dropped,
+               uint64_t &own)
+{
+    std::vector<simplechar_trace_event> batch(SIMPLECHAR_TRACE_BATCH);
+    uint32_t self = uint32_t(getpid());
+    simplechar_trace_read req{};
+
+    do {
+        req.seq = seq;
+        req.events = reinterpret_cast<uintptr_t>(batch.data());
+        req.max_events = uint32_t(batch.size());
+        if (ioctl(fd, SIMPLECHAR_IOC_READ_TRACE, &req) < 0) {
+            if (errno == ENODEV) {
+                throw bench_error("the module has no trace ring, load it "
+                                  "with trace_events=N");
+            }
+            throw_errno("SIMPLECHAR_IOC_READ_TRACE");
+        }
+        dropped += req.dropped;
+        for (uint32_t i = 0; i < req.nr_events; i++) {
+            /* Leave out our own open and close of the device */
+            if (batch[i].pid == self) {
+                own++;
+                continue;
+            }
+            writer.write(batch[i]);
+        }
+        seq = req.seq;
+    } while (req.nr_events == req.max_events);
+    return seq;
+}
+
+int run_capture(int argc, char **argv)
+{
+    capture_config cfg = parse_capture_args(argc, argv);
+    std::ofstream file;
+    std::ostream *out = &std::cout;
+    std::string restore;
+    uint64_t seq = 0, dropped = 0, own = 0;
+
+    if (cfg.output != "-") {
+        file.open(cfg.output);
+        if (!file) {
+            throw_errno("cannot create " + cfg.output);
+        }
+        out = &file;
+    }
+
+    int fd = ::open(cfg.device.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw_errno("cannot open " + cfg.device);
+    }
+
+    /* A zero-sized read reports the head without copying anything */
+    simplechar_trace_read probe{};
+    if (ioctl(fd, SIMPLECHAR_IOC_READ_TRACE, &probe) < 0) {
+        ::close(fd);
+        if (errno == ENODEV) {
+            throw bench_error("the module has no trace ring, load it with "
+                              "trace_events=N");
+        }
+        throw_errno("SIMPLECHAR_IOC_READ_TRACE");
+    }
+    seq = cfg.all ? 0 : probe.head;
+    if (cfg.enable) {
+        restore = set_recording("1");
+    }
+
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+    std::fprintf(stderr, "capturing from %s%s\n", cfg.device.c_str(),
+                 cfg.duration_ns ? "" : ", Ctrl-C to stop");
+
+    trace_writer writer(*out);
+    uint64_t deadline = cfg.duration_ns ? now_ns() + cfg.duration_ns : 0;
+    try {
+        while (!stop_requested && (!deadline || now_ns() < deadline)) {
+            uint64_t next = now_ns() + cfg.interval_ns;
+
+            seq = drain(fd, seq, writer, dropped, own);
+            wait_until(deadline ? std::min(next, deadline) : next);
+        }
+        seq = drain(fd, seq, writer, dropped, own);
+    } catch (...) {
+        if (!restore.empty()) {
+            set_recording(restore);
+        }
+        ::close(fd);
+        throw;
+    }
+
+    if (!restore.empty()) {
+        set_recording(restore);
+    }
+    ::close(fd);
+    out->flush();
+
+    std::fprintf(stderr, "captured %llu events",
+                 static_cast<unsigned long long>(writer.count()));
+    if (dropped) {
+        std::fprintf(stderr, ", lost %llu (raise trace_events or lower "
+                     "--interval)", static_cast<unsigned long long>(dropped));
+    }
+    std::fprintf(stderr, "\n");
+    return dropped ? 1 : 0;
+}
+
+/* ---- replay ---- */
+
+struct replay_config {
+    replay_params params;
+    std::string trace_path;
+    std::string json_path;
+};
+
+void replay_usage(FILE *out)
+{
+    std::fprintf(out,
+        "Usage: simplechar-replay replay [options] TRACE\n"
+        "\n"
+        "Replay a captured trace: one descriptor per recorded open, operations\n"
+        "at their recorded offsets and times.\n"
+        "\n"
+        "  -d, --device PATH        Device to replay against (default: /dev/simplechar)\n"
+        "  -x, --speed FACTOR       Scale the recorded timing, 2 = twice as fast\n"
+        "                           (default: 1)\n"
+        "  -f, --fast               Ignore the timing, replay as fast as possible\n"
+        "  -t, --lanes N            Worker threads (default: peak concurrent opens)\n"
+        "  -j, --json FILE          Also write results as JSON ('-' for stdout)\n"
+        "  -h, --help               Show this help\n");
+}
+
+replay_config parse_replay_args(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"device", required_argument, nullptr, 'd'},
+        {"speed", required_argument, nullptr, 'x'},
+        {"fast", no_argument, nullptr, 'f'},
+        {"lanes", required_argument, nullptr, 't'},
+        {"json", required_argument, nullptr, 'j'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    replay_config cfg;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "d:x:ft:j:h", options, nullptr)) != -1) {
+        switch (opt) {
+        case 'd':
+            cfg.params.device = optarg;
+            break;
+        case 'x':
+            cfg.params.speed = std::stod(optarg);
+            break;
+        case 'f':
+            cfg.params.fast = true;
+            break;
+        case 't':
+            cfg.params.lanes = std::stoi(optarg);
+            break;
+        case 'j':
+            cfg.json_path = optarg;
+            break;
+        case 'h':
+            replay_usage(stdout);
+            std::exit(0);
+        default:
+            replay_usage(stderr);
+            std::exit(2);
+        }
+    }
+    if (optind != argc - 1) {
+        replay_usage(stderr);
+        std::exit(2);
+    }
+    cfg.trace_path = argv[optind];
+    return cfg;
+}
+
+void print_replay(const replay_config &cfg, const replay_result &r)
+{
+    std::printf("%s: %s of trace in %s, %llu opens on %d lanes (%s)\n\n",
+                cfg.trace_path.c_str(), format_ns(double(r.trace_ns)).c_str(),
+                format_ns(double(r.elapsed_ns)).c_str(),
+                static_cast<unsigned long long>(r.opens), r.lanes,
+                cfg.params.fast ? "as fast as possible" : "recorded timing");
+    std::printf("%-6s %9s %7s %8s %9s %9s %9s %9s %9s %9s %9s\n", "op", "ops",
+                "errors", "diverged", "p50", "p99", "p99.9", "max",
+                "svc-p99", "orig-p50", "orig-p99");
+
+    for (int i = 0; i < nr_trace_ops; i++) {
+        const replay_op_stats &s = r.ops[i];
+
+        if (!s.ops) {
+            continue;
+        }
+        std::printf("%-6s %9llu %7llu %8llu %9s %9s %9s %9s %9s %9s %9s\n",
+                    trace_op_name(trace_op(i + 1)),
+                    static_cast<unsigned long long>(s.ops),
+                    static_cast<unsigned long long>(s.errors),
+                    static_cast<unsigned long long>(s.diverged),
+                    format_ns(double(s.latency.percentile(50))).c_str(),
+                    format_ns(double(s.latency.percentile(99))).c_str(),
+                    format_ns(double(s.latency.percentile(99.9))).c_str(),
+                    format_ns(double(s.latency.max())).c_str(),
+                    format_ns(double(s.service.percentile(99))).c_str(),
+                    format_ns(double(s.recorded.percentile(50))).c_str(),
+                    format_ns(double(s.recorded.percentile(99))).c_str());
+    }
+    std::printf("\nLatency runs from when each operation was due; svc is the "
+                "call alone,\norig the driver time recorded in the trace.\n");
+}
+
+void write_replay_json(std::ostream &out, const replay_config &cfg,
+                       const replay_result &r)
+{
+    json_writer json(out);
+
+    json.begin_object();
+    json.field("tool", "simplechar-replay");
+    json.field("mode", "replay");
+    write_run_info(json);
+    json.field("trace", cfg.trace_path);
+    json.field("fast", cfg.params.fast);
+    json.field("speed", cfg.params.speed);
+    json.field("lanes", r.lanes);
+    json.field("opens", r.opens);
+    json.field("trace_ns", r.trace_ns);
+    json.field("elapsed_ns", r.elapsed_ns);
+    json.key("results").begin_array();
+    for (int i = 0; i < nr_trace_ops; i++) {
+        const replay_op_stats &s = r.ops[i];
+
+        if (!s.ops) {
+            continue;
+        }
+        json.begin_object();
+        json.field("op", trace_op_name(trace_op(i + 1)));
+        json.field("ops", s.ops);
+        json.field("errors", s.errors);
+        json.field("diverged", s.diverged);
+        write_histogram_json(json, "latency_ns", s.latency);
+        write_histogram_json(json, "service_ns", s.service);
+        write_histogram_json(json, "recorded_ns", s.recorded);
+        json.end_object();
+    }
+    json.end_array();
+    json.end_object();
+    out << "\n";
+}
+
+int run_replay_command(int argc, char **argv)
+{
+    replay_config cfg = parse_replay_args(argc, argv);
+    std::vector<trace_record> trace = load_trace(cfg.trace_path);
+    replay_result r = run_replay(trace, cfg.params);
+
+    if (cfg.json_path != "-") {
+        print_replay(cfg, r);
+    }
+    if (cfg.json_path == "-") {
+        write_replay_json(std::cout, cfg, r);
+    } else if (!cfg.json_path.empty()) {
+        std::ofstream out(cfg.json_path);
+        if (!out) {
+            throw_errno("cannot create " + cfg.json_path);
+        }
+        write_replay_json(out, cfg, r);
+    }
+    return 0;
+}
+
+void usage(FILE *out)
+{
+    std::fprintf(out,
+        "Usage: simplechar-replay capture [options]\n"
+        "       simplechar-replay replay [options] TRACE\n"
+        "\n"
+        "Run 'simplechar-replay COMMAND --help' for the options.\n");
+}
+
+} /* namespace */
+
+} /* namespace simplechar::bench */
+
+int main(int argc, char **argv)
+{
+    using namespace simplechar::bench;
+
+    set_command_line(argc, argv);
+    try {
+        if (argc > 1 && std::strcmp(argv[1], "capture") == 0) {
+            return run_capture(argc - 1, argv + 1);
+        }
+        if (argc > 1 && std::strcmp(argv[1], "replay") == 0) {
+            return run_replay_command(argc - 1, argv + 1);
+        }
+        usage(argc > 1 && std::strcmp(argv[1], "--help") == 0 ? stdout : stderr);
+        return argc > 1 && std::strcmp(argv[1], "--help") == 0 ? 0 : 2;
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "simplechar-replay: %s\n", e.what());
+        return 1;
+    }
+}
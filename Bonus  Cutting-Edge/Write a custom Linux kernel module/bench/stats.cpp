@@ -0,0 +1,182 @@
+/*
+ * stats.cpp - Significance tests for comparing benchmark runs
+ *
+ * License: MIT
+ */
+
+#include "stats.h"
+#include "bench_common.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+
+namespace simplechar::bench {
+
+namespace {
+
+/* Samples up to this size per side use the exact U distribution */
+constexpr size_t exact_limit = 12;
+
+/*
+ * Number of arrangements of m + n distinct values whose U statistic is
+ * exactly u, by the recurrence on whether the largest value is from a
+ */
+double u_count(int u, int m, int n, std::map<std::tuple<int, int, int>, double> &memo)
+{
+    if (u < 0) {
+        return 0;
+    }
+    if (m == 0 || n == 0) {
+        return u == 0 ? 1 : 0;
+    }
+
+    auto key = std::make_tuple(u, m, n);
+    auto it = memo.find(key);
+    if (it != memo.end()) {
+        return it->second;
+    }
+
+    double count = u_count(u - n, m - 1, n, memo) + u_count(u, m, n - 1, memo);
+    memo[key] = count;
+    return count;
+}
+
+double exact_p(double u, int m, int n)
+{
+    std::map<std::tuple<int, int, int>, double> memo;
+    double total = 0, tail = 0;
+    int lower = int(std::floor(std::min(u, double(m) * n - u)));
+
+    for (int k = 0; k <= m * n; k++) {
+        double c = u_count(k, m, n, memo);
+
+        total += c;
+        if (k <= lower) {
+            tail += c;
+        }
+    }
+    return std::min(1.0, 2.0 * tail / total);
+}
+
+double sample_median(const std::vector<double> &v, std::vector<double> &scratch)
+{
+    scratch = v;
+    return median(std::move(scratch));
+}
+
+} /* namespace */
+
+double median(std::vector<double> v)
+{
+    if (v.empty()) {
+        return 0;
+    }
+
+    size_t mid = v.size() / 2;
+    std::nth_element(v.begin(), v.begin() + mid, v.end());
+    double hi = v[mid];
+    if (v.size() % 2) {
+        return hi;
+    }
+    return (*std::max_element(v.begin(), v.begin() + mid) + hi) / 2;
+}
+
+double mann_whitney_p(const std::vector<double> &a, const std::vector<double> &b)
+{
+    const size_t m = a.size(), n = b.size();
+
+    if (!m || !n) {
+        return 1.0;
+    }
+
+    /* Rank the pooled samples, averaging ranks over ties */
+    std::vector<std::pair<double, int>> pooled;
+    for (double x : a) {
+        pooled.emplace_back(x, 0);
+    }
+    for (double x : b) {
+        pooled.emplace_back(x, 1);
+    }
+    std::sort(pooled.begin(), pooled.end());
+
+    const double total = double(m + n);
+    double rank_sum_a = 0, tie_term = 0;
+    bool ties = false;
+
+    for (size_t i = 0; i < pooled.size();) {
+        size_t j = i;
+        while (j < pooled.size() && pooled[j].first == pooled[i].first) {
+            j++;
+        }
+
+        double rank = (double(i + 1) + double(j)) / 2;
+        double t = double(j - i);
+        for (size_t k = i; k < j; k++) {
+            if (pooled[k].second == 0) {
+                rank_sum_a += rank;
+            }
+        }
+        if (t > 1) {
+            ties = true;
+            tie_term += t * t * t - t;
+        }
+        i = j;
+    }
+
+    double u = rank_sum_a - double(m) * double(m + 1) / 2;
+
+    if (!ties && m <= exact_limit && n <= exact_limit) {
+        return exact_p(u, int(m), int(n));
+    }
+
+    double mean = double(m) * double(n) / 2;
+    double var = double(m) * double(n) / 12 *
+                 ((total + 1) - tie_term / (total * (total - 1)));
+    if (var <= 0) {
+        return 1.0;
+    }
+
+    /* Continuity-corrected z, two-sided */
+    double z = std::max(0.0, std::fabs(u - mean) - 0.5) / std::sqrt(var);
+    return std::erfc(z / std::sqrt(2.0));
+}
+
+interval bootstrap_change_ci(const std::vector<double> &a,
+                             const std::vector<double> &b,
+                             double confidence, int resamples)
+{
+    std::vector<double> changes, ra(a.size()), rb(b.size()), scratch;
+    xorshift64 rng(0xb0075);
+
+    if (a.empty() || b.empty()) {
+        return {0, 0};
+    }
+
+    changes.reserve(size_t(resamples));
+    for (int r = 0; r < resamples; r++) {
+        for (auto &x : ra) {
+            x = a[rng.next() % a.size()];
+        }
+        for (auto &x : rb) {
+            x = b[rng.next() % b.size()];
+        }
+
+        double base = sample_median(ra, scratch);
+        if (base != 0) {
+            changes.push_back(sample_median(rb, scratch) / base - 1);
+        }
+    }
+    if (changes.empty()) {
+        return {0, 0};
+    }
+
+    std::sort(changes.begin(), changes.end());
+    double tail = (1 - confidence) / 2;
+    size_t lo = size_t(tail * double(changes.size() - 1));
+    size_t hi = size_t((1 - tail) * double(changes.size() - 1));
+    return {changes[lo], changes[hi]};
+}
+
+} /* namespace simplechar::bench */
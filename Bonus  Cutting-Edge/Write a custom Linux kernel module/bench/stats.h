@@ -0,0 +1,43 @@
+/*
+ * stats.h - Significance tests for comparing benchmark runs
+ *
+ * Benchmark samples are rarely normal (long right tails, bimodal runs
+ * after a migration), so the comparison uses rank-based and resampling
+ * methods that make no distribution assumption.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_STATS_H
+#define SIMPLECHAR_STATS_H
+
+#include <vector>
+
+namespace simplechar::bench {
+
+double median(std::vector<double> v);
+
+/*
+ * Two-sided p-value of the Mann-Whitney U test that a and b come from the
+ * same distribution: exact for small samples without ties, normal
+ * approximation with tie correction otherwise. Returns 1 when either
+ * sample is empty.
+ */
+double mann_whitney_p(const std::vector<double> &a, const std::vector<double> &b);
+
+struct interval {
+    double low;
+    double high;
+};
+
+/*
+ * Percentile bootstrap interval of the relative change of the median,
+ * median(b) / median(a) - 1, at the given confidence
+ */
+interval bootstrap_change_ci(const std::vector<double> &a,
+                             const std::vector<double> &b,
+                             double confidence = 0.95, int resamples = 4000);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_STATS_H */
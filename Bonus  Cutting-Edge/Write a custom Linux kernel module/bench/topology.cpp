@@ -0,0 +1,161 @@
+/*
+ * topology.cpp - CPU and NUMA layout for thread placement
+ *
+ * License: MIT
+ */
+
+#include "topology.h"
+#include "bench_common.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+
+#include <dirent.h>
+#include <sched.h>
+
+namespace simplechar::bench {
+
+namespace {
+
+const std::string sysfs_cpu = "/sys/devices/system/cpu/";
+const std::string sysfs_node = "/sys/devices/system/node/";
+
+/* First line of a sysfs file, empty if it cannot be read */
+std::string read_line(const std::string &path)
+{
+    std::ifstream in(path);
+    std::string line;
+
+    std::getline(in, line);
+    return line;
+}
+
+} /* namespace */
+
+std::vector<int> parse_cpu_list(const std::string &text)
+{
+    std::vector<int> cpus;
+
+    for (const auto &part : split(text, ',')) {
+        auto range = split(part, '-');
+        int first, last;
+
+        try {
+            first = std::stoi(range.at(0));
+            last = range.size() > 1 ? std::stoi(range[1]) : first;
+        } catch (const std::exception &) {
+            throw bench_error("invalid CPU list: " + text);
+        }
+        if (range.size() > 2 || first < 0 || last < first) {
+            throw bench_error("invalid CPU list: " + text);
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+std::vector<cpu_info> cpu_topology()
+{
+    std::map<int, int> node_by_cpu;
+    std::vector<cpu_info> cpus;
+    cpu_set_t allowed;
+
+    /* node_by_cpu stays empty on kernels without NUMA support */
+    if (DIR *dir = opendir(sysfs_node.c_str())) {
+        while (struct dirent *ent = readdir(dir)) {
+            int node;
+
+            if (std::sscanf(ent->d_name, "node%d", &node) != 1) {
+                continue;
+            }
+            for (int cpu : parse_cpu_list(read_line(sysfs_node + ent->d_name +
+                                                    "/cpulist"))) {
+                node_by_cpu[cpu] = node;
+            }
+        }
+        closedir(dir);
+    }
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        throw_errno("sched_getaffinity");
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+
+        std::string topo = sysfs_cpu + "cpu" + std::to_string(cpu) + "/topology/";
+        std::string siblings = read_line(topo + "thread_siblings_list");
+        std::string core = read_line(topo + "core_id");
+        cpu_info info;
+
+        info.cpu = cpu;
+        info.node = node_by_cpu.count(cpu) ? node_by_cpu[cpu] : 0;
+        info.core = core.empty() ? cpu : std::atoi(core.c_str());
+        info.primary = siblings.empty() || parse_cpu_list(siblings).front() == cpu;
+        cpus.push_back(info);
+    }
+    return cpus;
+}
+
+std::vector<int> placement_order(const std::vector<cpu_info> &cpus,
+                                 placement_policy policy)
+{
+    std::vector<cpu_info> sorted(cpus);
+    std::map<int, int> rank_in_node;
+    std::vector<int> order;
+
+    /* Within a node: primary threads first, then siblings, by CPU number */
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const cpu_info &a, const cpu_info &b) {
+        if (a.node != b.node) {
+            return a.node < b.node;
+        }
+        if (a.primary != b.primary) {
+            return a.primary;
+        }
+        return a.cpu < b.cpu;
+    });
+
+    if (policy == placement_policy::spread) {
+        /* Interleave: the k-th CPU of every node before any (k+1)-th */
+        std::vector<std::pair<int, cpu_info>> ranked;
+
+        for (const auto &c : sorted) {
+            ranked.emplace_back(rank_in_node[c.node]++, c);
+        }
+        std::stable_sort(ranked.begin(), ranked.end(),
+                         [](const auto &a, const auto &b) {
+            if (a.second.primary != b.second.primary) {
+                return a.second.primary;
+            }
+            return a.first < b.first;
+        });
+        for (const auto &r : ranked) {
+            order.push_back(r.second.cpu);
+        }
+        return order;
+    }
+
+    for (const auto &c : sorted) {
+        order.push_back(c.cpu);
+    }
+    return order;
+}
+
+int node_of(const std::vector<cpu_info> &cpus, int cpu)
+{
+    for (const auto &c : cpus) {
+        if (c.cpu == cpu) {
+            return c.node;
+        }
+    }
+    return 0;
+}
+
+} /* namespace simplechar::bench */
@@ -0,0 +1,47 @@
+/*
+ * topology.h - CPU and NUMA layout for thread placement
+ *
+ * Reads the allowed CPUs with their NUMA node and core from sysfs so the
+ * benchmarks can pin threads in a reproducible order: filling one node's
+ * cores before moving on (compact) or alternating nodes (spread). Machines
+ * without NUMA information are treated as a single node.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_TOPOLOGY_H
+#define SIMPLECHAR_TOPOLOGY_H
+
+#include <string>
+#include <vector>
+
+namespace simplechar::bench {
+
+struct cpu_info {
+    int cpu;
+    int node;           /* NUMA node, 0 without NUMA information */
+    int core;           /* Core id within the package */
+    bool primary;       /* First hardware thread of its core */
+};
+
+enum class placement_policy {
+    compact,    /* Fill a node's cores, then their SMT siblings, then the next node */
+    spread,     /* Alternate nodes, cores before SMT siblings */
+};
+
+/* "0-3,8,10-11" to CPU numbers */
+std::vector<int> parse_cpu_list(const std::string &text);
+
+/* CPUs the process may run on, ordered by CPU number */
+std::vector<cpu_info> cpu_topology();
+
+/* CPU numbers in the order threads should be pinned under policy */
+std::vector<int> placement_order(const std::vector<cpu_info> &cpus,
+                                 placement_policy policy);
+
+/* NUMA node of a CPU in the topology, 0 if unknown */
+int node_of(const std::vector<cpu_info> &cpus, int cpu);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_TOPOLOGY_H */
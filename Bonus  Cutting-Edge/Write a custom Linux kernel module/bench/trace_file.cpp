@@ -0,0 +1,102 @@
+/*
+ * trace_file.cpp - Operation traces captured from the SimpleChar driver
+ *
+ * License: MIT
+ */
+
+#include "trace_file.h"
+#include "bench_common.h"
+
+#include <fstream>
+#include <sstream>
+
+namespace simplechar::bench {
+
+namespace {
+
+constexpr const char *trace_magic = "# simplechar-trace 1";
+
+bool parse_op(const std::string &name, trace_op &op)
+{
+    for (int i = 1; i <= nr_trace_ops; i++) {
+        if (name == trace_op_name(trace_op(i))) {
+            op = trace_op(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+} /* namespace */
+
+const char *trace_op_name(trace_op op)
+{
+    switch (op) {
+    case trace_op::open:
+        return "open";
+    case trace_op::close:
+        return "close";
+    case trace_op::read:
+        return "read";
+    case trace_op::write:
+        return "write";
+    }
+    return "?";
+}
+
+trace_writer::trace_writer(std::ostream &out) : out_(out)
+{
+    out_ << trace_magic << "\n"
+         << "# time_ns op open_id pid offset size result duration_ns gap_ns flags\n";
+}
+
+void trace_writer::write(const simplechar_trace_event &ev)
+{
+    if (!count_++) {
+        base_ns_ = ev.time_ns;
+    }
+    /* Completion order can put an earlier start after a later one */
+    uint64_t time = ev.time_ns > base_ns_ ? ev.time_ns - base_ns_ : 0;
+
+    out_ << time << ' ' << trace_op_name(trace_op(ev.op)) << ' '
+         << ev.open_id << ' ' << ev.pid << ' ' << ev.offset << ' '
+         << ev.size << ' ' << ev.result << ' ' << ev.duration_ns << ' '
+         << ev.gap_ns << ' ' << ev.flags << '\n';
+}
+
+std::vector<trace_record> load_trace(const std::string &path)
+{
+    std::ifstream in(path);
+    std::vector<trace_record> records;
+    std::string line;
+    int lineno = 0;
+
+    if (!in) {
+        throw_errno("cannot open " + path);
+    }
+    if (!std::getline(in, line) || line != trace_magic) {
+        throw bench_error(path + ": not a simplechar trace");
+    }
+    lineno++;
+
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        trace_record r;
+        std::string op;
+
+        lineno++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        fields >> r.time_ns >> op >> r.open_id >> r.pid >> r.offset >> r.size
+               >> r.result >> r.duration_ns >> r.gap_ns >> r.flags;
+        if (!fields || !parse_op(op, r.op)) {
+            throw bench_error(path + ":" + std::to_string(lineno) +
+                              ": malformed trace line");
+        }
+        records.push_back(r);
+    }
+    return records;
+}
+
+} /* namespace simplechar::bench */
@@ -0,0 +1,78 @@
+/*
+ * trace_file.h - Operation traces captured from the SimpleChar driver
+ *
+ * A trace is a text file with one operation per line, oldest first:
+ *
+ *   # simplechar-trace 1
+ *   # time_ns op open_id pid offset size result duration_ns gap_ns flags
+ *   0 open 1 4242 0 0 0 2100 0 0
+ *   18250 write 1 4242 0 512 512 3400 18250 0
+ *
+ * time_ns is relative to the first event, gap_ns is the inter-arrival
+ * time to the previous event of any open, and duration_ns is the time the
+ * call spent in the driver when it was recorded. Being text, a trace can
+ * be trimmed or edited by hand before it is replayed.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_TRACE_FILE_H
+#define SIMPLECHAR_TRACE_FILE_H
+
+#include "simplechar_ioctl.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace simplechar::bench {
+
+enum class trace_op : uint16_t {
+    open = SIMPLECHAR_TRACE_OPEN,
+    close = SIMPLECHAR_TRACE_CLOSE,
+    read = SIMPLECHAR_TRACE_READ,
+    write = SIMPLECHAR_TRACE_WRITE,
+};
+
+constexpr int nr_trace_ops = 4;
+
+/* 0..nr_trace_ops-1, for per-op tables */
+inline int trace_op_index(trace_op op) { return int(op) - 1; }
+
+const char *trace_op_name(trace_op op);
+
+struct trace_record {
+    uint64_t time_ns = 0;       /* Since the first event of the trace */
+    trace_op op = trace_op::read;
+    uint32_t open_id = 0;
+    uint32_t pid = 0;
+    uint64_t offset = 0;
+    uint32_t size = 0;
+    int32_t result = 0;         /* Bytes or negative errno, as recorded */
+    uint32_t duration_ns = 0;
+    uint32_t gap_ns = 0;
+    uint16_t flags = 0;         /* SIMPLECHAR_TRACE_* flags */
+};
+
+/* Writes the header on construction, then one line per record */
+class trace_writer {
+public:
+    explicit trace_writer(std::ostream &out);
+
+    /* Events must come in ring order; times are rebased on the first */
+    void write(const simplechar_trace_event &ev);
+    uint64_t count() const { return count_; }
+
+private:
+    std::ostream &out_;
+    uint64_t base_ns_ = 0;
+    uint64_t count_ = 0;
+};
+
+/* Parse a trace file, throws bench_error on malformed lines */
+std::vector<trace_record> load_trace(const std::string &path);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_TRACE_FILE_H */
@@ -0,0 +1,830 @@
+/*
+ * workload.cpp - Declarative workload files for simplechar-bench
+ *
+ * License: MIT
+ */
+
+#include "workload.h"
+#include "bench_common.h"
+#include "json_reader.h"
+#include "results.h"
+#include "simplechar_ioctl.h"
+#include "topology.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace simplechar::bench {
+
+double group_result::ops_per_sec() const
+{
+    return elapsed_ns ? double(ops) * 1e9 / double(elapsed_ns) : 0.0;
+}
+
+double group_result::mb_per_sec() const
+{
+    return elapsed_ns ? double(bytes) * 1e3 / double(elapsed_ns) : 0.0;
+}
+
+namespace {
+
+/* ---- parsing ---- */
+
+void check_keys(const json_value &obj, const std::string &where,
+                std::initializer_list<const char *> allowed)
+{
+    if (!obj.is_object()) {
+        throw bench_error(where + ": expected an object");
+    }
+    for (const auto &member : obj.object) {
+        if (std::none_of(allowed.begin(), allowed.end(),
+                         [&](const char *k) { return member.first == k; })) {
+            throw bench_error(where + ": unknown key '" + member.first + "'");
+        }
+    }
+}
+
+/*
+ * Numbers and strings both go through the command line parser, so 256,
+ * "256" and "0.25K" mean the same and a bare duration is in seconds
+ */
+template <typename T, typename Parse>
+T get_value(const json_value &obj, const std::string &key, T fallback,
+            const std::string &where, Parse parse)
+{
+    const json_value *v = obj.find(key);
+    char text[32];
+
+    if (!v) {
+        return fallback;
+    }
+    try {
+        if (v->is_number()) {
+            std::snprintf(text, sizeof(text), "%.17g", v->number);
+            return T(parse(text));
+        }
+        if (v->is_string()) {
+            return T(parse(v->string));
+        }
+    } catch (const std::exception &e) {
+        throw bench_error(where + ": " + key + ": " + e.what());
+    }
+    throw bench_error(where + ": " + key + " must be a number or a string");
+}
+
+std::string get_text(const json_value &obj, const std::string &key,
+                     const std::string &fallback, const std::string &where)
+{
+    const json_value *v = obj.find(key);
+
+    if (!v) {
+        return fallback;
+    }
+    if (!v->is_string()) {
+        throw bench_error(where + ": " + key + " must be a string");
+    }
+    return v->string;
+}
+
+bool get_flag(const json_value &obj, const std::string &key, bool fallback,
+              const std::string &where)
+{
+    const json_value *v = obj.find(key);
+
+    if (!v) {
+        return fallback;
+    }
+    if (v->type != json_value::kind::boolean) {
+        throw bench_error(where + ": " + key + " must be true or false");
+    }
+    return v->boolean;
+}
+
+/* "0-3,8", [0, 1, 2] or a placement policy for the group's threads */
+std::vector<int> parse_cpus(const json_value &v, int threads,
+                            const std::string &where)
+{
+    std::vector<int> cpus;
+
+    if (v.is_array()) {
+        for (const auto &cpu : v.array) {
+            if (!cpu.is_number()) {
+                throw bench_error(where + ": cpus must hold CPU numbers");
+            }
+            cpus.push_back(int(cpu.number));
+        }
+    } else if (v.is_string() && (v.string == "compact" || v.string == "spread")) {
+        cpus = placement_order(cpu_topology(), v.string == "compact"
+                                                   ? placement_policy::compact
+                                                   : placement_policy::spread);
+        cpus.resize(std::min<size_t>(cpus.size(), size_t(threads)));
+    } else if (v.is_string()) {
+        cpus = parse_cpu_list(v.string);
+    } else {
+        throw bench_error(where + ": cpus must be a list, a string or a policy");
+    }
+
+    auto allowed = cpu_topology();
+    for (int cpu : cpus) {
+        if (std::none_of(allowed.begin(), allowed.end(),
+                         [&](const cpu_info &c) { return c.cpu == cpu; })) {
+            throw bench_error(where + ": CPU " + std::to_string(cpu) +
+                              " is not available");
+        }
+    }
+    return cpus;
+}
+
+workload_target parse_target(const json_value &v, size_t index)
+{
+    std::string where = "target " + std::to_string(index);
+    workload_target t;
+
+    check_keys(v, where, {"name", "device", "mode", "span"});
+    t.name = get_text(v, "name", "", where);
+    if (t.name.empty()) {
+        throw bench_error(where + ": needs a name");
+    }
+    where = "target '" + t.name + "'";
+    t.device = get_text(v, "device", t.device, where);
+    t.span = get_value<uint64_t>(v, "span", 0, where, parse_size);
+
+    std::string mode = get_text(v, "mode", "fixed", where);
+    if (mode == "fixed") {
+        t.mode = target_mode::fixed;
+    } else if (mode == "sequential") {
+        t.mode = target_mode::sequential;
+    } else if (mode == "random") {
+        t.mode = target_mode::random;
+    } else {
+        throw bench_error(where + ": unknown mode '" + mode +
+                          "' (fixed, sequential or random)");
+    }
+    return t;
+}
+
+workload_group parse_group(const json_value &v, const workload &w,
+                           const std::string &phase, size_t index)
+{
+    std::string where = "phase '" + phase + "' group " + std::to_string(index);
+    workload_group g;
+
+    check_keys(v, where, {"name", "target", "subscribe", "mix", "size",
+                          "threads", "rate", "ramp_to", "arrival", "cpus",
+                          "poll"});
+    g.name = get_text(v, "name", "group" + std::to_string(index), where);
+    where = "phase '" + phase + "' group '" + g.name + "'";
+
+    g.target = get_text(v, "target", w.targets.size() == 1 ? w.targets[0].name
+                                                            : "", where);
+    if (std::none_of(w.targets.begin(), w.targets.end(),
+                     [&](const workload_target &t) { return t.name == g.target; })) {
+        throw bench_error(where + ": unknown target '" + g.target + "'");
+    }
+
+    g.subscribe = get_flag(v, "subscribe", false, where);
+    g.read_pct = parse_mix(get_text(v, "mix", "0:100", where));
+    g.size = get_value<uint64_t>(v, "size", g.size, where, parse_size);
+    g.threads = get_value<int>(v, "threads", 1, where,
+                               [](const std::string &s) { return std::stoi(s); });
+    g.rate = get_value<double>(v, "rate", 0, where, parse_rate);
+    g.ramp_to = get_value<double>(v, "ramp_to", 0, where, parse_rate);
+    g.poll_ns = get_value<uint64_t>(v, "poll", g.poll_ns, where, parse_duration);
+
+    std::string arrival = get_text(v, "arrival", "poisson", where);
+    if (arrival == "poisson") {
+        g.arrival = arrival_process::poisson;
+    } else if (arrival == "constant") {
+        g.arrival = arrival_process::constant;
+    } else {
+        throw bench_error(where + ": unknown arrival '" + arrival +
+                          "' (poisson or constant)");
+    }
+    if (const json_value *cpus = v.find("cpus")) {
+        g.cpus = parse_cpus(*cpus, g.threads, where);
+    }
+
+    if (g.threads <= 0 || !g.size || g.poll_ns == 0) {
+        throw bench_error(where + ": threads, size and poll must be positive");
+    }
+    if (g.rate < 0 || g.ramp_to < 0) {
+        throw bench_error(where + ": rates must be positive");
+    }
+    if (g.ramp_to && !g.rate) {
+        throw bench_error(where + ": ramp_to needs a starting rate");
+    }
+    if (g.subscribe && (v.find("mix") || v.find("rate"))) {
+        throw bench_error(where + ": subscribers take no mix or rate");
+    }
+    return g;
+}
+
+/* ---- running ---- */
+
+struct start_line {
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    uint64_t start = 0;
+    uint64_t end = 0;
+};
+
+struct target_state {
+    const workload_target *spec = nullptr;
+    uint64_t span = 0;
+    bool delta = false;         /* Answers SIMPLECHAR_IOC_GET_DELTA */
+    std::atomic<uint64_t> cursor{0};
+};
+
+struct thread_ctx {
+    const workload_group *group = nullptr;
+    target_state *target = nullptr;
+    int index = 0;              /* Within the group */
+    int fd = -1;
+    group_result stats;
+};
+
+/*
+ * Bytes a target addresses (its span, else the device or file size) and
+ * whether it can serve subscribers
+ */
+void probe_target(target_state &t)
+{
+    simplechar_autosize_info info;
+    simplechar_delta delta{};
+    struct stat st;
+
+    int fd = ::open(t.spec->device.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw_errno("cannot open " + t.spec->device);
+    }
+    t.span = t.spec->span ? t.spec->span : 4096;
+    if (::ioctl(fd, SIMPLECHAR_IOC_GET_AUTOSIZE, &info) == 0) {
+        t.span = t.spec->span ? t.spec->span : info.size;
+    } else if (!t.spec->span && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+               st.st_size > 0) {
+        t.span = uint64_t(st.st_size);
+    }
+    delta.since_gen = UINT64_MAX;
+    t.delta = ::ioctl(fd, SIMPLECHAR_IOC_GET_DELTA, &delta) == 0;
+    ::close(fd);
+}
+
+uint64_t next_offset(thread_ctx &ctx, xorshift64 &rng)
+{
+    target_state &t = *ctx.target;
+    uint64_t size = ctx.group->size;
+
+    if (size >= t.span) {
+        return 0;
+    }
+    switch (t.spec->mode) {
+    case target_mode::fixed:
+        return 0;
+    case target_mode::sequential: {
+        uint64_t off = t.cursor.fetch_add(size, std::memory_order_relaxed) %
+                       t.span;
+        return off + size > t.span ? 0 : off;
+    }
+    case target_mode::random:
+        return rng.next() % (t.span / size) * size;
+    }
+    return 0;
+}
+
+void wait_for_start(thread_ctx &ctx, start_line &line)
+{
+    const workload_group &g = *ctx.group;
+
+    if (!g.cpus.empty()) {
+        pin_to_cpu(g.cpus[size_t(ctx.index) % g.cpus.size()]);
+    }
+    line.ready.fetch_add(1, std::memory_order_release);
+    while (!line.go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+}
+
+void io_worker(thread_ctx &ctx, start_line &line)
+{
+    const workload_group &g = *ctx.group;
+    std::unique_ptr<char, decltype(&std::free)> buf(
+        static_cast<char *>(std::aligned_alloc(4096, (g.size + 4095) / 4096 * 4096)),
+        &std::free);
+    xorshift64 rng(0x9e3779b9ULL * uint64_t(ctx.index + 1) ^ std::hash<std::string>()(g.name));
+    const uint64_t read_threshold = uint64_t(g.read_pct);
+
+    std::fill_n(buf.get(), g.size, char('a' + ctx.index % 26));
+    wait_for_start(ctx, line);
+
+    double length = double(line.end - line.start);
+
+    /* Paced groups stagger their threads across the first interval */
+    double intended = double(line.start);
+    if (g.rate) {
+        intended += 1e9 / g.rate * ctx.index;
+    }
+
+    for (;;) {
+        uint64_t due = 0;
+
+        if (g.rate) {
+            double progress = (intended - double(line.start)) / length;
+            double rate = g.ramp_to ? g.rate + (g.ramp_to - g.rate) * progress
+                                    : g.rate;
+            double interval = 1e9 * g.threads / rate;
+
+            intended += g.arrival == arrival_process::poisson
+                            ? -std::log(1.0 - rng.uniform()) * interval
+                            : interval;
+            due = uint64_t(intended);
+            if (due >= line.end) {
+                break;
+            }
+            wait_until(due);
+        }
+
+        uint64_t t0 = now_ns();
+        if (t0 >= line.end) {
+            break;
+        }
+        bool is_read = read_threshold >= 100 ||
+                       (read_threshold && rng.next() % 100 < read_threshold);
+        off_t off = off_t(next_offset(ctx, rng));
+        ssize_t n = is_read ? ::pread(ctx.fd, buf.get(), g.size, off)
+                            : ::pwrite(ctx.fd, buf.get(), g.size, off);
+        uint64_t t1 = now_ns();
+
+        if (n < 0) {
+            ctx.stats.errors++;
+            continue;
+        }
+        ctx.stats.ops++;
+        ctx.stats.bytes += uint64_t(n);
+        ctx.stats.latency.record(t1 - (due ? due : t0));
+    }
+}
+
+/* Follow the target's changes with SIMPLECHAR_IOC_GET_DELTA */
+void subscribe_worker(thread_ctx &ctx, start_line &line)
+{
+    const workload_group &g = *ctx.group;
+    std::vector<char> buf(ctx.target->span * 2 + 4096);
+    simplechar_delta req{};
+
+    /* Nothing is newer than the largest generation: just learn the current one */
+    req.since_gen = UINT64_MAX;
+    if (::ioctl(ctx.fd, SIMPLECHAR_IOC_GET_DELTA, &req) < 0) {
+        ctx.stats.errors++;
+    }
+    uint64_t since = req.generation;
+
+    wait_for_start(ctx, line);
+
+    while (now_ns() < line.end) {
+        req = {};
+        req.since_gen = since;
+        req.data = reinterpret_cast<uintptr_t>(buf.data());
+        req.data_len = uint32_t(buf.size());
+
+        uint64_t t0 = now_ns();
+        int ret = ::ioctl(ctx.fd, SIMPLECHAR_IOC_GET_DELTA, &req);
+        uint64_t t1 = now_ns();
+
+        if (ret < 0 && errno == ENOSPC) {
+            buf.resize(req.bytes_used);
+            continue;
+        }
+        if (ret < 0) {
+            ctx.stats.errors++;
+        } else if (req.nr_ranges) {
+            since = req.generation;
+            ctx.stats.ops++;
+            ctx.stats.bytes += req.bytes_used;
+            ctx.stats.latency.record(t1 - t0);
+            continue;
+        } else {
+            ctx.stats.empty_polls++;
+        }
+        wait_until(std::min(now_ns() + g.poll_ns, line.end));
+    }
+}
+
+void run_phase(const workload_phase &phase, std::vector<target_state> &targets,
+               std::vector<group_result> &results)
+{
+    std::vector<thread_ctx> ctxs;
+    std::vector<std::thread> threads;
+    start_line line;
+
+    for (const auto &g : phase.groups) {
+        target_state *t = nullptr;
+
+        for (auto &candidate : targets) {
+            if (candidate.spec->name == g.target) {
+                t = &candidate;
+            }
+        }
+        for (int i = 0; i < g.threads; i++) {
+            thread_ctx ctx;
+
+            ctx.group = &g;
+            ctx.target = t;
+            ctx.index = i;
+            ctx.fd = ::open(t->spec->device.c_str(),
+                            g.subscribe ? O_RDONLY : O_RDWR);
+            if (ctx.fd < 0) {
+                int err = errno;
+                for (auto &c : ctxs) {
+                    ::close(c.fd);
+                }
+                errno = err;
+                throw_errno("cannot open " + t->spec->device);
+            }
+            ctxs.push_back(std::move(ctx));
+        }
+    }
+
+    for (auto &ctx : ctxs) {
+        threads.emplace_back(ctx.group->subscribe ? subscribe_worker : io_worker,
+                             std::ref(ctx), std::ref(line));
+    }
+    while (line.ready.load(std::memory_order_acquire) < int(ctxs.size())) {
+        std::this_thread::yield();
+    }
+    line.start = now_ns() + 1000000;
+    line.end = line.start + phase.duration_ns;
+    line.go.store(true, std::memory_order_release);
+
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    for (const auto &g : phase.groups) {
+        group_result r;
+
+        r.phase = phase.name;
+        r.group = g.name;
+        r.spec = &g;
+        r.elapsed_ns = phase.duration_ns;
+        for (auto &ctx : ctxs) {
+            if (ctx.group != &g) {
+                continue;
+            }
+            r.ops += ctx.stats.ops;
+            r.bytes += ctx.stats.bytes;
+            r.errors += ctx.stats.errors;
+            r.empty_polls += ctx.stats.empty_polls;
+            r.latency.merge(ctx.stats.latency);
+        }
+        if (phase.record) {
+            results.push_back(std::move(r));
+        }
+    }
+    for (auto &ctx : ctxs) {
+        ::close(ctx.fd);
+    }
+}
+
+} /* namespace */
+
+workload load_workload(const std::string &path)
+{
+    json_value doc = load_json(path);
+    workload w;
+
+    check_keys(doc, path, {"name", "description", "targets", "phases"});
+    w.name = get_text(doc, "name", path, path);
+    w.description = get_text(doc, "description", "", path);
+
+    const json_value *targets = doc.find("targets");
+    if (targets && !targets->is_array()) {
+        throw bench_error(path + ": targets must be a list");
+    }
+    if (targets) {
+        for (size_t i = 0; i < targets->array.size(); i++) {
+            w.targets.push_back(parse_target(targets->array[i], i));
+        }
+    } else {
+        /* A single default target keeps small files small */
+        w.targets.emplace_back();
+        w.targets.back().name = "default";
+    }
+
+    const json_value *phases = doc.find("phases");
+    if (!phases || !phases->is_array() || phases->array.empty()) {
+        throw bench_error(path + ": needs a non-empty list of phases");
+    }
+    for (size_t i = 0; i < phases->array.size(); i++) {
+        const json_value &p = phases->array[i];
+        std::string where = "phase " + std::to_string(i);
+        workload_phase phase;
+
+        check_keys(p, where, {"name", "duration", "record", "groups"});
+        phase.name = get_text(p, "name", "phase" + std::to_string(i), where);
+        where = "phase '" + phase.name + "'";
+        phase.duration_ns = get_value<uint64_t>(p, "duration", 0, where,
+                                                parse_duration);
+        phase.record = get_flag(p, "record", true, where);
+        if (!phase.duration_ns) {
+            throw bench_error(where + ": needs a duration");
+        }
+
+        const json_value *groups = p.find("groups");
+        if (!groups || !groups->is_array() || groups->array.empty()) {
+            throw bench_error(where + ": needs a non-empty list of groups");
+        }
+        for (size_t j = 0; j < groups->array.size(); j++) {
+            phase.groups.push_back(parse_group(groups->array[j], w,
+                                               phase.name, j));
+        }
+        w.phases.push_back(std::move(phase));
+    }
+    return w;
+}
+
+void remap_target(workload &w, const std::string &name,
+                  const std::string &device)
+{
+    bool found = false;
+
+    for (auto &t : w.targets) {
+        if (name.empty() || t.name == name) {
+            t.device = device;
+            found = true;
+        }
+    }
+    if (!found) {
+        throw bench_error("the workload has no target '" + name + "'");
+    }
+}
+
+std::vector<group_result> execute_workload(const workload &w)
+{
+    std::vector<target_state> targets(w.targets.size());
+    std::vector<group_result> results;
+
+    for (size_t i = 0; i < w.targets.size(); i++) {
+        targets[i].spec = &w.targets[i];
+        probe_target(targets[i]);
+    }
+    for (const auto &phase : w.phases) {
+        for (const auto &g : phase.groups) {
+            for (const auto &t : targets) {
+                if (g.subscribe && t.spec->name == g.target && !t.delta) {
+                    throw bench_error("group '" + g.name + "' subscribes to " +
+                                      t.spec->device + ", which does not "
+                                      "support delta reads");
+                }
+            }
+        }
+    }
+    for (const auto &phase : w.phases) {
+        run_phase(phase, targets, results);
+    }
+    return results;
+}
+
+namespace {
+
+/* ---- command line ---- */
+
+struct workload_config {
+    std::vector<std::pair<std::string, std::string>> devices;  /* target, path */
+    std::string json_path;
+    std::string path;
+    bool check = false;
+};
+
+void usage(FILE *out)
+{
+    std::fprintf(out,
+        "Usage: simplechar-bench workload [options] FILE\n"
+        "\n"
+        "Run the phases of a declarative workload file (see bench/workloads).\n"
+        "\n"
+        "  -d, --device [TARGET=]PATH  Point a target, or all targets, at PATH\n"
+        "  -n, --check                 Parse and print the workload, run nothing\n"
+        "  -j, --json FILE             Also write results as JSON ('-' for stdout)\n"
+        "  -h, --help                  Show this help\n");
+}
+
+workload_config parse_args(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"device", required_argument, nullptr, 'd'},
+        {"check", no_argument, nullptr, 'n'},
+        {"json", required_argument, nullptr, 'j'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    workload_config cfg;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "d:nj:h", options, nullptr)) != -1) {
+        switch (opt) {
+        case 'd': {
+            std::string arg = optarg;
+            size_t eq = arg.find('=');
+
+            if (eq == std::string::npos) {
+                cfg.devices.emplace_back("", arg);
+            } else {
+                cfg.devices.emplace_back(arg.substr(0, eq), arg.substr(eq + 1));
+            }
+            break;
+        }
+        case 'n':
+            cfg.check = true;
+            break;
+        case 'j':
+            cfg.json_path = optarg;
+            break;
+        case 'h':
+            usage(stdout);
+            std::exit(0);
+        default:
+            usage(stderr);
+            std::exit(2);
+        }
+    }
+    if (optind != argc - 1) {
+        usage(stderr);
+        std::exit(2);
+    }
+    cfg.path = argv[optind];
+    return cfg;
+}
+
+const char *mode_name(target_mode mode)
+{
+    switch (mode) {
+    case target_mode::fixed:
+        return "fixed";
+    case target_mode::sequential:
+        return "sequential";
+    case target_mode::random:
+        return "random";
+    }
+    return "?";
+}
+
+/* "8x 256B 0:100 @50k->100k" */
+std::string describe_group(const workload_group &g)
+{
+    char text[128];
+    int n;
+
+    if (g.subscribe) {
+        std::snprintf(text, sizeof(text), "%dx subscribe", g.threads);
+        return text;
+    }
+    n = std::snprintf(text, sizeof(text), "%dx %s %d:%d", g.threads,
+                      format_size(g.size).c_str(), g.read_pct,
+                      100 - g.read_pct);
+    if (g.rate) {
+        n += std::snprintf(text + n, sizeof(text) - size_t(n), " @%.0f",
+                           g.rate);
+    }
+    if (g.ramp_to) {
+        std::snprintf(text + n, sizeof(text) - size_t(n), "->%.0f", g.ramp_to);
+    }
+    return text;
+}
+
+void print_workload(const workload &w)
+{
+    std::printf("%s%s%s\n", w.name.c_str(), w.description.empty() ? "" : ": ",
+                w.description.c_str());
+    for (const auto &t : w.targets) {
+        std::printf("  target %-12s %-20s %s\n", t.name.c_str(),
+                    t.device.c_str(), mode_name(t.mode));
+    }
+    for (const auto &p : w.phases) {
+        std::printf("  phase  %-12s %s%s\n", p.name.c_str(),
+                    format_ns(double(p.duration_ns)).c_str(),
+                    p.record ? "" : " (not recorded)");
+        for (const auto &g : p.groups) {
+            std::printf("    %-14s %-8s %s\n", g.name.c_str(),
+                        g.target.c_str(), describe_group(g).c_str());
+        }
+    }
+    std::printf("\n");
+}
+
+void print_results(const std::vector<group_result> &results)
+{
+    std::printf("%-12s %-14s %-28s %10s %9s %9s %9s %9s %7s\n", "phase",
+                "group", "load", "ops/s", "MB/s", "p50", "p99", "p99.9",
+                "errors");
+    for (const auto &r : results) {
+        std::printf("%-12s %-14s %-28s %10.0f %9.2f %9s %9s %9s %7llu\n",
+                    r.phase.c_str(), r.group.c_str(),
+                    describe_group(*r.spec).c_str(), r.ops_per_sec(),
+                    r.mb_per_sec(),
+                    format_ns(double(r.latency.percentile(50))).c_str(),
+                    format_ns(double(r.latency.percentile(99))).c_str(),
+                    format_ns(double(r.latency.percentile(99.9))).c_str(),
+                    (unsigned long long)r.errors);
+    }
+}
+
+void write_workload_json(std::ostream &out, const workload &w,
+                         const std::string &path,
+                         const std::vector<group_result> &results)
+{
+    json_writer json(out);
+
+    json.begin_object();
+    json.field("tool", "simplechar-bench");
+    json.field("mode", "workload");
+    write_run_info(json);
+    json.field("workload", w.name);
+    json.field("file", path);
+    json.key("targets").begin_array();
+    for (const auto &t : w.targets) {
+        json.begin_object();
+        json.field("name", t.name);
+        json.field("device", t.device);
+        json.field("mode", mode_name(t.mode));
+        json.end_object();
+    }
+    json.end_array();
+    json.key("results").begin_array();
+    for (const auto &r : results) {
+        const workload_group &g = *r.spec;
+
+        json.begin_object();
+        json.field("phase", r.phase);
+        json.field("group", r.group);
+        json.field("target", g.target);
+        json.field("subscribe", g.subscribe);
+        json.field("threads", g.threads);
+        json.field("block_size", g.size);
+        json.field("read_pct", g.read_pct);
+        json.field("rate", g.rate);
+        json.field("ramp_to", g.ramp_to);
+        json.field("ops", r.ops);
+        json.field("ops_per_sec", r.ops_per_sec());
+        json.field("mb_per_sec", r.mb_per_sec());
+        json.field("errors", r.errors);
+        if (g.subscribe) {
+            json.field("empty_polls", r.empty_polls);
+        }
+        write_histogram_json(json, "latency_ns", r.latency);
+        json.end_object();
+    }
+    json.end_array();
+    json.end_object();
+    out << "\n";
+}
+
+} /* namespace */
+
+int run_workload(int argc, char **argv)
+{
+    workload_config cfg = parse_args(argc, argv);
+    workload w = load_workload(cfg.path);
+    bool json_stdout = cfg.json_path == "-";
+
+    for (const auto &d : cfg.devices) {
+        remap_target(w, d.first, d.second);
+    }
+    if (!json_stdout) {
+        print_workload(w);
+    }
+    if (cfg.check) {
+        return 0;
+    }
+
+    std::vector<group_result> results = execute_workload(w);
+    if (json_stdout) {
+        write_workload_json(std::cout, w, cfg.path, results);
+        return 0;
+    }
+    print_results(results);
+    if (!cfg.json_path.empty()) {
+        std::ofstream out(cfg.json_path);
+        if (!out) {
+            throw bench_error("cannot write " + cfg.json_path);
+        }
+        write_workload_json(out, w, cfg.path, results);
+    }
+    return 0;
+}
+
+} /* namespace simplechar::bench */
@@ -0,0 +1,114 @@
+/*
+ * workload.h - Declarative workload files for simplechar-bench
+ *
+ * A workload is a JSON file naming the target devices and a sequence of
+ * phases. Each phase runs its thread groups side by side for a duration;
+ * a group either reads and writes one target (closed loop, or paced at a
+ * fixed or ramping rate) or subscribes to its changes with delta reads:
+ *
+ *   {
+ *     "name": "log-ingest",
+ *     "targets": [{"name": "log", "device": "/dev/simplechar",
+ *                  "mode": "sequential"}],
+ *     "phases": [{
+ *       "name": "steady", "duration": "10s",
+ *       "groups": [
+ *         {"name": "producers", "target": "log", "mix": "0:100",
+ *          "size": "256", "threads": 8, "rate": "50k", "cpus": "0-7"},
+ *         {"name": "consumers", "target": "log", "subscribe": true,
+ *          "threads": 2, "poll": "1ms"}
+ *       ]
+ *     }]
+ *   }
+ *
+ * The target mode picks the offsets of its operations: "fixed" at 0,
+ * "sequential" advancing through the target like an append log and
+ * wrapping, or "random" block-aligned. See bench/workloads for examples.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_WORKLOAD_H
+#define SIMPLECHAR_WORKLOAD_H
+
+#include "hdr_histogram.h"
+#include "open_loop.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace simplechar::bench {
+
+enum class target_mode {
+    fixed,          /* Every operation at offset 0 */
+    sequential,     /* Shared cursor advancing by each size, wraps */
+    random,         /* Uniform block-aligned offsets */
+};
+
+struct workload_target {
+    std::string name;
+    std::string device = "/dev/simplechar";
+    target_mode mode = target_mode::fixed;
+    uint64_t span = 0;              /* Bytes addressed, 0 = device size */
+};
+
+struct workload_group {
+    std::string name;
+    std::string target;
+    bool subscribe = false;         /* Delta-read consumer instead of I/O */
+    int read_pct = 0;
+    uint64_t size = 4096;
+    int threads = 1;
+    double rate = 0;                /* Ops/s over the group, 0 = closed loop */
+    double ramp_to = 0;             /* Rate reached at the end, 0 = no ramp */
+    arrival_process arrival = arrival_process::poisson;
+    std::vector<int> cpus;          /* Thread i on cpus[i % n], empty = any */
+    uint64_t poll_ns = 1000000;     /* Subscriber sleep when nothing changed */
+};
+
+struct workload_phase {
+    std::string name;
+    uint64_t duration_ns = 0;
+    bool record = true;             /* false for warmups */
+    std::vector<workload_group> groups;
+};
+
+struct workload {
+    std::string name;
+    std::string description;
+    std::vector<workload_target> targets;
+    std::vector<workload_phase> phases;
+};
+
+struct group_result {
+    std::string phase;
+    std::string group;
+    const workload_group *spec = nullptr;
+    uint64_t elapsed_ns = 0;
+    uint64_t ops = 0;               /* I/O calls, or deltas with changes */
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+    uint64_t empty_polls = 0;       /* Subscriber polls without changes */
+    hdr_histogram latency;          /* From due time when paced */
+
+    double ops_per_sec() const;
+    double mb_per_sec() const;
+};
+
+/* Parse and check a workload file, throws bench_error naming the problem */
+workload load_workload(const std::string &path);
+
+/* Point every target named name at device */
+void remap_target(workload &w, const std::string &name,
+                  const std::string &device);
+
+/* Run all phases in order; results of recorded phases only */
+std::vector<group_result> execute_workload(const workload &w);
+
+/* The "workload" subcommand of simplechar-bench */
+int run_workload(int argc, char **argv);
+
+} /* namespace simplechar::bench */
+
+#endif /* SIMPLECHAR_WORKLOAD_H */
@@ -0,0 +1,726 @@
+/*
+ * server.cpp - CUSE front end of simplechar-cuse
+ *
+ * License: MIT
+ */
+
+#include "server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <linux/fuse.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace simplechar::cuse {
+
+namespace {
+
+/*
+ * Largest read or write the kernel forwards in one request: CUSE does
+ * not negotiate max_pages, so transfers are cut into its default of 32
+ * pages whatever max_read and max_write say
+ */
+constexpr size_t max_io_default = 32 * 4096;
+
+/* Room for the request headers in front of the largest payload */
+constexpr size_t header_room = 4096;
+
+/* What the driver's poll() reports without a record ring */
+constexpr uint32_t default_pollmask = POLLIN | POLLOUT | POLLRDNORM | POLLWRNORM;
+
+std::system_error cuse_error(int err, const std::string &what)
+{
+    return std::system_error(std::error_code(err, std::generic_category()), what);
+}
+
+template <typename T>
+T request_arg(const char *arg)
+{
+    T v;
+
+    std::memcpy(&v, arg, sizeof(v));
+    return v;
+}
+
+} /* namespace */
+
+/* Debug output in the driver's DEBUG_PRINT levels */
+#define DEBUG_PRINT(level, ...) \
+    do { \
+        if (opts_.debug_level >= (level)) { \
+            std::fprintf(stderr, "simplechar-cuse: " __VA_ARGS__); \
+        } \
+    } while (0)
+
+server::server(store &st, const server_options &opts)
+    : store_(st), opts_(opts), max_io_(max_io_default)
+{
+    opts_.threads = std::max(opts_.threads, 1U);
+    fd_ = ::open("/dev/cuse", O_RDWR | O_CLOEXEC | O_NONBLOCK);
+    if (fd_ < 0) {
+        throw cuse_error(errno, "cannot open /dev/cuse");
+    }
+    stop_fd_ = ::eventfd(0, EFD_CLOEXEC);
+    if (stop_fd_ < 0) {
+        int err = errno;
+        ::close(fd_);
+        throw cuse_error(err, "cannot create an eventfd");
+    }
+    try {
+        handshake();
+    } catch (...) {
+        ::close(stop_fd_);
+        ::close(fd_);
+        throw;
+    }
+}
+
+server::~server()
+{
+    stop();
+    for (auto &t : workers_) {
+        t.join();
+    }
+    ::close(stop_fd_);
+    ::close(fd_);
+
+    /* Files still open when the device goes away */
+    for (auto &p : pending_opens_) {
+        store_.open_gate().cancel(p.first);
+    }
+}
+
+/*
+ * Answer CUSE_INIT, the first request on a new /dev/cuse descriptor,
+ * with the protocol version, the transfer sizes and the device name
+ */
+void server::handshake()
+{
+    std::vector<char> buf(max_io_ + header_room);
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    fuse_in_header in;
+    cuse_init_out out = {};
+    std::string info = "DEVNAME=" + opts_.name;
+    ssize_t n;
+
+    for (;;) {
+        n = ::read(fd_, buf.data(), buf.size());
+        if (n >= 0 || (errno != EAGAIN && errno != EINTR)) {
+            break;
+        }
+        ::poll(&pfd, 1, -1);
+    }
+    if (n < ssize_t(sizeof(in) + sizeof(cuse_init_in))) {
+        throw cuse_error(n < 0 ? errno : EPROTO, "no CUSE_INIT from /dev/cuse");
+    }
+    std::memcpy(&in, buf.data(), sizeof(in));
+    auto init = request_arg<cuse_init_in>(buf.data() + sizeof(in));
+    if (in.opcode != CUSE_INIT || init.major != FUSE_KERNEL_VERSION) {
+        throw cuse_error(EPROTO, "unexpected CUSE_INIT from /dev/cuse");
+    }
+    DEBUG_PRINT(2, "kernel speaks FUSE %u.%u\n", init.major, init.minor);
+
+    out.major = FUSE_KERNEL_VERSION;
+    out.minor = FUSE_KERNEL_MINOR_VERSION;
+    out.flags = CUSE_UNRESTRICTED_IOCTL;
+    out.max_read = uint32_t(max_io_);
+    out.max_write = uint32_t(max_io_);
+
+    struct iovec iov[] = {
+        {&out, sizeof(out)},
+        {const_cast<char *>(info.c_str()), info.size() + 1},
+    };
+    reply(in.unique, 0, iov, 2);
+}
+
+void server::start()
+{
+    for (unsigned i = 0; i < opts_.threads; i++) {
+        workers_.emplace_back([this] { worker(); });
+    }
+}
+
+void server::stop()
+{
+    uint64_t one = 1;
+
+    if (!stopping_.exchange(true)) {
+        if (::write(stop_fd_, &one, sizeof(one)) < 0) {
+            DEBUG_PRINT(1, "cannot wake the workers: %s\n", std::strerror(errno));
+        }
+        finish();
+    }
+}
+
+void server::finish()
+{
+    {
+        std::lock_guard<std::mutex> lk(done_lock_);
+        done_ = true;
+    }
+    done_cv_.notify_all();
+}
+
+bool server::wait(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lk(done_lock_);
+
+    return done_cv_.wait_for(lk, timeout, [this] { return done_; });
+}
+
+server_stats server::stats() const
+{
+    server_stats st;
+
+    st.requests = requests_.load(std::memory_order_relaxed);
+    st.interrupts = interrupts_.load(std::memory_order_relaxed);
+    return st;
+}
+
+void server::reply(uint64_t unique, int error, const struct iovec *iov,
+                   int iovcnt)
+{
+    struct iovec vec[4];
+    fuse_out_header out;
+
+    out.len = sizeof(out);
+    out.error = error;
+    out.unique = unique;
+    vec[0] = {&out, sizeof(out)};
+    for (int i = 0; i < iovcnt; i++) {
+        vec[i + 1] = iov[i];
+        out.len += uint32_t(iov[i].iov_len);
+    }
+
+    /* ENOENT: the request was interrupted or aborted meanwhile */
+    if (::writev(fd_, vec, iovcnt + 1) < 0 && errno != ENOENT) {
+        DEBUG_PRINT(1, "reply to request %llu failed: %s\n",
+                    (unsigned long long)unique, std::strerror(errno));
+    }
+}
+
+/*
+ * Read requests until the server stops or the device goes away
+ * Every worker reads the same descriptor; the kernel hands each request
+ * to exactly one of them.
+ */
+void server::worker()
+{
+    std::vector<char> buf(max_io_ + header_room);
+    std::vector<char> scratch(max_io_);
+    struct pollfd pfd[2] = {{fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+    fuse_in_header in;
+
+    while (!stopping_.load(std::memory_order_relaxed)) {
+        ssize_t n = ::read(fd_, buf.data(), buf.size());
+
+        if (n < 0) {
+            if (errno == EAGAIN) {
+                ::poll(pfd, 2, -1);
+                continue;
+            }
+            if (errno == EINTR || errno == ENOENT) {
+                continue;
+            }
+            if (errno == ENODEV) {
+                DEBUG_PRINT(1, "/dev/%s was removed\n", opts_.name.c_str());
+            } else {
+                DEBUG_PRINT(1, "reading /dev/cuse failed: %s\n", std::strerror(errno));
+            }
+            finish();
+            return;
+        }
+        if (size_t(n) < sizeof(in)) {
+            continue;
+        }
+        std::memcpy(&in, buf.data(), sizeof(in));
+        requests_.fetch_add(1, std::memory_order_relaxed);
+        dispatch(in, buf.data() + sizeof(in), size_t(n) - sizeof(in), scratch);
+    }
+}
+
+void server::dispatch(const fuse_in_header &in, const char *arg, size_t len,
+                      std::vector<char> &scratch)
+{
+    DEBUG_PRINT(3, "request %llu: opcode %u, %zu bytes, pid %u\n",
+                (unsigned long long)in.unique, in.opcode, len, in.pid);
+
+    switch (in.opcode) {
+    case FUSE_OPEN:
+        do_open(in, arg);
+        break;
+    case FUSE_RELEASE:
+        do_release(in, arg);
+        break;
+    case FUSE_READ:
+        do_read(in, arg, scratch);
+        break;
+    case FUSE_WRITE:
+        do_write(in, arg, len);
+        break;
+    case FUSE_IOCTL:
+        do_ioctl(in, arg, len, scratch);
+        break;
+    case FUSE_POLL:
+        do_poll(in, arg);
+        break;
+    case FUSE_INTERRUPT:
+        do_interrupt(in, arg);
+        break;
+    case FUSE_FLUSH:
+    case FUSE_FSYNC:
+        /* Everything is in the store already */
+        reply_error(in.unique, 0);
+        break;
+    case FUSE_DESTROY:
+        reply_error(in.unique, 0);
+        stop();
+        break;
+    default:
+        reply_error(in.unique, -ENOSYS);
+        break;
+    }
+}
+
+/*
+ * Open: wait for a slot of the open gate in arrival order, or fail fast
+ * with EBUSY under O_NONBLOCK. A blocking open that has to wait is
+ * parked under its unique; whoever frees a slot answers it.
+ */
+void server::do_open(const fuse_in_header &in, const char *arg)
+{
+    auto req = request_arg<fuse_open_in>(arg);
+    auto file = std::make_unique<open_file>();
+    uint64_t start = store_.trace_start();
+    bool nonblock = req.flags & O_NONBLOCK;
+
+    if (nonblock) {
+        if (!store_.open_gate().try_enter()) {
+            DEBUG_PRINT(2, "Device open refused (%d)\n", -EBUSY);
+            reply_error(in.unique, -EBUSY);
+            return;
+        }
+    } else {
+        /* Parked under the lock, so a release cannot miss it */
+        std::lock_guard<std::mutex> lk(irq_lock_);
+
+        if (!store_.open_gate().enter_or_queue(in.unique)) {
+            pending_opens_[in.unique] = {std::move(file), start, in.pid, nonblock};
+            return;
+        }
+    }
+    finish_open(in.unique, std::move(file), start, in.pid, nonblock);
+}
+
+void server::finish_open(uint64_t unique, std::unique_ptr<open_file> file,
+                         uint64_t start, uint32_t pid, bool nonblock)
+{
+    fuse_open_out out = {};
+
+    file->open_id = store_.next_open_id();
+    store_.trace_record(file.get(), SIMPLECHAR_TRACE_OPEN, start, 0, 0, 0,
+                        pid, nonblock);
+    out.fh = reinterpret_cast<uintptr_t>(file.release());
+
+    struct iovec iov = {&out, sizeof(out)};
+    reply(unique, 0, &iov, 1);
+    DEBUG_PRINT(2, "Device opened successfully\n");
+}
+
+void server::do_release(const fuse_in_header &in, const char *arg)
+{
+    auto req = request_arg<fuse_release_in>(arg);
+    std::unique_ptr<open_file> file(reinterpret_cast<open_file *>(uintptr_t(req.fh)));
+    uint64_t ticket;
+
+    store_.trace_record(file.get(), SIMPLECHAR_TRACE_CLOSE, store_.trace_start(),
+                        0, 0, 0, in.pid, req.flags & O_NONBLOCK);
+    file.reset();
+    reply_error(in.unique, 0);
+
+    /* Hand the slot to the oldest parked open */
+    ticket = store_.open_gate().leave();
+    if (ticket) {
+        pending_open p;
+        {
+            std::lock_guard<std::mutex> lk(irq_lock_);
+            auto it = pending_opens_.find(ticket);
+            p = std::move(it->second);
+            pending_opens_.erase(it);
+        }
+        finish_open(ticket, std::move(p.file), p.start, p.pid, p.nonblock);
+    }
+}
+
+/*
+ * Charge one operation of len bytes against the file's QoS buckets,
+ * sleeping until the caller is within its limits unless nonblock is set
+ * Returns 0, -EAGAIN or, if the caller was interrupted, -EINTR.
+ */
+int server::throttle(open_file &f, uint64_t unique, size_t len, bool nonblock)
+{
+    uint64_t start = 0, wait, slept;
+    sleeper s;
+    int ret = 0;
+
+    for (;;) {
+        wait = f.ops.take(1);
+        if (!wait) {
+            wait = f.bytes.take(len);
+            if (!wait) {
+                break;
+            }
+            /* Return the operation token while we wait for bytes */
+            f.ops.put_back();
+        }
+
+        if (nonblock) {
+            f.rejected_ops.fetch_add(1, std::memory_order_relaxed);
+            return -EAGAIN;
+        }
+
+        if (!start) {
+            start = monotonic_ns();
+            f.throttled_ops.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lk(irq_lock_);
+            sleepers_[unique] = &s;
+        }
+
+        std::unique_lock<std::mutex> lk(s.lock);
+        if (s.cv.wait_for(lk, std::chrono::nanoseconds(wait),
+                          [&] { return s.interrupted; })) {
+            ret = -EINTR;
+            break;
+        }
+    }
+
+    if (start) {
+        {
+            std::lock_guard<std::mutex> lk(irq_lock_);
+            sleepers_.erase(unique);
+        }
+        slept = monotonic_ns() - start;
+        f.throttled_ns.fetch_add(slept, std::memory_order_relaxed);
+        store_.add_throttled_ns(slept);
+        DEBUG_PRINT(3, "Throttled for %llu ns\n", (unsigned long long)slept);
+    }
+    return ret;
+}
+
+void server::do_read(const fuse_in_header &in, const char *arg,
+                     std::vector<char> &scratch)
+{
+    auto req = request_arg<fuse_read_in>(arg);
+    auto &file = *reinterpret_cast<open_file *>(uintptr_t(req.fh));
+    size_t len = std::min<size_t>(req.size, max_io_);
+    bool nonblock = req.flags & O_NONBLOCK;
+    uint64_t start = store_.trace_start();
+    uint64_t pos = req.offset;
+    ssize_t bytes_read;
+
+    /* Apply per-open rate limits before touching the device */
+    bytes_read = throttle(file, in.unique, std::min(len, store_.size()), nonblock);
+    if (!bytes_read) {
+        if (opts_.position == position_mode::stream) {
+            std::lock_guard<std::mutex> lk(file.pos_lock);
+            pos = file.pos;
+            bytes_read = store_.read(scratch.data(), len, file.pos);
+        } else {
+            uint64_t at = pos;
+            bytes_read = store_.read(scratch.data(), len, at);
+        }
+    }
+    store_.trace_record(&file, SIMPLECHAR_TRACE_READ, start, pos, len,
+                        bytes_read, in.pid, nonblock);
+
+    if (bytes_read < 0) {
+        reply_error(in.unique, int(bytes_read));
+        return;
+    }
+    struct iovec iov = {scratch.data(), size_t(bytes_read)};
+    reply(in.unique, 0, &iov, 1);
+}
+
+void server::do_write(const fuse_in_header &in, const char *arg, size_t len)
+{
+    auto req = request_arg<fuse_write_in>(arg);
+    auto &file = *reinterpret_cast<open_file *>(uintptr_t(req.fh));
+    const char *data = arg + sizeof(req);
+    size_t size = std::min<size_t>(req.size, len - sizeof(req));
+    bool nonblock = req.flags & O_NONBLOCK;
+    bool append = req.flags & O_APPEND;
+    uint64_t start = store_.trace_start();
+    uint64_t pos = req.offset;
+    ssize_t bytes_written;
+    fuse_write_out out = {};
+
+    bytes_written = throttle(file, in.unique, std::min(size, store_.size()), nonblock);
+    if (!bytes_written) {
+        if (opts_.position == position_mode::stream) {
+            std::lock_guard<std::mutex> lk(file.pos_lock);
+            pos = file.pos;
+            bytes_written = store_.write(data, size, file.pos, append, in.uid);
+        } else {
+            uint64_t at = pos;
+            bytes_written = store_.write(data, size, at, append, in.uid);
+        }
+    }
+    store_.trace_record(&file, SIMPLECHAR_TRACE_WRITE, start, pos, size,
+                        bytes_written, in.pid, nonblock);
+
+    if (bytes_written < 0) {
+        reply_error(in.unique, int(bytes_written));
+        return;
+    }
+    out.size = uint32_t(bytes_written);
+    struct iovec iov = {&out, sizeof(out)};
+    reply(in.unique, 0, &iov, 1);
+}
+
+/*
+ * Ioctl: CUSE forwards the command and the raw argument, but not the
+ * memory behind it. The first call for a command asks the kernel to
+ * retry with the struct at arg copied in and room for it to be copied
+ * out; commands whose struct points at a buffer (GET_DELTA, READ_TRACE)
+ * ask a second time to add that buffer. The answer carries the result
+ * and the bytes to copy out, in the order of the out iovecs.
+ */
+void server::do_ioctl(const fuse_in_header &in, const char *arg, size_t len,
+                      std::vector<char> &scratch)
+{
+    auto req = request_arg<fuse_ioctl_in>(arg);
+    auto &file = *reinterpret_cast<open_file *>(uintptr_t(req.fh));
+    const char *data = arg + sizeof(req);
+    size_t data_len = len - sizeof(req);
+    fuse_ioctl_iovec retry_in[1], retry_out[2];
+    unsigned nr_in = 0, nr_out = 0;
+    fuse_ioctl_out out = {};
+    struct iovec iov[3];
+    int iovcnt = 1;
+    size_t need_in = 0, need_out = 0, extra = 0;
+    uint64_t extra_base = 0;
+
+    DEBUG_PRINT(3, "IOCTL request: cmd=0x%x, arg=%llu\n", req.cmd,
+                (unsigned long long)req.arg);
+
+    /* What each command reads and writes at arg */
+    switch (req.cmd) {
+    case SIMPLECHAR_IOC_GET_DELTA:
+        need_in = need_out = sizeof(simplechar_delta);
+        break;
+    case SIMPLECHAR_IOC_SET_QOS:
+        need_in = sizeof(simplechar_qos);
+        break;
+    case SIMPLECHAR_IOC_GET_QOS:
+        need_out = sizeof(simplechar_qos);
+        break;
+    case SIMPLECHAR_IOC_GET_QOS_STATS:
+        need_out = sizeof(simplechar_qos_stats);
+        break;
+    case SIMPLECHAR_IOC_GET_UID_USAGE:
+        need_in = need_out = sizeof(simplechar_uid_usage_info);
+        break;
+    case SIMPLECHAR_IOC_GET_AUTOSIZE:
+        need_out = sizeof(simplechar_autosize_info);
+        break;
+    case SIMPLECHAR_IOC_GET_LOCK_STATS:
+        need_out = sizeof(simplechar_lock_info);
+        break;
+    case SIMPLECHAR_IOC_READ_TRACE:
+        need_in = need_out = sizeof(simplechar_trace_read);
+        break;
+    case SIMPLECHAR_IOC_RING_INFO:
+    case SIMPLECHAR_IOC_RING_NOTIFY:
+        /* No mmap() over CUSE, so never a record ring */
+        out.result = -ENODEV;
+        goto answer;
+    default:
+        out.result = -ENOTTY;
+        goto answer;
+    }
+
+    /* The buffer behind the struct, once the struct is known */
+    if (req.in_size >= need_in && need_in) {
+        if (req.cmd == SIMPLECHAR_IOC_GET_DELTA) {
+            auto d = request_arg<simplechar_delta>(data);
+            extra_base = d.data;
+            extra = d.data_len;
+        } else if (req.cmd == SIMPLECHAR_IOC_READ_TRACE) {
+            auto t = request_arg<simplechar_trace_read>(data);
+            extra_base = t.events;
+            extra = std::min<uint32_t>(t.max_events, SIMPLECHAR_TRACE_BATCH) *
+                    sizeof(simplechar_trace_event);
+        }
+    }
+
+    if (req.in_size < need_in || req.out_size < need_out + extra) {
+        if (!(req.flags & FUSE_IOCTL_UNRESTRICTED)) {
+            out.result = -EIO;
+            goto answer;
+        }
+        if (need_in) {
+            retry_in[nr_in++] = {req.arg, need_in};
+        }
+        if (need_out) {
+            retry_out[nr_out++] = {req.arg, need_out};
+        }
+        if (extra) {
+            retry_out[nr_out++] = {extra_base, extra};
+        }
+        out.flags = FUSE_IOCTL_RETRY;
+        out.in_iovs = nr_in;
+        out.out_iovs = nr_out;
+        iov[0] = {&out, sizeof(out)};
+        iov[1] = {retry_in, nr_in * sizeof(retry_in[0])};
+        iov[2] = {retry_out, nr_out * sizeof(retry_out[0])};
+        reply(in.unique, 0, iov, 3);
+        return;
+    }
+    (void)data_len;
+
+    switch (req.cmd) {
+    case SIMPLECHAR_IOC_GET_DELTA: {
+        auto d = request_arg<simplechar_delta>(data);
+
+        if (scratch.size() < sizeof(d) + extra) {
+            scratch.resize(sizeof(d) + extra);
+        }
+        out.result = store_.get_delta(d, scratch.data() + sizeof(d));
+        if (out.result && out.result != -ENOSPC) {
+            goto answer;
+        }
+        std::memcpy(scratch.data(), &d, sizeof(d));
+        iov[iovcnt++] = {scratch.data(),
+                         sizeof(d) + (out.result ? 0 : std::min<size_t>(d.bytes_used, extra))};
+        break;
+    }
+    case SIMPLECHAR_IOC_SET_QOS: {
+        auto qos = request_arg<simplechar_qos>(data);
+
+        file.ops.reset(qos.ops_per_sec, qos.ops_burst);
+        file.bytes.reset(qos.bytes_per_sec, qos.bytes_burst);
+        DEBUG_PRINT(2, "QoS set: %llu ops/s, %llu bytes/s\n",
+                    (unsigned long long)qos.ops_per_sec,
+                    (unsigned long long)qos.bytes_per_sec);
+        break;
+    }
+    case SIMPLECHAR_IOC_GET_QOS: {
+        auto *qos = reinterpret_cast<simplechar_qos *>(scratch.data());
+
+        qos->ops_per_sec = file.ops.rate();
+        qos->bytes_per_sec = file.bytes.rate();
+        qos->ops_burst = file.ops.burst();
+        qos->bytes_burst = file.bytes.burst();
+        iov[iovcnt++] = {qos, sizeof(*qos)};
+        break;
+    }
+    case SIMPLECHAR_IOC_GET_QOS_STATS: {
+        auto *st = reinterpret_cast<simplechar_qos_stats *>(scratch.data());
+
+        st->throttled_ns = file.throttled_ns.load(std::memory_order_relaxed);
+        st->throttled_ops = file.throttled_ops.load(std::memory_order_relaxed);
+        st->rejected_ops = file.rejected_ops.load(std::memory_order_relaxed);
+        iov[iovcnt++] = {st, sizeof(*st)};
+        break;
+    }
+    case SIMPLECHAR_IOC_GET_UID_USAGE: {
+        auto *info = reinterpret_cast<simplechar_uid_usage_info *>(scratch.data());
+
+        *info = request_arg<simplechar_uid_usage_info>(data);
+        out.result = store_.get_uid_usage(*info, in.uid);
+        iov[iovcnt++] = {info, sizeof(*info)};
+        break;
+    }
+    case SIMPLECHAR_IOC_GET_AUTOSIZE: {
+        auto *info = reinterpret_cast<simplechar_autosize_info *>(scratch.data());
+
+        store_.get_autosize(*info);
+        iov[iovcnt++] = {info, sizeof(*info)};
+        break;
+    }
+    case SIMPLECHAR_IOC_GET_LOCK_STATS: {
+        auto *info = reinterpret_cast<simplechar_lock_info *>(scratch.data());
+
+        store_.get_lock_stats(*info);
+        iov[iovcnt++] = {info, sizeof(*info)};
+        break;
+    }
+    case SIMPLECHAR_IOC_READ_TRACE: {
+        auto t = request_arg<simplechar_trace_read>(data);
+        auto *events = reinterpret_cast<simplechar_trace_event *>(
+            scratch.data() + sizeof(t));
+
+        out.result = store_.read_trace(t, events);
+        if (out.result) {
+            goto answer;
+        }
+        std::memcpy(scratch.data(), &t, sizeof(t));
+        iov[iovcnt++] = {scratch.data(),
+                         sizeof(t) + t.nr_events * sizeof(simplechar_trace_event)};
+        break;
+    }
+    }
+
+answer:
+    iov[0] = {&out, sizeof(out)};
+    reply(in.unique, 0, iov, iovcnt);
+}
+
+/*
+ * Poll: without a record ring the driver never blocks, and neither does
+ * this device, so no wakeup is ever scheduled
+ */
+void server::do_poll(const fuse_in_header &in, const char *arg)
+{
+    fuse_poll_out out = {};
+
+    (void)arg;
+    out.revents = default_pollmask;
+    struct iovec iov = {&out, sizeof(out)};
+    reply(in.unique, 0, &iov, 1);
+}
+
+/*
+ * Interrupt: a signal reached the caller of a parked open or of a
+ * throttled read or write. Requests that are not waiting finish on their
+ * own; EAGAIN has the kernel send the interrupt again until they do.
+ */
+void server::do_interrupt(const fuse_in_header &in, const char *arg)
+{
+    uint64_t target = request_arg<fuse_interrupt_in>(arg).unique;
+    std::unique_lock<std::mutex> lk(irq_lock_);
+
+    interrupts_.fetch_add(1, std::memory_order_relaxed);
+    auto open = pending_opens_.find(target);
+    if (open != pending_opens_.end()) {
+        /* A release may already have handed it the slot */
+        if (store_.open_gate().cancel(target)) {
+            pending_opens_.erase(open);
+            lk.unlock();
+            reply_error(target, -EINTR);
+        }
+        return;
+    }
+
+    auto sleeping = sleepers_.find(target);
+    if (sleeping != sleepers_.end()) {
+        sleeper *s = sleeping->second;
+        std::lock_guard<std::mutex> slk(s->lock);
+        s->interrupted = true;
+        s->cv.notify_one();
+        return;
+    }
+    lk.unlock();
+    reply_error(in.unique, -EAGAIN);
+}
+
+} /* namespace simplechar::cuse */
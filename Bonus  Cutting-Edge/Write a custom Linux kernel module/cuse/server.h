@@ -0,0 +1,151 @@
+/*
+ * server.h - CUSE front end of simplechar-cuse
+ *
+ * Registers a character device through /dev/cuse and answers the
+ * requests the kernel forwards for it: open, read, write, ioctl, poll
+ * and release, each the way src/simplechar.c answers the same call, with
+ * the store behind them. The protocol is spoken directly from
+ * <linux/fuse.h>, so nothing beyond the kernel headers is needed.
+ *
+ * Worker threads read requests from the same /dev/cuse descriptor and
+ * answer them independently, so a read throttled by its QoS limits does
+ * not hold up other files. Requests that may wait for long are the two
+ * that can be interrupted: a throttled read or write sleeps in its
+ * worker, and an open waiting for a max_opens slot is parked without
+ * one and answered by the release that frees the slot.
+ *
+ * CUSE cannot offer what the kernel fills in itself: it passes no file
+ * position and cannot mmap(). position_mode picks what read() and
+ * write() start from, and the record ring ioctls fail with ENODEV, as
+ * they do for a module loaded without ring_size.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_CUSE_SERVER_H
+#define SIMPLECHAR_CUSE_SERVER_H
+
+#include "store.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct fuse_in_header;
+struct iovec;
+
+namespace simplechar::cuse {
+
+enum class position_mode {
+    stream,                         /* Each open keeps a position, as read() does */
+    zero,                           /* Every call starts at 0, as pread(fd, .., 0) */
+};
+
+struct server_options {
+    std::string name = "simplechar";    /* /dev/<name> */
+    unsigned threads = 4;               /* Workers reading requests */
+    position_mode position = position_mode::stream;
+    int debug_level = 1;
+};
+
+struct server_stats {
+    uint64_t requests = 0;
+    uint64_t interrupts = 0;
+};
+
+class server {
+public:
+    /*
+     * Open /dev/cuse and create /dev/<name>
+     * Throws std::system_error if /dev/cuse cannot be opened or the
+     * kernel refuses the device.
+     */
+    server(store &st, const server_options &opts);
+
+    /* Stops the workers; the device goes away with the descriptor */
+    ~server();
+
+    server(const server &) = delete;
+    server &operator=(const server &) = delete;
+
+    /* Start the workers */
+    void start();
+
+    /*
+     * Wait up to timeout for the server to end: stop() was called, or the
+     * kernel tore the device down, e.g. because /dev/<name> was taken
+     * Returns true once it has ended.
+     */
+    bool wait(std::chrono::milliseconds timeout);
+    void stop();
+
+    server_stats stats() const;
+
+private:
+    /* An open parked for a slot of the open gate */
+    struct pending_open {
+        std::unique_ptr<open_file> file;
+        uint64_t start;             /* Trace start */
+        uint32_t pid;
+        bool nonblock;
+    };
+
+    /* A request sleeping until its QoS buckets allow it */
+    struct sleeper {
+        std::mutex lock;
+        std::condition_variable cv;
+        bool interrupted = false;
+    };
+
+    void handshake();
+    void worker();
+    void finish();
+    void dispatch(const fuse_in_header &in, const char *arg, size_t len,
+                  std::vector<char> &scratch);
+    void reply(uint64_t unique, int error, const struct iovec *iov = nullptr,
+               int iovcnt = 0);
+    void reply_error(uint64_t unique, int error) { reply(unique, error); }
+
+    void do_open(const fuse_in_header &in, const char *arg);
+    void finish_open(uint64_t unique, std::unique_ptr<open_file> file,
+                     uint64_t start, uint32_t pid, bool nonblock);
+    void do_release(const fuse_in_header &in, const char *arg);
+    void do_read(const fuse_in_header &in, const char *arg,
+                 std::vector<char> &scratch);
+    void do_write(const fuse_in_header &in, const char *arg, size_t len);
+    void do_ioctl(const fuse_in_header &in, const char *arg, size_t len,
+                  std::vector<char> &scratch);
+    void do_poll(const fuse_in_header &in, const char *arg);
+    void do_interrupt(const fuse_in_header &in, const char *arg);
+    int throttle(open_file &f, uint64_t unique, size_t len, bool nonblock);
+
+    store &store_;
+    server_options opts_;
+    int fd_ = -1;
+    int stop_fd_ = -1;              /* eventfd that wakes idle workers */
+    size_t max_io_;                 /* Largest read or write request */
+    std::vector<std::thread> workers_;
+    std::atomic<bool> stopping_{false};
+    std::atomic<uint64_t> requests_{0};
+    std::atomic<uint64_t> interrupts_{0};
+
+    /* Requests an INTERRUPT can reach, by unique */
+    std::mutex irq_lock_;
+    std::unordered_map<uint64_t, pending_open> pending_opens_;
+    std::unordered_map<uint64_t, sleeper *> sleepers_;
+
+    std::mutex done_lock_;
+    std::condition_variable done_cv_;
+    bool done_ = false;
+};
+
+} /* namespace simplechar::cuse */
+
+#endif /* SIMPLECHAR_CUSE_SERVER_H */
@@ -0,0 +1,244 @@
+/*
+ * simplechar_cuse.cpp - SimpleChar as a CUSE character device
+ *
+ * Serves /dev/simplechar from user space through /dev/cuse, with the
+ * read, write, ioctl and poll semantics of the module. Nothing has to be
+ * loaded: any user who can open /dev/cuse can run the device, so it
+ * works on development machines and in containers without insmod.
+ * The options are the module's parameters.
+ *
+ * Usage: simplechar-cuse [options]
+ *
+ * License: MIT
+ */
+
+#include "server.h"
+#include "store.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <getopt.h>
+#include <pthread.h>
+
+namespace simplechar::cuse {
+
+namespace {
+
+struct config {
+    store_options store;
+    server_options server;
+};
+
+void usage(FILE *out)
+{
+    std::fprintf(out,
+        "Usage: simplechar-cuse [options]\n"
+        "\n"
+        "Serve the SimpleChar device from user space through /dev/cuse. The\n"
+        "device options take the module parameter of the same name; the\n"
+        "device lives until simplechar-cuse exits (Ctrl-C).\n"
+        "\n"
+        "  -n, --name NAME              Device name (default: simplechar)\n"
+        "      --buffer-size BYTES      Size of the buffer, max 4096 (default: 1024)\n"
+        "      --max-opens N            Maximum concurrent opens, 0 = unlimited\n"
+        "      --uid-quota BYTES        Backing store bytes per uid, 0 = unlimited\n"
+        "      --autosize               Grow and shrink the buffer with demand\n"
+        "      --autosize-max BYTES     Largest autosize size, max 4 MiB (default: 65536)\n"
+        "      --autosize-interval MS   Autosize sampling interval (default: 1000)\n"
+        "      --trace-events N         Operation trace ring size, 0 = no ring\n"
+        "      --trace                  Record operations into the trace ring\n"
+        "  -D, --debug LEVEL            Debug verbosity 0-3 (default: 1)\n"
+        "  -t, --threads N              Request threads (default: 4)\n"
+        "  -p, --position MODE          Where read() and write() start:\n"
+        "                                 stream  per-open position, as the module\n"
+        "                                 zero    offset 0, as pread(fd, .., 0)\n"
+        "                               (default: stream)\n"
+        "  -h, --help                   Show this help\n");
+}
+
+unsigned long parse_number(const char *name, const char *text)
+{
+    char *end;
+    unsigned long v;
+
+    errno = 0;
+    v = std::strtoul(text, &end, 0);
+    if (errno || end == text || *end || *text == '-') {
+        throw std::invalid_argument(std::string("invalid ") + name + ": " + text);
+    }
+    return v;
+}
+
+config parse_args(int argc, char **argv)
+{
+    enum {
+        opt_buffer_size = 256,
+        opt_max_opens,
+        opt_uid_quota,
+        opt_autosize,
+        opt_autosize_max,
+        opt_autosize_interval,
+        opt_trace_events,
+        opt_trace,
+    };
+    static const struct option options[] = {
+        {"name", required_argument, nullptr, 'n'},
+        {"buffer-size", required_argument, nullptr, opt_buffer_size},
+        {"max-opens", required_argument, nullptr, opt_max_opens},
+        {"uid-quota", required_argument, nullptr, opt_uid_quota},
+        {"autosize", no_argument, nullptr, opt_autosize},
+        {"autosize-max", required_argument, nullptr, opt_autosize_max},
+        {"autosize-interval", required_argument, nullptr, opt_autosize_interval},
+        {"trace-events", required_argument, nullptr, opt_trace_events},
+        {"trace", no_argument, nullptr, opt_trace},
+        {"debug", required_argument, nullptr, 'D'},
+        {"threads", required_argument, nullptr, 't'},
+        {"position", required_argument, nullptr, 'p'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    config cfg;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "n:D:t:p:h", options, nullptr)) != -1) {
+        switch (opt) {
+        case 'n':
+            cfg.server.name = optarg;
+            break;
+        case opt_buffer_size:
+            cfg.store.buffer_size = parse_number("buffer size", optarg);
+            break;
+        case opt_max_opens:
+            cfg.store.max_opens = unsigned(parse_number("max opens", optarg));
+            break;
+        case opt_uid_quota:
+            cfg.store.uid_quota = parse_number("uid quota", optarg);
+            break;
+        case opt_autosize:
+            cfg.store.autosize = true;
+            break;
+        case opt_autosize_max:
+            cfg.store.autosize_max = parse_number("autosize max", optarg);
+            break;
+        case opt_autosize_interval:
+            cfg.store.autosize_interval_ms =
+                unsigned(parse_number("autosize interval", optarg));
+            break;
+        case opt_trace_events:
+            cfg.store.trace_events = unsigned(parse_number("trace events", optarg));
+            break;
+        case opt_trace:
+            cfg.store.trace = true;
+            break;
+        case 'D':
+            cfg.server.debug_level = int(parse_number("debug level", optarg));
+            break;
+        case 't':
+            cfg.server.threads = unsigned(parse_number("thread count", optarg));
+            break;
+        case 'p':
+            if (!std::strcmp(optarg, "stream")) {
+                cfg.server.position = position_mode::stream;
+            } else if (!std::strcmp(optarg, "zero")) {
+                cfg.server.position = position_mode::zero;
+            } else {
+                throw std::invalid_argument(std::string("unknown position mode: ") + optarg);
+            }
+            break;
+        case 'h':
+            usage(stdout);
+            std::exit(0);
+        default:
+            usage(stderr);
+            std::exit(2);
+        }
+    }
+    if (optind != argc) {
+        usage(stderr);
+        std::exit(2);
+    }
+    if (cfg.server.name.empty() || cfg.server.name.find('/') != std::string::npos) {
+        throw std::invalid_argument("invalid device name: " + cfg.server.name);
+    }
+    if (!cfg.server.threads) {
+        throw std::invalid_argument("at least one request thread is needed");
+    }
+    return cfg;
+}
+
+int run(int argc, char **argv)
+{
+    config cfg = parse_args(argc, argv);
+    sigset_t signals;
+    struct timespec tick = {0, 0};
+    bool signalled = false;
+
+    /*
+     * Take SIGINT and SIGTERM with sigtimedwait() on this thread only,
+     * so that a signal never lands in a worker in the middle of a reply
+     */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    store st(cfg.store);
+    server srv(st, cfg.server);
+
+    srv.start();
+    if (cfg.server.debug_level >= 1) {
+        std::fprintf(stderr, "simplechar-cuse: serving /dev/%s (%zu bytes%s)\n",
+                     cfg.server.name.c_str(), cfg.store.buffer_size,
+                     cfg.store.autosize ? ", autosize" : "");
+    }
+
+    while (!srv.wait(std::chrono::milliseconds(200))) {
+        if (sigtimedwait(&signals, nullptr, &tick) > 0) {
+            signalled = true;
+            srv.stop();
+            break;
+        }
+    }
+
+    server_stats stats = srv.stats();
+    if (cfg.server.debug_level >= 2) {
+        std::fprintf(stderr, "simplechar-cuse: %llu requests, %llu interrupts\n",
+                     (unsigned long long)stats.requests,
+                     (unsigned long long)stats.interrupts);
+    }
+    if (!signalled && stats.requests == 0) {
+        /* The kernel drops a device whose name is taken right after CUSE_INIT */
+        std::fprintf(stderr, "simplechar-cuse: /dev/%s went away, is the name "
+                     "already in use?\n", cfg.server.name.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+} /* namespace */
+
+} /* namespace simplechar::cuse */
+
+int main(int argc, char **argv)
+{
+    try {
+        return simplechar::cuse::run(argc, argv);
+    } catch (const std::system_error &e) {
+        std::fprintf(stderr, "simplechar-cuse: %s\n", e.what());
+        if (e.code().value() == ENOENT || e.code().value() == EACCES) {
+            std::fprintf(stderr, "simplechar-cuse: needs read-write access to "
+                         "/dev/cuse (modprobe cuse, see README)\n");
+        }
+        return 1;
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "simplechar-cuse: %s\n", e.what());
+        return 1;
+    }
+}
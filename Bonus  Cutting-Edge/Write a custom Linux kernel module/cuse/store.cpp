@@ -0,0 +1,739 @@
+/*
+ * store.cpp - The SimpleChar store, in user space
+ *
+ * License: MIT
+ */
+
+#include "store.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <time.h>
+
+namespace simplechar::cuse {
+
+namespace {
+
+constexpr unsigned autosize_shrink_pct = 25;    /* Fill level considered low */
+constexpr unsigned autosize_shrink_samples = 5; /* Low samples before shrinking */
+constexpr unsigned autosize_decay_shift = 2;    /* High-water mark loses 1/4 per sample */
+
+size_t div_round_up(size_t n, size_t d)
+{
+    return (n + d - 1) / d;
+}
+
+uint64_t roundup_pow_of_two(uint64_t n)
+{
+    uint64_t p = 1;
+
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+/* a * b / c without overflowing the product */
+uint64_t mul_div(uint64_t a, uint64_t b, uint64_t c)
+{
+    return uint64_t((unsigned __int128)a * b / c);
+}
+
+} /* namespace */
+
+uint64_t monotonic_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + uint64_t(ts.tv_nsec);
+}
+
+fifo_gate::fifo_gate(unsigned limit)
+    : limit_(limit)
+{
+}
+
+fifo_gate::~fifo_gate()
+{
+    for (waiter *w : waiters_) {
+        if (w->ticket) {
+            delete w;
+        }
+    }
+}
+
+bool fifo_gate::admit_locked()
+{
+    if (!waiters_.empty() || (limit_ && held_ >= limit_)) {
+        return false;
+    }
+    held_++;
+    acquisitions_++;
+    if (limit_ == 1) {
+        held_since_ = monotonic_ns();
+    }
+    return true;
+}
+
+void fifo_gate::enter()
+{
+    std::unique_lock<std::mutex> lk(lock_);
+    waiter w;
+
+    if (admit_locked()) {
+        return;
+    }
+    w.queued_ns = monotonic_ns();
+    waiters_.push_back(&w);
+    contended_++;
+    w.cv.wait(lk, [&] { return w.granted; });
+}
+
+bool fifo_gate::try_enter()
+{
+    std::lock_guard<std::mutex> lk(lock_);
+
+    return admit_locked();
+}
+
+bool fifo_gate::enter_or_queue(uint64_t ticket)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+
+    if (admit_locked()) {
+        return true;
+    }
+    auto w = std::make_unique<waiter>();
+    w->ticket = ticket;
+    w->queued_ns = monotonic_ns();
+    waiters_.push_back(w.release());
+    contended_++;
+    return false;
+}
+
+bool fifo_gate::cancel(uint64_t ticket)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+
+    for (auto it = waiters_.begin(); it != waiters_.end(); ++it) {
+        if ((*it)->ticket == ticket) {
+            delete *it;
+            waiters_.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t fifo_gate::leave()
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    uint64_t now = 0, wait, ticket;
+    waiter *w;
+
+    if (limit_ == 1) {
+        now = monotonic_ns();
+        hold_ns_ += now - held_since_;
+    }
+    if (waiters_.empty()) {
+        held_--;
+        return 0;
+    }
+
+    w = waiters_.front();
+    waiters_.pop_front();
+
+    /* The slot changes hands without being released */
+    if (!now) {
+        now = monotonic_ns();
+    }
+    wait = now - w->queued_ns;
+    wait_ns_ += wait;
+    max_wait_ns_ = std::max(max_wait_ns_, wait);
+    acquisitions_++;
+    held_since_ = now;
+
+    ticket = w->ticket;
+    if (ticket) {
+        delete w;
+    } else {
+        w->granted = true;
+        w->cv.notify_one();
+    }
+    return ticket;
+}
+
+void fifo_gate::stats(simplechar_lock_stats &st)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+
+    st.acquisitions = acquisitions_;
+    st.contended = contended_;
+    st.wait_ns = wait_ns_;
+    st.max_wait_ns = max_wait_ns_;
+    st.hold_ns = hold_ns_;
+    /* Count the hold in progress so samples taken under load add up */
+    if (limit_ == 1 && held_) {
+        st.hold_ns += monotonic_ns() - held_since_;
+    }
+    st.holders = held_;
+    st.waiting = uint32_t(waiters_.size());
+}
+
+void token_bucket::reset(uint64_t rate, uint64_t burst)
+{
+    if (!burst) {
+        burst = rate;
+    }
+    rate_.store(0, std::memory_order_relaxed);
+    burst_.store(burst, std::memory_order_relaxed);
+    tokens_.store(int64_t(burst), std::memory_order_relaxed);
+    last_ns_.store(monotonic_ns(), std::memory_order_relaxed);
+    rate_.store(rate, std::memory_order_release);
+}
+
+uint64_t token_bucket::take(uint64_t cost)
+{
+    uint64_t rate = rate_.load(std::memory_order_acquire);
+    uint64_t burst = burst_.load(std::memory_order_relaxed);
+    uint64_t now, add, last;
+    int64_t cur, next;
+
+    if (!rate) {
+        return 0;
+    }
+
+    /* A request larger than the bucket could never be satisfied */
+    cost = std::min(cost, burst);
+
+    /* Refill: whoever wins the timestamp update adds the elapsed tokens */
+    now = monotonic_ns();
+    last = last_ns_.load(std::memory_order_relaxed);
+    if (now > last) {
+        add = mul_div(now - last, rate, 1000000000ULL);
+        if (add && last_ns_.compare_exchange_strong(last, now)) {
+            cur = tokens_.load(std::memory_order_relaxed);
+            do {
+                next = int64_t(std::min<uint64_t>(uint64_t(cur) + add, burst));
+            } while (!tokens_.compare_exchange_weak(cur, next));
+        }
+    }
+
+    cur = tokens_.fetch_sub(int64_t(cost)) - int64_t(cost);
+    if (cur >= 0) {
+        return 0;
+    }
+
+    /* Not enough tokens: give them back and report the deficit */
+    tokens_.fetch_add(int64_t(cost));
+    return std::max<uint64_t>(mul_div(uint64_t(-cur), 1000000000ULL, rate), 1);
+}
+
+void token_bucket::put_back()
+{
+    if (rate_.load(std::memory_order_relaxed)) {
+        tokens_.fetch_add(1);
+    }
+}
+
+store::store(const store_options &opts)
+    : opts_(opts),
+      io_gate_(1),
+      open_gate_(opts.max_opens),
+      buffer_size_(opts.buffer_size),
+      size_min_(opts.buffer_size),
+      size_max_(opts.autosize ? opts.autosize_max : opts.buffer_size)
+{
+    if (!opts.buffer_size || opts.buffer_size > buffer_size_max) {
+        throw std::invalid_argument("invalid buffer size: " +
+                                    std::to_string(opts.buffer_size) +
+                                    " (max: " + std::to_string(buffer_size_max) + ")");
+    }
+    if (opts.autosize && (opts.autosize_max < opts.buffer_size ||
+                          opts.autosize_max > store_size_max)) {
+        throw std::invalid_argument("invalid autosize_max: " +
+                                    std::to_string(opts.autosize_max) +
+                                    " (range: " + std::to_string(opts.buffer_size) +
+                                    "-" + std::to_string(store_size_max) + ")");
+    }
+    if (opts.trace_events > trace_events_max) {
+        throw std::invalid_argument("invalid trace_events: " +
+                                    std::to_string(opts.trace_events) +
+                                    " (max: " + std::to_string(trace_events_max) + ")");
+    }
+
+    /* Size all tables for the largest store autosize may grow to */
+    pages_.resize(div_round_up(size_max_, store_page_size));
+    page_owner_.resize(pages_.size());
+    block_gen_.resize(div_round_up(size_max_, SIMPLECHAR_DIRTY_BLOCK_SIZE));
+    if (opts.trace_events) {
+        trace_mask_ = roundup_pow_of_two(opts.trace_events) - 1;
+        trace_events_.resize(trace_mask_ + 1);
+    }
+    if (opts.autosize) {
+        sampler_ = std::thread([this] { sampler(); });
+    }
+}
+
+store::~store()
+{
+    if (sampler_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lk(sampler_lock_);
+            stopping_ = true;
+        }
+        sampler_cv_.notify_one();
+        sampler_.join();
+    }
+}
+
+/*
+ * Make sure every page backing [offset, offset + len) exists, charging
+ * new ones to uid against the quota
+ * Must be called with the I/O gate held
+ */
+int store::populate(size_t offset, size_t len, uint32_t uid)
+{
+    size_t first = offset / store_page_size;
+    size_t last = (offset + len - 1) / store_page_size;
+    size_t missing = 0;
+    uint64_t *usage;
+
+    for (size_t i = first; i <= last; i++) {
+        if (!pages_[i]) {
+            missing++;
+        }
+    }
+    if (!missing) {
+        return 0;
+    }
+
+    usage = &uid_usage_[uid];
+    if (opts_.uid_quota && *usage + missing * store_page_size > opts_.uid_quota) {
+        return -EDQUOT;
+    }
+
+    for (size_t i = first; i <= last; i++) {
+        if (pages_[i]) {
+            continue;
+        }
+        pages_[i].reset(new char[store_page_size]());
+        page_owner_[i] = uid;
+        *usage += store_page_size;
+    }
+    return 0;
+}
+
+/*
+ * Copy len bytes at offset out of the store; unwritten pages read as zeros
+ * Must be called with the I/O gate held
+ */
+void store::copy_out(char *dst, size_t offset, size_t len) const
+{
+    while (len) {
+        const char *page = pages_[offset / store_page_size].get();
+        size_t pgoff = offset % store_page_size;
+        size_t chunk = std::min(len, store_page_size - pgoff);
+
+        if (page) {
+            std::memcpy(dst, page + pgoff, chunk);
+        } else {
+            std::memset(dst, 0, chunk);
+        }
+        dst += chunk;
+        offset += chunk;
+        len -= chunk;
+    }
+}
+
+/*
+ * Change the store size, recording the decision in the resize history
+ * Pages entirely beyond the new size are released and uncharged; callers
+ * never shrink below the data length, so those pages hold no data.
+ * Must be called with the I/O gate held
+ */
+void store::resize(size_t new_size, uint32_t reason)
+{
+    size_t old_size = buffer_size_.load(std::memory_order_relaxed);
+    simplechar_resize_event *ev;
+
+    for (size_t i = div_round_up(new_size, store_page_size); i < pages_.size(); i++) {
+        if (!pages_[i]) {
+            continue;
+        }
+        pages_[i].reset();
+        uid_usage_[page_owner_[i]] -= store_page_size;
+    }
+
+    ev = &resize_history_[nr_resizes_ % SIMPLECHAR_RESIZE_HISTORY];
+    ev->time_ns = monotonic_ns();
+    ev->old_size = uint32_t(old_size);
+    ev->new_size = uint32_t(new_size);
+    ev->reason = reason;
+    ev->fill_pct = fill_pct_;
+    nr_resizes_++;
+    buffer_size_.store(new_size, std::memory_order_relaxed);
+}
+
+/*
+ * Grow the store in doubling steps until end fits or the ceiling is hit
+ * Must be called with the I/O gate held
+ */
+void store::grow(size_t end)
+{
+    size_t size = buffer_size_.load(std::memory_order_relaxed);
+    size_t new_size = size;
+
+    while (new_size < end && new_size < size_max_) {
+        new_size = std::min(new_size * 2, size_max_);
+    }
+    if (new_size > size) {
+        resize(new_size, SIMPLECHAR_RESIZE_GROW);
+    }
+}
+
+/*
+ * Count a write refused or cut short at end, the demand autosize grows for
+ * Must be called with the I/O gate held
+ */
+void store::note_full(size_t end)
+{
+    writer_full_++;
+    want_end_ = std::max(want_end_, end);
+}
+
+/*
+ * Tag the blocks covering [offset, offset + len) with a new generation
+ * Must be called with the I/O gate held
+ */
+void store::mark_dirty(size_t offset, size_t len)
+{
+    size_t first = offset >> SIMPLECHAR_DIRTY_BLOCK_SHIFT;
+    size_t last = (offset + len - 1) >> SIMPLECHAR_DIRTY_BLOCK_SHIFT;
+
+    generation_++;
+    for (size_t i = first; i <= last; i++) {
+        block_gen_[i] = generation_;
+    }
+}
+
+ssize_t store::read(void *buf, size_t len, uint64_t &pos)
+{
+    ssize_t bytes_read = 0;
+
+    io_gate_.enter();
+    if (pos >= buffer_len_) {
+        reader_empty_++;
+    } else {
+        bytes_read = ssize_t(std::min<uint64_t>(len, buffer_len_ - pos));
+        copy_out(static_cast<char *>(buf), pos, size_t(bytes_read));
+        pos += uint64_t(bytes_read);
+        access_end_ = std::max<size_t>(access_end_, pos);
+        read_count_++;
+    }
+    io_gate_.leave();
+    return bytes_read;
+}
+
+ssize_t store::write(const void *buf, size_t len, uint64_t &pos, bool append,
+                     uint32_t uid)
+{
+    const char *src = static_cast<const char *>(buf);
+    ssize_t bytes_written = 0;
+    size_t size, offset;
+    int ret;
+
+    io_gate_.enter();
+    if (append) {
+        pos = buffer_len_;
+    }
+
+    /* A write that does not fit is refused; autosize grows for it later */
+    size = buffer_size_.load(std::memory_order_relaxed);
+    if (pos >= size) {
+        note_full(pos + len);
+        bytes_written = -ENOSPC;
+        goto out;
+    }
+
+    bytes_written = ssize_t(std::min<uint64_t>(len, size - pos));
+    if (size_t(bytes_written) < len) {
+        note_full(pos + len);
+    }
+    if (!bytes_written) {
+        goto out;
+    }
+
+    ret = populate(pos, size_t(bytes_written), uid);
+    if (ret) {
+        bytes_written = ret;
+        goto out;
+    }
+
+    offset = pos;
+    for (size_t left = size_t(bytes_written); left;) {
+        size_t pgoff = offset % store_page_size;
+        size_t chunk = std::min(left, store_page_size - pgoff);
+
+        std::memcpy(pages_[offset / store_page_size].get() + pgoff, src, chunk);
+        src += chunk;
+        offset += chunk;
+        left -= chunk;
+    }
+
+    pos += uint64_t(bytes_written);
+    buffer_len_ = std::max<size_t>(buffer_len_, pos);
+    access_end_ = std::max<size_t>(access_end_, pos);
+    mark_dirty(pos - uint64_t(bytes_written), size_t(bytes_written));
+    write_count_++;
+
+out:
+    io_gate_.leave();
+    return bytes_written;
+}
+
+/*
+ * Find the next run of blocks written after since_gen, from block first
+ * Must be called with the I/O gate held
+ */
+bool store::find_dirty(uint64_t since_gen, size_t &first, size_t &next) const
+{
+    size_t nblocks = div_round_up(buffer_len_, SIMPLECHAR_DIRTY_BLOCK_SIZE);
+    size_t i = first;
+
+    while (i < nblocks && block_gen_[i] <= since_gen) {
+        i++;
+    }
+    if (i >= nblocks) {
+        return false;
+    }
+
+    /* Coalesce adjacent dirty blocks into a single range */
+    first = i;
+    while (i < nblocks && block_gen_[i] > since_gen) {
+        i++;
+    }
+    next = i;
+    return true;
+}
+
+int store::get_delta(simplechar_delta &req, char *out)
+{
+    simplechar_delta_range range;
+    size_t first, next, end, record;
+    size_t used = 0;
+
+    if (req.flags) {
+        return -EINVAL;
+    }
+
+    io_gate_.enter();
+    req.nr_ranges = 0;
+    for (first = 0; find_dirty(req.since_gen, first, next); first = next) {
+        end = std::min<size_t>(next << SIMPLECHAR_DIRTY_BLOCK_SHIFT, buffer_len_);
+
+        range.offset = uint32_t(first << SIMPLECHAR_DIRTY_BLOCK_SHIFT);
+        range.length = uint32_t(end - range.offset);
+        record = (sizeof(range) + range.length + SIMPLECHAR_DELTA_ALIGN - 1) &
+                 ~size_t(SIMPLECHAR_DELTA_ALIGN - 1);
+
+        /* Keep counting once the buffer is full to report the needed size */
+        if (used + record <= req.data_len) {
+            std::memcpy(out + used, &range, sizeof(range));
+            copy_out(out + used + sizeof(range), range.offset, range.length);
+        }
+        used += record;
+        req.nr_ranges++;
+    }
+    req.generation = generation_;
+    req.data_size = buffer_len_;
+    req.bytes_used = uint32_t(used);
+    io_gate_.leave();
+
+    return used > req.data_len ? -ENOSPC : 0;
+}
+
+int store::get_uid_usage(simplechar_uid_usage_info &info, uint32_t caller)
+{
+    if (info.uid == SIMPLECHAR_UID_SELF) {
+        info.uid = caller;
+    }
+    info.bytes = 0;
+    info.quota = opts_.uid_quota;
+
+    io_gate_.enter();
+    auto it = uid_usage_.find(info.uid);
+    if (it != uid_usage_.end()) {
+        info.bytes = it->second;
+    }
+    io_gate_.leave();
+    return 0;
+}
+
+void store::get_autosize(simplechar_autosize_info &info)
+{
+    uint64_t first;
+
+    info = {};
+    io_gate_.enter();
+    info.enabled = opts_.autosize;
+    info.size = uint32_t(buffer_size_.load(std::memory_order_relaxed));
+    info.min_size = uint32_t(size_min_);
+    info.max_size = uint32_t(size_max_);
+    info.writer_full = writer_full_;
+    info.reader_empty = reader_empty_;
+    info.writer_full_rate = writer_full_rate_;
+    info.reader_empty_rate = reader_empty_rate_;
+    info.fill_pct = fill_pct_;
+    info.nr_resizes = nr_resizes_;
+
+    first = nr_resizes_ > SIMPLECHAR_RESIZE_HISTORY ?
+            nr_resizes_ - SIMPLECHAR_RESIZE_HISTORY : 0;
+    for (uint64_t i = first; i < nr_resizes_; i++) {
+        info.events[info.nr_events++] =
+            resize_history_[i % SIMPLECHAR_RESIZE_HISTORY];
+    }
+    io_gate_.leave();
+}
+
+void store::get_lock_stats(simplechar_lock_info &info)
+{
+    info = {};
+    io_gate_.stats(info.io);
+    open_gate_.stats(info.open);
+}
+
+int store::read_trace(simplechar_trace_read &req, simplechar_trace_event *out)
+{
+    uint64_t oldest, seq;
+    uint32_t n;
+
+    if (trace_events_.empty()) {
+        return -ENODEV;
+    }
+
+    std::lock_guard<std::mutex> lk(trace_lock_);
+    n = std::min<uint32_t>(req.max_events, SIMPLECHAR_TRACE_BATCH);
+    oldest = trace_head_ > trace_mask_ + 1 ? trace_head_ - (trace_mask_ + 1) : 0;
+    seq = std::max<uint64_t>(req.seq, oldest);
+    req.dropped = seq - std::min<uint64_t>(req.seq, seq);
+    req.head = trace_head_;
+    n = uint32_t(std::min<uint64_t>(n, trace_head_ > seq ? trace_head_ - seq : 0));
+    for (uint32_t i = 0; i < n; i++) {
+        out[i] = trace_events_[(seq + i) & trace_mask_];
+    }
+    req.nr_events = n;
+    req.seq = seq + n;
+    return 0;
+}
+
+uint64_t store::trace_start() const
+{
+    if (trace_events_.empty() || !opts_.trace) {
+        return 0;
+    }
+    return monotonic_ns();
+}
+
+void store::trace_record(const open_file *f, uint16_t op, uint64_t start,
+                         uint64_t offset, size_t size, long result,
+                         uint32_t pid, bool nonblock)
+{
+    simplechar_trace_event *ev;
+    uint64_t now;
+
+    if (!start) {
+        return;
+    }
+    now = monotonic_ns();
+
+    std::lock_guard<std::mutex> lk(trace_lock_);
+    ev = &trace_events_[trace_head_ & trace_mask_];
+    ev->time_ns = start;
+    ev->offset = offset;
+    ev->size = uint32_t(std::min<size_t>(size, UINT32_MAX));
+    ev->result = int32_t(result);
+    ev->duration_ns = uint32_t(std::min<uint64_t>(now - start, UINT32_MAX));
+    ev->gap_ns = trace_last_ns_ && start > trace_last_ns_ ?
+                 uint32_t(std::min<uint64_t>(start - trace_last_ns_, UINT32_MAX)) : 0;
+    ev->open_id = f ? f->open_id : 0;
+    ev->pid = pid;
+    ev->op = op;
+    ev->flags = nonblock ? SIMPLECHAR_TRACE_NONBLOCK : 0;
+    ev->reserved = 0;
+    trace_last_ns_ = std::max(trace_last_ns_, start);
+    trace_head_++;
+}
+
+/*
+ * Periodic autosize sample
+ * Updates the blocked reader/writer rates and the fill level, a decaying
+ * high-water mark of the data read and written. Writers that ran out of
+ * space grow the store to fit the largest of their writes; after
+ * autosize_shrink_samples consecutive samples with low fill and no
+ * writer running out of space the store is halved, never below the
+ * high-water mark or the data length, as in the driver.
+ */
+void store::sample()
+{
+    unsigned interval_ms = std::max(opts_.autosize_interval_ms, 10U);
+    uint64_t full, empty;
+    size_t size, target;
+
+    io_gate_.enter();
+    size = buffer_size_.load(std::memory_order_relaxed);
+    full = writer_full_ - last_writer_full_;
+    empty = reader_empty_ - last_reader_empty_;
+    last_writer_full_ = writer_full_;
+    last_reader_empty_ = reader_empty_;
+    writer_full_rate_ = uint32_t(full * 1000 / interval_ms);
+    reader_empty_rate_ = uint32_t(empty * 1000 / interval_ms);
+    high_water_ -= high_water_ >> autosize_decay_shift;
+    high_water_ = std::max(high_water_, access_end_);
+    access_end_ = 0;
+    fill_pct_ = uint32_t(std::min(high_water_, size) * 100 / size);
+
+    if (full) {
+        low_fill_samples_ = 0;
+        if (want_end_ > size) {
+            grow(want_end_);
+        }
+    } else if (fill_pct_ < autosize_shrink_pct) {
+        low_fill_samples_++;
+    } else {
+        low_fill_samples_ = 0;
+    }
+    want_end_ = 0;
+
+    if (low_fill_samples_ >= autosize_shrink_samples) {
+        size = buffer_size_.load(std::memory_order_relaxed);
+        target = std::max({size_min_, size / 2,
+                           div_round_up(std::max(high_water_, buffer_len_),
+                                        store_page_size) * store_page_size});
+        if (target < size) {
+            resize(target, SIMPLECHAR_RESIZE_SHRINK);
+        }
+        low_fill_samples_ = 0;
+    }
+    io_gate_.leave();
+}
+
+void store::sampler()
+{
+    auto interval = std::chrono::milliseconds(std::max(opts_.autosize_interval_ms, 10U));
+    std::unique_lock<std::mutex> lk(sampler_lock_);
+
+    while (!sampler_cv_.wait_for(lk, interval, [this] { return stopping_; })) {
+        lk.unlock();
+        sample();
+        lk.lock();
+    }
+}
+
+} /* namespace simplechar::cuse */
@@ -0,0 +1,273 @@
+/*
+ * store.h - The SimpleChar store, in user space
+ *
+ * simplechar-cuse serves /dev/simplechar from this process instead of
+ * the kernel. The store here follows src/simplechar.c operation for
+ * operation so a client cannot tell the two apart through read(),
+ * write() and the ioctls of simplechar_ioctl.h:
+ *
+ *   - one FIFO I/O gate serializes every access, and a second one of
+ *     max_opens slots admits opens in arrival order
+ *   - backing pages come on first write, charged to the writer's uid
+ *     against uid_quota
+ *   - every write bumps the generation and tags its 64-byte blocks for
+ *     SIMPLECHAR_IOC_GET_DELTA
+ *   - a sampling thread grows the store in doubling steps for writers
+ *     that ran out of space, and halves it after a run of low-fill
+ *     samples
+ *   - the operation trace keeps the last trace_events opens, closes,
+ *     reads and writes
+ *
+ * Per-open rate limits live in open_file; the server charges them
+ * before calling into the store, as device_read() does before
+ * simplechar_do_read().
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_CUSE_STORE_H
+#define SIMPLECHAR_CUSE_STORE_H
+
+#include "simplechar_ioctl.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace simplechar::cuse {
+
+/* The module's limits on its parameters */
+constexpr size_t buffer_size_max = 4096;
+constexpr size_t store_size_max = 4 << 20;
+constexpr unsigned trace_events_max = 1 << 20;
+
+/* Unit of backing store allocation and of quota charges */
+constexpr size_t store_page_size = 4096;
+
+uint64_t monotonic_ns();
+
+/* The module parameters that shape the store, with the same defaults */
+struct store_options {
+    size_t buffer_size = 1024;
+    unsigned max_opens = 0;         /* 0 = unlimited */
+    uint64_t uid_quota = 0;         /* Bytes per uid, 0 = unlimited */
+    bool autosize = false;
+    size_t autosize_max = 64 * 1024;
+    unsigned autosize_interval_ms = 1000;
+    unsigned trace_events = 0;      /* 0 = no trace ring */
+    bool trace = false;
+};
+
+/*
+ * FIFO gate
+ * Admits up to limit holders at a time. When full, callers queue in
+ * arrival order and a leaving holder hands its slot directly to the
+ * oldest waiter. A waiter is either a thread blocked in enter() or a
+ * ticket from enter_or_queue(), whose request is answered by whoever
+ * leave() hands the slot to; opens are queued that way so that a
+ * waiting open does not hold a server thread.
+ */
+class fifo_gate {
+public:
+    explicit fifo_gate(unsigned limit);
+    ~fifo_gate();
+
+    fifo_gate(const fifo_gate &) = delete;
+    fifo_gate &operator=(const fifo_gate &) = delete;
+
+    void enter();
+
+    /* Admit the caller if that needs no queueing */
+    bool try_enter();
+
+    /* Admit the caller, or queue ticket (non-zero) and return false */
+    bool enter_or_queue(uint64_t ticket);
+
+    /* Take a queued ticket out of the queue; false if it was handed a slot */
+    bool cancel(uint64_t ticket);
+
+    /* Returns the ticket handed the slot, 0 if none or a blocked thread */
+    uint64_t leave();
+
+    void stats(simplechar_lock_stats &st);
+
+private:
+    struct waiter {
+        uint64_t ticket = 0;        /* 0 for a thread in enter() */
+        uint64_t queued_ns = 0;
+        bool granted = false;
+        std::condition_variable cv;
+    };
+
+    bool admit_locked();
+
+    std::mutex lock_;
+    unsigned held_ = 0;
+    unsigned limit_;                /* Maximum holders, 0 = unlimited */
+    std::list<waiter *> waiters_;   /* Oldest first; tickets are owned here */
+    uint64_t acquisitions_ = 0;
+    uint64_t contended_ = 0;
+    uint64_t wait_ns_ = 0;
+    uint64_t max_wait_ns_ = 0;
+    uint64_t hold_ns_ = 0;          /* When limit is 1 */
+    uint64_t held_since_ = 0;
+};
+
+/* Token bucket for per-open rate limiting, updated without locks */
+class token_bucket {
+public:
+    /* A rate of 0 disables the bucket; a burst of 0 means one second worth */
+    void reset(uint64_t rate, uint64_t burst);
+
+    /* 0 if cost tokens were taken, otherwise nanoseconds until there are */
+    uint64_t take(uint64_t cost);
+
+    /* Return one token taken by take(1) */
+    void put_back();
+
+    uint64_t rate() const { return rate_.load(std::memory_order_relaxed); }
+    uint64_t burst() const { return burst_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> tokens_{0};
+    std::atomic<uint64_t> last_ns_{0};
+    std::atomic<uint64_t> rate_{0};
+    std::atomic<uint64_t> burst_{0};
+};
+
+/* Per-open state, the counterpart of struct simplechar_file */
+struct open_file {
+    token_bucket ops;               /* Operations per second */
+    token_bucket bytes;             /* Bytes per second */
+    std::atomic<uint64_t> throttled_ns{0};
+    std::atomic<uint64_t> throttled_ops{0};
+    std::atomic<uint64_t> rejected_ops{0};
+    uint32_t open_id = 0;           /* Names this open in the trace */
+
+    /* File position, for servers that keep one per open */
+    std::mutex pos_lock;
+    uint64_t pos = 0;
+};
+
+class store {
+public:
+    /* Throws std::invalid_argument for options the module would refuse */
+    explicit store(const store_options &opts);
+
+    /* Stops the autosize sampler */
+    ~store();
+
+    store(const store &) = delete;
+    store &operator=(const store &) = delete;
+
+    fifo_gate &open_gate() { return open_gate_; }
+    uint32_t next_open_id() { return ++next_open_id_; }
+
+    /* Current store size, read without the gate to size QoS charges */
+    size_t size() const { return buffer_size_.load(std::memory_order_relaxed); }
+
+    /*
+     * Read up to len bytes at pos, advancing pos
+     * Returns the bytes read or a negative errno, like simplechar_do_read()
+     */
+    ssize_t read(void *buf, size_t len, uint64_t &pos);
+
+    /*
+     * Write len bytes at pos, or at the end of the data when append is
+     * set, and advance pos past them; new pages are charged to uid
+     * Returns the bytes written or a negative errno
+     */
+    ssize_t write(const void *buf, size_t len, uint64_t &pos, bool append,
+                  uint32_t uid);
+
+    /* The ioctl handlers; out buffers are the caller's copies */
+    int get_delta(simplechar_delta &req, char *out);
+    int get_uid_usage(simplechar_uid_usage_info &info, uint32_t caller);
+    void get_autosize(simplechar_autosize_info &info);
+    void get_lock_stats(simplechar_lock_info &info);
+
+    /* out holds min(req.max_events, SIMPLECHAR_TRACE_BATCH) events */
+    int read_trace(simplechar_trace_read &req, simplechar_trace_event *out);
+
+    /* Start timing an operation for the trace; 0 when not recording */
+    uint64_t trace_start() const;
+
+    /* Append one operation to the trace ring; start is from trace_start() */
+    void trace_record(const open_file *f, uint16_t op, uint64_t start,
+                      uint64_t offset, size_t size, long result,
+                      uint32_t pid, bool nonblock);
+
+    void add_throttled_ns(uint64_t ns)
+    {
+        throttled_ns_.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+private:
+    int populate(size_t offset, size_t len, uint32_t uid);
+    void resize(size_t new_size, uint32_t reason);
+    void grow(size_t end);
+    void note_full(size_t end);
+    void mark_dirty(size_t offset, size_t len);
+    bool find_dirty(uint64_t since_gen, size_t &first, size_t &next) const;
+    void copy_out(char *dst, size_t offset, size_t len) const;
+    void sample();
+    void sampler();
+
+    const store_options opts_;
+    fifo_gate io_gate_;
+    fifo_gate open_gate_;
+    std::atomic<uint32_t> next_open_id_{0};
+    std::atomic<uint64_t> throttled_ns_{0};
+
+    /* Everything below is protected by io_gate_ */
+    std::vector<std::unique_ptr<char[]>> pages_;
+    std::vector<uint32_t> page_owner_;
+    std::unordered_map<uint32_t, uint64_t> uid_usage_;  /* Bytes per uid */
+    std::vector<uint64_t> block_gen_;
+    size_t buffer_len_ = 0;
+    std::atomic<size_t> buffer_size_;
+    size_t size_min_;
+    size_t size_max_;
+    uint64_t generation_ = 0;
+    uint64_t read_count_ = 0;
+    uint64_t write_count_ = 0;
+    uint64_t writer_full_ = 0;
+    uint64_t reader_empty_ = 0;
+    uint64_t last_writer_full_ = 0;
+    uint64_t last_reader_empty_ = 0;
+    uint32_t writer_full_rate_ = 0;
+    uint32_t reader_empty_rate_ = 0;
+    uint32_t fill_pct_ = 0;
+    size_t access_end_ = 0;         /* Highest end read or written this sample */
+    size_t high_water_ = 0;         /* Decaying high-water mark of access_end_ */
+    size_t want_end_ = 0;           /* Largest end a write ran out of space for */
+    unsigned low_fill_samples_ = 0;
+    uint64_t nr_resizes_ = 0;
+    simplechar_resize_event resize_history_[SIMPLECHAR_RESIZE_HISTORY] = {};
+
+    /* Operation trace, under its own lock */
+    std::mutex trace_lock_;
+    std::vector<simplechar_trace_event> trace_events_;
+    uint64_t trace_mask_ = 0;
+    uint64_t trace_head_ = 0;
+    uint64_t trace_last_ns_ = 0;
+
+    /* Autosize sampler */
+    std::mutex sampler_lock_;
+    std::condition_variable sampler_cv_;
+    bool stopping_ = false;
+    std::thread sampler_;
+};
+
+} /* namespace simplechar::cuse */
+
+#endif /* SIMPLECHAR_CUSE_STORE_H */
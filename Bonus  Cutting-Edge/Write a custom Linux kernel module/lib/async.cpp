@@ -0,0 +1,380 @@
+/*
+ * async.cpp - C++20 coroutine API for the SimpleChar device
+ *
+ * License: MIT
+ */
+
+#include "async.h"
+#include "probes.h"
+#include "uring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+
+#include <sys/mman.h>
+
+namespace simplechar {
+
+namespace {
+
+thread_local scheduler *current_scheduler = nullptr;
+
+std::error_code errno_code(int err)
+{
+    return std::error_code(err, std::generic_category());
+}
+
+} /* namespace */
+
+/* Frame of a spawned task; the scheduler resumes it on its first tick */
+struct scheduler::detached {
+    struct promise_type {
+        detached get_return_object() noexcept
+        {
+            return {std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> h;
+};
+
+scheduler::detached scheduler::start(scheduler *sched, task<> t)
+{
+    try {
+        co_await std::move(t);
+    } catch (...) {
+        if (!sched->error_) {
+            sched->error_ = std::current_exception();
+        }
+    }
+    sched->live_--;
+}
+
+scheduler::scheduler(const scheduler_options &opts) : opts_(opts)
+{
+    if (current_scheduler) {
+        throw std::logic_error("thread already has a simplechar scheduler");
+    }
+    ring_ = std::make_unique<uring>(opts.ring_entries);
+
+    /* A sparse table; async_device fills in slots */
+    files_.assign(opts.max_files, -1);
+    files_registered_ = opts.max_files &&
+                        ring_->register_files(files_.data(), opts.max_files) == 0;
+
+    if (opts.buffers && opts.buffer_size) {
+        size_t len = opts.buffers * opts.buffer_size;
+        void *p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "mmap buffers");
+        }
+        buf_region_ = static_cast<char *>(p);
+        buf_region_len_ = len;
+
+        std::vector<iovec> iov(opts.buffers);
+        for (unsigned i = 0; i < opts.buffers; i++) {
+            iov[i] = {buf_region_ + i * opts.buffer_size, opts.buffer_size};
+        }
+        /* Pinning can fail under RLIMIT_MEMLOCK; the leases still work */
+        if (ring_->register_buffers(iov.data(), opts.buffers) == 0) {
+            for (unsigned i = opts.buffers; i > 0; i--) {
+                free_buffers_.push_back(i - 1);
+            }
+        } else {
+            ::munmap(buf_region_, buf_region_len_);
+            buf_region_ = nullptr;
+            buf_region_len_ = 0;
+        }
+    }
+
+    ready_.reserve(opts.ring_entries);
+    running_.reserve(opts.ring_entries);
+    current_scheduler = this;
+}
+
+scheduler::~scheduler()
+{
+    /* The ring goes first, so no operation can land in the buffers */
+    ring_.reset();
+    if (buf_region_) {
+        ::munmap(buf_region_, buf_region_len_);
+    }
+    current_scheduler = nullptr;
+}
+
+scheduler &scheduler::current()
+{
+    if (!current_scheduler) {
+        throw std::logic_error("no simplechar scheduler on this thread");
+    }
+    return *current_scheduler;
+}
+
+void scheduler::spawn(task<> t)
+{
+    live_++;
+    ready_.push_back(start(this, std::move(t)).h);
+}
+
+void scheduler::run()
+{
+    for (;;) {
+        /* Resume everything runnable; their I/O queues up behind them */
+        running_.swap(ready_);
+        for (std::coroutine_handle<> h : running_) {
+            h.resume();
+        }
+        running_.clear();
+
+        if (!ready_.empty()) {
+            /* More runnable work: submit what is queued but don't wait */
+            if (ring_->pending()) {
+                ring_->submit_and_wait(0);
+                stats_.enters++;
+            }
+        } else if (inflight_) {
+            int ret = ring_->submit_and_wait(1);
+            stats_.enters++;
+            /* EBUSY: completions overflowed, reaping below makes room */
+            if (ret < 0 && ret != -EBUSY && ret != -EAGAIN) {
+                throw std::system_error(-ret, std::generic_category(),
+                                        "io_uring_enter");
+            }
+        } else {
+            /* Nothing runnable or in flight: done, or stuck on a foreign awaitable */
+            break;
+        }
+        reap();
+        stats_.ticks++;
+    }
+
+    if (error_) {
+        std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+}
+
+/*
+ * A free SQE, submitting the queue when it is full
+ * The kernel may take only part of the queue, or none of it with EBUSY
+ * while completions overflow. Then what has completed is reaped, waiting
+ * for a completion if none has, until a slot frees up; completions that
+ * resubmit come back here, each one with a completion fewer to reap.
+ */
+io_uring_sqe *scheduler::get_sqe()
+{
+    io_uring_sqe *sqe;
+
+    while (!(sqe = ring_->get_sqe())) {
+        int ret = ring_->submit_and_wait(0);
+        stats_.enters++;
+        if (ret < 0 && ret != -EBUSY && ret != -EAGAIN) {
+            throw std::system_error(-ret, std::generic_category(),
+                                    "io_uring_enter");
+        }
+        if (ret > 0) {
+            continue;
+        }
+        if (!ring_->peek_cqe()) {
+            ret = ring_->submit_and_wait(1);
+            stats_.enters++;
+            if (ret < 0 && ret != -EBUSY && ret != -EAGAIN) {
+                throw std::system_error(-ret, std::generic_category(),
+                                        "io_uring_enter");
+            }
+        }
+        reap();
+    }
+    inflight_++;
+    stats_.ops++;
+    return sqe;
+}
+
+void scheduler::submit(io_op &op)
+{
+    io_uring_sqe *sqe = get_sqe();
+    const async_device &dev = *op.dev_;
+    int index = fixed_index(op.data_, op.len_);
+
+    if (index >= 0) {
+        sqe->opcode = op.write_ ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = uint16_t(index);
+        stats_.fixed_buffer_ops++;
+    } else {
+        sqe->opcode = op.write_ ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    if (dev.slot_ >= 0) {
+        sqe->fd = dev.slot_;
+        sqe->flags = IOSQE_FIXED_FILE;
+        stats_.fixed_file_ops++;
+    } else {
+        sqe->fd = dev.dev_->fd();
+    }
+    sqe->addr = uint64_t(uintptr_t(op.data_));
+    sqe->len = uint32_t(op.len_);
+    sqe->off = op.offset_;
+    sqe->user_data = uint64_t(uintptr_t(&op));
+    SIMPLECHAR_PROBE(op__submit, dev.dev_->fd(), op.write_, op.len_,
+                     op.offset_, &op);
+}
+
+/* A pure timer: completes with -ETIME after the backoff */
+void scheduler::submit_backoff(io_op &op)
+{
+    const retry_policy &policy = op.dev_->dev_->options().retry;
+    auto wait = std::min(policy.backoff * (1 << std::min(op.attempts_ - 1, 20)),
+                         policy.max_backoff);
+    io_uring_sqe *sqe = get_sqe();
+
+    op.backoff_.tv_sec = wait.count() / 1000000;
+    op.backoff_.tv_nsec = (wait.count() % 1000000) * 1000;
+    op.sleeping_ = true;
+    SIMPLECHAR_PROBE(backoff, EAGAIN, op.attempts_, wait.count());
+
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = uint64_t(uintptr_t(&op.backoff_));
+    sqe->len = 1;
+    sqe->user_data = uint64_t(uintptr_t(&op));
+}
+
+void scheduler::complete(io_op &op, int res)
+{
+    inflight_--;
+    if (op.sleeping_) {
+        op.sleeping_ = false;
+        stats_.retries++;
+        submit(op);
+        return;
+    }
+    if (res == -EINTR) {
+        stats_.retries++;
+        submit(op);
+        return;
+    }
+    if (res == -EAGAIN &&
+        ++op.attempts_ < op.dev_->dev_->options().retry.attempts) {
+        submit_backoff(op);
+        return;
+    }
+
+    if (res >= 0) {
+        op.result_ = {size_t(res), {}};
+    } else {
+        op.result_ = {0, errno_code(-res)};
+    }
+    SIMPLECHAR_PROBE(op__complete, op.dev_->dev_->fd(), op.write_, res, &op);
+    ready_.push_back(op.waiter_);
+}
+
+void scheduler::reap()
+{
+    while (io_uring_cqe *cqe = ring_->peek_cqe()) {
+        io_op &op = *reinterpret_cast<io_op *>(uintptr_t(cqe->user_data));
+        int res = cqe->res;
+
+        ring_->cqe_seen();
+        complete(op, res);
+    }
+}
+
+int scheduler::register_file(int fd) noexcept
+{
+    if (!files_registered_) {
+        return -1;
+    }
+    auto it = std::find(files_.begin(), files_.end(), -1);
+    if (it == files_.end()) {
+        return -1;
+    }
+    int slot = int(it - files_.begin());
+    if (ring_->update_files(unsigned(slot), &fd, 1) < 0) {
+        return -1;
+    }
+    *it = fd;
+    return slot;
+}
+
+void scheduler::unregister_file(int slot) noexcept
+{
+    int none = -1;
+
+    if (slot >= 0 && ring_) {
+        ring_->update_files(unsigned(slot), &none, 1);
+        files_[size_t(slot)] = -1;
+    }
+}
+
+/* Registered buffer holding all of [data, data + len), or -1 */
+int scheduler::fixed_index(const char *data, size_t len) const noexcept
+{
+    if (!buf_region_ || data < buf_region_ ||
+        data + len > buf_region_ + buf_region_len_) {
+        return -1;
+    }
+    size_t first = size_t(data - buf_region_) / opts_.buffer_size;
+    size_t last = (size_t(data - buf_region_) + len - (len ? 1 : 0)) /
+                  opts_.buffer_size;
+    return first == last ? int(first) : -1;
+}
+
+fixed_buffer scheduler::lease_buffer() noexcept
+{
+    if (free_buffers_.empty()) {
+        return {};
+    }
+    unsigned index = free_buffers_.back();
+    free_buffers_.pop_back();
+    return fixed_buffer(this, index, buf_region_ + index * opts_.buffer_size,
+                        opts_.buffer_size);
+}
+
+void scheduler::release_buffer(unsigned index) noexcept
+{
+    free_buffers_.push_back(index);
+}
+
+fixed_buffer &fixed_buffer::operator=(fixed_buffer &&other) noexcept
+{
+    if (this != &other) {
+        if (sched_) {
+            sched_->release_buffer(index_);
+        }
+        sched_ = std::exchange(other.sched_, nullptr);
+        index_ = other.index_;
+        data_ = other.data_;
+        size_ = other.size_;
+    }
+    return *this;
+}
+
+fixed_buffer::~fixed_buffer()
+{
+    if (sched_) {
+        sched_->release_buffer(index_);
+    }
+}
+
+void io_op::await_suspend(std::coroutine_handle<> h)
+{
+    waiter_ = h;
+    sched_->submit(*this);
+}
+
+async_device::async_device(device &dev, scheduler &sched)
+    : dev_(&dev), sched_(&sched), slot_(sched.register_file(dev.fd()))
+{
+}
+
+async_device::~async_device()
+{
+    sched_->unregister_file(slot_);
+}
+
+} /* namespace simplechar */
@@ -0,0 +1,397 @@
+/*
+ * async.h - C++20 coroutine API for the SimpleChar device
+ *
+ * Lets coroutine code await device I/O instead of parking a thread in a
+ * blocking read() or write():
+ *
+ *   simplechar::task<> echo(simplechar::async_device &adev)
+ *   {
+ *       char buf[256];
+ *       auto r = co_await adev.read(buf, 0);     // r.bytes, r.error
+ *       co_await adev.write(buf, 4096);
+ *   }
+ *
+ *   simplechar::scheduler sched;                 // One per thread
+ *   auto dev = simplechar::device::open("/dev/simplechar");
+ *   simplechar::async_device adev(dev);
+ *   sched.spawn(echo(adev));
+ *   sched.spawn([&]() -> simplechar::task<> {    // The callable, not a call:
+ *       co_await echo(adev);                     // spawn keeps it alive
+ *   });
+ *   sched.run();                                 // Until all tasks finish
+ *
+ * Tasks start lazily, so a coroutine lambda called on the spot, as in
+ * spawn([&]() -> task<> { ... }()), is destroyed before its body runs
+ * and leaves the body with dangling captures. Pass the lambda itself, or
+ * write a coroutine function that takes its state as parameters.
+ *
+ * The scheduler owns the thread's io_uring. Each pass of run() resumes
+ * every runnable coroutine, then submits all the reads and writes they
+ * queued with a single io_uring_enter() and collects completions. Device
+ * fds go into the ring's registered file table, and buffers leased from
+ * the scheduler are registered buffers, so those operations skip the
+ * per-call fd and page lookups in the kernel.
+ *
+ * EINTR is resubmitted at once. EAGAIN from the QoS limits of a
+ * non-blocking open is resubmitted after a ring timeout, following the
+ * device's retry policy, so no thread sleeps.
+ *
+ * Requires C++20. Everything here belongs to the thread that created
+ * the scheduler, which must outlive its async_devices and be run() to
+ * completion before it is destroyed.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_ASYNC_H
+#define SIMPLECHAR_ASYNC_H
+
+#if __cplusplus < 202002L
+#error "async.h needs C++20 coroutines"
+#endif
+
+#include "simplechar.h"
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <linux/time_types.h>
+
+struct io_uring_sqe;
+
+namespace simplechar {
+
+class scheduler;
+class async_device;
+
+template <typename T = void>
+class task;
+
+namespace detail {
+
+struct promise_base {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr error;
+
+    struct final_awaiter {
+        bool await_ready() const noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+        {
+            return h.promise().continuation;
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    final_awaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+};
+
+template <typename T>
+struct promise : promise_base {
+    std::optional<T> value;
+
+    task<T> get_return_object() noexcept;
+    template <typename U>
+    void return_value(U &&v) { value.emplace(std::forward<U>(v)); }
+    T take()
+    {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value);
+    }
+};
+
+template <>
+struct promise<void> : promise_base {
+    task<void> get_return_object() noexcept;
+    void return_void() const noexcept {}
+    void take() const
+    {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+} /* namespace detail */
+
+/*
+ * A lazily started coroutine returning T
+ * It runs when awaited, and the awaiter resumes when it finishes.
+ */
+template <typename T>
+class [[nodiscard]] task {
+public:
+    using promise_type = detail::promise<T>;
+
+    task() noexcept = default;
+    explicit task(std::coroutine_handle<promise_type> h) noexcept : h_(h) {}
+    task(task &&other) noexcept : h_(std::exchange(other.h_, {})) {}
+    task &operator=(task &&other) noexcept
+    {
+        if (this != &other) {
+            if (h_) {
+                h_.destroy();
+            }
+            h_ = std::exchange(other.h_, {});
+        }
+        return *this;
+    }
+    ~task()
+    {
+        if (h_) {
+            h_.destroy();
+        }
+    }
+
+    auto operator co_await() && noexcept
+    {
+        struct awaiter {
+            std::coroutine_handle<promise_type> h;
+
+            bool await_ready() const noexcept { return !h || h.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> cont) noexcept
+            {
+                h.promise().continuation = cont;
+                return h;
+            }
+            T await_resume() { return h.promise().take(); }
+        };
+        return awaiter{h_};
+    }
+
+private:
+    std::coroutine_handle<promise_type> h_;
+};
+
+namespace detail {
+
+template <typename T>
+task<T> promise<T>::get_return_object() noexcept
+{
+    return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+}
+
+inline task<void> promise<void>::get_return_object() noexcept
+{
+    return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+}
+
+} /* namespace detail */
+
+/*
+ * One read or write in flight
+ * Returned by async_device and meant to be awaited at once; it must stay
+ * put until it completes, which co_await guarantees.
+ */
+class [[nodiscard]] io_op {
+public:
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h);
+    io_result await_resume() const noexcept { return result_; }
+
+private:
+    friend class scheduler;
+    friend class async_device;
+
+    io_op(scheduler &sched, const async_device &dev, bool write,
+          char *data, size_t len, uint64_t offset) noexcept
+        : sched_(&sched), dev_(&dev), write_(write), data_(data), len_(len),
+          offset_(offset) {}
+
+    scheduler *sched_;
+    const async_device *dev_;
+    bool write_;
+    char *data_;
+    size_t len_;
+    uint64_t offset_;
+
+    std::coroutine_handle<> waiter_;
+    io_result result_;
+    int attempts_ = 0;
+    bool sleeping_ = false;         /* A backoff timeout is in flight */
+    __kernel_timespec backoff_{};
+};
+
+/*
+ * A buffer registered with the scheduler's ring
+ * Converts to mutable_buffer and const_buffer like any contiguous
+ * container. Reads and writes that stay within one lease use the
+ * fixed-buffer opcodes. Returned to the scheduler on destruction.
+ */
+class fixed_buffer {
+public:
+    fixed_buffer() noexcept = default;
+    fixed_buffer(fixed_buffer &&other) noexcept
+        : sched_(std::exchange(other.sched_, nullptr)), index_(other.index_),
+          data_(other.data_), size_(other.size_) {}
+    fixed_buffer &operator=(fixed_buffer &&other) noexcept;
+    fixed_buffer(const fixed_buffer &) = delete;
+    fixed_buffer &operator=(const fixed_buffer &) = delete;
+    ~fixed_buffer();
+
+    explicit operator bool() const noexcept { return sched_ != nullptr; }
+    char *data() const noexcept { return data_; }
+    size_t size() const noexcept { return size_; }
+
+private:
+    friend class scheduler;
+
+    fixed_buffer(scheduler *sched, unsigned index, char *data, size_t size) noexcept
+        : sched_(sched), index_(index), data_(data), size_(size) {}
+
+    scheduler *sched_ = nullptr;
+    unsigned index_ = 0;
+    char *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+struct scheduler_options {
+    unsigned ring_entries = 256;    /* Operations one tick can submit */
+    unsigned max_files = 64;        /* Registered file table slots */
+    unsigned buffers = 0;           /* Registered buffers to lease */
+    size_t buffer_size = 64 * 1024;
+};
+
+struct scheduler_stats {
+    uint64_t ticks = 0;             /* Passes of the event loop */
+    uint64_t enters = 0;            /* io_uring_enter() calls */
+    uint64_t ops = 0;               /* SQEs submitted, retries included */
+    uint64_t fixed_file_ops = 0;
+    uint64_t fixed_buffer_ops = 0;
+    uint64_t retries = 0;           /* EINTR and EAGAIN resubmissions */
+};
+
+/*
+ * The per-thread event loop
+ * Constructing one makes it the thread's current scheduler; there can
+ * be only one per thread at a time. Throws std::system_error if the ring
+ * cannot be set up and std::logic_error if the thread already has one.
+ */
+class scheduler {
+public:
+    explicit scheduler(const scheduler_options &opts = {});
+    ~scheduler();
+    scheduler(const scheduler &) = delete;
+    scheduler &operator=(const scheduler &) = delete;
+
+    /* The calling thread's scheduler; throws std::logic_error if none */
+    static scheduler &current();
+
+    /* Start t on the next tick; run() waits for it */
+    void spawn(task<> t);
+
+    /*
+     * Start fn() on the next tick, keeping fn, and with it a lambda's
+     * captures, alive until the task it returns has finished
+     */
+    template <typename F,
+              typename = std::enable_if_t<std::is_invocable_r_v<task<>, F &>>>
+    void spawn(F fn)
+    {
+        spawn(call(std::move(fn)));
+    }
+
+    /*
+     * Run until every spawned task has finished
+     * Rethrows the first exception that escaped a spawned task.
+     */
+    void run();
+
+    /* Lease a registered buffer; empty if all are taken or none exist */
+    fixed_buffer lease_buffer() noexcept;
+
+    const scheduler_stats &stats() const noexcept { return stats_; }
+
+private:
+    friend class io_op;
+    friend class fixed_buffer;
+    friend class async_device;
+
+    struct detached;
+    static detached start(scheduler *sched, task<> t);
+
+    /* fn lives in this coroutine's frame while the task it returns runs */
+    template <typename F>
+    static task<> call(F fn)
+    {
+        co_await fn();
+    }
+
+    void submit(io_op &op);
+    void submit_backoff(io_op &op);
+    io_uring_sqe *get_sqe();
+    void complete(io_op &op, int res);
+    void reap();
+
+    int register_file(int fd) noexcept;
+    void unregister_file(int slot) noexcept;
+    int fixed_index(const char *data, size_t len) const noexcept;
+    void release_buffer(unsigned index) noexcept;
+
+    scheduler_options opts_;
+    std::unique_ptr<uring> ring_;
+    std::vector<std::coroutine_handle<>> ready_;
+    std::vector<std::coroutine_handle<>> running_;
+    size_t live_ = 0;               /* Spawned tasks not yet finished */
+    size_t inflight_ = 0;           /* SQEs queued or submitted */
+    std::exception_ptr error_;
+
+    std::vector<int> files_;        /* Registered fd per slot, -1 free */
+    bool files_registered_ = false;
+
+    char *buf_region_ = nullptr;
+    size_t buf_region_len_ = 0;
+    std::vector<unsigned> free_buffers_;
+
+    scheduler_stats stats_;
+};
+
+/*
+ * A device bound to the current thread's scheduler
+ * Registers the device's fd with the ring for as long as it lives. The
+ * device must outlive it. Offsets default to the file position, like
+ * read() and write(); pass one to get pread()/pwrite() semantics.
+ */
+class async_device {
+public:
+    static constexpr uint64_t at_position = device::at_position;
+
+    explicit async_device(device &dev, scheduler &sched = scheduler::current());
+    ~async_device();
+    async_device(const async_device &) = delete;
+    async_device &operator=(const async_device &) = delete;
+
+    io_op read(mutable_buffer buf, uint64_t offset = at_position) noexcept
+    {
+        return io_op(*sched_, *this, false, buf.data(), buf.size(), offset);
+    }
+    io_op write(const_buffer buf, uint64_t offset = at_position) noexcept
+    {
+        /* Never written through: the same op serves reads */
+        return io_op(*sched_, *this, true, const_cast<char *>(buf.data()),
+                     buf.size(), offset);
+    }
+
+    device &dev() const noexcept { return *dev_; }
+
+private:
+    friend class scheduler;
+
+    device *dev_;
+    scheduler *sched_;
+    int slot_;                      /* Registered file slot, -1 if none */
+};
+
+} /* namespace simplechar */
+
+#endif /* SIMPLECHAR_ASYNC_H */
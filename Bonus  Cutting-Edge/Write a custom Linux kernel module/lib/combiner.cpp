@@ -0,0 +1,390 @@
+/*
+ * combiner.cpp - Client-side write combining for the SimpleChar device
+ *
+ * License: MIT
+ */
+
+#include "combiner.h"
+#include "probes.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <sys/uio.h>
+
+namespace simplechar {
+
+namespace {
+
+std::atomic<uint64_t> next_combiner_id{1};
+
+/* Combiners that are still alive, so exiting threads can find theirs */
+std::mutex live_lock;
+std::unordered_map<uint64_t, write_combiner *> live_combiners;
+
+size_t round_up_pow2(size_t n)
+{
+    size_t p = 1;
+
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+} /* namespace */
+
+/*
+ * A single-producer, single-consumer byte ring
+ * The owning thread advances tail, the flusher advances head; each sits
+ * on its own cache line so the two sides never write the same line.
+ */
+struct write_combiner::stage {
+    explicit stage(size_t size) : buf(new char[size]), mask(size - 1) {}
+
+    std::unique_ptr<char[]> buf;
+    size_t mask;
+
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> messages{0};
+
+    alignas(64) std::atomic<uint64_t> head{0};
+};
+
+write_combiner::write_combiner(device &dev, const combiner_options &opts)
+    : dev_(&dev), opts_(opts), id_(next_combiner_id.fetch_add(1))
+{
+    opts_.stage_size = round_up_pow2(std::max<size_t>(opts.stage_size, 64));
+    if (opts_.wrap_at && opts_.stage_size > opts_.wrap_at) {
+        throw std::invalid_argument("combiner stage larger than wrap_at");
+    }
+    thread_ = std::thread([this] { flusher(); });
+
+    std::lock_guard<std::mutex> guard(live_lock);
+    live_combiners.emplace(id_, this);
+}
+
+write_combiner::~write_combiner()
+{
+    {
+        /* From here on exiting threads leave their stages to the flusher */
+        std::lock_guard<std::mutex> guard(live_lock);
+        live_combiners.erase(id_);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_cv_.notify_one();
+    thread_.join();
+}
+
+/*
+ * The stages a thread holds, one per combiner it wrote to
+ * On thread exit each goes back to its combiner, if that still exists;
+ * live_lock keeps the combiner from being destroyed meanwhile.
+ */
+struct write_combiner::thread_stages {
+    struct entry {
+        uint64_t id;
+        stage *s;
+    };
+
+    ~thread_stages()
+    {
+        std::lock_guard<std::mutex> guard(live_lock);
+
+        for (const entry &e : entries) {
+            auto it = live_combiners.find(e.id);
+            if (it != live_combiners.end()) {
+                it->second->release_stage(e.s);
+            }
+        }
+    }
+
+    /* The last combiner this thread wrote to, which is nearly always it */
+    uint64_t cached_id = 0;
+    stage *cached = nullptr;
+    std::vector<entry> entries;
+};
+
+write_combiner::stage *write_combiner::local_stage()
+{
+    static thread_local thread_stages mine;
+
+    if (mine.cached_id == id_) {
+        return mine.cached;
+    }
+
+    /* A thread that alternates between combiners finds its old stage */
+    stage *s = nullptr;
+    for (const thread_stages::entry &e : mine.entries) {
+        if (e.id == id_) {
+            s = e.s;
+            break;
+        }
+    }
+
+    if (!s) {
+        {
+            /* Forget stages of combiners that are gone */
+            std::lock_guard<std::mutex> guard(live_lock);
+            auto &v = mine.entries;
+            v.erase(std::remove_if(v.begin(), v.end(),
+                                   [](const thread_stages::entry &e) {
+                                       return !live_combiners.count(e.id);
+                                   }),
+                    v.end());
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_stages_.empty()) {
+            s = free_stages_.back();
+            free_stages_.pop_back();
+        } else {
+            stages_.push_back(std::make_unique<stage>(opts_.stage_size));
+            s = stages_.back().get();
+        }
+        mine.entries.push_back({id_, s});
+    }
+    mine.cached_id = id_;
+    mine.cached = s;
+    return s;
+}
+
+/*
+ * Take back the stage of an exiting thread
+ * What it still holds goes out with the next pass, ahead of anything
+ * the next owner stages behind it.
+ */
+void write_combiner::release_stage(stage *s)
+{
+    bool staged = s->tail.load(std::memory_order_relaxed) !=
+                  s->head.load(std::memory_order_acquire);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_stages_.push_back(s);
+    }
+    if (staged) {
+        wake();
+    }
+}
+
+/*
+ * Ask the flusher for a pass
+ * The notify can race with the flusher going to sleep; it then runs at
+ * the end of the interval instead, which bounds the delay.
+ */
+void write_combiner::wake() noexcept
+{
+    if (!woken_.load(std::memory_order_relaxed) &&
+        !woken_.exchange(true, std::memory_order_acq_rel)) {
+        wake_cv_.notify_one();
+    }
+}
+
+bool write_combiner::write(const_buffer msg)
+{
+    size_t len = msg.size();
+
+    if (len > opts_.stage_size) {
+        return false;
+    }
+
+    stage *s = local_stage();
+    uint64_t tail = s->tail.load(std::memory_order_relaxed);
+    uint64_t head = s->head.load(std::memory_order_acquire);
+
+    if (opts_.stage_size - (tail - head) < len) {
+        SIMPLECHAR_PROBE(combiner__stall, len);
+        while (opts_.stage_size - (tail - head) < len) {
+            wake();
+            std::this_thread::yield();
+            head = s->head.load(std::memory_order_acquire);
+        }
+        SIMPLECHAR_PROBE(combiner__resume, len);
+    }
+
+    size_t at = tail & s->mask;
+    size_t first = std::min(len, opts_.stage_size - at);
+    std::memcpy(s->buf.get() + at, msg.data(), first);
+    std::memcpy(s->buf.get(), msg.data() + first, len - first);
+
+    s->tail.store(tail + len, std::memory_order_release);
+    s->messages.store(s->messages.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+
+    if (tail + len - head >= opts_.flush_bytes) {
+        wake();
+    }
+    return true;
+}
+
+void write_combiner::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t ticket = ++flush_requested_;
+
+    wake_cv_.notify_one();
+    done_cv_.wait(lock, [&] { return flushed_ >= ticket; });
+}
+
+void write_combiner::flusher()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    for (;;) {
+        wake_cv_.wait_for(lock, opts_.flush_interval, [&] {
+            return stop_ || woken_.load(std::memory_order_relaxed) ||
+                   flush_requested_ != flushed_;
+        });
+        woken_.store(false, std::memory_order_relaxed);
+
+        bool stopping = stop_;
+        uint64_t ticket = flush_requested_;
+
+        lock.unlock();
+        drain();
+        lock.lock();
+
+        flushed_ = ticket;
+        done_cv_.notify_all();
+        if (stopping) {
+            break;
+        }
+    }
+}
+
+/*
+ * One pass over every stage
+ * Whole stage contents are gathered into as few pwritev() calls as
+ * IOV_MAX and wrap_at allow; a stage's head only moves once its bytes
+ * are written, which is what frees the space for its thread.
+ */
+void write_combiner::drain()
+{
+    struct taken {
+        stage *s;
+        uint64_t tail;
+    };
+    std::vector<stage *> stages;
+    std::vector<iovec> iov;
+    std::vector<taken> pending;
+    size_t batch_bytes = 0;
+    bool found = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto &st : stages_) {
+            stages.push_back(st.get());
+        }
+    }
+
+    auto write_batch = [&] {
+        size_t i = 0;
+        size_t left = batch_bytes;
+        uint64_t off = opts_.wrap_at ? cursor_ : device::at_position;
+        int err = 0;
+
+        SIMPLECHAR_PROBE(flush__start, dev_->fd(), batch_bytes, iov.size());
+        while (left && i < iov.size()) {
+            int count = int(iov.size() - i);
+            io_result r = dev_->writev(&iov[i], count, off);
+
+            syscalls_.fetch_add(1, std::memory_order_relaxed);
+            /* A full device writes short and then fails: drop the rest */
+            if (!r || r.bytes == 0) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_) {
+                    error_ = r ? std::make_error_code(std::errc::no_space_on_device)
+                               : r.error;
+                }
+                dropped_.fetch_add(left, std::memory_order_relaxed);
+                err = r ? ENOSPC : r.error.value();
+                break;
+            }
+            bytes_.fetch_add(r.bytes, std::memory_order_relaxed);
+            left -= r.bytes;
+            if (opts_.wrap_at) {
+                off += r.bytes;
+                cursor_ = off;
+            }
+            for (size_t done = r.bytes; done;) {
+                size_t n = std::min(done, iov[i].iov_len);
+                iov[i].iov_base = static_cast<char *>(iov[i].iov_base) + n;
+                iov[i].iov_len -= n;
+                done -= n;
+                if (!iov[i].iov_len) {
+                    i++;
+                }
+            }
+        }
+
+        SIMPLECHAR_PROBE(flush__done, dev_->fd(), batch_bytes - left, err);
+        for (const taken &t : pending) {
+            t.s->head.store(t.tail, std::memory_order_release);
+        }
+        iov.clear();
+        pending.clear();
+        batch_bytes = 0;
+    };
+
+    for (stage *s : stages) {
+        uint64_t head = s->head.load(std::memory_order_relaxed);
+        uint64_t tail = s->tail.load(std::memory_order_acquire);
+        size_t len = size_t(tail - head);
+
+        if (!len) {
+            continue;
+        }
+        found = true;
+        if (iov.size() + 2 > IOV_MAX ||
+            (opts_.wrap_at && cursor_ + batch_bytes + len > opts_.wrap_at)) {
+            write_batch();
+        }
+        if (opts_.wrap_at && cursor_ + len > opts_.wrap_at) {
+            cursor_ = 0;
+        }
+
+        size_t at = head & s->mask;
+        size_t first = std::min(len, s->mask + 1 - at);
+        iov.push_back({s->buf.get() + at, first});
+        if (first < len) {
+            iov.push_back({s->buf.get(), len - first});
+        }
+        pending.push_back({s, tail});
+        batch_bytes += len;
+    }
+    if (batch_bytes) {
+        write_batch();
+    }
+    if (found) {
+        flushes_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+combiner_stats write_combiner::stats() const
+{
+    combiner_stats st;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (const auto &s : stages_) {
+        st.messages += s->messages.load(std::memory_order_relaxed);
+    }
+    st.bytes = bytes_.load(std::memory_order_relaxed);
+    st.syscalls = syscalls_.load(std::memory_order_relaxed);
+    st.flushes = flushes_.load(std::memory_order_relaxed);
+    st.dropped = dropped_.load(std::memory_order_relaxed);
+    return st;
+}
+
+std::error_code write_combiner::error() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return error_;
+}
+
+} /* namespace simplechar */
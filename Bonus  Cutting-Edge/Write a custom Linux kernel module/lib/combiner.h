@@ -0,0 +1,144 @@
+/*
+ * combiner.h - Client-side write combining for the SimpleChar device
+ *
+ * Threads that emit many small messages hand them to a write_combiner
+ * instead of calling write() for each:
+ *
+ *   simplechar::open_options opts;
+ *   opts.append = true;
+ *   auto dev = simplechar::device::open("/dev/simplechar", opts);
+ *   simplechar::write_combiner wc(dev);
+ *   wc.write(msg);                     // Copies into this thread's stage
+ *
+ * Each writing thread gets its own staging ring, which only that thread
+ * fills and only the flusher drains, so staging a message is a copy and
+ * a release store with no lock or shared cache line. A flusher thread
+ * gathers whatever every stage holds into one pwritev(), which the driver
+ * writes under a single acquisition of its I/O gate. It runs when a
+ * thread has flush_bytes staged or flush_interval has passed, whichever
+ * comes first.
+ *
+ * Each thread's messages land in the device in the order it wrote them,
+ * and the combiner never interleaves them with other staged messages.
+ * Messages from different threads are ordered only by when they were
+ * flushed. The driver writes a vector whole unless the device fills up;
+ * a short write is continued by the next pwritev(), so a message only
+ * comes apart when another writer gets in between, or when the device
+ * stays full and the rest of the pass is dropped (stats().dropped).
+ *
+ * A thread's stage outlives it: when the thread exits, whatever it
+ * staged is still flushed and the stage is handed to the next thread
+ * that writes, so threads that come and go do not pile up stages.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_COMBINER_H
+#define SIMPLECHAR_COMBINER_H
+
+#include "simplechar.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace simplechar {
+
+struct combiner_options {
+    size_t stage_size = 64 * 1024;  /* Per-thread ring, rounded to a power of 2 */
+    size_t flush_bytes = 16 * 1024; /* Staged bytes that trigger a flush */
+    std::chrono::microseconds flush_interval{1000};  /* Longest a message waits */
+
+    /*
+     * 0 writes at the file position, so open the device for append to
+     * get a log. Otherwise flushes go to an internal offset that restarts
+     * at 0 rather than cross wrap_at bytes, for a circular log; stages
+     * must then fit in wrap_at.
+     */
+    uint64_t wrap_at = 0;
+};
+
+struct combiner_stats {
+    uint64_t messages = 0;          /* Staged by write() */
+    uint64_t bytes = 0;             /* Written to the device */
+    uint64_t syscalls = 0;          /* pwritev() calls of the flusher */
+    uint64_t flushes = 0;           /* Flusher passes that found data */
+    uint64_t dropped = 0;           /* Bytes discarded after write errors */
+
+    double syscalls_per_message() const noexcept
+    {
+        return messages ? double(syscalls) / double(messages) : 0.0;
+    }
+};
+
+class write_combiner {
+public:
+    /*
+     * Starts the flusher; dev must outlive the combiner
+     * Throws std::invalid_argument if a stage does not fit in wrap_at.
+     */
+    explicit write_combiner(device &dev, const combiner_options &opts = {});
+
+    /* Flushes everything staged, then stops the flusher */
+    ~write_combiner();
+
+    write_combiner(const write_combiner &) = delete;
+    write_combiner &operator=(const write_combiner &) = delete;
+
+    /*
+     * Stage one message
+     * Waits for the flusher while the thread's stage is full. Returns
+     * false, staging nothing, if the message is larger than a stage.
+     */
+    bool write(const_buffer msg);
+
+    /* Write out everything staged before the call, and wait for it */
+    void flush();
+
+    combiner_stats stats() const;
+
+    /* First write error the flusher ran into, if any */
+    std::error_code error() const;
+
+private:
+    struct stage;
+    struct thread_stages;
+
+    stage *local_stage();
+    void release_stage(stage *s);
+    void wake() noexcept;
+    void flusher();
+    void drain();
+
+    device *dev_;
+    combiner_options opts_;
+    uint64_t id_;                   /* Tells combiners apart in thread caches */
+    uint64_t cursor_ = 0;           /* Next offset when wrapping */
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_cv_;
+    std::condition_variable done_cv_;
+    std::vector<std::unique_ptr<stage>> stages_;
+    std::vector<stage *> free_stages_;  /* Left behind by exited threads */
+    uint64_t flush_requested_ = 0;
+    uint64_t flushed_ = 0;
+    bool stop_ = false;
+    std::atomic<bool> woken_{false};
+    std::error_code error_;
+
+    std::atomic<uint64_t> bytes_{0};
+    std::atomic<uint64_t> syscalls_{0};
+    std::atomic<uint64_t> flushes_{0};
+    std::atomic<uint64_t> dropped_{0};
+
+    std::thread thread_;
+};
+
+} /* namespace simplechar */
+
+#endif /* SIMPLECHAR_COMBINER_H */
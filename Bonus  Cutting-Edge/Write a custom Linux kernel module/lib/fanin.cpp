@@ -0,0 +1,140 @@
+/*
+ * fanin.cpp - One thread reading the record rings of many SimpleChar devices
+ *
+ * License: MIT
+ */
+
+#include "fanin.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace simplechar {
+
+namespace {
+
+std::system_error fanin_error(int err, const char *what)
+{
+    return std::system_error(std::error_code(err, std::generic_category()), what);
+}
+
+} /* namespace */
+
+fanin_reader::fanin_reader(const fanin_options &opts)
+    : opts_(opts)
+{
+    opts_.batch_budget = std::max<size_t>(opts_.batch_budget, 1);
+    opts_.max_events = std::max<size_t>(opts_.max_events, 1);
+    epfd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epfd_ < 0) {
+        throw fanin_error(errno, "cannot create the epoll set");
+    }
+    events_.reset(new epoll_event[opts_.max_events]);
+}
+
+fanin_reader::~fanin_reader()
+{
+    ::close(epfd_);
+}
+
+size_t fanin_reader::add(device &dev, uint64_t schema)
+{
+    auto in = std::make_unique<instance>(dev, schema);
+    size_t id = instances_.size();
+    struct epoll_event ev = {};
+
+    /* Level-triggered: a ring left with records stays ready */
+    ev.events = EPOLLIN;
+    ev.data.u64 = id;
+    if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, in->rc.fd(), &ev) < 0) {
+        if (errno != EPERM) {
+            throw fanin_error(errno, "cannot add the device to the epoll set");
+        }
+        in->pollable = false;
+        unpollable_++;
+    }
+    instances_.push_back(std::move(in));
+    enqueue(id);
+    return id;
+}
+
+void fanin_reader::enqueue(size_t id) noexcept
+{
+    instance &in = *instances_[id];
+
+    if (!in.queued) {
+        in.queued = true;
+        queue_.push_back(id);
+    }
+}
+
+/*
+ * Sleep until some ring has records
+ * Every consumer is armed first, and its ring checked once armed: a
+ * producer that published before we armed is seen here, one that
+ * publishes after sees the flag and notifies, which wakes the epoll set.
+ */
+bool fanin_reader::wait(std::chrono::milliseconds timeout)
+{
+    stats_.scans++;
+    for (size_t id = 0; id < instances_.size(); id++) {
+        if (instances_[id]->rc.arm()) {
+            enqueue(id);
+        }
+    }
+
+    if (queue_.empty()) {
+        auto limit = timeout;
+        int n;
+
+        if (unpollable_ && (limit < std::chrono::milliseconds(0) ||
+                            limit > opts_.rescan_interval)) {
+            limit = opts_.rescan_interval;
+        }
+        n = ::epoll_wait(epfd_, events_.get(), int(opts_.max_events),
+                         int(limit.count()));
+        stats_.waits++;
+        if (n < 0 && errno != EINTR) {
+            throw fanin_error(errno, "epoll_wait failed");
+        }
+        for (int i = 0; i < n; i++) {
+            enqueue(size_t(events_[size_t(i)].data.u64));
+            stats_.wakeups++;
+        }
+
+        /* Unpollable instances have no event to wake us; look at them */
+        if (unpollable_) {
+            for (size_t id = 0; id < instances_.size(); id++) {
+                if (!instances_[id]->pollable && instances_[id]->rc.backlog()) {
+                    enqueue(id);
+                }
+            }
+        }
+    }
+
+    for (const auto &in : instances_) {
+        in->rc.disarm();
+    }
+    return !queue_.empty();
+}
+
+fanin_lag fanin_reader::lag(size_t id) const noexcept
+{
+    const instance &in = *instances_[id];
+    fanin_lag l;
+
+    l.backlog = in.rc.backlog();
+    l.max_backlog = std::max(in.max_backlog, l.backlog);
+    l.capacity = in.rc.capacity();
+    l.records = in.rc.stats().records;
+    l.bytes = in.rc.stats().bytes;
+    l.turns = in.turns;
+    l.budget_hits = in.budget_hits;
+    return l;
+}
+
+} /* namespace simplechar */
@@ -0,0 +1,186 @@
+/*
+ * fanin.h - One thread reading the record rings of many SimpleChar devices
+ *
+ * A consumer that follows many instances adds each to a fanin_reader and
+ * runs one loop:
+ *
+ *   simplechar::fanin_reader fan;
+ *   for (auto &dev : devices) {
+ *       fan.add(dev);                  // Maps its ring, joins the epoll set
+ *   }
+ *   for (;;) {
+ *       fan.poll([](size_t instance, simplechar::const_buffer rec) { ... });
+ *   }
+ *
+ * Instances with records wait their turn in a round-robin queue. A turn
+ * consumes at most batch_budget records, in place as ring_consumer does,
+ * and an instance that used its whole budget goes to the back of the
+ * queue, so a flooded ring cannot starve the others. While the queue
+ * has work, poll() makes no system call at all.
+ *
+ * Only when every ring looks empty does poll() sleep, in one
+ * epoll_wait() over all their fds. Before that it tells each producer
+ * that the consumer is about to sleep, exactly as ring_consumer::wait()
+ * does, so producers notify only then; that pass costs one store and
+ * one load per instance, and only the idle path pays it.
+ *
+ * lag(i) reports how far behind the reader is on each instance: the
+ * bytes published and not yet consumed, now and at worst.
+ *
+ * Devices must outlive the reader. Like ring_consumer, a fanin_reader
+ * belongs to one thread.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_FANIN_H
+#define SIMPLECHAR_FANIN_H
+
+#include "ring.h"
+#include "simplechar.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+struct epoll_event;
+
+namespace simplechar {
+
+struct fanin_options {
+    size_t batch_budget = 64;       /* Records per instance per turn */
+    size_t max_events = 256;        /* Ready fds taken per epoll_wait() */
+
+    /*
+     * Longest sleep while some instance is not pollable, such as a
+     * regular file standing in for a device; those are only looked at
+     * when the reader wakes
+     */
+    std::chrono::milliseconds rescan_interval{1};
+};
+
+/* One instance as the reader sees it */
+struct fanin_lag {
+    uint64_t backlog = 0;           /* Bytes published, not yet consumed */
+    uint64_t max_backlog = 0;       /* Worst backlog seen at a turn */
+    uint64_t capacity = 0;          /* Bytes of record space in the ring */
+    uint64_t records = 0;           /* Delivered to the callback */
+    uint64_t bytes = 0;
+    uint64_t turns = 0;             /* Turns that found records */
+    uint64_t budget_hits = 0;       /* Turns cut short by the budget */
+
+    /* Share of the ring the reader is behind by */
+    double fill() const noexcept
+    {
+        return capacity ? double(backlog) / double(capacity) : 0.0;
+    }
+};
+
+struct fanin_stats {
+    uint64_t records = 0;           /* Delivered, all instances */
+    uint64_t turns = 0;
+    uint64_t scans = 0;             /* Passes over every ring before sleeping */
+    uint64_t waits = 0;             /* epoll_wait() calls */
+    uint64_t wakeups = 0;           /* Ready fds those returned */
+};
+
+class fanin_reader {
+public:
+    /* Throws std::system_error if the epoll set cannot be created */
+    explicit fanin_reader(const fanin_options &opts = {});
+    ~fanin_reader();
+
+    fanin_reader(const fanin_reader &) = delete;
+    fanin_reader &operator=(const fanin_reader &) = delete;
+
+    /*
+     * Start following the ring of dev, whose records are of schema (0
+     * for untyped); returns the instance number poll() passes to the
+     * callback, counting from 0
+     * Throws std::system_error as ring_consumer does, or if the fd cannot
+     * join the epoll set for a reason other than not being pollable.
+     */
+    size_t add(device &dev, uint64_t schema = 0);
+
+    size_t size() const noexcept { return instances_.size(); }
+
+    /*
+     * Give one turn to each instance queued with records, calling
+     * fn(size_t instance, const_buffer record) for each record; if none
+     * has any, first sleep until one does or timeout passes
+     * Returns the records delivered. Record buffers point into the ring
+     * and are only valid during the call.
+     */
+    template <typename F>
+    size_t poll(F &&fn, std::chrono::milliseconds timeout = ring_forever);
+
+    fanin_lag lag(size_t instance) const noexcept;
+    const fanin_stats &stats() const noexcept { return stats_; }
+
+private:
+    struct instance {
+        instance(device &dev, uint64_t schema) : rc(dev, schema) {}
+
+        ring_consumer rc;
+        bool queued = false;
+        bool pollable = true;
+        uint64_t max_backlog = 0;
+        uint64_t turns = 0;
+        uint64_t budget_hits = 0;
+    };
+
+    void enqueue(size_t id) noexcept;
+    bool wait(std::chrono::milliseconds timeout);
+
+    fanin_options opts_;
+    int epfd_ = -1;
+    std::unique_ptr<epoll_event[]> events_;
+    size_t unpollable_ = 0;
+    std::vector<std::unique_ptr<instance>> instances_;
+    std::deque<size_t> queue_;
+    fanin_stats stats_;
+};
+
+template <typename F>
+size_t fanin_reader::poll(F &&fn, std::chrono::milliseconds timeout)
+{
+    size_t delivered = 0;
+
+    if (queue_.empty() && !wait(timeout)) {
+        return 0;
+    }
+
+    /* Instances requeued during this pass wait for the next one */
+    for (size_t turns = queue_.size(); turns; turns--) {
+        size_t id = queue_.front();
+        instance &in = *instances_[id];
+        uint64_t backlog = in.rc.backlog();
+        size_t n;
+
+        queue_.pop_front();
+        in.queued = false;
+        if (backlog > in.max_backlog) {
+            in.max_backlog = backlog;
+        }
+        n = in.rc.consume([&](const_buffer rec) { fn(id, rec); },
+                          opts_.batch_budget);
+        delivered += n;
+        if (n) {
+            in.turns++;
+            stats_.turns++;
+        }
+        if (n == opts_.batch_budget) {
+            in.budget_hits++;
+            enqueue(id);
+        }
+    }
+    stats_.records += delivered;
+    return delivered;
+}
+
+} /* namespace simplechar */
+
+#endif /* SIMPLECHAR_FANIN_H */
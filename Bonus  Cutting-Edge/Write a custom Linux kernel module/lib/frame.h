@@ -0,0 +1,126 @@
+/*
+ * frame.h - Length-prefixed, checksummed record frames
+ *
+ * Records that travel through the device's byte store as a stream are
+ * framed as a frame_header followed by the payload, with no padding
+ * between frames. A consumer reads megabytes at a time and lets a
+ * frame_scanner split them:
+ *
+ *   simplechar::frame_scanner scanner;             // Best CPU path
+ *   std::vector<simplechar::frame_ref> frames(4096);
+ *   auto r = scanner.scan(buf, frames.data(), frames.size());
+ *   for (size_t i = 0; i < r.frames; i++) {
+ *       if (frames[i].valid) { ... buf.data() + frames[i].offset ... }
+ *   }
+ *   // The r.consumed bytes are done; the rest starts a partial frame
+ *
+ * The scanner makes two passes. The first walks the length fields to
+ * index boundaries; each frame's position depends on the one before,
+ * so that walk is inherently serial but only touches one word per
+ * frame. The second checks the CRC32C of every payload, which is where
+ * the bytes are, with the CPU's CRC32C instruction when it has one:
+ * SSE4.2 on x86-64, the CRC32 extension on ARMv8. The instruction has a
+ * latency of several cycles but can start one per cycle, so the check
+ * runs three independent CRC streams at once: three blocks of a long
+ * payload, or three short frames side by side. Other CPUs use a
+ * slicing-by-8 table. The path is picked once, at run time.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_FRAME_H
+#define SIMPLECHAR_FRAME_H
+
+#include "simplechar.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace simplechar {
+
+struct frame_header {
+    uint32_t length;                /* Payload bytes */
+    uint32_t crc;                   /* CRC32C of the payload */
+};
+
+/* Where one frame's payload lies in the scanned buffer */
+struct frame_ref {
+    size_t offset;                  /* Payload start */
+    uint32_t length;
+    bool valid;                     /* The CRC matched */
+};
+
+struct scan_result {
+    size_t frames = 0;              /* Complete frames indexed */
+    size_t consumed = 0;            /* Bytes of those frames */
+    size_t bad = 0;                 /* Frames whose CRC did not match */
+
+    /*
+     * A length field above max_length: the stream is not framed, or
+     * lost its place. Scanning stopped at that frame.
+     */
+    bool corrupt = false;
+};
+
+/* CRC32C (Castagnoli) of data, continuing from crc, with the best path */
+uint32_t crc32c(const void *data, size_t len, uint32_t crc = 0) noexcept;
+
+/*
+ * Frame payload into the start of out
+ * Returns the bytes written, or 0 if the frame does not fit.
+ */
+size_t frame_encode(mutable_buffer out, const_buffer payload) noexcept;
+
+class frame_scanner {
+public:
+    enum class isa {
+        scalar,                     /* Slicing-by-8 tables */
+        sse42,                      /* x86-64 crc32 instruction */
+        armv8_crc,                  /* ARMv8 crc32c instructions */
+    };
+
+    /* Frames longer than this end a scan as corrupt */
+    static constexpr uint32_t default_max_length = 64 << 20;
+
+    /* Uses the fastest path this CPU supports */
+    explicit frame_scanner(uint32_t max_length = default_max_length) noexcept;
+
+    /*
+     * Uses the given path; throws std::invalid_argument if the CPU does
+     * not support it. For benchmarks and cross-checking paths.
+     */
+    frame_scanner(isa path, uint32_t max_length = default_max_length);
+
+    static bool supported(isa path) noexcept;
+    static isa best() noexcept;
+    static const char *name(isa path) noexcept;
+
+    isa path() const noexcept { return path_; }
+
+    /*
+     * Index up to max complete frames at the start of buf into out and
+     * check their CRCs
+     * A frame cut off by the end of buf is left for the next scan: carry
+     * the bytes after r.consumed over to the front of the next read.
+     */
+    scan_result scan(const_buffer buf, frame_ref *out, size_t max) const noexcept;
+
+    /* CRC32C with this scanner's path */
+    uint32_t checksum(const void *data, size_t len, uint32_t crc = 0) const noexcept
+    {
+        return crc_(data, len, crc);
+    }
+
+private:
+    using crc_fn = uint32_t (*)(const void *, size_t, uint32_t) noexcept;
+    using verify_fn = size_t (*)(const char *, frame_ref *, size_t) noexcept;
+
+    isa path_;
+    crc_fn crc_;
+    verify_fn verify_;
+    uint32_t max_length_;
+};
+
+} /* namespace simplechar */
+
+#endif /* SIMPLECHAR_FRAME_H */
@@ -0,0 +1,302 @@
+/*
+ * pool.cpp - Pooled read buffers for the SimpleChar device
+ *
+ * License: MIT
+ */
+
+#include "pool.h"
+#include "simplechar_ioctl.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace simplechar {
+
+namespace {
+
+std::atomic<uint64_t> next_pool_id{1};
+
+size_t page_size()
+{
+    static const size_t page = size_t(::sysconf(_SC_PAGESIZE));
+    return page;
+}
+
+size_t round_up(size_t n, size_t to)
+{
+    return (n + to - 1) / to * to;
+}
+
+/*
+ * The largest read dev can return: its store, or the autosize ceiling
+ * when the store may grow; regular files standing in for the device give
+ * their size
+ */
+size_t read_geometry(const device &dev)
+{
+    simplechar_autosize_info info;
+    struct stat st;
+
+    if (::ioctl(dev.fd(), SIMPLECHAR_IOC_GET_AUTOSIZE, &info) == 0) {
+        return info.enabled ? info.max_size : info.size;
+    }
+    if (::fstat(dev.fd(), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        return size_t(st.st_size);
+    }
+    return page_size();
+}
+
+} /* namespace */
+
+/*
+ * The free buffers of one thread
+ * Only the owner pushes and pops; the counters are written by the owner
+ * alone and read by stats(), hence relaxed atomics without RMW.
+ */
+struct buffer_pool::cache {
+    cache(size_t limit, std::thread::id owner) : owner(owner)
+    {
+        free.reserve(limit + 1);
+    }
+
+    void bump(std::atomic<uint64_t> &counter) noexcept
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+    }
+
+    std::vector<char *> free;
+    std::thread::id owner;
+
+    std::atomic<uint64_t> acquires{0};
+    std::atomic<uint64_t> local_hits{0};
+    std::atomic<uint64_t> releases{0};
+};
+
+lease::lease(lease &&other) noexcept
+    : pool_(other.pool_), data_(std::exchange(other.data_, nullptr)),
+      size_(other.size_), capacity_(other.capacity_)
+{
+}
+
+lease &lease::operator=(lease &&other) noexcept
+{
+    if (this != &other) {
+        release();
+        pool_ = other.pool_;
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = other.size_;
+        capacity_ = other.capacity_;
+    }
+    return *this;
+}
+
+void lease::release() noexcept
+{
+    if (data_) {
+        pool_->put(std::exchange(data_, nullptr));
+        size_ = 0;
+    }
+}
+
+buffer_pool::buffer_pool(device &dev, const pool_options &opts)
+    : buffer_pool([&] {
+          pool_options o = opts;
+          if (!o.buffer_size) {
+              o.buffer_size = read_geometry(dev);
+          }
+          return o;
+      }())
+{
+}
+
+buffer_pool::buffer_pool(const pool_options &opts)
+    : opts_(opts), id_(next_pool_id.fetch_add(1))
+{
+    if (!opts_.buffer_size) {
+        throw std::invalid_argument("pool buffers need a size");
+    }
+    /* Whole pages, so no two buffers share one and reads start aligned */
+    opts_.buffer_size = round_up(opts_.buffer_size, page_size());
+    opts_.cache_buffers = std::max<size_t>(opts_.cache_buffers, 1);
+    buffers_per_arena_ = std::max<size_t>(opts_.arena_size / opts_.buffer_size, 1);
+}
+
+buffer_pool::~buffer_pool()
+{
+    for (auto &[base, len] : arenas_) {
+        ::munmap(base, len);
+    }
+}
+
+/*
+ * This thread's cache, made on first use if create is set; nullptr if
+ * there is none and create is not
+ */
+buffer_pool::cache *buffer_pool::local_cache(bool create)
+{
+    /* The last pool this thread used, which is nearly always this one */
+    thread_local uint64_t cached_id = 0;
+    thread_local cache *cached = nullptr;
+
+    if (cached_id == id_) {
+        return cached;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::thread::id me = std::this_thread::get_id();
+    cache *c = nullptr;
+
+    for (const auto &ca : caches_) {
+        if (ca->owner == me) {
+            c = ca.get();
+            break;
+        }
+    }
+    if (!c) {
+        if (!create) {
+            return nullptr;
+        }
+        caches_.push_back(std::make_unique<cache>(opts_.cache_buffers, me));
+        c = caches_.back().get();
+    }
+    cached_id = id_;
+    cached = c;
+    return c;
+}
+
+/* Called with mutex_ held */
+void buffer_pool::map_arena()
+{
+    size_t len = buffers_per_arena_ * opts_.buffer_size;
+    void *base = ::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (base == MAP_FAILED) {
+        throw std::system_error(std::error_code(errno, std::generic_category()),
+                                "cannot map a buffer arena");
+    }
+    arenas_.emplace_back(base, len);
+
+    /* Every buffer can end up on the shared list; never grow it in put() */
+    size_t total = arenas_.size() * buffers_per_arena_;
+    shared_.reserve(total);
+    fresh_.reserve(total);
+    for (size_t i = buffers_per_arena_; i-- > 0;) {
+        fresh_.push_back(static_cast<char *>(base) + i * opts_.buffer_size);
+    }
+}
+
+/*
+ * Take a batch of buffers from the shared list into c, returning one of
+ * them, or a buffer no one has used yet when the list is empty
+ */
+char *buffer_pool::refill(cache &c)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!shared_.empty()) {
+        size_t n = std::min(shared_.size(), std::max<size_t>(opts_.cache_buffers / 2, 1));
+        char *data = shared_.back();
+
+        shared_.pop_back();
+        c.free.insert(c.free.end(), shared_.end() - ptrdiff_t(n - 1), shared_.end());
+        shared_.resize(shared_.size() - (n - 1));
+        shared_hits_.fetch_add(1, std::memory_order_relaxed);
+        return data;
+    }
+
+    if (fresh_.empty()) {
+        map_arena();
+    }
+    char *data = fresh_.back();
+    fresh_.pop_back();
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return data;
+}
+
+lease buffer_pool::acquire()
+{
+    cache *c = local_cache(true);
+    char *data;
+
+    if (!c->free.empty()) {
+        data = c->free.back();
+        c->free.pop_back();
+        c->bump(c->local_hits);
+    } else {
+        data = refill(*c);
+    }
+    c->bump(c->acquires);
+    return lease(this, data, opts_.buffer_size);
+}
+
+/*
+ * Back to the releasing thread's cache, or to the shared list when the
+ * thread has no cache here or the cache is full
+ * Neither allocates: caches and the shared list are reserved up front.
+ */
+void buffer_pool::put(char *data) noexcept
+{
+    cache *c = local_cache(false);
+
+    if (!c) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        shared_.push_back(data);
+        orphan_releases_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    c->free.push_back(data);
+    c->bump(c->releases);
+    if (c->free.size() > opts_.cache_buffers) {
+        size_t keep = opts_.cache_buffers / 2;
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        shared_.insert(shared_.end(), c->free.begin() + ptrdiff_t(keep), c->free.end());
+        c->free.resize(keep);
+    }
+}
+
+io_result buffer_pool::read(device &dev, uint64_t offset, lease &out)
+{
+    if (!out || out.pool_ != this) {
+        out = acquire();
+    }
+
+    io_result r = dev.read(out.space(), offset);
+    out.resize(r.bytes);
+    return r;
+}
+
+pool_stats buffer_pool::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    pool_stats st;
+    uint64_t releases = orphan_releases_.load(std::memory_order_relaxed);
+
+    for (const auto &c : caches_) {
+        st.acquires += c->acquires.load(std::memory_order_relaxed);
+        st.local_hits += c->local_hits.load(std::memory_order_relaxed);
+        releases += c->releases.load(std::memory_order_relaxed);
+    }
+    st.shared_hits = shared_hits_.load(std::memory_order_relaxed);
+    st.misses = misses_.load(std::memory_order_relaxed);
+    st.arenas = arenas_.size();
+    st.buffer_size = opts_.buffer_size;
+    st.reserved_bytes = arenas_.size() * buffers_per_arena_ * opts_.buffer_size;
+    st.outstanding = st.acquires - std::min(releases, st.acquires);
+    return st;
+}
+
+} /* namespace simplechar */
@@ -0,0 +1,176 @@
+/*
+ * pool.h - Pooled read buffers for the SimpleChar device
+ *
+ * Consumers that read the device in a loop take their buffers from a
+ * buffer_pool instead of allocating one per read:
+ *
+ *   simplechar::buffer_pool pool(dev);             // Sized from dev
+ *   simplechar::lease buf;
+ *   auto r = pool.read(dev, 0, buf);               // Fills a pooled buffer
+ *   consume(buf.bytes());                          // Valid until released
+ *   buf.release();                                 // Or let it go out of scope
+ *
+ * Every buffer in a pool has the same size: the largest read the device
+ * can return, which is its store size, or the autosize ceiling when the
+ * store grows, rounded up to whole pages. Buffers are carved from
+ * page-aligned arenas mapped a few at a time and never returned to the
+ * system while the pool lives, so steady-state reads allocate nothing.
+ *
+ * Each thread keeps its own cache of free buffers, which only it
+ * touches: taking and returning a buffer is a pointer push or pop with
+ * no lock. A buffer goes back to the cache of the thread that releases
+ * it. Caches that grow past cache_buffers hand half their buffers to a
+ * shared list, and empty caches refill from it, under the pool's mutex;
+ * only when that is empty too is a new arena mapped. stats() shows how
+ * often each level served a request.
+ *
+ * A lease is a move-only handle on one buffer, and views of its bytes
+ * stay valid until it is released or destroyed. The pool must outlive
+ * its leases.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_POOL_H
+#define SIMPLECHAR_POOL_H
+
+#include "simplechar.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace simplechar {
+
+class buffer_pool;
+
+struct pool_options {
+    size_t buffer_size = 0;         /* 0: the largest read of the device */
+    size_t arena_size = 1 << 20;    /* Mapped at a time, at least one buffer */
+    size_t cache_buffers = 8;       /* Free buffers a thread keeps to itself */
+};
+
+struct pool_stats {
+    uint64_t acquires = 0;          /* Buffers handed out */
+    uint64_t local_hits = 0;        /* Served from the thread's own cache */
+    uint64_t shared_hits = 0;       /* Served from the shared list */
+    uint64_t misses = 0;            /* Needed a buffer no one had used yet */
+    uint64_t arenas = 0;            /* Arenas mapped */
+    uint64_t outstanding = 0;       /* Leases not yet released */
+    size_t buffer_size = 0;
+    size_t reserved_bytes = 0;      /* Mapped for arenas */
+
+    /* Acquires served by a buffer some earlier lease used */
+    double hit_rate() const noexcept
+    {
+        return acquires ? double(local_hits + shared_hits) / double(acquires) : 0.0;
+    }
+
+    double local_hit_rate() const noexcept
+    {
+        return acquires ? double(local_hits) / double(acquires) : 0.0;
+    }
+};
+
+/* One pooled buffer, returned to its pool on release or destruction */
+class lease {
+public:
+    lease() noexcept = default;
+    ~lease() { release(); }
+    lease(lease &&other) noexcept;
+    lease &operator=(lease &&other) noexcept;
+    lease(const lease &) = delete;
+    lease &operator=(const lease &) = delete;
+
+    explicit operator bool() const noexcept { return data_ != nullptr; }
+
+    char *data() const noexcept { return data_; }
+    size_t size() const noexcept { return size_; }
+    size_t capacity() const noexcept { return capacity_; }
+
+    /* Bytes in use, set by buffer_pool::read() or by the holder */
+    void resize(size_t size) noexcept { size_ = size < capacity_ ? size : capacity_; }
+
+    const_buffer bytes() const noexcept { return {data_, size_}; }
+    mutable_buffer space() const noexcept { return {data_, capacity_}; }
+
+    /* Give the buffer back now; views of it are invalid afterwards */
+    void release() noexcept;
+
+private:
+    friend class buffer_pool;
+
+    lease(buffer_pool *pool, char *data, size_t capacity) noexcept
+        : pool_(pool), data_(data), capacity_(capacity) {}
+
+    buffer_pool *pool_ = nullptr;
+    char *data_ = nullptr;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+};
+
+class buffer_pool {
+public:
+    /*
+     * Buffers sized for reads of dev, unless opts.buffer_size says
+     * otherwise; arenas are mapped on first use
+     */
+    explicit buffer_pool(device &dev, const pool_options &opts = {});
+
+    /* Buffers of opts.buffer_size bytes, which must not be 0 */
+    explicit buffer_pool(const pool_options &opts);
+
+    /* Unmaps every arena; all leases must have been released */
+    ~buffer_pool();
+
+    buffer_pool(const buffer_pool &) = delete;
+    buffer_pool &operator=(const buffer_pool &) = delete;
+
+    size_t buffer_size() const noexcept { return opts_.buffer_size; }
+
+    /*
+     * A buffer from this thread's cache, the shared list or a new arena
+     * Throws std::system_error if a new arena cannot be mapped.
+     */
+    lease acquire();
+
+    /*
+     * Read from dev at offset into a pooled buffer held by out, which
+     * gives back whatever it held before; out.size() is the bytes read
+     */
+    io_result read(device &dev, uint64_t offset, lease &out);
+
+    pool_stats stats() const;
+
+private:
+    friend class lease;
+
+    struct cache;
+
+    cache *local_cache(bool create);
+    char *refill(cache &c);
+    void put(char *data) noexcept;
+    void map_arena();
+
+    pool_options opts_;
+    uint64_t id_;                   /* Tells pools apart in thread caches */
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<cache>> caches_;
+    std::vector<char *> shared_;    /* Released buffers beyond the caches */
+    std::vector<char *> fresh_;     /* Carved from an arena, never leased */
+    std::vector<std::pair<void *, size_t>> arenas_;
+    size_t buffers_per_arena_;
+
+    std::atomic<uint64_t> shared_hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> orphan_releases_{0};  /* By threads with no cache */
+};
+
+} /* namespace simplechar */
+
+#endif /* SIMPLECHAR_POOL_H */
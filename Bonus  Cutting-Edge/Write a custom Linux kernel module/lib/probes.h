@@ -0,0 +1,61 @@
+/*
+ * probes.h - USDT probes of the SimpleChar client library
+ *
+ * The library marks where its requests enter and leave the kernel and
+ * where callers are held back, as static user-space probes of provider
+ * "simplechar" that bpftrace, perf and SystemTap can attach to:
+ *
+ *   batch__submit       fd, ops, batch          batch::submit() starts
+ *   batch__complete     fd, ops, bytes, errno, syscalls, batch
+ *   op__submit          fd, write, len, offset, op   Coroutine I/O queued
+ *   op__complete        fd, write, result, op        Result handed back
+ *   flush__start        fd, bytes, iovecs       write_combiner pwritev()s
+ *   flush__done         fd, bytes, errno
+ *   ring__publish       fd, bytes, tail         ring_producer::publish()
+ *   ring__release       fd, bytes, head         ring_consumer::release()
+ *
+ * and the backpressure points, each a begin/end pair or a single event
+ * carrying the wait:
+ *
+ *   combiner__stall     len                     A thread's stage is full
+ *   combiner__resume    len
+ *   ring__full          fd, len                 Producer sleeps for space
+ *   ring__resume        fd, fits
+ *   backoff             errno, attempt, wait_us EAGAIN/ENOSPC retry sleep
+ *
+ * errno is 0 for success, and "result" is bytes or a negative errno as
+ * io_uring reports it. batch and op are addresses that pair a submit
+ * with its completion. scripts/bpftrace joins these with the driver's
+ * functions into latency breakdowns.
+ *
+ * A probe site compiles to a single nop and a note in the ELF file;
+ * arguments are only described to the tracer, never computed, and
+ * every argument here is a value the code has at hand anyway. Without
+ * <sys/sdt.h> (systemtap-sdt-dev, systemtap-sdt-devel) or with
+ * SIMPLECHAR_NO_PROBES defined the probes compile to nothing.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_PROBES_H
+#define SIMPLECHAR_PROBES_H
+
+#if !defined(SIMPLECHAR_NO_PROBES) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SIMPLECHAR_PROBE(name, ...) STAP_PROBEV(simplechar, name, __VA_ARGS__)
+#else
+namespace simplechar::detail {
+template <typename... Args>
+inline void probe_args(const Args &...) noexcept {}
+}
+
+/* Never runs, but keeps probe-only variables from looking unused */
+#define SIMPLECHAR_PROBE(name, ...)                                     \
+    do {                                                                \
+        if (false) {                                                    \
+            ::simplechar::detail::probe_args(__VA_ARGS__);              \
+        }                                                               \
+    } while (0)
+#endif
+
+#endif /* SIMPLECHAR_PROBES_H */
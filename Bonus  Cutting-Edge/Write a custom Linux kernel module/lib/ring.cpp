@@ -0,0 +1,333 @@
+/*
+ * ring.cpp - Zero-copy access to the SimpleChar record ring
+ *
+ * License: MIT
+ */
+
+#include "ring.h"
+#include "probes.h"
+
+#include <cerrno>
+#include <utility>
+
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace simplechar {
+
+namespace detail {
+
+namespace {
+
+std::system_error ring_error(int err, const char *what)
+{
+    return std::system_error(std::error_code(err, std::generic_category()), what);
+}
+
+bool valid_header(const simplechar_ring_header &h, size_t page)
+{
+    return h.magic == SIMPLECHAR_RING_MAGIC &&
+           h.version == SIMPLECHAR_RING_VERSION &&
+           h.size >= page && (h.size & (h.size - 1)) == 0 &&
+           h.data_offset >= sizeof(h) && h.data_offset % page == 0;
+}
+
+/* Both sides publish, then look for a sleeper; see the waits below */
+inline void full_fence() noexcept
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+inline void set_flag(__u32 *flag, uint32_t v) noexcept
+{
+    __atomic_store_n(flag, v, __ATOMIC_RELAXED);
+}
+
+inline bool flag_set(const __u32 *flag) noexcept
+{
+    return __atomic_load_n(flag, __ATOMIC_RELAXED) != 0;
+}
+
+} /* namespace */
+
+ring_map::ring_map(device &dev, uint64_t schema)
+    : fd_(dev.fd())
+{
+    size_t page = size_t(::sysconf(_SC_PAGESIZE));
+    int prot = PROT_READ | PROT_WRITE;
+    simplechar_ring_header h;
+
+    void *first = ::mmap(nullptr, page, prot, MAP_SHARED, fd_, 0);
+    if (first == MAP_FAILED) {
+        throw ring_error(errno, "cannot map the record ring");
+    }
+    std::memcpy(&h, first, sizeof(h));
+    ::munmap(first, page);
+    if (!valid_header(h, page)) {
+        throw ring_error(EPROTO, "unsupported record ring header");
+    }
+
+    map_len_ = size_t(h.data_offset + h.size);
+    void *map = ::mmap(nullptr, map_len_, prot, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+        throw ring_error(errno, "cannot map the record ring");
+    }
+    hdr_ = static_cast<simplechar_ring_header *>(map);
+    data_ = static_cast<char *>(map) + h.data_offset;
+    size_ = h.size;
+
+    /* Claim an untyped ring for our schema, or check the one it has */
+    uint64_t expected = 0;
+    if (schema &&
+        !__atomic_compare_exchange_n(&hdr_->schema, &expected, schema, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) &&
+        expected != schema) {
+        ::munmap(hdr_, map_len_);
+        hdr_ = nullptr;
+        throw ring_error(EPROTO, "record ring carries another schema");
+    }
+}
+
+ring_map::~ring_map()
+{
+    if (hdr_) {
+        ::munmap(hdr_, map_len_);
+    }
+}
+
+ring_map::ring_map(ring_map &&other) noexcept
+    : fd_(other.fd_), hdr_(std::exchange(other.hdr_, nullptr)),
+      data_(other.data_), size_(other.size_), map_len_(other.map_len_)
+{
+}
+
+ring_map &ring_map::operator=(ring_map &&other) noexcept
+{
+    if (this != &other) {
+        if (hdr_) {
+            ::munmap(hdr_, map_len_);
+        }
+        fd_ = other.fd_;
+        hdr_ = std::exchange(other.hdr_, nullptr);
+        data_ = other.data_;
+        size_ = other.size_;
+        map_len_ = other.map_len_;
+    }
+    return *this;
+}
+
+void ring_map::notify() noexcept
+{
+    ::ioctl(fd_, SIMPLECHAR_IOC_RING_NOTIFY);
+}
+
+bool ring_map::poll(short events, std::chrono::milliseconds timeout) noexcept
+{
+    struct pollfd pfd = {fd_, events, 0};
+    int ret;
+
+    do {
+        ret = ::poll(&pfd, 1, int(timeout.count()));
+    } while (ret < 0 && errno == EINTR);
+    return ret > 0;
+}
+
+void ring_corrupt()
+{
+    throw ring_error(EBADMSG, "corrupt record in the ring");
+}
+
+} /* namespace detail */
+
+ring_consumer::ring_consumer(device &dev, uint64_t schema)
+    : map_(dev, schema)
+{
+    head_ = detail::ring_load(&map_.header()->head);
+    mask_ = map_.size() - 1;
+}
+
+/*
+ * Hand the consumed space back, and wake the producer if it went to
+ * sleep for want of it
+ * The producer sets producer_waiting before its last look at head, and
+ * we look at the flag after storing head; the fences make sure at least
+ * one of the two sees the other.
+ */
+void ring_consumer::release(uint64_t head) noexcept
+{
+    simplechar_ring_header *hdr = map_.header();
+
+    detail::ring_store(&hdr->head, head);
+    SIMPLECHAR_PROBE(ring__release, map_.fd(), head - head_, head);
+    head_ = head;
+    stats_.batches++;
+
+    detail::full_fence();
+    if (detail::flag_set(&hdr->producer_waiting)) {
+        map_.notify();
+        stats_.notifies++;
+    }
+}
+
+bool ring_consumer::arm() noexcept
+{
+    simplechar_ring_header *hdr = map_.header();
+
+    detail::set_flag(&hdr->consumer_waiting, 1);
+    detail::full_fence();
+    return detail::ring_load(&hdr->tail) != head_;
+}
+
+void ring_consumer::disarm() noexcept
+{
+    detail::set_flag(&map_.header()->consumer_waiting, 0);
+}
+
+bool ring_consumer::wait(std::chrono::milliseconds timeout)
+{
+    bool ready = arm();
+
+    if (!ready) {
+        map_.poll(POLLIN, timeout);
+        stats_.polls++;
+        ready = detail::ring_load(&map_.header()->tail) != head_;
+    }
+    disarm();
+    return ready;
+}
+
+ring_producer::ring_producer(device &dev, uint64_t schema)
+    : map_(dev, schema)
+{
+    simplechar_ring_header *hdr = map_.header();
+
+    tail_ = published_ = detail::ring_load(&hdr->tail);
+    head_cache_ = detail::ring_load(&hdr->head);
+    mask_ = map_.size() - 1;
+    max_payload_ = size_t(SIMPLECHAR_RING_RECORD_MAX(map_.size()) -
+                          sizeof(simplechar_ring_record));
+}
+
+uint64_t ring_producer::footprint(size_t len) const noexcept
+{
+    uint64_t need = detail::ring_align(sizeof(simplechar_ring_record) + len);
+    uint64_t left = map_.size() - (tail_ & mask_);
+
+    /* Records never wrap: what is left at the end becomes padding */
+    return need > left ? left + need : need;
+}
+
+mutable_buffer ring_producer::try_reserve(size_t len) noexcept
+{
+    if (len > max_payload_) {
+        return {};
+    }
+
+    uint64_t need = footprint(len);
+    if (map_.size() - (tail_ - head_cache_) < need) {
+        head_cache_ = detail::ring_load(&map_.header()->head);
+        if (map_.size() - (tail_ - head_cache_) < need) {
+            return {};
+        }
+    }
+
+    char *data = map_.data();
+    uint64_t at = tail_ & mask_;
+
+    if (map_.size() - at < need) {
+        simplechar_ring_record pad = {
+            uint32_t(map_.size() - at - sizeof(pad)), SIMPLECHAR_RING_PAD};
+        std::memcpy(data + at, &pad, sizeof(pad));
+        tail_ += map_.size() - at;
+        at = 0;
+    }
+    reserved_at_ = at;
+    return mutable_buffer(data + at + sizeof(simplechar_ring_record), len);
+}
+
+void ring_producer::commit(size_t len) noexcept
+{
+    simplechar_ring_record rec = {uint32_t(len), 0};
+
+    std::memcpy(map_.data() + reserved_at_, &rec, sizeof(rec));
+    tail_ += detail::ring_align(sizeof(rec) + len);
+    stats_.records++;
+    stats_.bytes += len;
+}
+
+bool ring_producer::try_push(const_buffer msg) noexcept
+{
+    mutable_buffer slot = try_reserve(msg.size());
+
+    if (!slot.data()) {
+        return false;
+    }
+    std::memcpy(slot.data(), msg.data(), msg.size());
+    commit(msg.size());
+    return true;
+}
+
+/* The mirror image of ring_consumer::release() */
+void ring_producer::publish() noexcept
+{
+    simplechar_ring_header *hdr = map_.header();
+
+    if (tail_ == published_) {
+        return;
+    }
+    detail::ring_store(&hdr->tail, tail_);
+    SIMPLECHAR_PROBE(ring__publish, map_.fd(), tail_ - published_, tail_);
+    published_ = tail_;
+    stats_.batches++;
+
+    detail::full_fence();
+    if (detail::flag_set(&hdr->consumer_waiting)) {
+        map_.notify();
+        stats_.notifies++;
+    }
+}
+
+bool ring_producer::write(const_buffer msg, std::chrono::milliseconds timeout)
+{
+    if (msg.size() > max_payload_) {
+        return false;
+    }
+    while (!try_write(msg)) {
+        if (!wait(msg.size(), timeout)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * The driver reports POLLOUT once half the ring is free, which always
+ * fits a record of max_record(), so a sleeping producer is woken once
+ * per half ring the consumer drains rather than once per record.
+ */
+bool ring_producer::wait(size_t len, std::chrono::milliseconds timeout)
+{
+    simplechar_ring_header *hdr = map_.header();
+    uint64_t need = footprint(len);
+    bool fits;
+
+    publish();
+    detail::set_flag(&hdr->producer_waiting, 1);
+    detail::full_fence();
+    head_cache_ = detail::ring_load(&hdr->head);
+    fits = map_.size() - (tail_ - head_cache_) >= need;
+    if (!fits) {
+        SIMPLECHAR_PROBE(ring__full, map_.fd(), len);
+        map_.poll(POLLOUT, timeout);
+        stats_.polls++;
+        head_cache_ = detail::ring_load(&hdr->head);
+        fits = map_.size() - (tail_ - head_cache_) >= need;
+        SIMPLECHAR_PROBE(ring__resume, map_.fd(), fits);
+    }
+    detail::set_flag(&hdr->producer_waiting, 0);
+    return fits;
+}
+
+} /* namespace simplechar */
@@ -0,0 +1,300 @@
+/*
+ * ring.h - Zero-copy access to the SimpleChar record ring
+ *
+ * A driver loaded with ring_size=N exposes a ring of records that one
+ * producer and one consumer share through mmap():
+ *
+ *   auto dev = simplechar::device::open("/dev/simplechar");
+ *   simplechar::ring_consumer rc(dev);
+ *   for (;;) {
+ *       if (!rc.consume([](simplechar::const_buffer rec) { ... })) {
+ *           rc.wait();                 // poll() only when empty
+ *       }
+ *   }
+ *
+ *   simplechar::ring_producer rp(dev);
+ *   rp.write(msg);                     // Or try_push() many, publish()
+ *
+ * Records are read and written in place in the mapping, so moving one
+ * costs no system call and no copy beyond the producer's own. The
+ * consumer takes a whole batch per call with one acquire load of the
+ * producer's tail and hands it back with one release store of its head;
+ * the producer likewise publishes any number of pushed records with one
+ * release store. Each side touches only its own cache line of the
+ * header, and caches the other side's index until it runs out of work.
+ *
+ * A side only enters the kernel when it has to sleep, or when it must
+ * wake the other side, which it only does when that side said it was
+ * about to sleep. See simplechar_ioctl.h for the ring layout.
+ *
+ * Both ends can name the record schema they speak (see schema.h); the
+ * first to open the ring with one claims it, and an end with a different
+ * schema is refused at open.
+ *
+ * Neither class is thread safe: each is one end of a single-producer,
+ * single-consumer ring.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_RING_H
+#define SIMPLECHAR_RING_H
+
+#include "simplechar.h"
+#include "simplechar_ioctl.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+namespace simplechar {
+
+struct ring_stats {
+    uint64_t records = 0;           /* Pushed or consumed */
+    uint64_t bytes = 0;             /* Payload bytes of those records */
+    uint64_t batches = 0;           /* Index stores that moved records */
+    uint64_t polls = 0;             /* poll() calls while waiting */
+    uint64_t notifies = 0;          /* SIMPLECHAR_IOC_RING_NOTIFY calls */
+
+    double syscalls_per_record() const noexcept
+    {
+        return records ? double(polls + notifies) / double(records) : 0.0;
+    }
+};
+
+namespace detail {
+
+/*
+ * The shared mapping, common to both ends
+ * Reads the header to size the mapping, so any file laid out like the
+ * driver's ring, such as a preformatted regular file, works too.
+ */
+class ring_map {
+public:
+    ring_map(device &dev, uint64_t schema);
+    ~ring_map();
+
+    ring_map(ring_map &&other) noexcept;
+    ring_map &operator=(ring_map &&other) noexcept;
+
+    int fd() const noexcept { return fd_; }
+    simplechar_ring_header *header() const noexcept { return hdr_; }
+    char *data() const noexcept { return data_; }
+    uint64_t size() const noexcept { return size_; }
+
+    /* Wake the other end's poll(); errors only mean nobody can sleep */
+    void notify() noexcept;
+
+    /* poll() for events until they come or timeout; false on timeout */
+    bool poll(short events, std::chrono::milliseconds timeout) noexcept;
+
+private:
+    int fd_ = -1;
+    simplechar_ring_header *hdr_ = nullptr;
+    char *data_ = nullptr;
+    uint64_t size_ = 0;
+    size_t map_len_ = 0;
+};
+
+[[noreturn]] void ring_corrupt();
+
+inline uint64_t ring_load(const __u64 *p) noexcept
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+inline void ring_store(__u64 *p, uint64_t v) noexcept
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+constexpr uint64_t ring_align(uint64_t n) noexcept
+{
+    return (n + SIMPLECHAR_RING_ALIGN - 1) & ~uint64_t(SIMPLECHAR_RING_ALIGN - 1);
+}
+
+} /* namespace detail */
+
+/* Wait forever */
+inline constexpr std::chrono::milliseconds ring_forever{-1};
+
+class ring_consumer {
+public:
+    /*
+     * Map the ring of dev and resume at its current head
+     * schema is the hash of the record schema, 0 for untyped records.
+     * Throws std::system_error: ENODEV if the driver has no ring,
+     * EPROTO if the header is not one this library understands or the
+     * ring carries another schema.
+     */
+    explicit ring_consumer(device &dev, uint64_t schema = 0);
+
+    ring_consumer(ring_consumer &&) noexcept = default;
+    ring_consumer &operator=(ring_consumer &&) noexcept = default;
+
+    /*
+     * Call fn(const_buffer) for each published record, oldest first, up
+     * to max of them, and return how many there were
+     * The buffer points into the ring and is only valid during the call.
+     * Throws std::system_error(EBADMSG) on a record that runs past the
+     * published data or the end of the ring.
+     */
+    template <typename F>
+    size_t consume(F &&fn, size_t max = SIZE_MAX);
+
+    /*
+     * Sleep in poll() until records are published or timeout passes
+     * Returns whether there are records to consume.
+     */
+    bool wait(std::chrono::milliseconds timeout = ring_forever);
+
+    /*
+     * For event loops that sleep on fd() themselves, as fanin_reader does:
+     * arm() says the consumer is about to sleep, so the producer will
+     * notify, and returns whether records came in anyway; disarm() after
+     * waking
+     */
+    bool arm() noexcept;
+    void disarm() noexcept;
+    int fd() const noexcept { return map_.fd(); }
+
+    /* Bytes published and not yet consumed, records and padding alike */
+    uint64_t backlog() const noexcept
+    {
+        return detail::ring_load(&map_.header()->tail) - head_;
+    }
+
+    /* Bytes of record space */
+    uint64_t capacity() const noexcept { return map_.size(); }
+
+    const ring_stats &stats() const noexcept { return stats_; }
+
+    /* Bytes read ahead of the record being handed out */
+    static constexpr uint64_t prefetch_distance = 256;
+
+private:
+    void release(uint64_t head) noexcept;
+
+    detail::ring_map map_;
+    uint64_t head_;
+    uint64_t mask_;
+    ring_stats stats_;
+};
+
+class ring_producer {
+public:
+    /* Map the ring of dev and resume at its current tail; as above */
+    explicit ring_producer(device &dev, uint64_t schema = 0);
+
+    ring_producer(ring_producer &&) noexcept = default;
+    ring_producer &operator=(ring_producer &&) noexcept = default;
+
+    /* Largest payload a record can carry */
+    size_t max_record() const noexcept { return max_payload_; }
+
+    /*
+     * Copy msg into the ring without publishing it
+     * Returns false, pushing nothing, if there is no room right now or
+     * msg is larger than max_record().
+     */
+    bool try_push(const_buffer msg) noexcept;
+
+    /*
+     * Room for a record of up to len bytes, to be filled in place
+     * Empty if there is no room right now or len exceeds max_record().
+     * The record only exists once commit() is called; a later reserve
+     * or push replaces an uncommitted reservation.
+     */
+    mutable_buffer try_reserve(size_t len) noexcept;
+
+    /* Push the reserved record, cut to its first len bytes */
+    void commit(size_t len) noexcept;
+
+    /* Make every pushed record visible to the consumer */
+    void publish() noexcept;
+
+    /* try_push() and publish() */
+    bool try_write(const_buffer msg) noexcept
+    {
+        if (!try_push(msg)) {
+            return false;
+        }
+        publish();
+        return true;
+    }
+
+    /*
+     * Write msg, sleeping in poll() while the ring is full
+     * Returns false if timeout passed first or msg is too large.
+     */
+    bool write(const_buffer msg, std::chrono::milliseconds timeout = ring_forever);
+
+    /*
+     * Publish, then sleep in poll() until len bytes of payload fit or
+     * timeout passes; returns whether they fit
+     */
+    bool wait(size_t len, std::chrono::milliseconds timeout = ring_forever);
+
+    const ring_stats &stats() const noexcept { return stats_; }
+
+private:
+    /* Bytes, padding included, a record of len bytes needs at tail_ */
+    uint64_t footprint(size_t len) const noexcept;
+
+    detail::ring_map map_;
+    uint64_t tail_;                 /* Next record, pushed or not */
+    uint64_t published_;            /* Tail the consumer can see */
+    uint64_t head_cache_;           /* Consumer head at the last look */
+    uint64_t mask_;
+    size_t max_payload_;
+    uint64_t reserved_at_ = 0;      /* Record offset of try_reserve() */
+    ring_stats stats_;
+};
+
+template <typename F>
+size_t ring_consumer::consume(F &&fn, size_t max)
+{
+    simplechar_ring_header *hdr = map_.header();
+    const char *data = map_.data();
+    const uint64_t size = mask_ + 1;
+    const uint64_t tail = detail::ring_load(&hdr->tail);
+    uint64_t head = head_;
+    size_t n = 0;
+
+    while (head != tail && n < max) {
+        uint64_t at = head & mask_;
+        simplechar_ring_record rec;
+
+        if (tail - head < sizeof(rec) || size - at < sizeof(rec)) {
+            detail::ring_corrupt();
+        }
+        std::memcpy(&rec, data + at, sizeof(rec));
+        if (rec.flags & SIMPLECHAR_RING_PAD) {
+            head += size - at;
+            continue;
+        }
+
+        uint64_t len = detail::ring_align(sizeof(rec) + uint64_t(rec.len));
+        if (len > size - at || len > tail - head) {
+            detail::ring_corrupt();
+        }
+        /* Pull in the next records while this one is handled */
+        if (tail - head > len + prefetch_distance) {
+            __builtin_prefetch(data + ((head + len + prefetch_distance) & mask_));
+        }
+        fn(const_buffer(data + at + sizeof(rec), rec.len));
+        stats_.bytes += rec.len;
+        head += len;
+        n++;
+    }
+
+    stats_.records += n;
+    if (head != head_) {
+        release(head);
+    }
+    return n;
+}
+
+} /* namespace simplechar */
+
+#endif /* SIMPLECHAR_RING_H */
@@ -0,0 +1,392 @@
+/*
+ * schema.h - Compile-time record schemas for SimpleChar messages
+ *
+ * A schema is a list of field types known at compile time, from which
+ * it derives the record layout, an encoder, an in-place decoder and a
+ * hash that both ends of a ring check when they open it:
+ *
+ *   SIMPLECHAR_FIELD(ts, uint64_t);
+ *   SIMPLECHAR_FIELD(qty, uint32_t);
+ *   SIMPLECHAR_TEXT_FIELD(symbol);
+ *   using trade = simplechar::schema<ts, qty, symbol>;
+ *
+ *   simplechar::ring_producer rp(dev, trade::hash);
+ *   simplechar::try_push<trade>(rp, now, 100, "ACME");  // Encodes in the slot
+ *
+ *   simplechar::ring_consumer rc(dev, trade::hash);
+ *   rc.consume([](simplechar::const_buffer rec) {
+ *       if (auto t = trade::decode(rec)) {
+ *           t->get<qty>();                 // uint32_t
+ *           t->get<symbol>();              // std::string_view into the ring
+ *       }
+ *   });
+ *
+ * A record holds the fixed-size fields at offsets fixed by the schema,
+ * each aligned to its type, then the end offset of each variable-size
+ * field as a uint32_t, then the variable-size data. Encoding copies each
+ * value once, straight into the destination; decoding validates the
+ * variable-size table once and then reads fields where they lie, with
+ * no allocation. Values are stored in host byte order, for producers
+ * and consumers on the same machine.
+ *
+ * The hash covers the names, kinds and sizes of the fields in order, so
+ * renaming, reordering or retyping a field changes it.
+ *
+ * Header-only; encode() and decode() work with any buffer, not just
+ * ring slots.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_SCHEMA_H
+#define SIMPLECHAR_SCHEMA_H
+
+#include "ring.h"
+#include "simplechar.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+
+namespace simplechar {
+
+enum class field_kind : uint8_t {
+    fixed = 1,                      /* A trivially copyable value */
+    bytes = 2,                      /* Variable-size, read as const_buffer */
+    text = 3,                       /* Variable-size, read as string_view */
+};
+
+/*
+ * Field types derive from one of these and add
+ *   static constexpr std::string_view name = "...";
+ * which the SIMPLECHAR_*FIELD macros do for you.
+ */
+template <typename T>
+struct fixed_field {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "fixed fields are copied as bytes");
+    static_assert(alignof(T) <= 8, "records are only 8-byte aligned");
+
+    using value_type = T;
+    using param_type = T;
+    static constexpr field_kind kind = field_kind::fixed;
+    static constexpr size_t size = sizeof(T);
+    static constexpr size_t align = alignof(T);
+};
+
+struct bytes_field {
+    using value_type = const_buffer;
+    using param_type = const_buffer;
+    static constexpr field_kind kind = field_kind::bytes;
+    static constexpr size_t size = 0;
+    static constexpr size_t align = 1;
+
+    static const_buffer make(const char *p, size_t n) noexcept { return {p, n}; }
+    static size_t length(const_buffer v) noexcept { return v.size(); }
+    static const void *bytes(const_buffer v) noexcept { return v.data(); }
+};
+
+struct text_field {
+    using value_type = std::string_view;
+    using param_type = std::string_view;
+    static constexpr field_kind kind = field_kind::text;
+    static constexpr size_t size = 0;
+    static constexpr size_t align = 1;
+
+    static std::string_view make(const char *p, size_t n) noexcept { return {p, n}; }
+    static size_t length(std::string_view v) noexcept { return v.size(); }
+    static const void *bytes(std::string_view v) noexcept { return v.data(); }
+};
+
+#define SIMPLECHAR_FIELD(id, type)                                      \
+    struct id : ::simplechar::fixed_field<type> {                       \
+        static constexpr std::string_view name = #id;                   \
+    }
+
+#define SIMPLECHAR_BYTES_FIELD(id)                                      \
+    struct id : ::simplechar::bytes_field {                             \
+        static constexpr std::string_view name = #id;                   \
+    }
+
+#define SIMPLECHAR_TEXT_FIELD(id)                                       \
+    struct id : ::simplechar::text_field {                              \
+        static constexpr std::string_view name = #id;                   \
+    }
+
+namespace detail {
+
+constexpr uint64_t fnv_offset = 0xcbf29ce484222325ULL;
+constexpr uint64_t fnv_prime = 0x100000001b3ULL;
+
+constexpr uint64_t fnv_byte(uint64_t h, uint8_t b) noexcept
+{
+    return (h ^ b) * fnv_prime;
+}
+
+constexpr uint64_t fnv_u64(uint64_t h, uint64_t v) noexcept
+{
+    for (int i = 0; i < 8; i++) {
+        h = fnv_byte(h, uint8_t(v >> (8 * i)));
+    }
+    return h;
+}
+
+template <typename F>
+constexpr uint64_t hash_field(uint64_t h) noexcept
+{
+    for (char c : F::name) {
+        h = fnv_byte(h, uint8_t(c));
+    }
+    h = fnv_byte(h, 0);
+    h = fnv_byte(h, uint8_t(F::kind));
+    return fnv_u64(h, F::size);
+}
+
+template <typename F, typename... Fields>
+constexpr size_t index_of() noexcept
+{
+    constexpr bool match[] = {std::is_same_v<F, Fields>...};
+    for (size_t i = 0; i < sizeof...(Fields); i++) {
+        if (match[i]) {
+            return i;
+        }
+    }
+    return sizeof...(Fields);
+}
+
+} /* namespace detail */
+
+template <typename... Fields>
+class schema {
+    static_assert(sizeof...(Fields) > 0, "a schema needs fields");
+
+    static constexpr size_t count = sizeof...(Fields);
+    static constexpr bool variable[] = {(Fields::kind != field_kind::fixed)...};
+    static constexpr size_t sizes[] = {Fields::size...};
+    static constexpr size_t aligns[] = {Fields::align...};
+
+    struct layout {
+        std::array<size_t, count> offset{};  /* Fixed: byte offset; variable: table slot */
+        size_t nr_var = 0;
+        size_t table = 0;                   /* Start of the uint32_t end offsets */
+        size_t data = 0;                    /* Start of the variable-size data */
+    };
+
+    static constexpr layout compute() noexcept
+    {
+        layout l;
+        size_t at = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            if (variable[i]) {
+                l.offset[i] = l.nr_var++;
+                continue;
+            }
+            at = (at + aligns[i] - 1) & ~(aligns[i] - 1);
+            l.offset[i] = at;
+            at += sizes[i];
+        }
+        l.table = (at + alignof(uint32_t) - 1) & ~(alignof(uint32_t) - 1);
+        l.data = l.table + l.nr_var * sizeof(uint32_t);
+        return l;
+    }
+
+    static constexpr layout layout_ = compute();
+
+    template <typename F>
+    static constexpr size_t index = detail::index_of<F, Fields...>();
+
+public:
+    /* Checked by ring_producer and ring_consumer at open */
+    static constexpr uint64_t hash = [] {
+        uint64_t h = detail::fnv_u64(detail::fnv_offset, count);
+        ((h = detail::hash_field<Fields>(h)), ...);
+        return h;
+    }();
+
+    /* Bytes of a record whose variable-size fields are all empty */
+    static constexpr size_t fixed_size = layout_.data;
+
+    /* Where a fixed-size field lies in the record */
+    template <typename F>
+    static constexpr size_t offset_of() noexcept
+    {
+        static_assert(index<F> < count, "field is not in this schema");
+        static_assert(F::kind == field_kind::fixed, "only fixed fields have offsets");
+        return layout_.offset[index<F>];
+    }
+
+    /* Bytes encode() needs for these values */
+    static size_t encoded_size(const typename Fields::param_type &...values) noexcept
+    {
+        size_t n = fixed_size;
+
+        ((n += var_length<Fields>(values)), ...);
+        return n;
+    }
+
+    /*
+     * Write a record of values, given in field order, to the start of buf
+     * Returns the record's size, or 0, writing nothing, if it does not fit.
+     */
+    static size_t encode(mutable_buffer buf,
+                         const typename Fields::param_type &...values) noexcept
+    {
+        size_t n = encoded_size(values...);
+
+        if (n > buf.size() || n - fixed_size > UINT32_MAX) {
+            return 0;
+        }
+
+        char *p = buf.data();
+        size_t end = 0;
+
+        /* Alignment holes are zeroed so equal records are equal bytes */
+        std::memset(p, 0, fixed_size);
+        (put<Fields>(p, end, values), ...);
+        return n;
+    }
+
+    /* A record read in place; only valid while the bytes it views are */
+    class view {
+    public:
+        template <typename F>
+        typename F::value_type get() const noexcept
+        {
+            static_assert(index<F> < count, "field is not in this schema");
+            constexpr size_t at = layout_.offset[index<F>];
+
+            if constexpr (F::kind == field_kind::fixed) {
+                typename F::value_type v;
+                std::memcpy(&v, data_ + at, sizeof(v));
+                return v;
+            } else {
+                uint32_t begin = at ? end_of(at - 1) : 0;
+                return F::make(data_ + layout_.data + begin, end_of(at) - begin);
+            }
+        }
+
+        /* The whole record */
+        const_buffer bytes() const noexcept { return {data_, size_}; }
+
+    private:
+        friend class schema;
+
+        view(const char *data, size_t size) noexcept : data_(data), size_(size) {}
+
+        uint32_t end_of(size_t slot) const noexcept
+        {
+            uint32_t end;
+            std::memcpy(&end, data_ + layout_.table + slot * sizeof(end), sizeof(end));
+            return end;
+        }
+
+        const char *data_;
+        size_t size_;
+    };
+
+    /*
+     * Check that rec holds a record of this schema and view it
+     * Empty if rec is too short for the fixed part or its variable-size
+     * fields run outside it; rec may be longer than the record.
+     */
+    static std::optional<view> decode(const_buffer rec) noexcept
+    {
+        if (rec.size() < fixed_size) {
+            return std::nullopt;
+        }
+
+        view v(rec.data(), rec.size());
+        uint32_t prev = 0;
+
+        for (size_t slot = 0; slot < layout_.nr_var; slot++) {
+            uint32_t end = v.end_of(slot);
+            if (end < prev || end > rec.size() - fixed_size) {
+                return std::nullopt;
+            }
+            prev = end;
+        }
+        return v;
+    }
+
+private:
+    template <typename F>
+    static size_t var_length(const typename F::param_type &value) noexcept
+    {
+        if constexpr (F::kind == field_kind::fixed) {
+            (void)value;
+            return 0;
+        } else {
+            return F::length(value);
+        }
+    }
+
+    template <typename F>
+    static void put(char *p, size_t &end,
+                    const typename F::param_type &value) noexcept
+    {
+        constexpr size_t at = layout_.offset[index<F>];
+
+        if constexpr (F::kind == field_kind::fixed) {
+            std::memcpy(p + at, &value, sizeof(value));
+        } else {
+            size_t len = F::length(value);
+            uint32_t new_end = uint32_t(end + len);
+
+            if (len) {
+                std::memcpy(p + layout_.data + end, F::bytes(value), len);
+            }
+            std::memcpy(p + layout_.table + at * sizeof(new_end), &new_end,
+                        sizeof(new_end));
+            end = new_end;
+        }
+    }
+};
+
+/*
+ * Encode a record of schema S straight into the next slot of rp
+ * Returns false, pushing nothing, if the ring has no room right now or
+ * the values cannot be encoded.
+ */
+template <typename S, typename... Values>
+bool try_push(ring_producer &rp, const Values &...values) noexcept
+{
+    size_t len = S::encoded_size(values...);
+    mutable_buffer slot = rp.try_reserve(len);
+
+    if (!slot.data()) {
+        return false;
+    }
+    /* Left uncommitted, the reservation is taken over by the next push */
+    if (!S::encode(slot, values...)) {
+        return false;
+    }
+    rp.commit(len);
+    return true;
+}
+
+/*
+ * try_push(), sleeping in poll() while the ring is full
+ * Returns false only if the record is larger than rp.max_record() or
+ * its variable-size data exceeds what encode() can index.
+ */
+template <typename S, typename... Values>
+bool push(ring_producer &rp, const Values &...values)
+{
+    size_t len = S::encoded_size(values...);
+
+    if (len > rp.max_record() || len - S::fixed_size > UINT32_MAX) {
+        return false;
+    }
+    while (!try_push<S>(rp, values...)) {
+        rp.wait(len);
+    }
+    return true;
+}
+
+} /* namespace simplechar */
+
+#endif /* SIMPLECHAR_SCHEMA_H */
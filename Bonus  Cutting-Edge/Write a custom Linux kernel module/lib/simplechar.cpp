@@ -0,0 +1,472 @@
+/*
+ * simplechar.cpp - C++ client library for the SimpleChar device
+ *
+ * License: MIT
+ */
+
+#include "simplechar.h"
+#include "probes.h"
+#include "uring.h"
+#include "simplechar_ioctl.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace simplechar {
+
+namespace {
+
+std::error_code errno_code(int err)
+{
+    return std::error_code(err, std::generic_category());
+}
+
+/*
+ * Call fn, which returns -1 and sets errno on failure, until it succeeds
+ * or fails for good; EINTR always retries, EAGAIN and optionally ENOSPC
+ * retry with backoff up to the policy's attempts. EBUSY is transient only
+ * for open(), where it means the driver's open limit was reached.
+ */
+template <typename F>
+io_result with_retry(const retry_policy &policy, F &&fn, bool opening = false)
+{
+    auto wait = policy.backoff;
+    int attempt = 0;
+
+    for (;;) {
+        ssize_t ret = fn();
+        if (ret >= 0) {
+            return {size_t(ret), {}};
+        }
+        int err = errno;
+        if (err == EINTR) {
+            continue;
+        }
+        bool transient = err == EAGAIN ||
+                         (err == EBUSY && opening) ||
+                         (err == ENOSPC && policy.retry_enospc);
+        if (!transient || ++attempt >= policy.attempts) {
+            return {0, errno_code(err)};
+        }
+        SIMPLECHAR_PROBE(backoff, err, attempt, wait.count());
+        std::this_thread::sleep_for(wait);
+        wait = std::min(wait * 2, policy.max_backoff);
+    }
+}
+
+/*
+ * What a device node supports, probed on its first open in the process
+ * Keyed by the node rather than the path, so that a reloaded module,
+ * whose node is created anew, is probed again. mmap is only known once
+ * the node was opened for reading.
+ */
+struct node_features {
+    struct features f;
+    bool mmap_probed = false;
+};
+
+std::mutex node_lock;
+std::map<std::pair<dev_t, ino_t>, node_features> node_cache;
+
+node_features probe_ioctls(int fd)
+{
+    node_features n;
+    simplechar_delta delta{};
+    simplechar_qos qos{};
+    simplechar_trace_read trace{};
+    simplechar_autosize_info autosize{};
+    simplechar_ring_info ring{};
+
+    delta.since_gen = UINT64_MAX;
+    n.f.delta = ::ioctl(fd, SIMPLECHAR_IOC_GET_DELTA, &delta) == 0;
+    n.f.qos = ::ioctl(fd, SIMPLECHAR_IOC_GET_QOS, &qos) == 0;
+    n.f.trace = ::ioctl(fd, SIMPLECHAR_IOC_READ_TRACE, &trace) == 0;
+    n.f.autosize = ::ioctl(fd, SIMPLECHAR_IOC_GET_AUTOSIZE, &autosize) == 0;
+    n.f.ring = ::ioctl(fd, SIMPLECHAR_IOC_RING_INFO, &ring) == 0;
+    return n;
+}
+
+bool probe_mmap(int fd)
+{
+    long page = ::sysconf(_SC_PAGESIZE);
+    void *map = ::mmap(nullptr, size_t(page), PROT_READ, MAP_SHARED, fd, 0);
+
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    ::munmap(map, size_t(page));
+    return true;
+}
+
+struct features probe_features(int fd, const open_options &opts)
+{
+    struct stat st;
+    struct features f;
+
+    if (::fstat(fd, &st) < 0) {
+        f = probe_ioctls(fd).f;
+        f.mmap = opts.read && probe_mmap(fd);
+    } else {
+        std::lock_guard<std::mutex> guard(node_lock);
+        auto key = std::make_pair(st.st_dev, st.st_ino);
+        auto it = node_cache.find(key);
+
+        if (it == node_cache.end()) {
+            it = node_cache.emplace(key, probe_ioctls(fd)).first;
+        }
+        if (opts.read && !it->second.mmap_probed) {
+            it->second.f.mmap = probe_mmap(fd);
+            it->second.mmap_probed = true;
+        }
+        f = it->second.f;
+        f.mmap = f.mmap && opts.read;
+    }
+    f.io_uring = opts.use_io_uring && uring::supported();
+    return f;
+}
+
+} /* namespace */
+
+device device::open(const std::string &path, const open_options &opts)
+{
+    std::error_code ec;
+    device dev = open(path, opts, ec);
+
+    if (ec) {
+        throw std::system_error(ec, "cannot open " + path);
+    }
+    return dev;
+}
+
+device device::open(const std::string &path, const open_options &opts,
+                    std::error_code &ec) noexcept
+{
+    device dev;
+    int flags = O_CLOEXEC;
+
+    if (opts.read && opts.write) {
+        flags |= O_RDWR;
+    } else {
+        flags |= opts.write ? O_WRONLY : O_RDONLY;
+    }
+    if (opts.nonblock) {
+        flags |= O_NONBLOCK;
+    }
+    if (opts.append) {
+        flags |= O_APPEND;
+    }
+
+    /* The open limit of the driver fails non-blocking opens with EBUSY */
+    io_result r = with_retry(opts.retry, [&] {
+        return ::open(path.c_str(), flags);
+    }, true);
+    ec = r.error;
+    if (ec) {
+        return dev;
+    }
+    dev.fd_ = int(r.bytes);
+    dev.opts_ = opts;
+    dev.features_ = probe_features(dev.fd_, opts);
+    return dev;
+}
+
+device::device() noexcept = default;
+
+device::~device()
+{
+    close();
+}
+
+device::device(device &&other) noexcept
+    : fd_(other.fd_), features_(other.features_), opts_(other.opts_),
+      ring_(std::move(other.ring_)), ring_failed_(other.ring_failed_)
+{
+    other.fd_ = -1;
+}
+
+device &device::operator=(device &&other) noexcept
+{
+    if (this != &other) {
+        close();
+        fd_ = other.fd_;
+        features_ = other.features_;
+        opts_ = other.opts_;
+        ring_ = std::move(other.ring_);
+        ring_failed_ = other.ring_failed_;
+        other.fd_ = -1;
+    }
+    return *this;
+}
+
+void device::close() noexcept
+{
+    ring_.reset();
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+io_result device::read(mutable_buffer buf, uint64_t offset) noexcept
+{
+    return with_retry(opts_.retry, [&] {
+        if (offset == at_position) {
+            return ::read(fd_, buf.data(), buf.size());
+        }
+        return ::pread(fd_, buf.data(), buf.size(), off_t(offset));
+    });
+}
+
+io_result device::write(const_buffer buf, uint64_t offset) noexcept
+{
+    return with_retry(opts_.retry, [&] {
+        if (offset == at_position) {
+            return ::write(fd_, buf.data(), buf.size());
+        }
+        return ::pwrite(fd_, buf.data(), buf.size(), off_t(offset));
+    });
+}
+
+io_result device::writev(const iovec *iov, int count, uint64_t offset) noexcept
+{
+    /* pwritev2() takes -1 as the file position */
+    off_t off = offset == at_position ? -1 : off_t(offset);
+
+    return with_retry(opts_.retry, [&] {
+        return ::pwritev2(fd_, iov, count, off, 0);
+    });
+}
+
+std::error_code device::ioctl(unsigned long request, void *arg) noexcept
+{
+    int ret;
+
+    do {
+        ret = ::ioctl(fd_, request, arg);
+    } while (ret < 0 && errno == EINTR);
+    return ret < 0 ? errno_code(errno) : std::error_code();
+}
+
+uring *device::ring() noexcept
+{
+    if (!ring_ && !ring_failed_ && features_.io_uring) {
+        try {
+            ring_ = std::make_unique<uring>(opts_.ring_entries);
+        } catch (...) {
+            ring_failed_ = true;
+        }
+    }
+    return ring_.get();
+}
+
+void device::drop_ring() noexcept
+{
+    ring_.reset();
+    ring_failed_ = true;
+}
+
+bool batch::read(mutable_buffer buf, uint64_t offset) noexcept
+{
+    if (n_ == capacity) {
+        return false;
+    }
+    ops_[n_++] = op{false, buf.data(), buf.size(), offset, {}};
+    return true;
+}
+
+bool batch::write(const_buffer buf, uint64_t offset) noexcept
+{
+    if (n_ == capacity) {
+        return false;
+    }
+    /* Never written through: the same op slot serves reads */
+    ops_[n_++] = op{true, const_cast<char *>(buf.data()), buf.size(), offset, {}};
+    return true;
+}
+
+io_result batch::submit() noexcept
+{
+    io_result total;
+    uring *ring = nullptr;
+
+    syscalls_ = 0;
+    for (size_t i = 0; i < n_; i++) {
+        ops_[i].result = {};
+    }
+    SIMPLECHAR_PROBE(batch__submit, dev_->fd(), n_, this);
+
+    /* A single operation is cheapest as a plain system call */
+    if (n_ > 1) {
+        ring = dev_->ring();
+    }
+    if (!ring || !submit_uring(*ring)) {
+        submit_vectored();
+    }
+
+    for (size_t i = 0; i < n_; i++) {
+        total.bytes += ops_[i].result.bytes;
+        if (!total.error) {
+            total.error = ops_[i].result.error;
+        }
+    }
+    SIMPLECHAR_PROBE(batch__complete, dev_->fd(), n_, total.bytes,
+                     total.error.value(), syscalls_, this);
+    return total;
+}
+
+/*
+ * All operations in one io_uring_enter(), linked so they run in order
+ * A failed or short operation cancels the rest of the chain; those, and
+ * any that hit EINTR or EAGAIN, are finished one by one afterwards.
+ */
+bool batch::submit_uring(uring &ring) noexcept
+{
+    bool redo[capacity] = {};
+    size_t submitted, done = 0;
+    int ret;
+
+    if (n_ > ring.entries()) {
+        return false;
+    }
+    for (size_t i = 0; i < n_; i++) {
+        io_uring_sqe *sqe = ring.get_sqe();
+        op &o = ops_[i];
+
+        sqe->opcode = o.write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd = dev_->fd();
+        sqe->addr = uint64_t(uintptr_t(o.data));
+        sqe->len = uint32_t(o.len);
+        sqe->off = o.offset;
+        sqe->user_data = i;
+        if (i + 1 < n_) {
+            sqe->flags = IOSQE_IO_LINK;
+        }
+    }
+
+    ret = ring.submit_and_wait(unsigned(n_));
+    syscalls_++;
+    if (ret <= 0) {
+        /* The queued SQEs would leak into the next batch */
+        dev_->drop_ring();
+        return false;
+    }
+    submitted = size_t(ret);
+    std::fill(redo + submitted, redo + n_, true);
+
+    while (done < submitted) {
+        io_uring_cqe *cqe = ring.peek_cqe();
+        if (!cqe) {
+            ring.submit_and_wait(1);
+            syscalls_++;
+            continue;
+        }
+        op &o = ops_[cqe->user_data];
+        int res = cqe->res;
+
+        ring.cqe_seen();
+        done++;
+        if (res >= 0) {
+            o.result.bytes = size_t(res);
+        } else if (res == -ECANCELED || res == -EINTR || res == -EAGAIN) {
+            redo[cqe->user_data] = true;
+        } else {
+            o.result.error = errno_code(-res);
+        }
+    }
+    if (submitted < n_) {
+        dev_->drop_ring();
+    }
+
+    for (size_t i = 0; i < n_; i++) {
+        if (redo[i]) {
+            finish_one(ops_[i]);
+        }
+    }
+    return true;
+}
+
+/*
+ * One preadv()/pwritev() per run of operations that follow each other in
+ * the same direction at adjacent offsets, and one readv()/writev() per
+ * run of operations at the file position
+ */
+void batch::submit_vectored() noexcept
+{
+    iovec iov[capacity];
+    size_t i = 0;
+
+    while (i < n_) {
+        size_t j = i + 1;
+        bool stream = ops_[i].offset == device::at_position;
+        uint64_t end = stream ? device::at_position
+                              : ops_[i].offset + ops_[i].len;
+
+        while (j < n_ && ops_[j].write == ops_[i].write &&
+               ops_[j].offset == end) {
+            if (!stream) {
+                end += ops_[j].len;
+            }
+            j++;
+        }
+        if (j - i == 1) {
+            finish_one(ops_[i]);
+            i = j;
+            continue;
+        }
+
+        for (size_t k = i; k < j; k++) {
+            iov[k - i] = {ops_[k].data, ops_[k].len};
+        }
+        int fd = dev_->fd();
+        bool write = ops_[i].write;
+        off_t off = off_t(ops_[i].offset);
+        int cnt = int(j - i);
+        io_result r = with_retry(dev_->options().retry, [&] {
+            if (stream) {
+                return write ? ::writev(fd, iov, cnt) : ::readv(fd, iov, cnt);
+            }
+            return write ? ::pwritev(fd, iov, cnt, off)
+                         : ::preadv(fd, iov, cnt, off);
+        });
+        syscalls_++;
+
+        /*
+         * An error means nothing moved, so each operation can be redone
+         * on its own to find out which one failed. Otherwise the bytes
+         * fill the operations in order; those after a short one never
+         * ran and are issued on their own.
+         */
+        size_t left = r.bytes;
+        bool cut = bool(r.error);
+        for (size_t k = i; k < j; k++) {
+            if (cut) {
+                finish_one(ops_[k]);
+                continue;
+            }
+            ops_[k].result.bytes = std::min(ops_[k].len, left);
+            left -= ops_[k].result.bytes;
+            cut = ops_[k].result.bytes < ops_[k].len;
+        }
+        i = j;
+    }
+}
+
+void batch::finish_one(op &o) noexcept
+{
+    o.result = o.write ? dev_->write(const_buffer(o.data, o.len), o.offset)
+                       : dev_->read(mutable_buffer(o.data, o.len), o.offset);
+    syscalls_++;
+}
+
+} /* namespace simplechar */
@@ -0,0 +1,263 @@
+/*
+ * simplechar.h - C++ client library for the SimpleChar device
+ *
+ * libsimplechar wraps /dev/simplechar for applications:
+ *
+ *   simplechar::device dev = simplechar::device::open("/dev/simplechar");
+ *   char buf[256];
+ *   auto r = dev.read(buf, 0);         // r.bytes, r.error
+ *
+ *   simplechar::batch b(dev);
+ *   b.write(header, 0);
+ *   b.write(body, sizeof(header));     // adjacent: one pwritev()
+ *   b.write(footer, 4000);
+ *   b.submit();                        // one io_uring_enter() if possible
+ *
+ * Devices are move-only handles that close on destruction. Reads and
+ * writes take non-owning buffer views and never allocate. EINTR, which
+ * is how the driver's ERESTARTSYS reaches user space, is always retried;
+ * EAGAIN from the per-open rate limits of a non-blocking open, EBUSY from
+ * the open limit, and optionally ENOSPC, are retried with a capped
+ * exponential backoff.
+ *
+ * Features of the loaded driver are probed once per device node and
+ * process, not on every open. A batch goes through io_uring when the
+ * kernel allows it and otherwise through one preadv()/pwritev() per run
+ * of adjacent operations, or readv()/writev() at the file position.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_H
+#define SIMPLECHAR_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+
+struct iovec;
+
+namespace simplechar {
+
+class uring;
+
+/*
+ * Non-owning views of caller memory, the C++17 stand-in for
+ * std::span<std::byte>. Both convert from pointer and size, from
+ * contiguous containers (std::string, std::vector, std::array, C arrays)
+ * and, in C++20, from std::span.
+ */
+class mutable_buffer {
+public:
+    constexpr mutable_buffer() noexcept = default;
+    constexpr mutable_buffer(void *data, size_t size) noexcept
+        : data_(static_cast<char *>(data)), size_(size) {}
+
+    template <typename C, typename = decltype(std::declval<C &>().data()),
+              typename = std::enable_if_t<
+                  !std::is_const_v<std::remove_pointer_t<
+                      decltype(std::declval<C &>().data())>>>>
+    constexpr mutable_buffer(C &c) noexcept
+        : mutable_buffer(c.data(), c.size() * sizeof(*c.data())) {}
+
+    template <typename T, size_t N>
+    constexpr mutable_buffer(T (&a)[N]) noexcept
+        : mutable_buffer(a, sizeof(a)) {}
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+    template <typename T, size_t E>
+    constexpr mutable_buffer(std::span<T, E> s) noexcept
+        : mutable_buffer(s.data(), s.size_bytes()) {}
+#endif
+
+    constexpr char *data() const noexcept { return data_; }
+    constexpr size_t size() const noexcept { return size_; }
+
+private:
+    char *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+class const_buffer {
+public:
+    constexpr const_buffer() noexcept = default;
+    constexpr const_buffer(const void *data, size_t size) noexcept
+        : data_(static_cast<const char *>(data)), size_(size) {}
+    constexpr const_buffer(mutable_buffer b) noexcept
+        : data_(b.data()), size_(b.size()) {}
+
+    template <typename C, typename = decltype(std::declval<const C &>().data())>
+    constexpr const_buffer(const C &c) noexcept
+        : const_buffer(c.data(), c.size() * sizeof(*c.data())) {}
+
+    template <typename T, size_t N>
+    constexpr const_buffer(const T (&a)[N]) noexcept
+        : const_buffer(a, sizeof(a)) {}
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+    template <typename T, size_t E>
+    constexpr const_buffer(std::span<T, E> s) noexcept
+        : const_buffer(s.data(), s.size_bytes()) {}
+#endif
+
+    constexpr const char *data() const noexcept { return data_; }
+    constexpr size_t size() const noexcept { return size_; }
+
+private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/* Outcome of one operation; bytes may be short at the end of the device */
+struct io_result {
+    size_t bytes = 0;
+    std::error_code error;
+
+    explicit operator bool() const noexcept { return !error; }
+};
+
+struct retry_policy {
+    int attempts = 16;              /* Tries for EAGAIN, and ENOSPC if set */
+    std::chrono::microseconds backoff{20};      /* First wait, doubles */
+    std::chrono::microseconds max_backoff{5000};
+    bool retry_enospc = false;      /* Wait for space someone else frees */
+};
+
+struct open_options {
+    bool read = true;
+    bool write = true;
+    bool nonblock = false;          /* Limits fail with EAGAIN or EBUSY */
+    bool append = false;            /* Writes at the file position append */
+    bool use_io_uring = true;       /* Submit batches through io_uring */
+    unsigned ring_entries = 64;
+    retry_policy retry;
+};
+
+/* What the opened device and the kernel offer, probed once per node */
+struct features {
+    bool delta = false;             /* SIMPLECHAR_IOC_GET_DELTA */
+    bool qos = false;               /* Per-open rate limits */
+    bool trace = false;             /* Operation trace ring */
+    bool autosize = false;          /* SIMPLECHAR_IOC_GET_AUTOSIZE */
+    bool mmap = false;              /* The device can be mapped */
+    bool ring = false;              /* A record ring, see ring.h */
+    bool io_uring = false;          /* A ring could be set up for it */
+};
+
+class device {
+public:
+    /* Throws std::system_error if the device cannot be opened */
+    static device open(const std::string &path = "/dev/simplechar",
+                       const open_options &opts = {});
+    static device open(const std::string &path, const open_options &opts,
+                       std::error_code &ec) noexcept;
+
+    device() noexcept;
+    ~device();
+    device(device &&other) noexcept;
+    device &operator=(device &&other) noexcept;
+    device(const device &) = delete;
+    device &operator=(const device &) = delete;
+
+    bool is_open() const noexcept { return fd_ >= 0; }
+    int fd() const noexcept { return fd_; }
+    const struct features &features() const noexcept { return features_; }
+    const open_options &options() const noexcept { return opts_; }
+    void close() noexcept;
+
+    /* Offset meaning the file position, as read() and write() use */
+    static constexpr uint64_t at_position = UINT64_MAX;
+
+    /*
+     * Like pread()/pwrite() with the retry policy applied; at_position
+     * reads or writes at the file position like read()/write()
+     */
+    io_result read(mutable_buffer buf, uint64_t offset) noexcept;
+    io_result write(const_buffer buf, uint64_t offset) noexcept;
+
+    /* Like pwritev(); the driver writes the whole vector in one go */
+    io_result writev(const iovec *iov, int count, uint64_t offset) noexcept;
+
+    /* ioctl() with EINTR retried; 0 or the error */
+    std::error_code ioctl(unsigned long request, void *arg) noexcept;
+
+    /* The device's io_uring, set up on first use; nullptr if unavailable */
+    uring *ring() noexcept;
+
+private:
+    friend class batch;
+
+    /* Give up on io_uring after the ring was left in an unknown state */
+    void drop_ring() noexcept;
+
+    int fd_ = -1;
+    struct features features_;
+    open_options opts_;
+    std::unique_ptr<uring> ring_;
+    bool ring_failed_ = false;
+};
+
+/*
+ * A batch of reads and writes submitted together
+ * Holds up to capacity operations in place, so building and submitting a
+ * batch allocates nothing. Operations complete in the order they were
+ * added: io_uring submissions are linked, and the fallback path only
+ * merges operations that are adjacent in both order and offset.
+ */
+class batch {
+public:
+    static constexpr size_t capacity = 64;
+
+    explicit batch(device &dev) noexcept : dev_(&dev) {}
+
+    /* Queue an operation; false when the batch is full */
+    bool read(mutable_buffer buf, uint64_t offset) noexcept;
+    bool write(const_buffer buf, uint64_t offset) noexcept;
+
+    size_t size() const noexcept { return n_; }
+    bool empty() const noexcept { return n_ == 0; }
+
+    /*
+     * Run every queued operation; the result is the first error, if any,
+     * and the bytes moved by all of them. Per-operation results stay
+     * available through result() until clear().
+     */
+    io_result submit() noexcept;
+    const io_result &result(size_t i) const noexcept { return ops_[i].result; }
+
+    /* System calls the last submit made */
+    unsigned syscalls() const noexcept { return syscalls_; }
+
+    void clear() noexcept { n_ = 0; syscalls_ = 0; }
+
+private:
+    struct op {
+        bool write;
+        char *data;
+        size_t len;
+        uint64_t offset;
+        io_result result;
+    };
+
+    bool submit_uring(uring &ring) noexcept;
+    void submit_vectored() noexcept;
+    void finish_one(op &o) noexcept;
+
+    device *dev_;
+    std::array<op, capacity> ops_;
+    size_t n_ = 0;
+    unsigned syscalls_ = 0;
+};
+
+} /* namespace simplechar */
+
+#endif /* SIMPLECHAR_H */
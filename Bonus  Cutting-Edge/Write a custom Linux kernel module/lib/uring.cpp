@@ -0,0 +1,207 @@
+/*
+ * uring.cpp - Minimal io_uring ring for libsimplechar
+ *
+ * License: MIT
+ */
+
+#include "uring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace simplechar {
+
+namespace {
+
+int sys_setup(unsigned entries, io_uring_params *p)
+{
+    return int(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+int sys_enter(int fd, unsigned to_submit, unsigned min_complete,
+              unsigned flags)
+{
+    return int(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                         flags, nullptr, 0));
+}
+
+int sys_register(int fd, unsigned opcode, const void *arg, unsigned nr)
+{
+    return int(::syscall(__NR_io_uring_register, fd, opcode, arg, nr));
+}
+
+unsigned load_acquire(const unsigned *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void store_release(unsigned *p, unsigned v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+template <typename T>
+T *at(void *base, uint32_t off)
+{
+    return reinterpret_cast<T *>(static_cast<char *>(base) + off);
+}
+
+} /* namespace */
+
+bool uring::supported() noexcept
+{
+    static const bool ok = [] {
+        io_uring_params p{};
+        int fd = sys_setup(1, &p);
+
+        if (fd < 0) {
+            return false;
+        }
+        ::close(fd);
+        return true;
+    }();
+    return ok;
+}
+
+uring::uring(unsigned entries)
+{
+    io_uring_params p{};
+
+    fd_ = sys_setup(entries, &p);
+    if (fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(),
+                                "io_uring_setup");
+    }
+    sq_entries_ = p.sq_entries;
+    features_ = p.features;
+
+    sq_map_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_map_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (features_ & IORING_FEAT_SINGLE_MMAP) {
+        sq_map_len_ = cq_map_len_ = std::max(sq_map_len_, cq_map_len_);
+    }
+
+    sq_map_ = ::mmap(nullptr, sq_map_len_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_map_ == MAP_FAILED) {
+        int err = errno;
+        ::close(fd_);
+        throw std::system_error(err, std::generic_category(), "mmap sq ring");
+    }
+    if (features_ & IORING_FEAT_SINGLE_MMAP) {
+        cq_map_ = sq_map_;
+    } else {
+        cq_map_ = ::mmap(nullptr, cq_map_len_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    }
+    sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = ::mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (cq_map_ == MAP_FAILED || sqes == MAP_FAILED) {
+        int err = errno;
+        if (sqes != MAP_FAILED) {
+            ::munmap(sqes, sqes_len_);
+        }
+        if (cq_map_ != MAP_FAILED && cq_map_ != sq_map_) {
+            ::munmap(cq_map_, cq_map_len_);
+        }
+        ::munmap(sq_map_, sq_map_len_);
+        ::close(fd_);
+        throw std::system_error(err, std::generic_category(), "mmap io_uring");
+    }
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+    sq_head_ = at<unsigned>(sq_map_, p.sq_off.head);
+    sq_tail_ptr_ = at<unsigned>(sq_map_, p.sq_off.tail);
+    sq_mask_ = at<unsigned>(sq_map_, p.sq_off.ring_mask);
+    sq_array_ = at<unsigned>(sq_map_, p.sq_off.array);
+    cq_head_ = at<unsigned>(cq_map_, p.cq_off.head);
+    cq_tail_ = at<unsigned>(cq_map_, p.cq_off.tail);
+    cq_mask_ = at<unsigned>(cq_map_, p.cq_off.ring_mask);
+    cqes_ = at<io_uring_cqe>(cq_map_, p.cq_off.cqes);
+
+    sq_tail_ = sq_submitted_ = *sq_tail_ptr_;
+}
+
+uring::~uring()
+{
+    ::munmap(sqes_, sqes_len_);
+    if (cq_map_ != sq_map_) {
+        ::munmap(cq_map_, cq_map_len_);
+    }
+    ::munmap(sq_map_, sq_map_len_);
+    ::close(fd_);
+}
+
+io_uring_sqe *uring::get_sqe() noexcept
+{
+    if (sq_tail_ - load_acquire(sq_head_) >= sq_entries_) {
+        return nullptr;
+    }
+    unsigned idx = sq_tail_ & *sq_mask_;
+    io_uring_sqe *sqe = &sqes_[idx];
+
+    sq_array_[idx] = idx;
+    sq_tail_++;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int uring::submit_and_wait(unsigned wait_nr) noexcept
+{
+    unsigned to_submit = pending();
+    int ret;
+
+    store_release(sq_tail_ptr_, sq_tail_);
+    do {
+        ret = sys_enter(fd_, to_submit, wait_nr,
+                        wait_nr ? IORING_ENTER_GETEVENTS : 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        return -errno;
+    }
+    sq_submitted_ += unsigned(ret);
+    return ret;
+}
+
+io_uring_cqe *uring::peek_cqe() noexcept
+{
+    unsigned head = *cq_head_;
+
+    if (head == load_acquire(cq_tail_)) {
+        return nullptr;
+    }
+    return &cqes_[head & *cq_mask_];
+}
+
+void uring::cqe_seen() noexcept
+{
+    store_release(cq_head_, *cq_head_ + 1);
+}
+
+int uring::register_buffers(const iovec *iov, unsigned nr) noexcept
+{
+    return sys_register(fd_, IORING_REGISTER_BUFFERS, iov, nr) < 0 ? -errno : 0;
+}
+
+int uring::register_files(const int *fds, unsigned nr) noexcept
+{
+    return sys_register(fd_, IORING_REGISTER_FILES, fds, nr) < 0 ? -errno : 0;
+}
+
+int uring::update_files(unsigned off, const int *fds, unsigned nr) noexcept
+{
+    io_uring_files_update up{};
+
+    up.offset = off;
+    up.fds = uint64_t(uintptr_t(fds));
+    return sys_register(fd_, IORING_REGISTER_FILES_UPDATE, &up, nr) < 0 ? -errno : 0;
+}
+
+} /* namespace simplechar */
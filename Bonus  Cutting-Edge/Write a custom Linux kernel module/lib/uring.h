@@ -0,0 +1,87 @@
+/*
+ * uring.h - Minimal io_uring ring for libsimplechar
+ *
+ * Sets up one submission/completion ring pair with the raw system calls,
+ * so the library has no liburing dependency. It offers what the batch
+ * path needs: grab SQEs, submit and wait, walk CQEs, and register fixed
+ * buffers and files. One ring is meant for one thread.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_URING_H
+#define SIMPLECHAR_URING_H
+
+#include <cstdint>
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+namespace simplechar {
+
+class uring {
+public:
+    /* Whether this kernel lets the process create rings, probed once */
+    static bool supported() noexcept;
+
+    /* Throws std::system_error if the ring cannot be set up */
+    explicit uring(unsigned entries);
+    ~uring();
+
+    uring(const uring &) = delete;
+    uring &operator=(const uring &) = delete;
+
+    int fd() const noexcept { return fd_; }
+    unsigned entries() const noexcept { return sq_entries_; }
+
+    /* Next free SQE, zeroed; nullptr when the submission queue is full */
+    io_uring_sqe *get_sqe() noexcept;
+
+    /* SQEs filled since the last submit */
+    unsigned pending() const noexcept { return sq_tail_ - sq_submitted_; }
+
+    /*
+     * Submit the pending SQEs and wait for at least wait_nr completions
+     * Returns the number submitted or -errno; EINTR is retried.
+     */
+    int submit_and_wait(unsigned wait_nr = 0) noexcept;
+
+    /* Oldest unseen completion, nullptr if none is ready */
+    io_uring_cqe *peek_cqe() noexcept;
+    void cqe_seen() noexcept;
+
+    /* IORING_REGISTER_BUFFERS / FILES; 0 or -errno */
+    int register_buffers(const iovec *iov, unsigned nr) noexcept;
+    int register_files(const int *fds, unsigned nr) noexcept;
+
+    /* Replace registered files from slot off on; -1 empties a slot */
+    int update_files(unsigned off, const int *fds, unsigned nr) noexcept;
+
+private:
+    int fd_ = -1;
+    unsigned sq_entries_ = 0;
+    unsigned features_ = 0;
+
+    void *sq_map_ = nullptr;
+    size_t sq_map_len_ = 0;
+    void *cq_map_ = nullptr;
+    size_t cq_map_len_ = 0;
+    io_uring_sqe *sqes_ = nullptr;
+    size_t sqes_len_ = 0;
+
+    unsigned *sq_head_ = nullptr;
+    unsigned *sq_tail_ptr_ = nullptr;
+    unsigned *sq_mask_ = nullptr;
+    unsigned *sq_array_ = nullptr;
+    unsigned *cq_head_ = nullptr;
+    unsigned *cq_tail_ = nullptr;
+    unsigned *cq_mask_ = nullptr;
+    io_uring_cqe *cqes_ = nullptr;
+
+    unsigned sq_tail_ = 0;          /* Local tail, published at submit */
+    unsigned sq_submitted_ = 0;     /* Tail as of the last submit */
+};
+
+} /* namespace simplechar */
+
+#endif /* SIMPLECHAR_URING_H */
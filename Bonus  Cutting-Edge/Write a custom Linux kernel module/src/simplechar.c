@@ -16,26 +16,68 @@
 #include <linux/fs.h>            /* Header for Linux file system support */
 #include <linux/cdev.h>          /* Character device structure */
 #include <linux/uaccess.h>       /* Required for copy_to_user/copy_from_user */
+#include <linux/uio.h>           /* iov_iter for the store copy helpers */
 #include <linux/slab.h>          /* Required for kmalloc/kfree */
-#include <linux/mutex.h>         /* Mutex support for concurrency */
+#include <linux/gfp.h>           /* Page allocation for the backing store */
+#include <linux/hashtable.h>     /* Per-uid usage table */
+#include <linux/cred.h>          /* current_fsuid() */
+#include <linux/spinlock.h>      /* Spinlocks protecting the FIFO gates */
+#include <linux/list.h>          /* FIFO waiter queues */
 #include <linux/proc_fs.h>       /* Proc filesystem support */
 #include <linux/seq_file.h>      /* Sequential file operations */
+#include <linux/ktime.h>         /* Monotonic clock for rate limiting */
+#include <linux/hrtimer.h>       /* High resolution sleeps while throttled */
+#include <linux/math64.h>        /* 64-bit multiply/divide helpers */
+#include <linux/sched/signal.h>  /* signal_pending() */
+#include <linux/rcupdate.h>      /* rcu_read_lock() around gate hand-offs */
+#include <linux/workqueue.h>     /* Periodic fill sampling for autosize */
+#include <linux/log2.h>          /* roundup_pow_of_two() for the trace ring */
+#include <linux/vmalloc.h>       /* vmalloc_user() for the record ring */
+#include <linux/poll.h>          /* poll() on the record ring */
+#include <linux/wait.h>          /* Record ring sleepers */
+#include <linux/version.h>       /* class_create() lost its owner in 6.4 */
+
+#include "simplechar_ioctl.h"    /* ioctl interface shared with user space */
+#include "simplechar_engine.h"   /* Entry points exported to companion modules */
 
 #define DEVICE_NAME "simplechar"  /* Device name as it appears in /dev */
 #define CLASS_NAME  "simple"      /* Device class name */
 #define BUFFER_SIZE_DEFAULT 1024  /* Default buffer size */
 #define BUFFER_SIZE_MAX 4096      /* Maximum buffer size */
+#define STORE_SIZE_MAX (4 << 20)  /* Maximum size autosize may grow to */
+#define AUTOSIZE_SHRINK_PCT 25    /* Fill level considered low */
+#define AUTOSIZE_SHRINK_SAMPLES 5 /* Consecutive low samples before shrinking */
+#define AUTOSIZE_DECAY_SHIFT 2    /* High-water mark loses 1/4 per sample */
+#define TRACE_EVENTS_MAX (1 << 20) /* Largest trace ring, in events */
+#define RING_SIZE_MAX (64 << 20)  /* Largest record ring, in bytes */
+
+#ifndef SIMPLECHAR_GIT_HASH
+#define SIMPLECHAR_GIT_HASH "unknown" /* Set by the Makefile */
+#endif
 
-/* Module information */
-MODULE_LICENSE("MIT");
+/*
+ * Module information
+ * Dual licensed: the QoS throttle's hrtimer sleep and the ktime clocks
+ * are only exported to GPL-compatible modules
+ */
+MODULE_LICENSE("Dual MIT/GPL");
 MODULE_AUTHOR("Your Name");
 MODULE_DESCRIPTION("A simple character device driver");
 MODULE_VERSION("1.0");
+MODULE_INFO(git_hash, SIMPLECHAR_GIT_HASH);
 
 /* Module parameters */
 static int buffer_size = BUFFER_SIZE_DEFAULT;
 static int debug_level = 1;
 static char *device_name = DEVICE_NAME;
+static int max_opens = 0;
+static unsigned long uid_quota = 0;
+static bool autosize = false;
+static int autosize_max = 64 * 1024;
+static unsigned int autosize_interval_ms = 1000;
+static unsigned int trace_events = 0;
+static bool trace = false;
+static unsigned int ring_size = 0;
 
 module_param(buffer_size, int, S_IRUGO);
 MODULE_PARM_DESC(buffer_size, "Size of the internal buffer (max 4096)");
@@ -46,16 +88,150 @@ MODULE_PARM_DESC(debug_level, "Debug verbosity level (0-3)");
 module_param(device_name, charp, S_IRUGO);
 MODULE_PARM_DESC(device_name, "Device name (default: simplechar)");
 
+module_param(max_opens, int, S_IRUGO);
+MODULE_PARM_DESC(max_opens, "Maximum concurrent opens, 0 = unlimited (default: 0)");
+
+module_param(uid_quota, ulong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(uid_quota, "Backing store bytes each uid may allocate, 0 = unlimited (default: 0)");
+
+module_param(autosize, bool, S_IRUGO);
+MODULE_PARM_DESC(autosize, "Grow and shrink the buffer with demand (default: off)");
+
+module_param(autosize_max, int, S_IRUGO);
+MODULE_PARM_DESC(autosize_max, "Largest size autosize may grow to (default: 65536, max 4 MiB)");
+
+module_param(autosize_interval_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(autosize_interval_ms, "Fill sampling interval for autosize (default: 1000)");
+
+module_param(trace_events, uint, S_IRUGO);
+MODULE_PARM_DESC(trace_events, "Operation trace ring size in events, 0 = no ring (default: 0)");
+
+module_param(trace, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(trace, "Record operations into the trace ring (default: off)");
+
+module_param(ring_size, uint, S_IRUGO);
+MODULE_PARM_DESC(ring_size, "Shared record ring size in bytes, 0 = no ring (default: 0)");
+
+/*
+ * FIFO gate
+ * Admits up to limit holders at a time. When full, callers queue in
+ * arrival order and a leaving holder hands its slot directly to the
+ * oldest waiter, so late arrivals can never overtake queued ones.
+ */
+struct simplechar_gate {
+    spinlock_t lock;            /* Protects the fields below */
+    unsigned int held;          /* Current number of holders */
+    unsigned int limit;         /* Maximum holders, 0 = unlimited */
+    unsigned int nr_waiting;    /* Length of the waiters queue */
+    struct list_head waiters;   /* Queued simplechar_gate_waiter, oldest first */
+    u64 acquisitions;           /* Statistics: entries */
+    u64 contended;              /* Statistics: entries that queued */
+    u64 wait_ns;                /* Statistics: time from queueing to hand-off */
+    u64 max_wait_ns;            /* Statistics: longest wait */
+    u64 hold_ns;                /* Statistics: time held, when limit is 1 */
+    u64 held_since;             /* When the current exclusive hold began */
+};
+
+/*
+ * One queued call, on the stack of the caller
+ * Each blocked read, write, ioctl or open queues its own entry, so opens
+ * of the same task, or calls on different files, are served in their own
+ * arrival order rather than as one task.
+ */
+struct simplechar_gate_waiter {
+    struct list_head node;
+    struct task_struct *task;   /* Only to wake the caller */
+    u64 queued_ns;              /* When the waiter joined the queue */
+    bool granted;               /* Set by the holder handing over its slot */
+};
+
+/* Backing store charged to one uid */
+struct simplechar_uid_usage {
+    struct hlist_node node;
+    kuid_t uid;
+    u64 bytes;              /* Bytes of backing pages allocated by this uid */
+};
+
+/*
+ * Operation trace ring
+ * Overwrites the oldest events when full; head is the sequence number of
+ * the next event, so event seq lives at events[seq & mask].
+ */
+struct simplechar_trace {
+    spinlock_t lock;        /* Protects the fields below */
+    struct simplechar_trace_event *events;
+    u32 mask;               /* Ring size - 1, size is a power of two */
+    u64 head;               /* Events recorded since load */
+    u64 last_ns;            /* Time of the previous event, for gap_ns */
+};
+
+/*
+ * Shared record ring
+ * User space moves the indices in hdr itself; the driver only maps the
+ * ring, reports its state to poll() and wakes sleepers on request. The
+ * header can be scribbled on by any mapper, so size is kept here.
+ */
+struct simplechar_ring {
+    struct simplechar_ring_header *hdr; /* Header page, the data follows */
+    u64 size;               /* Data bytes, a power of two */
+    wait_queue_head_t wait; /* Producers and consumers in poll() */
+    atomic64_t notifies;    /* Statistics: SIMPLECHAR_IOC_RING_NOTIFY calls */
+};
+
 /* Device structure */
 struct simplechar_dev {
-    char *buffer;           /* Internal data buffer */
+    char **pages;           /* Backing pages, allocated on first write */
+    struct simplechar_uid_usage **page_owner; /* Uid charged for each page */
+    size_t nr_pages;        /* Number of entries in pages */
+    DECLARE_HASHTABLE(uid_usage, 4);   /* Per-uid simplechar_uid_usage */
     size_t buffer_len;      /* Current data length */
     size_t buffer_size;     /* Total buffer size */
-    struct mutex mutex;     /* Mutex for thread safety */
+    size_t size_min;        /* Autosize floor, the initial buffer size */
+    size_t size_max;        /* Autosize ceiling, sizes pages and block_gen */
+    struct simplechar_gate io_gate;    /* Serializes buffer access, FIFO */
+    struct simplechar_gate open_gate;  /* Admission control for opens */
     struct cdev cdev;       /* Character device structure */
     atomic_t open_count;    /* Number of times device is open */
     unsigned long read_count;  /* Statistics: read operations */
     unsigned long write_count; /* Statistics: write operations */
+    u64 generation;         /* Bumped on every write */
+    u64 *block_gen;         /* Generation of the last write to each block */
+    atomic64_t throttled_ns;   /* Statistics: time spent throttled by QoS */
+    u64 writer_full;        /* Statistics: writes refused or cut short */
+    u64 reader_empty;       /* Statistics: reads that found no data */
+    u64 last_writer_full;   /* writer_full at the previous sample */
+    u64 last_reader_empty;  /* reader_empty at the previous sample */
+    u32 writer_full_rate;   /* Per second over the last sample interval */
+    u32 reader_empty_rate;  /* Per second over the last sample interval */
+    u32 fill_pct;           /* Fill level at the last sample */
+    size_t access_end;      /* Highest end read or written since the last sample */
+    size_t high_water;      /* Decaying high-water mark of access_end */
+    size_t want_end;        /* Largest end a write ran out of space for */
+    unsigned int low_fill_samples; /* Consecutive samples below threshold */
+    u64 nr_resizes;         /* Total resizes, indexes resize_history */
+    struct simplechar_resize_event resize_history[SIMPLECHAR_RESIZE_HISTORY];
+    struct delayed_work autosize_work; /* Periodic fill sampling */
+    struct simplechar_trace trace;     /* Recent operations, if enabled */
+    struct simplechar_ring ring;       /* Shared record ring, if enabled */
+    atomic_t next_open_id;  /* Source of simplechar_file.open_id */
+};
+
+/* Token bucket for per-open rate limiting, updated without locks */
+struct simplechar_bucket {
+    atomic64_t tokens;      /* Tokens currently available */
+    atomic64_t last_ns;     /* Time of the last refill */
+    u64 rate;               /* Tokens added per second, 0 = unlimited */
+    u64 burst;              /* Maximum number of tokens */
+};
+
+/* Per-open state, stored in file->private_data */
+struct simplechar_file {
+    struct simplechar_bucket ops;      /* Operations per second */
+    struct simplechar_bucket bytes;    /* Bytes per second */
+    atomic64_t throttled_ns;           /* Time spent waiting for tokens */
+    atomic64_t throttled_ops;          /* Operations that had to wait */
+    atomic64_t rejected_ops;           /* Operations failed with -EAGAIN */
+    u32 open_id;                       /* Names this open in the trace */
 };
 
 /* Global variables */
@@ -73,203 +249,1685 @@ static struct proc_dir_entry *proc_entry = NULL;
         } \
     } while (0)
 
-#define INFO_PRINT(fmt, args...) \
-    printk(KERN_INFO "simplechar: " fmt, ##args)
+#define INFO_PRINT(fmt, args...) \
+    printk(KERN_INFO "simplechar: " fmt, ##args)
+
+#define WARN_PRINT(fmt, args...) \
+    printk(KERN_WARNING "simplechar: " fmt, ##args)
+
+#define ERR_PRINT(fmt, args...) \
+    printk(KERN_ERR "simplechar: " fmt, ##args)
+
+/* Function prototypes */
+static int device_open(struct inode *, struct file *);
+static int device_release(struct inode *, struct file *);
+static ssize_t device_read(struct file *, char __user *, size_t, loff_t *);
+static ssize_t device_write(struct file *, const char __user *, size_t, loff_t *);
+static ssize_t device_write_iter(struct kiocb *, struct iov_iter *);
+static long device_ioctl(struct file *, unsigned int, unsigned long);
+static int device_mmap(struct file *, struct vm_area_struct *);
+static __poll_t device_poll(struct file *, poll_table *);
+static int simplechar_gate_enter(struct simplechar_gate *, bool);
+static void simplechar_gate_leave(struct simplechar_gate *);
+static void simplechar_gate_stats(struct simplechar_gate *,
+                                  struct simplechar_lock_stats *);
+
+/* File operations structure */
+static struct file_operations fops = {
+    .owner = THIS_MODULE,
+    .open = device_open,
+    .release = device_release,
+    .read = device_read,
+    .write = device_write,
+    .write_iter = device_write_iter,
+    .unlocked_ioctl = device_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .mmap = device_mmap,
+    .poll = device_poll,
+};
+
+/* Proc filesystem operations */
+static int simplechar_proc_show(struct seq_file *m, void *v)
+{
+    struct simplechar_lock_stats lock_stats;
+    struct simplechar_uid_usage *usage;
+    struct simplechar_resize_event *ev;
+    u64 i;
+    int bkt;
+
+    seq_printf(m, "SimpleChar Module Status:\n");
+    seq_printf(m, "  Build: %s\n", SIMPLECHAR_GIT_HASH);
+    seq_printf(m, "  Major Number: %d\n", major_number);
+    seq_printf(m, "  Buffer Size: %zu bytes\n", simple_dev->buffer_size);
+    seq_printf(m, "  Current Data Length: %zu bytes\n", simple_dev->buffer_len);
+    seq_printf(m, "  Open Count: %d\n", atomic_read(&simple_dev->open_count));
+    seq_printf(m, "  Open Limit: %u\n", simple_dev->open_gate.limit);
+    seq_printf(m, "  Waiting Opens: %u\n",
+               READ_ONCE(simple_dev->open_gate.nr_waiting));
+    seq_printf(m, "  Waiting I/O: %u\n",
+               READ_ONCE(simple_dev->io_gate.nr_waiting));
+    simplechar_gate_stats(&simple_dev->io_gate, &lock_stats);
+    seq_printf(m, "  I/O Lock: %llu acquired, %llu contended, "
+               "%llu ns waiting, %llu ns held\n",
+               lock_stats.acquisitions, lock_stats.contended,
+               lock_stats.wait_ns, lock_stats.hold_ns);
+    seq_printf(m, "  Read Operations: %lu\n", simple_dev->read_count);
+    seq_printf(m, "  Write Operations: %lu\n", simple_dev->write_count);
+    seq_printf(m, "  Generation: %llu\n", simple_dev->generation);
+    seq_printf(m, "  QoS Throttled Time: %lld ns\n",
+               atomic64_read(&simple_dev->throttled_ns));
+    seq_printf(m, "  Uid Quota: %lu bytes\n", READ_ONCE(uid_quota));
+    if (simplechar_gate_enter(&simple_dev->io_gate, false)) {
+        return -ERESTARTSYS;
+    }
+    hash_for_each(simple_dev->uid_usage, bkt, usage, node) {
+        seq_printf(m, "  Uid %u Usage: %llu bytes\n",
+                   from_kuid_munged(seq_user_ns(m), usage->uid), usage->bytes);
+    }
+    if (simple_dev->trace.events) {
+        seq_printf(m, "  Trace: %s, %llu events (ring of %u)\n",
+                   READ_ONCE(trace) ? "recording" : "paused",
+                   simple_dev->trace.head, simple_dev->trace.mask + 1);
+    }
+    if (simple_dev->ring.hdr) {
+        seq_printf(m, "  Record Ring: %llu bytes, %llu notifies\n",
+                   simple_dev->ring.size,
+                   atomic64_read(&simple_dev->ring.notifies));
+    }
+    seq_printf(m, "  Autosize: %s (%zu-%zu bytes)\n",
+               autosize ? "on" : "off",
+               simple_dev->size_min, simple_dev->size_max);
+    seq_printf(m, "  Writer Full Events: %llu (%u/s)\n",
+               simple_dev->writer_full, simple_dev->writer_full_rate);
+    seq_printf(m, "  Reader Empty Events: %llu (%u/s)\n",
+               simple_dev->reader_empty, simple_dev->reader_empty_rate);
+    for (i = simple_dev->nr_resizes > SIMPLECHAR_RESIZE_HISTORY ?
+             simple_dev->nr_resizes - SIMPLECHAR_RESIZE_HISTORY : 0;
+         i < simple_dev->nr_resizes; i++) {
+        ev = &simple_dev->resize_history[i % SIMPLECHAR_RESIZE_HISTORY];
+        seq_printf(m, "  Resize %llu: %u -> %u bytes (%s, fill %u%%) at %llu ns\n",
+                   i, ev->old_size, ev->new_size,
+                   ev->reason == SIMPLECHAR_RESIZE_GROW ? "grow" : "shrink",
+                   ev->fill_pct, ev->time_ns);
+    }
+    simplechar_gate_leave(&simple_dev->io_gate);
+    seq_printf(m, "  Debug Level: %d\n", debug_level);
+    return 0;
+}
+
+static int simplechar_proc_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, simplechar_proc_show, NULL);
+}
+
+static const struct proc_ops simplechar_proc_ops = {
+    .proc_open = simplechar_proc_open,
+    .proc_read = seq_read,
+    .proc_lseek = seq_lseek,
+    .proc_release = single_release,
+};
+
+static void simplechar_gate_init(struct simplechar_gate *g, unsigned int limit)
+{
+    spin_lock_init(&g->lock);
+    g->held = 0;
+    g->limit = limit;
+    g->nr_waiting = 0;
+    INIT_LIST_HEAD(&g->waiters);
+    g->acquisitions = 0;
+    g->contended = 0;
+    g->wait_ns = 0;
+    g->max_wait_ns = 0;
+    g->hold_ns = 0;
+    g->held_since = 0;
+}
+
+/*
+ * Copy the statistics of a gate for SIMPLECHAR_IOC_GET_LOCK_STATS
+ */
+static void simplechar_gate_stats(struct simplechar_gate *g,
+                                  struct simplechar_lock_stats *st)
+{
+    spin_lock(&g->lock);
+    st->acquisitions = g->acquisitions;
+    st->contended = g->contended;
+    st->wait_ns = g->wait_ns;
+    st->max_wait_ns = g->max_wait_ns;
+    st->hold_ns = g->hold_ns;
+    /* Count the hold in progress so samples taken under load add up */
+    if (g->limit == 1 && g->held) {
+        st->hold_ns += ktime_get_ns() - g->held_since;
+    }
+    st->holders = g->held;
+    st->waiting = g->nr_waiting;
+    spin_unlock(&g->lock);
+}
+
+/*
+ * Enter a FIFO gate
+ * Returns 0 once admitted, -EBUSY if the gate is full and nonblock is
+ * set, or -ERESTARTSYS if interrupted while queued
+ * Never inlined, so scripts/bpftrace can time gate waits with kprobes.
+ */
+static noinline int simplechar_gate_enter(struct simplechar_gate *g,
+                                          bool nonblock)
+{
+    struct simplechar_gate_waiter w;
+    int ret = 0;
+
+    spin_lock(&g->lock);
+    if (list_empty(&g->waiters) && (!g->limit || g->held < g->limit)) {
+        g->held++;
+        g->acquisitions++;
+        if (g->limit == 1) {
+            g->held_since = ktime_get_ns();
+        }
+        spin_unlock(&g->lock);
+        return 0;
+    }
+    if (nonblock) {
+        spin_unlock(&g->lock);
+        return -EBUSY;
+    }
+    w.task = current;
+    w.queued_ns = ktime_get_ns();
+    w.granted = false;
+    list_add_tail(&w.node, &g->waiters);
+    g->nr_waiting++;
+    g->contended++;
+    spin_unlock(&g->lock);
+
+    for (;;) {
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (smp_load_acquire(&w.granted)) {
+            break;
+        }
+        if (signal_pending(current)) {
+            ret = -ERESTARTSYS;
+            break;
+        }
+        schedule();
+    }
+    __set_current_state(TASK_RUNNING);
+
+    if (ret) {
+        spin_lock(&g->lock);
+        if (w.granted) {
+            /* The slot was handed to us before we could leave the queue */
+            ret = 0;
+        } else {
+            list_del(&w.node);
+            g->nr_waiting--;
+        }
+        spin_unlock(&g->lock);
+    }
+    return ret;
+}
+
+/*
+ * Leave a FIFO gate, handing the slot to the oldest waiter if any
+ */
+static void simplechar_gate_leave(struct simplechar_gate *g)
+{
+    struct simplechar_gate_waiter *w;
+    struct task_struct *task;
+    u64 now = 0, wait;
+
+    spin_lock(&g->lock);
+    if (g->limit == 1) {
+        now = ktime_get_ns();
+        g->hold_ns += now - g->held_since;
+    }
+    if (list_empty(&g->waiters)) {
+        g->held--;
+        spin_unlock(&g->lock);
+        return;
+    }
+
+    w = list_first_entry(&g->waiters, struct simplechar_gate_waiter, node);
+    list_del(&w->node);
+    g->nr_waiting--;
+
+    /* The slot changes hands without being released */
+    if (!now) {
+        now = ktime_get_ns();
+    }
+    wait = now - w->queued_ns;
+    g->wait_ns += wait;
+    g->max_wait_ns = max(g->max_wait_ns, wait);
+    g->acquisitions++;
+    g->held_since = now;
+
+    /*
+     * The waiter may return, and its task exit, as soon as it sees
+     * granted; task_struct is freed after an RCU grace period, so the
+     * read-side section keeps it valid for the wakeup
+     */
+    task = w->task;
+    rcu_read_lock();
+    smp_store_release(&w->granted, true);
+    spin_unlock(&g->lock);
+
+    wake_up_process(task);
+    rcu_read_unlock();
+}
+
+/*
+ * Find the usage entry of uid, creating it if needed
+ * Must be called with the device I/O gate held
+ */
+static struct simplechar_uid_usage *
+simplechar_uid_usage_get(struct simplechar_dev *dev, kuid_t uid)
+{
+    struct simplechar_uid_usage *usage;
+
+    hash_for_each_possible(dev->uid_usage, usage, node, __kuid_val(uid)) {
+        if (uid_eq(usage->uid, uid)) {
+            return usage;
+        }
+    }
+
+    usage = kzalloc(sizeof(*usage), GFP_KERNEL);
+    if (!usage) {
+        return NULL;
+    }
+    usage->uid = uid;
+    hash_add(dev->uid_usage, &usage->node, __kuid_val(uid));
+    return usage;
+}
+
+/*
+ * Make sure every page backing [offset, offset + len) exists
+ * New pages are charged with __GFP_ACCOUNT to the writer's memory cgroup
+ * and against the writer's uid quota. Overwriting existing pages costs
+ * nothing, so the quota lookup only happens when the store grows.
+ * Must be called with the device I/O gate held
+ */
+static int simplechar_store_populate(struct simplechar_dev *dev,
+                                     size_t offset, size_t len)
+{
+    size_t first = offset >> PAGE_SHIFT;
+    size_t last = (offset + len - 1) >> PAGE_SHIFT;
+    struct simplechar_uid_usage *usage;
+    unsigned long quota;
+    size_t missing = 0;
+    size_t i;
+
+    for (i = first; i <= last; i++) {
+        if (!dev->pages[i]) {
+            missing++;
+        }
+    }
+    if (!missing) {
+        return 0;
+    }
+
+    usage = simplechar_uid_usage_get(dev, current_fsuid());
+    if (!usage) {
+        return -ENOMEM;
+    }
+
+    quota = READ_ONCE(uid_quota);
+    if (quota && usage->bytes + missing * PAGE_SIZE > quota) {
+        DEBUG_PRINT(2, "Uid %u over quota (%llu + %zu > %lu bytes)\n",
+                    from_kuid_munged(&init_user_ns, usage->uid),
+                    usage->bytes, missing * PAGE_SIZE, quota);
+        return -EDQUOT;
+    }
+
+    for (i = first; i <= last; i++) {
+        if (dev->pages[i]) {
+            continue;
+        }
+        dev->pages[i] = (char *)get_zeroed_page(GFP_KERNEL_ACCOUNT);
+        if (!dev->pages[i]) {
+            return -ENOMEM;
+        }
+        dev->page_owner[i] = usage;
+        usage->bytes += PAGE_SIZE;
+    }
+    return 0;
+}
+
+/*
+ * Copy len bytes at offset from the store into an iterator
+ * Pages that were never written read back as zeros. The iterator is a
+ * user buffer for file operations and a kernel one for the engine entry
+ * points. Returns the number of bytes that could not be copied, like
+ * copy_to_user().
+ */
+static unsigned long simplechar_store_copy_out(struct simplechar_dev *dev,
+                                               struct iov_iter *to,
+                                               size_t offset, size_t len)
+{
+    size_t pgoff, chunk, copied;
+    char *page;
+
+    while (len) {
+        page = dev->pages[offset >> PAGE_SHIFT];
+        pgoff = offset & ~PAGE_MASK;
+        chunk = min_t(size_t, len, PAGE_SIZE - pgoff);
+
+        copied = page ? copy_to_iter(page + pgoff, chunk, to)
+                      : iov_iter_zero(chunk, to);
+        if (copied != chunk) {
+            return len;
+        }
+        offset += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+/*
+ * Copy len bytes from an iterator into the store at offset
+ * The pages must have been populated. Returns the number of bytes that
+ * could not be copied, like copy_from_user().
+ */
+static unsigned long simplechar_store_copy_in(struct simplechar_dev *dev,
+                                              size_t offset,
+                                              struct iov_iter *from,
+                                              size_t len)
+{
+    size_t pgoff, chunk;
+
+    while (len) {
+        pgoff = offset & ~PAGE_MASK;
+        chunk = min_t(size_t, len, PAGE_SIZE - pgoff);
+
+        if (copy_from_iter(dev->pages[offset >> PAGE_SHIFT] + pgoff,
+                           chunk, from) != chunk) {
+            return len;
+        }
+        offset += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+/*
+ * Change the store size, recording the decision in the resize history
+ * Pages entirely beyond the new size are released and uncharged from
+ * their uid; callers never shrink below the data length, so those pages
+ * hold no data.
+ * Must be called with the device I/O gate held
+ */
+static void simplechar_autosize_resize(struct simplechar_dev *dev,
+                                       size_t new_size, u32 reason)
+{
+    struct simplechar_resize_event *ev;
+    size_t i;
+
+    for (i = DIV_ROUND_UP(new_size, PAGE_SIZE); i < dev->nr_pages; i++) {
+        if (!dev->pages[i]) {
+            continue;
+        }
+        free_page((unsigned long)dev->pages[i]);
+        dev->page_owner[i]->bytes -= PAGE_SIZE;
+        dev->pages[i] = NULL;
+        dev->page_owner[i] = NULL;
+    }
+
+    ev = &dev->resize_history[dev->nr_resizes % SIMPLECHAR_RESIZE_HISTORY];
+    ev->time_ns = ktime_get_ns();
+    ev->old_size = dev->buffer_size;
+    ev->new_size = new_size;
+    ev->reason = reason;
+    ev->fill_pct = dev->fill_pct;
+    dev->nr_resizes++;
+
+    DEBUG_PRINT(1, "Buffer %s: %zu -> %zu bytes\n",
+                reason == SIMPLECHAR_RESIZE_GROW ? "grown" : "shrunk",
+                dev->buffer_size, new_size);
+    WRITE_ONCE(dev->buffer_size, new_size);
+}
+
+/*
+ * Grow the store in doubling steps until end fits or the ceiling is hit
+ * Must be called with the device I/O gate held
+ */
+static void simplechar_autosize_grow(struct simplechar_dev *dev, size_t end)
+{
+    size_t new_size = dev->buffer_size;
+
+    while (new_size < end && new_size < dev->size_max) {
+        new_size = min(new_size * 2, dev->size_max);
+    }
+    if (new_size > dev->buffer_size) {
+        simplechar_autosize_resize(dev, new_size, SIMPLECHAR_RESIZE_GROW);
+    }
+}
+
+/*
+ * Count a write refused or cut short at end, the demand autosize grows for
+ * Must be called with the device I/O gate held
+ */
+static void simplechar_autosize_note_full(struct simplechar_dev *dev,
+                                          size_t end)
+{
+    dev->writer_full++;
+    dev->want_end = max(dev->want_end, end);
+}
+
+/*
+ * Take one autosize sample over the last interval_ms
+ * Updates the blocked reader/writer rates and the fill level, the
+ * decaying high-water mark of the data read and written relative to the
+ * store size. Writers that ran out of space grow the store to fit the
+ * largest of their writes. After AUTOSIZE_SHRINK_SAMPLES consecutive
+ * samples with low fill and no writer running out of space the store is
+ * halved, never below the high-water mark or the data it holds: data
+ * that sits untouched lets the mark decay, but still bounds the shrink.
+ * Must be called with the device I/O gate held
+ */
+static void simplechar_autosize_sample(struct simplechar_dev *dev,
+                                       unsigned int interval_ms)
+{
+    u64 full, empty;
+    size_t target;
+
+    full = dev->writer_full - dev->last_writer_full;
+    empty = dev->reader_empty - dev->last_reader_empty;
+    dev->last_writer_full = dev->writer_full;
+    dev->last_reader_empty = dev->reader_empty;
+    dev->writer_full_rate = div_u64(full * MSEC_PER_SEC, interval_ms);
+    dev->reader_empty_rate = div_u64(empty * MSEC_PER_SEC, interval_ms);
+
+    dev->high_water -= dev->high_water >> AUTOSIZE_DECAY_SHIFT;
+    dev->high_water = max(dev->high_water, dev->access_end);
+    dev->access_end = 0;
+    dev->fill_pct = min_t(size_t, dev->high_water, dev->buffer_size) * 100 /
+                    dev->buffer_size;
+
+    if (full) {
+        dev->low_fill_samples = 0;
+        if (dev->want_end > dev->buffer_size) {
+            simplechar_autosize_grow(dev, dev->want_end);
+        }
+    } else if (dev->fill_pct < AUTOSIZE_SHRINK_PCT) {
+        dev->low_fill_samples++;
+    } else {
+        dev->low_fill_samples = 0;
+    }
+    dev->want_end = 0;
+
+    if (dev->low_fill_samples >= AUTOSIZE_SHRINK_SAMPLES) {
+        target = max3(dev->size_min, dev->buffer_size / 2,
+                      PAGE_ALIGN(max(dev->high_water, dev->buffer_len)));
+        if (target < dev->buffer_size) {
+            simplechar_autosize_resize(dev, target,
+                                       SIMPLECHAR_RESIZE_SHRINK);
+        }
+        dev->low_fill_samples = 0;
+    }
+}
+
+static void simplechar_autosize_work(struct work_struct *work)
+{
+    struct simplechar_dev *dev = container_of(to_delayed_work(work),
+                                              struct simplechar_dev,
+                                              autosize_work);
+    unsigned int interval_ms = max(READ_ONCE(autosize_interval_ms), 10U);
+
+    if (simplechar_gate_enter(&dev->io_gate, false)) {
+        goto resched;
+    }
+    simplechar_autosize_sample(dev, interval_ms);
+    simplechar_gate_leave(&dev->io_gate);
+
+resched:
+    schedule_delayed_work(&dev->autosize_work,
+                          msecs_to_jiffies(interval_ms));
+}
+
+/*
+ * Tag the blocks covering [offset, offset + len) with a new generation
+ * Must be called with the device I/O gate held
+ */
+static void simplechar_mark_dirty(struct simplechar_dev *dev,
+                                  size_t offset, size_t len)
+{
+    size_t first = offset >> SIMPLECHAR_DIRTY_BLOCK_SHIFT;
+    size_t last = (offset + len - 1) >> SIMPLECHAR_DIRTY_BLOCK_SHIFT;
+    size_t i;
+
+    dev->generation++;
+    for (i = first; i <= last; i++) {
+        dev->block_gen[i] = dev->generation;
+    }
+}
+
+/*
+ * Reset a token bucket to a new rate; a zero burst means one second worth
+ */
+static void simplechar_bucket_init(struct simplechar_bucket *b,
+                                   u64 rate, u64 burst)
+{
+    if (!burst) {
+        burst = rate;
+    }
+    WRITE_ONCE(b->rate, 0);
+    WRITE_ONCE(b->burst, burst);
+    atomic64_set(&b->tokens, burst);
+    atomic64_set(&b->last_ns, ktime_get_ns());
+    WRITE_ONCE(b->rate, rate);
+}
+
+/*
+ * Try to take cost tokens from a bucket
+ * Returns 0 on success, otherwise the nanoseconds until enough tokens
+ * will have accumulated. Only atomics are used so concurrent users of
+ * the same open file never serialize here.
+ */
+static u64 simplechar_bucket_take(struct simplechar_bucket *b, u64 cost)
+{
+    u64 rate = READ_ONCE(b->rate);
+    u64 burst = READ_ONCE(b->burst);
+    u64 now, add;
+    s64 last, cur, new;
+
+    if (!rate) {
+        return 0;
+    }
+
+    /* A request larger than the bucket could never be satisfied */
+    cost = min(cost, burst);
+
+    /* Refill: whoever wins the timestamp update adds the elapsed tokens */
+    now = ktime_get_ns();
+    last = atomic64_read(&b->last_ns);
+    if (now > last) {
+        add = mul_u64_u64_div_u64(now - last, rate, NSEC_PER_SEC);
+        if (add && atomic64_try_cmpxchg(&b->last_ns, &last, now)) {
+            cur = atomic64_read(&b->tokens);
+            do {
+                new = min_t(s64, cur + add, burst);
+            } while (!atomic64_try_cmpxchg(&b->tokens, &cur, new));
+        }
+    }
+
+    cur = atomic64_sub_return(cost, &b->tokens);
+    if (cur >= 0) {
+        return 0;
+    }
+
+    /* Not enough tokens: give them back and report the deficit */
+    atomic64_add(cost, &b->tokens);
+    return max_t(u64, mul_u64_u64_div_u64(-cur, NSEC_PER_SEC, rate), 1);
+}
+
+/*
+ * Charge one operation of len bytes against the open file's QoS buckets
+ * Sleeps until the caller is within its limits, or fails with -EAGAIN
+ * for non-blocking opens
+ * Never inlined, so scripts/bpftrace can time throttling with kprobes.
+ */
+static noinline int simplechar_qos_throttle(struct file *filep, size_t len)
+{
+    struct simplechar_file *sf = filep->private_data;
+    u64 start = 0;
+    u64 wait, slept;
+    ktime_t expires;
+    int ret = 0;
+
+    for (;;) {
+        wait = simplechar_bucket_take(&sf->ops, 1);
+        if (!wait) {
+            wait = simplechar_bucket_take(&sf->bytes, len);
+            if (!wait) {
+                break;
+            }
+            /* Return the operation token while we wait for bytes */
+            if (READ_ONCE(sf->ops.rate)) {
+                atomic64_inc(&sf->ops.tokens);
+            }
+        }
+
+        if (filep->f_flags & O_NONBLOCK) {
+            atomic64_inc(&sf->rejected_ops);
+            return -EAGAIN;
+        }
+
+        if (!start) {
+            start = ktime_get_ns();
+            atomic64_inc(&sf->throttled_ops);
+        }
+
+        expires = ns_to_ktime(wait);
+        set_current_state(TASK_INTERRUPTIBLE);
+        schedule_hrtimeout_range(&expires, NSEC_PER_USEC * 50,
+                                 HRTIMER_MODE_REL);
+        if (signal_pending(current)) {
+            ret = -ERESTARTSYS;
+            break;
+        }
+    }
+
+    if (start) {
+        slept = ktime_get_ns() - start;
+        atomic64_add(slept, &sf->throttled_ns);
+        atomic64_add(slept, &simple_dev->throttled_ns);
+        DEBUG_PRINT(3, "Throttled for %llu ns\n", slept);
+    }
+    return ret;
+}
+
+/*
+ * Start timing an operation for the trace; 0 when not recording
+ */
+static u64 simplechar_trace_start(void)
+{
+    if (!simple_dev->trace.events || !READ_ONCE(trace)) {
+        return 0;
+    }
+    return ktime_get_ns();
+}
+
+/*
+ * Append one operation to the trace ring, overwriting the oldest event
+ * when full. start is the value simplechar_trace_start() returned.
+ */
+static void simplechar_trace_record(struct file *filep, u16 op, u64 start,
+                                    u64 offset, size_t size, long result)
+{
+    struct simplechar_trace *t = &simple_dev->trace;
+    struct simplechar_file *sf = filep->private_data;
+    struct simplechar_trace_event *ev;
+    u64 now;
+
+    if (!start) {
+        return;
+    }
+    now = ktime_get_ns();
+
+    spin_lock(&t->lock);
+    ev = &t->events[t->head & t->mask];
+    ev->time_ns = start;
+    ev->offset = offset;
+    ev->size = min_t(size_t, size, U32_MAX);
+    ev->result = result;
+    ev->duration_ns = min_t(u64, now - start, U32_MAX);
+    ev->gap_ns = t->last_ns && start > t->last_ns ?
+                 min_t(u64, start - t->last_ns, U32_MAX) : 0;
+    ev->open_id = sf ? sf->open_id : 0;
+    ev->pid = task_tgid_nr(current);
+    ev->op = op;
+    ev->flags = filep->f_flags & O_NONBLOCK ? SIMPLECHAR_TRACE_NONBLOCK : 0;
+    ev->reserved = 0;
+    t->last_ns = max(t->last_ns, start);
+    t->head++;
+    spin_unlock(&t->lock);
+}
+
+/*
+ * Device open function
+ * Called when a process opens the device file
+ */
+static int device_open(struct inode *inodep, struct file *filep)
+{
+    struct simplechar_file *sf;
+    u64 start = simplechar_trace_start();
+    int ret;
+
+    DEBUG_PRINT(2, "Device open attempt\n");
+
+    /* Wait for an open slot in arrival order, or fail fast if asked to */
+    ret = simplechar_gate_enter(&simple_dev->open_gate,
+                                filep->f_flags & O_NONBLOCK);
+    if (ret) {
+        DEBUG_PRINT(2, "Device open refused (%d)\n", ret);
+        return ret;
+    }
+
+    /* Allocate per-open state; QoS buckets start out unlimited */
+    sf = kzalloc(sizeof(*sf), GFP_KERNEL);
+    if (!sf) {
+        simplechar_gate_leave(&simple_dev->open_gate);
+        return -ENOMEM;
+    }
+    sf->open_id = atomic_inc_return(&simple_dev->next_open_id);
+    filep->private_data = sf;
+    
+    /* Increment open count atomically */
+    atomic_inc(&simple_dev->open_count);
+    simplechar_trace_record(filep, SIMPLECHAR_TRACE_OPEN, start, 0, 0, 0);
+    
+    DEBUG_PRINT(2, "Device opened successfully (open count: %d)\n",
+                atomic_read(&simple_dev->open_count));
+    
+    return 0;
+}
+
+/*
+ * Device release function
+ * Called when a process closes the device file
+ */
+static int device_release(struct inode *inodep, struct file *filep)
+{
+    DEBUG_PRINT(2, "Device release attempt\n");
+    
+    /* Decrement open count atomically */
+    atomic_dec(&simple_dev->open_count);
+    simplechar_trace_record(filep, SIMPLECHAR_TRACE_CLOSE,
+                            simplechar_trace_start(), 0, 0, 0);
+    
+    kfree(filep->private_data);
+    simplechar_gate_leave(&simple_dev->open_gate);
+
+    DEBUG_PRINT(2, "Device closed (open count: %d)\n",
+                atomic_read(&simple_dev->open_count));
+    
+    INFO_PRINT("Device closed, total reads: %lu, writes: %lu\n",
+               simple_dev->read_count, simple_dev->write_count);
+    
+    return 0;
+}
+
+/*
+ * Read up to iov_iter_count(to) bytes at *pos, advancing *pos
+ * The body of device_read() without the per-open rate limits and the
+ * trace, shared with the engine entry points. Returns the number of bytes
+ * read or a negative errno.
+ */
+static ssize_t simplechar_do_read(struct simplechar_dev *dev,
+                                  struct iov_iter *to, loff_t *pos)
+{
+    size_t len = iov_iter_count(to);
+    ssize_t bytes_read = 0;
+
+    /* Acquire the I/O gate to prevent concurrent access */
+    if (simplechar_gate_enter(&dev->io_gate, false)) {
+        return -ERESTARTSYS;
+    }
+    
+    /* Check if we're at end of data */
+    if (*pos >= dev->buffer_len) {
+        DEBUG_PRINT(3, "Read at EOF\n");
+        dev->reader_empty++;
+        goto out;
+    }
+    
+    /* Calculate how many bytes to read */
+    bytes_read = min_t(size_t, len, dev->buffer_len - *pos);
+    
+    /* Copy data out of the store */
+    if (simplechar_store_copy_out(dev, to, *pos, bytes_read)) {
+        ERR_PRINT("Failed to copy %zd bytes out of the device\n", bytes_read);
+        bytes_read = -EFAULT;
+        goto out;
+    }
+    
+    /* Update offset and statistics */
+    *pos += bytes_read;
+    dev->access_end = max_t(size_t, dev->access_end, *pos);
+    dev->read_count++;
+    
+    DEBUG_PRINT(2, "Read %zd bytes from device\n", bytes_read);
+
+out:
+    simplechar_gate_leave(&dev->io_gate);
+    return bytes_read;
+}
+
+/*
+ * Write iov_iter_count(from) bytes at *pos, or at the end of the data
+ * when append is set, and advance *pos past them
+ * The body of device_write() without the per-open rate limits and the
+ * trace, shared with the engine entry points. Returns the number of bytes
+ * written or a negative errno.
+ */
+static ssize_t simplechar_do_write(struct simplechar_dev *dev,
+                                   struct iov_iter *from, loff_t *pos,
+                                   bool append)
+{
+    size_t len = iov_iter_count(from);
+    ssize_t bytes_written = 0;
+    int ret;
+
+    /* Acquire the I/O gate to prevent concurrent access */
+    if (simplechar_gate_enter(&dev->io_gate, false)) {
+        return -ERESTARTSYS;
+    }
+
+    if (append) {
+        *pos = dev->buffer_len;
+    }
+    
+    /* Check if write would exceed buffer size; autosize grows for it later */
+    if (*pos >= dev->buffer_size) {
+        WARN_PRINT("Write attempt beyond buffer size\n");
+        simplechar_autosize_note_full(dev, *pos + len);
+        bytes_written = -ENOSPC;
+        goto out;
+    }
+    
+    /* Calculate how many bytes to write */
+    bytes_written = min_t(size_t, len, dev->buffer_size - *pos);
+    if (bytes_written < len) {
+        simplechar_autosize_note_full(dev, *pos + len);
+    }
+    if (!bytes_written) {
+        goto out;
+    }
+
+    /* Allocate and charge any backing pages this write needs */
+    ret = simplechar_store_populate(dev, *pos, bytes_written);
+    if (ret) {
+        bytes_written = ret;
+        goto out;
+    }
+    
+    /* Copy data into the store */
+    if (simplechar_store_copy_in(dev, *pos, from, bytes_written)) {
+        ERR_PRINT("Failed to copy %zd bytes into the device\n", bytes_written);
+        bytes_written = -EFAULT;
+        goto out;
+    }
+    
+    /* Update offset, data length, and statistics */
+    *pos += bytes_written;
+    if (*pos > dev->buffer_len) {
+        dev->buffer_len = *pos;
+    }
+    dev->access_end = max_t(size_t, dev->access_end, *pos);
+    simplechar_mark_dirty(dev, *pos - bytes_written, bytes_written);
+    dev->write_count++;
+    
+    DEBUG_PRINT(2, "Wrote %zd bytes to device\n", bytes_written);
+
+out:
+    simplechar_gate_leave(&dev->io_gate);
+    return bytes_written;
+}
+
+/*
+ * Device read function
+ * Called when a process reads from the device file
+ */
+static ssize_t device_read(struct file *filep, char __user *buffer, 
+                          size_t len, loff_t *offset)
+{
+    ssize_t bytes_read;
+    u64 start = simplechar_trace_start();
+    loff_t pos = *offset;
+    struct iov_iter iter;
+    int ret;
+    
+    DEBUG_PRINT(3, "Read request: len=%zu, offset=%lld\n", len, *offset);
+
+    /* Apply per-open rate limits before touching the device */
+    ret = simplechar_qos_throttle(filep, min(len, simple_dev->buffer_size));
+    if (!ret) {
+        ret = import_ubuf(ITER_DEST, buffer, len, &iter);
+    }
+    if (ret) {
+        bytes_read = ret;
+        goto done;
+    }
+    
+    bytes_read = simplechar_do_read(simple_dev, &iter, offset);
+
+done:
+    simplechar_trace_record(filep, SIMPLECHAR_TRACE_READ, start, pos, len,
+                            bytes_read);
+    return bytes_read;
+}
+
+/*
+ * Device write function
+ * Called when a process writes to the device file
+ */
+static ssize_t device_write(struct file *filep, const char __user *buffer,
+                           size_t len, loff_t *offset)
+{
+    ssize_t bytes_written;
+    u64 start = simplechar_trace_start();
+    loff_t pos = *offset;
+    struct iov_iter iter;
+    int ret;
+    
+    DEBUG_PRINT(3, "Write request: len=%zu, offset=%lld\n", len, *offset);
+
+    /* Apply per-open rate limits before touching the device */
+    ret = simplechar_qos_throttle(filep, min(len, simple_dev->buffer_size));
+    if (!ret) {
+        ret = import_ubuf(ITER_SOURCE, (char __user *)buffer, len, &iter);
+    }
+    if (ret) {
+        bytes_written = ret;
+        goto done;
+    }
+    
+    bytes_written = simplechar_do_write(simple_dev, &iter, offset,
+                                        filep->f_flags & O_APPEND);
+
+done:
+    simplechar_trace_record(filep, SIMPLECHAR_TRACE_WRITE, start, pos, len,
+                            bytes_written);
+    return bytes_written;
+}
+
+/*
+ * Vectored write function
+ * Called for writev() and io_uring writes. The whole vector is written
+ * under one acquisition of the I/O gate, where the ->write() fallback
+ * would take it once per segment.
+ */
+static ssize_t device_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    struct file *filep = iocb->ki_filp;
+    size_t len = iov_iter_count(from);
+    u64 start = simplechar_trace_start();
+    loff_t pos = iocb->ki_pos;
+    ssize_t bytes_written;
+    int ret;
+
+    DEBUG_PRINT(3, "Vectored write request: len=%zu, offset=%lld\n", len, pos);
+
+    /* Apply per-open rate limits before touching the device */
+    ret = simplechar_qos_throttle(filep, min(len, simple_dev->buffer_size));
+    if (ret) {
+        bytes_written = ret;
+        goto done;
+    }
+
+    bytes_written = simplechar_do_write(simple_dev, from, &iocb->ki_pos,
+                                        iocb->ki_flags & IOCB_APPEND);
+
+done:
+    simplechar_trace_record(filep, SIMPLECHAR_TRACE_WRITE, start, pos, len,
+                            bytes_written);
+    return bytes_written;
+}
+
+/*
+ * Find the next run of blocks written after since_gen
+ * Scans from block *first; on success stores the run as blocks
+ * [*first, *next) and returns true.
+ * Must be called with the device I/O gate held
+ */
+static bool simplechar_find_dirty(struct simplechar_dev *dev, u64 since_gen,
+                                  size_t *first, size_t *next)
+{
+    size_t nblocks = DIV_ROUND_UP(dev->buffer_len, SIMPLECHAR_DIRTY_BLOCK_SIZE);
+    size_t i = *first;
+
+    while (i < nblocks && dev->block_gen[i] <= since_gen) {
+        i++;
+    }
+    if (i >= nblocks) {
+        return false;
+    }
+
+    /* Coalesce adjacent dirty blocks into a single range */
+    *first = i;
+    while (i < nblocks && dev->block_gen[i] > since_gen) {
+        i++;
+    }
+    *next = i;
+    return true;
+}
+
+/*
+ * SIMPLECHAR_IOC_GET_DELTA handler
+ * Packs every range written after req.since_gen, together with its data,
+ * into the caller's buffer so replicators only copy what changed
+ */
+static long simplechar_ioctl_get_delta(struct simplechar_dev *dev,
+                                       void __user *argp)
+{
+    struct simplechar_delta req;
+    struct simplechar_delta_range range;
+    struct iov_iter iter;
+    char __user *out;
+    size_t first, next, end, record;
+    size_t used = 0;
+    long ret = 0;
+
+    if (copy_from_user(&req, argp, sizeof(req))) {
+        return -EFAULT;
+    }
+    if (req.flags) {
+        return -EINVAL;
+    }
+    out = u64_to_user_ptr(req.data);
+
+    if (simplechar_gate_enter(&dev->io_gate, false)) {
+        return -ERESTARTSYS;
+    }
+
+    req.nr_ranges = 0;
+    for (first = 0; simplechar_find_dirty(dev, req.since_gen, &first, &next);
+         first = next) {
+        end = min_t(size_t, next << SIMPLECHAR_DIRTY_BLOCK_SHIFT,
+                    dev->buffer_len);
+
+        range.offset = first << SIMPLECHAR_DIRTY_BLOCK_SHIFT;
+        range.length = end - range.offset;
+        record = ALIGN(sizeof(range) + range.length, SIMPLECHAR_DELTA_ALIGN);
+
+        /* Keep counting once the buffer is full to report the needed size */
+        if (used + record <= req.data_len) {
+            if (copy_to_user(out + used, &range, sizeof(range)) ||
+                import_ubuf(ITER_DEST, out + used + sizeof(range),
+                            range.length, &iter) ||
+                simplechar_store_copy_out(dev, &iter, range.offset,
+                                          range.length)) {
+                ret = -EFAULT;
+                goto out;
+            }
+        }
+        used += record;
+        req.nr_ranges++;
+    }
+
+    req.generation = dev->generation;
+    req.data_size = dev->buffer_len;
+    req.bytes_used = used;
+
+out:
+    simplechar_gate_leave(&dev->io_gate);
+    if (ret) {
+        return ret;
+    }
+
+    DEBUG_PRINT(2, "Delta since generation %llu: %u ranges, %zu bytes\n",
+                req.since_gen, req.nr_ranges, used);
+
+    if (copy_to_user(argp, &req, sizeof(req))) {
+        return -EFAULT;
+    }
+    return used > req.data_len ? -ENOSPC : 0;
+}
+
+/*
+ * SIMPLECHAR_IOC_SET_QOS / GET_QOS / GET_QOS_STATS handlers
+ */
+static long simplechar_ioctl_set_qos(struct file *filep, void __user *argp)
+{
+    struct simplechar_file *sf = filep->private_data;
+    struct simplechar_qos qos;
+
+    if (copy_from_user(&qos, argp, sizeof(qos))) {
+        return -EFAULT;
+    }
+
+    simplechar_bucket_init(&sf->ops, qos.ops_per_sec, qos.ops_burst);
+    simplechar_bucket_init(&sf->bytes, qos.bytes_per_sec, qos.bytes_burst);
+
+    DEBUG_PRINT(2, "QoS set: %llu ops/s, %llu bytes/s\n",
+                qos.ops_per_sec, qos.bytes_per_sec);
+    return 0;
+}
+
+static long simplechar_ioctl_get_qos(struct file *filep, void __user *argp)
+{
+    struct simplechar_file *sf = filep->private_data;
+    struct simplechar_qos qos = {
+        .ops_per_sec = READ_ONCE(sf->ops.rate),
+        .bytes_per_sec = READ_ONCE(sf->bytes.rate),
+        .ops_burst = READ_ONCE(sf->ops.burst),
+        .bytes_burst = READ_ONCE(sf->bytes.burst),
+    };
+
+    return copy_to_user(argp, &qos, sizeof(qos)) ? -EFAULT : 0;
+}
+
+static long simplechar_ioctl_get_qos_stats(struct file *filep,
+                                           void __user *argp)
+{
+    struct simplechar_file *sf = filep->private_data;
+    struct simplechar_qos_stats stats = {
+        .throttled_ns = atomic64_read(&sf->throttled_ns),
+        .throttled_ops = atomic64_read(&sf->throttled_ops),
+        .rejected_ops = atomic64_read(&sf->rejected_ops),
+    };
+
+    return copy_to_user(argp, &stats, sizeof(stats)) ? -EFAULT : 0;
+}
+
+/*
+ * SIMPLECHAR_IOC_GET_UID_USAGE handler
+ */
+static long simplechar_ioctl_get_uid_usage(struct simplechar_dev *dev,
+                                           void __user *argp)
+{
+    struct simplechar_uid_usage_info info;
+    struct simplechar_uid_usage *usage;
+    kuid_t uid;
+
+    if (copy_from_user(&info, argp, sizeof(info))) {
+        return -EFAULT;
+    }
+
+    if (info.uid == SIMPLECHAR_UID_SELF) {
+        uid = current_fsuid();
+    } else {
+        uid = make_kuid(current_user_ns(), info.uid);
+        if (!uid_valid(uid)) {
+            return -EINVAL;
+        }
+    }
+
+    info.uid = from_kuid_munged(current_user_ns(), uid);
+    info.bytes = 0;
+    info.quota = READ_ONCE(uid_quota);
+
+    if (simplechar_gate_enter(&dev->io_gate, false)) {
+        return -ERESTARTSYS;
+    }
+    hash_for_each_possible(dev->uid_usage, usage, node, __kuid_val(uid)) {
+        if (uid_eq(usage->uid, uid)) {
+            info.bytes = usage->bytes;
+            break;
+        }
+    }
+    simplechar_gate_leave(&dev->io_gate);
+
+    return copy_to_user(argp, &info, sizeof(info)) ? -EFAULT : 0;
+}
+
+/*
+ * SIMPLECHAR_IOC_GET_AUTOSIZE handler
+ */
+static long simplechar_ioctl_get_autosize(struct simplechar_dev *dev,
+                                          void __user *argp)
+{
+    struct simplechar_autosize_info *info;
+    u64 first, i;
+    long ret = 0;
+
+    info = kzalloc(sizeof(*info), GFP_KERNEL);
+    if (!info) {
+        return -ENOMEM;
+    }
+
+    if (simplechar_gate_enter(&dev->io_gate, false)) {
+        kfree(info);
+        return -ERESTARTSYS;
+    }
+    info->enabled = autosize;
+    info->size = dev->buffer_size;
+    info->min_size = dev->size_min;
+    info->max_size = dev->size_max;
+    info->writer_full = dev->writer_full;
+    info->reader_empty = dev->reader_empty;
+    info->writer_full_rate = dev->writer_full_rate;
+    info->reader_empty_rate = dev->reader_empty_rate;
+    info->fill_pct = dev->fill_pct;
+    info->nr_resizes = dev->nr_resizes;
+
+    first = dev->nr_resizes > SIMPLECHAR_RESIZE_HISTORY ?
+            dev->nr_resizes - SIMPLECHAR_RESIZE_HISTORY : 0;
+    for (i = first; i < dev->nr_resizes; i++) {
+        info->events[info->nr_events++] =
+            dev->resize_history[i % SIMPLECHAR_RESIZE_HISTORY];
+    }
+    simplechar_gate_leave(&dev->io_gate);
+
+    if (copy_to_user(argp, info, sizeof(*info))) {
+        ret = -EFAULT;
+    }
+    kfree(info);
+    return ret;
+}
+
+/*
+ * SIMPLECHAR_IOC_GET_LOCK_STATS handler
+ */
+static long simplechar_ioctl_get_lock_stats(struct simplechar_dev *dev,
+                                            void __user *argp)
+{
+    struct simplechar_lock_info info = {};
+
+    simplechar_gate_stats(&dev->io_gate, &info.io);
+    simplechar_gate_stats(&dev->open_gate, &info.open);
+
+    return copy_to_user(argp, &info, sizeof(info)) ? -EFAULT : 0;
+}
+
+/*
+ * SIMPLECHAR_IOC_READ_TRACE handler
+ * Copies at most SIMPLECHAR_TRACE_BATCH events starting at req.seq; a
+ * caller that fell behind the ring resumes at the oldest kept event.
+ */
+static long simplechar_ioctl_read_trace(struct simplechar_dev *dev,
+                                        void __user *argp)
+{
+    struct simplechar_trace *t = &dev->trace;
+    struct simplechar_trace_read req;
+    struct simplechar_trace_event *batch;
+    u64 oldest, seq;
+    u32 n, i;
+    long ret = 0;
+
+    if (!t->events) {
+        return -ENODEV;
+    }
+    if (copy_from_user(&req, argp, sizeof(req))) {
+        return -EFAULT;
+    }
+
+    n = min_t(u32, req.max_events, SIMPLECHAR_TRACE_BATCH);
+    batch = kmalloc_array(max_t(u32, n, 1), sizeof(*batch), GFP_KERNEL);
+    if (!batch) {
+        return -ENOMEM;
+    }
 
-#define WARN_PRINT(fmt, args...) \
-    printk(KERN_WARNING "simplechar: " fmt, ##args)
+    /* Snapshot under the lock, copy to user space after dropping it */
+    spin_lock(&t->lock);
+    oldest = t->head > t->mask + 1 ? t->head - (t->mask + 1) : 0;
+    seq = max(req.seq, oldest);
+    req.dropped = seq - min(req.seq, seq);
+    req.head = t->head;
+    n = min_t(u64, n, t->head > seq ? t->head - seq : 0);
+    for (i = 0; i < n; i++) {
+        batch[i] = t->events[(seq + i) & t->mask];
+    }
+    spin_unlock(&t->lock);
 
-#define ERR_PRINT(fmt, args...) \
-    printk(KERN_ERR "simplechar: " fmt, ##args)
+    req.nr_events = n;
+    req.seq = seq + n;
+    if (n && copy_to_user(u64_to_user_ptr(req.events), batch,
+                          n * sizeof(*batch))) {
+        ret = -EFAULT;
+    } else if (copy_to_user(argp, &req, sizeof(req))) {
+        ret = -EFAULT;
+    }
+    kfree(batch);
+    return ret;
+}
 
-/* Function prototypes */
-static int device_open(struct inode *, struct file *);
-static int device_release(struct inode *, struct file *);
-static ssize_t device_read(struct file *, char __user *, size_t, loff_t *);
-static ssize_t device_write(struct file *, const char __user *, size_t, loff_t *);
-static long device_ioctl(struct file *, unsigned int, unsigned long);
+/*
+ * SIMPLECHAR_IOC_RING_INFO handler
+ */
+static long simplechar_ioctl_ring_info(struct simplechar_dev *dev,
+                                       void __user *argp)
+{
+    struct simplechar_ring_info info = {};
 
-/* File operations structure */
-static struct file_operations fops = {
-    .owner = THIS_MODULE,
-    .open = device_open,
-    .release = device_release,
-    .read = device_read,
-    .write = device_write,
-    .unlocked_ioctl = device_ioctl,
-};
+    if (!dev->ring.hdr) {
+        return -ENODEV;
+    }
+    info.size = dev->ring.size;
+    info.data_offset = PAGE_SIZE;
+    info.map_size = PAGE_SIZE + dev->ring.size;
+    info.notifies = atomic64_read(&dev->ring.notifies);
 
-/* Proc filesystem operations */
-static int simplechar_proc_show(struct seq_file *m, void *v)
+    return copy_to_user(argp, &info, sizeof(info)) ? -EFAULT : 0;
+}
+
+/*
+ * SIMPLECHAR_IOC_RING_NOTIFY handler
+ * Wakes every poll() sleeper on the ring; each re-reads the indices and
+ * goes back to sleep if there is still nothing for it.
+ */
+static long simplechar_ioctl_ring_notify(struct simplechar_dev *dev)
 {
-    seq_printf(m, "SimpleChar Module Status:\n");
-    seq_printf(m, "  Major Number: %d\n", major_number);
-    seq_printf(m, "  Buffer Size: %zu bytes\n", simple_dev->buffer_size);
-    seq_printf(m, "  Current Data Length: %zu bytes\n", simple_dev->buffer_len);
-    seq_printf(m, "  Open Count: %d\n", atomic_read(&simple_dev->open_count));
-    seq_printf(m, "  Read Operations: %lu\n", simple_dev->read_count);
-    seq_printf(m, "  Write Operations: %lu\n", simple_dev->write_count);
-    seq_printf(m, "  Debug Level: %d\n", debug_level);
+    if (!dev->ring.hdr) {
+        return -ENODEV;
+    }
+    atomic64_inc(&dev->ring.notifies);
+    wake_up_interruptible(&dev->ring.wait);
     return 0;
 }
 
-static int simplechar_proc_open(struct inode *inode, struct file *file)
+/*
+ * Device ioctl function
+ * Handles device-specific control operations
+ */
+static long device_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 {
-    return single_open(file, simplechar_proc_show, NULL);
-}
+    void __user *argp = (void __user *)arg;
 
-static const struct proc_ops simplechar_proc_ops = {
-    .proc_open = simplechar_proc_open,
-    .proc_read = seq_read,
-    .proc_lseek = seq_lseek,
-    .proc_release = single_release,
-};
+    DEBUG_PRINT(3, "IOCTL request: cmd=0x%x, arg=%lu\n", cmd, arg);
+
+    switch (cmd) {
+    case SIMPLECHAR_IOC_GET_DELTA:
+        return simplechar_ioctl_get_delta(simple_dev, argp);
+    case SIMPLECHAR_IOC_SET_QOS:
+        return simplechar_ioctl_set_qos(filep, argp);
+    case SIMPLECHAR_IOC_GET_QOS:
+        return simplechar_ioctl_get_qos(filep, argp);
+    case SIMPLECHAR_IOC_GET_QOS_STATS:
+        return simplechar_ioctl_get_qos_stats(filep, argp);
+    case SIMPLECHAR_IOC_GET_UID_USAGE:
+        return simplechar_ioctl_get_uid_usage(simple_dev, argp);
+    case SIMPLECHAR_IOC_GET_AUTOSIZE:
+        return simplechar_ioctl_get_autosize(simple_dev, argp);
+    case SIMPLECHAR_IOC_GET_LOCK_STATS:
+        return simplechar_ioctl_get_lock_stats(simple_dev, argp);
+    case SIMPLECHAR_IOC_READ_TRACE:
+        return simplechar_ioctl_read_trace(simple_dev, argp);
+    case SIMPLECHAR_IOC_RING_INFO:
+        return simplechar_ioctl_ring_info(simple_dev, argp);
+    case SIMPLECHAR_IOC_RING_NOTIFY:
+        return simplechar_ioctl_ring_notify(simple_dev);
+    default:
+        return -ENOTTY;
+    }
+}
 
 /*
- * Device open function
- * Called when a process opens the device file
+ * Device mmap function
+ * Maps the record ring, header page first, as one shared mapping of at
+ * most PAGE_SIZE + ring size bytes from offset 0
  */
-static int device_open(struct inode *inodep, struct file *filep)
+static int device_mmap(struct file *filep, struct vm_area_struct *vma)
 {
-    DEBUG_PRINT(2, "Device open attempt\n");
-    
-    /* Increment open count atomically */
-    atomic_inc(&simple_dev->open_count);
-    
-    DEBUG_PRINT(2, "Device opened successfully (open count: %d)\n",
-                atomic_read(&simple_dev->open_count));
-    
-    return 0;
+    struct simplechar_ring *ring = &simple_dev->ring;
+
+    if (!ring->hdr) {
+        return -ENODEV;
+    }
+    /* VM_SHARED is dropped for read-only opens, which still see the ring */
+    if (vma->vm_pgoff || !(vma->vm_flags & VM_MAYSHARE)) {
+        return -EINVAL;
+    }
+    return remap_vmalloc_range(vma, ring->hdr, 0);
 }
 
 /*
- * Device release function
- * Called when a process closes the device file
+ * Device poll function
+ * Readable while the ring holds records, writable while at least half of
+ * it is free, so a producer waiting for room is not woken for every
+ * record the consumer frees. Without a ring the device never blocks.
  */
-static int device_release(struct inode *inodep, struct file *filep)
+static __poll_t device_poll(struct file *filep, poll_table *wait)
 {
-    DEBUG_PRINT(2, "Device release attempt\n");
-    
-    /* Decrement open count atomically */
-    atomic_dec(&simple_dev->open_count);
-    
-    DEBUG_PRINT(2, "Device closed (open count: %d)\n",
-                atomic_read(&simple_dev->open_count));
-    
-    INFO_PRINT("Device closed, total reads: %lu, writes: %lu\n",
-               simple_dev->read_count, simple_dev->write_count);
-    
-    return 0;
+    struct simplechar_ring *ring = &simple_dev->ring;
+    __poll_t mask = 0;
+    u64 head, tail;
+
+    if (!ring->hdr) {
+        return DEFAULT_POLLMASK;
+    }
+    poll_wait(filep, &ring->wait, wait);
+
+    head = smp_load_acquire(&ring->hdr->head);
+    tail = smp_load_acquire(&ring->hdr->tail);
+    if (tail != head) {
+        mask |= EPOLLIN | EPOLLRDNORM;
+    }
+    /* Indices come from user space: a bogus pair only confuses its owner */
+    if (tail - head <= ring->size / 2) {
+        mask |= EPOLLOUT | EPOLLWRNORM;
+    }
+    return mask;
 }
 
 /*
- * Device read function
- * Called when a process reads from the device file
+ * In-kernel engine entry points, see simplechar_engine.h
  */
-static ssize_t device_read(struct file *filep, char __user *buffer, 
-                          size_t len, loff_t *offset)
+int simplechar_engine_stat(struct simplechar_engine_stat *st)
+{
+    if (simplechar_gate_enter(&simple_dev->io_gate, false)) {
+        return -ERESTARTSYS;
+    }
+    st->buffer_len = simple_dev->buffer_len;
+    st->buffer_size = simple_dev->buffer_size;
+    st->generation = simple_dev->generation;
+    simplechar_gate_leave(&simple_dev->io_gate);
+    return 0;
+}
+EXPORT_SYMBOL(simplechar_engine_stat);
+
+ssize_t simplechar_engine_read(void *buf, size_t len, loff_t pos)
+{
+    struct kvec kv = { .iov_base = buf, .iov_len = len };
+    struct iov_iter iter;
+
+    iov_iter_kvec(&iter, ITER_DEST, &kv, 1, len);
+    return simplechar_do_read(simple_dev, &iter, &pos);
+}
+EXPORT_SYMBOL(simplechar_engine_read);
+
+ssize_t simplechar_engine_write(const void *buf, size_t len, loff_t pos)
+{
+    struct kvec kv = { .iov_base = (void *)buf, .iov_len = len };
+    struct iov_iter iter;
+
+    iov_iter_kvec(&iter, ITER_SOURCE, &kv, 1, len);
+    return simplechar_do_write(simple_dev, &iter, &pos, false);
+}
+EXPORT_SYMBOL(simplechar_engine_write);
+
+ssize_t simplechar_engine_append(const void *buf, size_t len, loff_t *pos)
+{
+    struct kvec kv = { .iov_base = (void *)buf, .iov_len = len };
+    struct iov_iter iter;
+
+    iov_iter_kvec(&iter, ITER_SOURCE, &kv, 1, len);
+    return simplechar_do_write(simple_dev, &iter, pos, true);
+}
+EXPORT_SYMBOL(simplechar_engine_append);
+
+int simplechar_engine_truncate(size_t len)
+{
+    if (simplechar_gate_enter(&simple_dev->io_gate, false)) {
+        return -ERESTARTSYS;
+    }
+    simple_dev->buffer_len = min(simple_dev->buffer_len, len);
+    simplechar_gate_leave(&simple_dev->io_gate);
+    return 0;
+}
+EXPORT_SYMBOL(simplechar_engine_truncate);
+
+int simplechar_engine_reserve(size_t len, loff_t pos,
+                              struct simplechar_reservation *res)
 {
-    int bytes_read = 0;
+    struct simplechar_dev *dev = simple_dev;
     int ret;
-    
-    DEBUG_PRINT(3, "Read request: len=%zu, offset=%lld\n", len, *offset);
-    
-    /* Acquire mutex to prevent concurrent access */
-    if (mutex_lock_interruptible(&simple_dev->mutex)) {
+
+    if (!len || pos < 0 || (pos & ~PAGE_MASK) + len > PAGE_SIZE) {
+        return -EINVAL;
+    }
+    if (simplechar_gate_enter(&dev->io_gate, false)) {
         return -ERESTARTSYS;
     }
-    
-    /* Check if we're at end of data */
-    if (*offset >= simple_dev->buffer_len) {
-        DEBUG_PRINT(3, "Read at EOF\n");
-        goto out;
+
+    if (pos + len > dev->buffer_size) {
+        simplechar_autosize_note_full(dev, pos + len);
+        ret = -ENOSPC;
+        goto fail;
     }
-    
-    /* Calculate how many bytes to read */
-    bytes_read = min(len, simple_dev->buffer_len - *offset);
-    
-    /* Copy data to user space */
-    ret = copy_to_user(buffer, simple_dev->buffer + *offset, bytes_read);
+    ret = simplechar_store_populate(dev, pos, len);
     if (ret) {
-        ERR_PRINT("Failed to copy %d bytes to user space\n", ret);
-        bytes_read = -EFAULT;
-        goto out;
+        goto fail;
     }
-    
-    /* Update offset and statistics */
-    *offset += bytes_read;
-    simple_dev->read_count++;
-    
-    DEBUG_PRINT(2, "Read %d bytes from device\n", bytes_read);
 
-out:
-    mutex_unlock(&simple_dev->mutex);
-    return bytes_read;
+    /* The gate stays held until the commit */
+    res->pos = pos;
+    res->len = len;
+    res->data = dev->pages[pos >> PAGE_SHIFT] + (pos & ~PAGE_MASK);
+    return 0;
+
+fail:
+    simplechar_gate_leave(&dev->io_gate);
+    return ret;
+}
+EXPORT_SYMBOL(simplechar_engine_reserve);
+
+void simplechar_engine_commit(struct simplechar_reservation *res)
+{
+    struct simplechar_dev *dev = simple_dev;
+
+    if (res->pos + res->len > dev->buffer_len) {
+        dev->buffer_len = res->pos + res->len;
+    }
+    dev->access_end = max_t(size_t, dev->access_end, res->pos + res->len);
+    simplechar_mark_dirty(dev, res->pos, res->len);
+    dev->write_count++;
+    simplechar_gate_leave(&dev->io_gate);
+}
+EXPORT_SYMBOL(simplechar_engine_commit);
+
+int simplechar_engine_lookup(u64 since_gen, loff_t pos, loff_t *start,
+                             size_t *len)
+{
+    struct simplechar_dev *dev = simple_dev;
+    size_t first, next;
+    bool found;
+
+    if (pos < 0) {
+        return -EINVAL;
+    }
+    if (simplechar_gate_enter(&dev->io_gate, false)) {
+        return -ERESTARTSYS;
+    }
+
+    first = pos >> SIMPLECHAR_DIRTY_BLOCK_SHIFT;
+    found = simplechar_find_dirty(dev, since_gen, &first, &next);
+    if (found) {
+        *start = first << SIMPLECHAR_DIRTY_BLOCK_SHIFT;
+        *len = min_t(size_t, next << SIMPLECHAR_DIRTY_BLOCK_SHIFT,
+                     dev->buffer_len) - *start;
+    }
+
+    simplechar_gate_leave(&dev->io_gate);
+    return found ? 0 : -ENOENT;
 }
+EXPORT_SYMBOL(simplechar_engine_lookup);
 
 /*
- * Device write function
- * Called when a process writes to the device file
+ * Release every backing page and the per-uid usage table
  */
-static ssize_t device_write(struct file *filep, const char __user *buffer,
-                           size_t len, loff_t *offset)
+static void simplechar_store_free(struct simplechar_dev *dev)
 {
-    int bytes_written = 0;
-    int ret;
-    
-    DEBUG_PRINT(3, "Write request: len=%zu, offset=%lld\n", len, *offset);
-    
-    /* Acquire mutex to prevent concurrent access */
-    if (mutex_lock_interruptible(&simple_dev->mutex)) {
-        return -ERESTARTSYS;
+    struct simplechar_uid_usage *usage;
+    struct hlist_node *tmp;
+    size_t i;
+    int bkt;
+
+    for (i = 0; i < dev->nr_pages; i++) {
+        if (dev->pages[i]) {
+            free_page((unsigned long)dev->pages[i]);
+        }
     }
-    
-    /* Check if write would exceed buffer size */
-    if (*offset >= simple_dev->buffer_size) {
-        WARN_PRINT("Write attempt beyond buffer size\n");
-        bytes_written = -ENOSPC;
-        goto out;
+    kfree(dev->page_owner);
+    kfree(dev->pages);
+
+    hash_for_each_safe(dev->uid_usage, bkt, tmp, usage, node) {
+        hash_del(&usage->node);
+        kfree(usage);
     }
-    
-    /* Calculate how many bytes to write */
-    bytes_written = min(len, simple_dev->buffer_size - *offset);
-    
-    /* Copy data from user space */
-    ret = copy_from_user(simple_dev->buffer + *offset, buffer, bytes_written);
-    if (ret) {
-        ERR_PRINT("Failed to copy %d bytes from user space\n", ret);
-        bytes_written = -EFAULT;
-        goto out;
+}
+
+/*
+ * Allocate a device with a store of size bytes that may grow to size_max
+ * and a trace ring of at least nr_trace events (0 for none)
+ * Only the store is set up; registering the character device is left to
+ * the caller. Returns NULL when out of memory.
+ */
+static struct simplechar_dev *simplechar_dev_create(size_t size,
+                                                    size_t size_max,
+                                                    unsigned int nr_trace)
+{
+    struct simplechar_dev *dev;
+
+    dev = kzalloc(sizeof(struct simplechar_dev), GFP_KERNEL);
+    if (!dev) {
+        ERR_PRINT("Failed to allocate device structure\n");
+        return NULL;
     }
     
-    /* Update offset, data length, and statistics */
-    *offset += bytes_written;
-    if (*offset > simple_dev->buffer_len) {
-        simple_dev->buffer_len = *offset;
+    /* Size all tables for the largest store autosize may grow to */
+    dev->size_min = size;
+    dev->size_max = size_max;
+
+    /* Allocate the page table of the backing store; pages come on demand */
+    dev->nr_pages = DIV_ROUND_UP(dev->size_max, PAGE_SIZE);
+    dev->pages = kcalloc(dev->nr_pages, sizeof(char *), GFP_KERNEL);
+    dev->page_owner = kcalloc(dev->nr_pages,
+                              sizeof(struct simplechar_uid_usage *),
+                              GFP_KERNEL);
+    if (!dev->pages || !dev->page_owner) {
+        ERR_PRINT("Failed to allocate buffer\n");
+        goto fail_buffer;
+    }
+    hash_init(dev->uid_usage);
+
+    /* Allocate per-block generation tags for dirty-range tracking */
+    dev->block_gen = kvcalloc(DIV_ROUND_UP(dev->size_max,
+                                           SIMPLECHAR_DIRTY_BLOCK_SIZE),
+                              sizeof(u64), GFP_KERNEL);
+    if (!dev->block_gen) {
+        ERR_PRINT("Failed to allocate dirty-range tracking\n");
+        goto fail_block_gen;
+    }
+
+    /* Allocate the operation trace ring */
+    spin_lock_init(&dev->trace.lock);
+    if (nr_trace) {
+        dev->trace.mask = roundup_pow_of_two(nr_trace) - 1;
+        dev->trace.events =
+            kvcalloc(dev->trace.mask + 1,
+                     sizeof(struct simplechar_trace_event), GFP_KERNEL);
+        if (!dev->trace.events) {
+            ERR_PRINT("Failed to allocate the trace ring\n");
+            goto fail_trace;
+        }
     }
-    simple_dev->write_count++;
     
-    DEBUG_PRINT(2, "Wrote %d bytes to device\n", bytes_written);
+    /* Initialize device structure */
+    dev->buffer_size = size;
+    dev->buffer_len = 0;
+    simplechar_gate_init(&dev->io_gate, 1);
+    simplechar_gate_init(&dev->open_gate, max_opens);
+    atomic_set(&dev->open_count, 0);
+    atomic_set(&dev->next_open_id, 0);
+    dev->read_count = 0;
+    dev->write_count = 0;
+    atomic64_set(&dev->throttled_ns, 0);
+    init_waitqueue_head(&dev->ring.wait);
+    atomic64_set(&dev->ring.notifies, 0);
+    INIT_DELAYED_WORK(&dev->autosize_work, simplechar_autosize_work);
+    return dev;
 
-out:
-    mutex_unlock(&simple_dev->mutex);
-    return bytes_written;
+fail_trace:
+    kvfree(dev->block_gen);
+fail_block_gen:
+fail_buffer:
+    kfree(dev->page_owner);
+    kfree(dev->pages);
+    kfree(dev);
+    return NULL;
 }
 
 /*
- * Device ioctl function
- * Handles device-specific control operations
+ * Give dev a shared record ring of at least size bytes
+ * Rounded up to a power of two of at least a page and allocated with a
+ * header page in front, zeroed so both indices start at 0.
  */
-static long device_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
+static int simplechar_ring_create(struct simplechar_dev *dev, size_t size)
 {
-    DEBUG_PRINT(3, "IOCTL request: cmd=0x%x, arg=%lu\n", cmd, arg);
-    
-    /* For now, just return success for any ioctl call */
-    /* In a real driver, you would handle specific commands here */
-    
+    struct simplechar_ring *ring = &dev->ring;
+
+    ring->size = roundup_pow_of_two(max_t(size_t, size, PAGE_SIZE));
+    ring->hdr = vmalloc_user(PAGE_SIZE + ring->size);
+    if (!ring->hdr) {
+        ERR_PRINT("Failed to allocate the record ring\n");
+        return -ENOMEM;
+    }
+    ring->hdr->magic = SIMPLECHAR_RING_MAGIC;
+    ring->hdr->version = SIMPLECHAR_RING_VERSION;
+    ring->hdr->size = ring->size;
+    ring->hdr->data_offset = PAGE_SIZE;
     return 0;
 }
 
+/*
+ * Free a device from simplechar_dev_create()
+ */
+static void simplechar_dev_destroy(struct simplechar_dev *dev)
+{
+    simplechar_store_free(dev);
+    vfree(dev->ring.hdr);
+    kvfree(dev->trace.events);
+    kvfree(dev->block_gen);
+    kfree(dev);
+}
+
 /*
  * Module initialization function
  * Called when the module is loaded
@@ -288,34 +1946,49 @@ static int __init simplechar_init(void)
         return -EINVAL;
     }
     
+    if (autosize && (autosize_max < buffer_size ||
+                     autosize_max > STORE_SIZE_MAX)) {
+        ERR_PRINT("Invalid autosize_max: %d (range: %d-%d)\n",
+                  autosize_max, buffer_size, STORE_SIZE_MAX);
+        return -EINVAL;
+    }
+    
+    if (max_opens < 0) {
+        ERR_PRINT("Invalid max_opens: %d\n", max_opens);
+        return -EINVAL;
+    }
+    
+    if (trace_events > TRACE_EVENTS_MAX) {
+        ERR_PRINT("Invalid trace_events: %u (max: %d)\n",
+                  trace_events, TRACE_EVENTS_MAX);
+        return -EINVAL;
+    }
+    
+    if (ring_size > RING_SIZE_MAX) {
+        ERR_PRINT("Invalid ring_size: %u (max: %d)\n",
+                  ring_size, RING_SIZE_MAX);
+        return -EINVAL;
+    }
+    
     if (debug_level < 0 || debug_level > 3) {
         WARN_PRINT("Debug level out of range, setting to 1\n");
         debug_level = 1;
     }
     
-    /* Allocate device structure */
-    simple_dev = kzalloc(sizeof(struct simplechar_dev), GFP_KERNEL);
+    /* Allocate device structure, sizing its tables for autosize */
+    simple_dev = simplechar_dev_create(buffer_size,
+                                       autosize ? autosize_max : buffer_size,
+                                       trace_events);
     if (!simple_dev) {
-        ERR_PRINT("Failed to allocate device structure\n");
         return -ENOMEM;
     }
-    
-    /* Allocate buffer */
-    simple_dev->buffer = kzalloc(buffer_size, GFP_KERNEL);
-    if (!simple_dev->buffer) {
-        ERR_PRINT("Failed to allocate buffer\n");
-        ret = -ENOMEM;
-        goto fail_buffer;
+    if (ring_size) {
+        ret = simplechar_ring_create(simple_dev, ring_size);
+        if (ret) {
+            goto fail_chrdev;
+        }
     }
     
-    /* Initialize device structure */
-    simple_dev->buffer_size = buffer_size;
-    simple_dev->buffer_len = 0;
-    mutex_init(&simple_dev->mutex);
-    atomic_set(&simple_dev->open_count, 0);
-    simple_dev->read_count = 0;
-    simple_dev->write_count = 0;
-    
     /* Allocate device number */
     ret = alloc_chrdev_region(&dev_num, 0, 1, device_name);
     if (ret < 0) {
@@ -336,7 +2009,11 @@ static int __init simplechar_init(void)
     }
     
     /* Create device class */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+    simple_class = class_create(CLASS_NAME);
+#else
     simple_class = class_create(THIS_MODULE, CLASS_NAME);
+#endif
     if (IS_ERR(simple_class)) {
         ERR_PRINT("Failed to create device class\n");
         ret = PTR_ERR(simple_class);
@@ -358,9 +2035,24 @@ static int __init simplechar_init(void)
         /* Not a fatal error, continue without proc entry */
     }
     
+    /* Start sampling the fill level */
+    if (autosize) {
+        schedule_delayed_work(&simple_dev->autosize_work,
+                              msecs_to_jiffies(autosize_interval_ms));
+    }
+    
     INFO_PRINT("SimpleChar module loaded successfully\n");
     INFO_PRINT("Buffer size: %d bytes\n", buffer_size);
     INFO_PRINT("Debug level: %d\n", debug_level);
+    if (max_opens) {
+        INFO_PRINT("Open limit: %d\n", max_opens);
+    }
+    if (trace_events) {
+        INFO_PRINT("Trace ring: %u events\n", simple_dev->trace.mask + 1);
+    }
+    if (ring_size) {
+        INFO_PRINT("Record ring: %llu bytes\n", simple_dev->ring.size);
+    }
     INFO_PRINT("Device major number: %d\n", major_number);
     INFO_PRINT("Device file: /dev/%s created\n", device_name);
     
@@ -373,9 +2065,7 @@ fail_class:
 fail_cdev:
     unregister_chrdev_region(MKDEV(major_number, 0), 1);
 fail_chrdev:
-    kfree(simple_dev->buffer);
-fail_buffer:
-    kfree(simple_dev);
+    simplechar_dev_destroy(simple_dev);
     return ret;
 }
 
@@ -387,6 +2077,11 @@ static void __exit simplechar_exit(void)
 {
     INFO_PRINT("Cleaning up SimpleChar module\n");
     
+    /* Stop autosize sampling before anything it touches goes away */
+    if (simple_dev) {
+        cancel_delayed_work_sync(&simple_dev->autosize_work);
+    }
+    
     /* Remove proc entry */
     if (proc_entry) {
         proc_remove(proc_entry);
@@ -417,10 +2112,7 @@ static void __exit simplechar_exit(void)
     
     /* Free allocated memory */
     if (simple_dev) {
-        if (simple_dev->buffer) {
-            kfree(simple_dev->buffer);
-        }
-        kfree(simple_dev);
+        simplechar_dev_destroy(simple_dev);
         DEBUG_PRINT(1, "Memory freed\n");
     }
     
@@ -429,4 +2121,8 @@ static void __exit simplechar_exit(void)
 
 /* Register module entry and exit points */
 module_init(simplechar_init);
-module_exit(simplechar_exit);
\ No newline at end of file
+module_exit(simplechar_exit);
+
+#if IS_ENABLED(CONFIG_SIMPLECHAR_KUNIT_TEST)
+#include "simplechar_kunit.c"     /* KUnit suites, see tests/kunit */
+#endif
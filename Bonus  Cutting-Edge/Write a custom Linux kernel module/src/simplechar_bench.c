@@ -0,0 +1,480 @@
+/*
+ * simplechar_bench.c - In-kernel microbenchmark of the SimpleChar store
+ *
+ * Calls the driver's engine entry points (simplechar_engine.h) in tight
+ * loops from kthreads bound to chosen CPUs, measuring what the store
+ * itself costs without system calls or user copies. The operations run
+ * one after the other, each on all selected CPUs at once:
+ *
+ *   append   simplechar_engine_append(), rewinding the data when full
+ *   read     simplechar_engine_read() at advancing offsets of a full store
+ *   reserve  simplechar_engine_reserve(), fill in place, then
+ *            simplechar_engine_commit()
+ *   lookup   simplechar_engine_lookup() of the latest write, which sits at
+ *            the end of the store so every call scans all block generations
+ *
+ * Writing anything to /sys/kernel/debug/simplechar_bench/run starts a run
+ * with the current module parameters and returns when it is done;
+ * /sys/kernel/debug/simplechar_bench/results shows the last run. A run
+ * overwrites the contents of the device, so use an idle one.
+ *
+ * License: MIT
+ */
+
+#include <linux/init.h>          /* Macros used to mark functions */
+#include <linux/module.h>        /* Core header for loading LKMs */
+#include <linux/moduleparam.h>   /* kernel_param_lock() around cpus */
+#include <linux/kthread.h>       /* Worker threads bound to CPUs */
+#include <linux/cpumask.h>       /* CPU list parsing */
+#include <linux/completion.h>    /* Start line and per-worker completion */
+#include <linux/debugfs.h>       /* run and results files */
+#include <linux/seq_file.h>      /* Sequential file operations */
+#include <linux/slab.h>          /* Required for kmalloc/kfree */
+#include <linux/mutex.h>         /* One run at a time */
+#include <linux/ktime.h>         /* Monotonic clock */
+#include <linux/math64.h>        /* 64-bit multiply/divide helpers */
+#include <linux/fs.h>            /* File operations of the run file */
+
+#include "simplechar_engine.h"   /* Entry points exported by simplechar */
+
+/* debugfs is only exported to GPL-compatible modules */
+MODULE_LICENSE("Dual MIT/GPL");
+MODULE_AUTHOR("Your Name");
+MODULE_DESCRIPTION("In-kernel microbenchmark of the SimpleChar store");
+MODULE_VERSION("1.0");
+
+/* Module parameters, read at the start of every run */
+static char *cpus = "0";
+static unsigned int iterations = 100000;
+static unsigned int op_size = 64;
+
+module_param(cpus, charp, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(cpus, "CPUs to run a worker on, as a list like 0-3,8 (default: 0)");
+
+module_param(iterations, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(iterations, "Operations per worker and operation (default: 100000)");
+
+module_param(op_size, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(op_size, "Bytes per operation, at most one page (default: 64)");
+
+#define INFO_PRINT(fmt, args...) \
+    printk(KERN_INFO "simplechar_bench: " fmt, ##args)
+
+#define ERR_PRINT(fmt, args...) \
+    printk(KERN_ERR "simplechar_bench: " fmt, ##args)
+
+enum simplechar_bench_op {
+    BENCH_APPEND,
+    BENCH_READ,
+    BENCH_RESERVE,
+    BENCH_LOOKUP,
+    NR_BENCH_OPS
+};
+
+static const char *const bench_op_names[NR_BENCH_OPS] = {
+    "append", "read", "reserve", "lookup",
+};
+
+/* Outcome of one operation on one CPU */
+struct simplechar_bench_result {
+    unsigned int cpu;
+    u64 ops;
+    u64 errors;             /* Failed or short operations */
+    u64 elapsed_ns;
+};
+
+/* Shared by the workers of one operation */
+struct simplechar_bench_phase {
+    enum simplechar_bench_op op;
+    size_t size;
+    unsigned int iterations;
+    size_t buffer_size;     /* Store size when the phase started */
+    u64 since_gen;          /* Generation before the write lookup finds */
+    struct completion go;   /* Start line, released once all are bound */
+};
+
+struct simplechar_bench_worker {
+    struct task_struct *task;
+    struct simplechar_bench_phase *phase;
+    struct simplechar_bench_result *result;
+    struct completion done;
+    loff_t pos;             /* Cursor of append, read and reserve */
+    char *buf;
+};
+
+/* Last run, protected by bench_lock */
+static DEFINE_MUTEX(bench_lock);
+static struct simplechar_bench_result *results;  /* [op][worker] */
+static unsigned int nr_workers;
+static size_t run_size;
+static unsigned int run_iterations;
+static u64 run_time_ns;
+
+static struct dentry *bench_dir;
+
+/*
+ * One operation of a worker
+ * Returns 0, or a negative errno for failed and short operations
+ */
+static int simplechar_bench_one(struct simplechar_bench_worker *w)
+{
+    struct simplechar_bench_phase *ph = w->phase;
+    struct simplechar_reservation res;
+    loff_t start;
+    size_t len;
+    ssize_t ret;
+
+    switch (ph->op) {
+    case BENCH_APPEND:
+        /* Rewind before the other workers could run the store full */
+        if (w->pos + ph->size * nr_workers > ph->buffer_size) {
+            simplechar_engine_truncate(0);
+        }
+        ret = simplechar_engine_append(w->buf, ph->size, &w->pos);
+        break;
+    case BENCH_READ:
+        if (w->pos + ph->size > ph->buffer_size) {
+            w->pos = 0;
+        }
+        ret = simplechar_engine_read(w->buf, ph->size, w->pos);
+        w->pos += ph->size;
+        break;
+    case BENCH_RESERVE:
+        if ((w->pos & ~PAGE_MASK) + ph->size > PAGE_SIZE) {
+            w->pos = round_up(w->pos, PAGE_SIZE);
+        }
+        if (w->pos + ph->size > ph->buffer_size) {
+            w->pos = 0;
+        }
+        ret = simplechar_engine_reserve(ph->size, w->pos, &res);
+        if (ret) {
+            return ret;
+        }
+        memset(res.data, w->pos, res.len);
+        simplechar_engine_commit(&res);
+        w->pos += ph->size;
+        return 0;
+    case BENCH_LOOKUP:
+        return simplechar_engine_lookup(ph->since_gen, 0, &start, &len);
+    default:
+        return -EINVAL;
+    }
+
+    if (ret < 0) {
+        return ret;
+    }
+    return ret == ph->size ? 0 : -EIO;
+}
+
+static int simplechar_bench_thread(void *data)
+{
+    struct simplechar_bench_worker *w = data;
+    struct simplechar_bench_result *r = w->result;
+    unsigned int i;
+    u64 start;
+
+    wait_for_completion(&w->phase->go);
+
+    start = ktime_get_ns();
+    for (i = 0; i < w->phase->iterations; i++) {
+        if (simplechar_bench_one(w)) {
+            r->errors++;
+        }
+        if (!(i & 1023)) {
+            cond_resched();
+        }
+    }
+    r->elapsed_ns = ktime_get_ns() - start;
+    r->ops = i;
+    complete(&w->done);
+
+    /* Stay around until reaped, kthread_stop() needs the task */
+    set_current_state(TASK_INTERRUPTIBLE);
+    while (!kthread_should_stop()) {
+        schedule();
+        set_current_state(TASK_INTERRUPTIBLE);
+    }
+    __set_current_state(TASK_RUNNING);
+    return 0;
+}
+
+/*
+ * Put the store into the state an operation expects
+ * Read and lookup want a full store; lookup also wants exactly one write
+ * newer than since_gen, at the very end.
+ */
+static int simplechar_bench_prepare(struct simplechar_bench_phase *ph,
+                                    char *page)
+{
+    struct simplechar_engine_stat st;
+    size_t off, chunk;
+    ssize_t ret;
+
+    ret = simplechar_engine_stat(&st);
+    if (ret) {
+        return ret;
+    }
+    ph->buffer_size = st.buffer_size;
+    if (ph->size > st.buffer_size) {
+        return -EINVAL;
+    }
+
+    if (ph->op == BENCH_APPEND) {
+        return simplechar_engine_truncate(0);
+    }
+    if (ph->op == BENCH_RESERVE) {
+        return 0;
+    }
+
+    for (off = 0; off < st.buffer_size; off += chunk) {
+        chunk = min_t(size_t, PAGE_SIZE, st.buffer_size - off);
+        ret = simplechar_engine_write(page, chunk, off);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    if (ph->op == BENCH_LOOKUP) {
+        ret = simplechar_engine_stat(&st);
+        if (ret) {
+            return ret;
+        }
+        ph->since_gen = st.generation;
+        ret = simplechar_engine_write(page, ph->size,
+                                      st.buffer_size - ph->size);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Run one operation on every worker CPU
+ * All threads are created and bound before any is woken, so a failure
+ * can still stop them before they run.
+ */
+static int simplechar_bench_phase_run(struct simplechar_bench_phase *ph,
+                                      struct simplechar_bench_worker *workers,
+                                      const struct cpumask *mask,
+                                      struct simplechar_bench_result *out)
+{
+    unsigned int cpu, i = 0, created;
+    int ret = 0;
+
+    init_completion(&ph->go);
+    for_each_cpu(cpu, mask) {
+        struct simplechar_bench_worker *w = &workers[i];
+
+        w->phase = ph;
+        w->result = &out[i];
+        w->result->cpu = cpu;
+        w->pos = ph->op == BENCH_READ ? i * ph->size : 0;
+        init_completion(&w->done);
+        w->task = kthread_create_on_node(simplechar_bench_thread, w,
+                                         cpu_to_node(cpu),
+                                         "simplechar_bench/%u", cpu);
+        if (IS_ERR(w->task)) {
+            ret = PTR_ERR(w->task);
+            break;
+        }
+        kthread_bind(w->task, cpu);
+        i++;
+    }
+    created = i;
+
+    if (!ret) {
+        for (i = 0; i < created; i++) {
+            wake_up_process(workers[i].task);
+        }
+        complete_all(&ph->go);
+        for (i = 0; i < created; i++) {
+            wait_for_completion(&workers[i].done);
+        }
+    }
+
+    for (i = 0; i < created; i++) {
+        kthread_stop(workers[i].task);
+    }
+    return ret;
+}
+
+static int simplechar_bench_run(void)
+{
+    struct simplechar_bench_phase ph = {};
+    struct simplechar_bench_worker *workers = NULL;
+    struct simplechar_bench_result *out = NULL;
+    cpumask_var_t mask;
+    unsigned int nr, i;
+    char *page = NULL;
+    int op, ret;
+
+    ph.size = READ_ONCE(op_size);
+    ph.iterations = READ_ONCE(iterations);
+    if (!ph.size || ph.size > PAGE_SIZE || !ph.iterations) {
+        return -EINVAL;
+    }
+
+    if (!zalloc_cpumask_var(&mask, GFP_KERNEL)) {
+        return -ENOMEM;
+    }
+    kernel_param_lock(THIS_MODULE);
+    ret = cpulist_parse(cpus, mask);
+    kernel_param_unlock(THIS_MODULE);
+    if (ret) {
+        goto out;
+    }
+    cpumask_and(mask, mask, cpu_online_mask);
+    nr = cpumask_weight(mask);
+    if (!nr) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    ret = -ENOMEM;
+    workers = kcalloc(nr, sizeof(*workers), GFP_KERNEL);
+    out = kcalloc(nr * NR_BENCH_OPS, sizeof(*out), GFP_KERNEL);
+    page = kmalloc(PAGE_SIZE, GFP_KERNEL);
+    if (!workers || !out || !page) {
+        goto out;
+    }
+    memset(page, 'b', PAGE_SIZE);
+    for (i = 0; i < nr; i++) {
+        workers[i].buf = page;
+    }
+
+    if (mutex_lock_interruptible(&bench_lock)) {
+        ret = -ERESTARTSYS;
+        goto out;
+    }
+
+    /* Sizes the append rewind, the workers read it */
+    nr_workers = nr;
+    for (op = 0; op < NR_BENCH_OPS; op++) {
+        ph.op = op;
+        ret = simplechar_bench_prepare(&ph, page);
+        if (!ret) {
+            ret = simplechar_bench_phase_run(&ph, workers, mask,
+                                             &out[op * nr]);
+        }
+        if (ret) {
+            ERR_PRINT("%s failed: %d\n", bench_op_names[op], ret);
+            break;
+        }
+    }
+
+    if (!ret) {
+        swap(results, out);
+        run_size = ph.size;
+        run_iterations = ph.iterations;
+        run_time_ns = ktime_get_real_ns();
+        INFO_PRINT("Run of %u x %zu bytes on %u CPUs done\n",
+                   ph.iterations, ph.size, nr);
+    }
+    mutex_unlock(&bench_lock);
+
+out:
+    kfree(page);
+    kfree(out);
+    kfree(workers);
+    free_cpumask_var(mask);
+    return ret;
+}
+
+static ssize_t simplechar_bench_run_write(struct file *filep,
+                                          const char __user *buf,
+                                          size_t len, loff_t *offset)
+{
+    int ret = simplechar_bench_run();
+
+    return ret ? ret : len;
+}
+
+static const struct file_operations simplechar_bench_run_fops = {
+    .owner = THIS_MODULE,
+    .write = simplechar_bench_run_write,
+    .llseek = noop_llseek,
+};
+
+/* ns/op with one decimal */
+static void simplechar_bench_show_row(struct seq_file *m, const char *op,
+                                      const char *cpu, u64 ops, u64 errors,
+                                      u64 elapsed_ns)
+{
+    u64 tenths = ops ? div64_u64(elapsed_ns * 10, ops) : 0;
+    u32 frac;
+
+    tenths = div_u64_rem(tenths, 10, &frac);
+    seq_printf(m, "%-8s %5s %12llu %8llu %10llu.%u\n",
+               op, cpu, ops, errors, tenths, frac);
+}
+
+/*
+ * The all row of an operation divides the time of the slowest worker by
+ * the operations of every worker, the cost per operation of all CPUs
+ * working together
+ */
+static int simplechar_bench_results_show(struct seq_file *m, void *v)
+{
+    const struct simplechar_bench_result *r;
+    char cpu[12];
+    u64 ops, errors, elapsed;
+    unsigned int i;
+    int op;
+
+    if (mutex_lock_interruptible(&bench_lock)) {
+        return -ERESTARTSYS;
+    }
+    if (!results) {
+        seq_puts(m, "No run yet, write to run to start one\n");
+        goto out;
+    }
+
+    seq_printf(m, "# %zu bytes per op, %u ops per worker, %u workers, at %llu ns\n",
+               run_size, run_iterations, nr_workers, run_time_ns);
+    seq_printf(m, "%-8s %5s %12s %8s %12s\n",
+               "op", "cpu", "ops", "errors", "ns/op");
+    for (op = 0; op < NR_BENCH_OPS; op++) {
+        ops = errors = elapsed = 0;
+        for (i = 0; i < nr_workers; i++) {
+            r = &results[op * nr_workers + i];
+            snprintf(cpu, sizeof(cpu), "%u", r->cpu);
+            simplechar_bench_show_row(m, bench_op_names[op], cpu, r->ops,
+                                      r->errors, r->elapsed_ns);
+            ops += r->ops;
+            errors += r->errors;
+            elapsed = max(elapsed, r->elapsed_ns);
+        }
+        if (nr_workers > 1) {
+            simplechar_bench_show_row(m, bench_op_names[op], "all", ops,
+                                      errors, elapsed);
+        }
+    }
+
+out:
+    mutex_unlock(&bench_lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(simplechar_bench_results);
+
+static int __init simplechar_bench_init(void)
+{
+    bench_dir = debugfs_create_dir("simplechar_bench", NULL);
+    debugfs_create_file("run", 0200, bench_dir, NULL,
+                        &simplechar_bench_run_fops);
+    debugfs_create_file("results", 0444, bench_dir, NULL,
+                        &simplechar_bench_results_fops);
+
+    INFO_PRINT("Ready, write to /sys/kernel/debug/simplechar_bench/run\n");
+    return 0;
+}
+
+static void __exit simplechar_bench_exit(void)
+{
+    /* Waits for a run still inside the run file */
+    debugfs_remove_recursive(bench_dir);
+    kfree(results);
+}
+
+module_init(simplechar_bench_init);
+module_exit(simplechar_bench_exit);
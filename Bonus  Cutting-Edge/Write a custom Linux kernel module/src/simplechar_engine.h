@@ -0,0 +1,63 @@
+/*
+ * simplechar_engine.h - In-kernel entry points into the SimpleChar store
+ *
+ * The driver exports the store operations behind its file operations for
+ * companion modules such as simplechar_bench. They work on kernel buffers
+ * and skip the per-open rate limits and the operation trace; everything
+ * else takes the same path as read() and write(): the FIFO I/O gate,
+ * autosize, page population with its uid quota, and the dirty-block
+ * generations. All of them act on the one loaded device and may sleep.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_ENGINE_H
+#define SIMPLECHAR_ENGINE_H
+
+#include <linux/types.h>
+
+/* Snapshot of the store */
+struct simplechar_engine_stat {
+    size_t buffer_len;      /* Current data length */
+    size_t buffer_size;     /* Current store size */
+    u64 generation;         /* Bumped by every write */
+};
+
+/* A range of the store being written in place */
+struct simplechar_reservation {
+    loff_t pos;
+    size_t len;
+    char *data;             /* len writable bytes inside one backing page */
+};
+
+int simplechar_engine_stat(struct simplechar_engine_stat *st);
+
+/* Like pread()/pwrite(): bytes transferred or a negative errno */
+ssize_t simplechar_engine_read(void *buf, size_t len, loff_t pos);
+ssize_t simplechar_engine_write(const void *buf, size_t len, loff_t pos);
+
+/* Write at the end of the data; *pos is left just past the new bytes */
+ssize_t simplechar_engine_append(const void *buf, size_t len, loff_t *pos);
+
+/* Drop the data past len bytes, keeping the backing pages */
+int simplechar_engine_truncate(size_t len);
+
+/*
+ * Write [pos, pos + len) in place
+ * The range may not cross a page boundary. On success the I/O gate is
+ * held until simplechar_engine_commit(), which publishes whatever was
+ * stored at res->data, so every other user of the device waits until
+ * then; commit promptly.
+ */
+int simplechar_engine_reserve(size_t len, loff_t pos,
+                              struct simplechar_reservation *res);
+void simplechar_engine_commit(struct simplechar_reservation *res);
+
+/*
+ * Find the first range at or after pos written after since_gen, the
+ * unit SIMPLECHAR_IOC_GET_DELTA returns. -ENOENT when nothing changed.
+ */
+int simplechar_engine_lookup(u64 since_gen, loff_t pos, loff_t *start,
+                             size_t *len);
+
+#endif /* SIMPLECHAR_ENGINE_H */
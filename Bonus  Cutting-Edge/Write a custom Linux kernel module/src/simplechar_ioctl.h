@@ -0,0 +1,282 @@
+/*
+ * simplechar_ioctl.h - ioctl interface of the SimpleChar character device
+ *
+ * This header is shared between the kernel module and user space tools.
+ * It only uses fixed-width types so the same layout works for 32-bit
+ * callers on 64-bit kernels.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_IOCTL_H
+#define SIMPLECHAR_IOCTL_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define SIMPLECHAR_IOC_MAGIC 0xB5
+
+/*
+ * Dirty-range tracking
+ *
+ * Every write bumps the device generation and tags the blocks it touched
+ * with the new generation. SIMPLECHAR_IOC_GET_DELTA returns all ranges
+ * modified after generation since_gen, packed together with their data:
+ *
+ *   [struct simplechar_delta_range][data, padded to SIMPLECHAR_DELTA_ALIGN]...
+ *
+ * If the output buffer is too small the call fails with ENOSPC and
+ * bytes_used holds the size that would have been needed.
+ */
+#define SIMPLECHAR_DIRTY_BLOCK_SHIFT 6
+#define SIMPLECHAR_DIRTY_BLOCK_SIZE  (1U << SIMPLECHAR_DIRTY_BLOCK_SHIFT)
+#define SIMPLECHAR_DELTA_ALIGN       8
+
+struct simplechar_delta_range {
+    __u32 offset;           /* Byte offset of the range in the device */
+    __u32 length;           /* Number of data bytes following this header */
+};
+
+struct simplechar_delta {
+    __u64 since_gen;        /* in:  return ranges newer than this */
+    __u64 data;             /* in:  user pointer to the output buffer */
+    __u32 data_len;         /* in:  size of the output buffer */
+    __u32 flags;            /* in:  must be zero */
+    __u64 generation;       /* out: current device generation */
+    __u64 data_size;        /* out: current data length of the device */
+    __u32 nr_ranges;        /* out: number of ranges returned */
+    __u32 bytes_used;       /* out: bytes written (or needed) in data */
+};
+
+#define SIMPLECHAR_IOC_GET_DELTA _IOWR(SIMPLECHAR_IOC_MAGIC, 1, struct simplechar_delta)
+
+/*
+ * Per-open QoS
+ *
+ * Each open file has two token buckets, one for operations per second and
+ * one for bytes per second. A rate of zero disables the bucket; a burst of
+ * zero defaults to one second worth of tokens. Callers over the limit sleep
+ * until tokens are available, or get EAGAIN when opened with O_NONBLOCK.
+ */
+struct simplechar_qos {
+    __u64 ops_per_sec;      /* Operation rate limit, 0 = unlimited */
+    __u64 bytes_per_sec;    /* Byte rate limit, 0 = unlimited */
+    __u64 ops_burst;        /* Operation bucket depth */
+    __u64 bytes_burst;      /* Byte bucket depth */
+};
+
+struct simplechar_qos_stats {
+    __u64 throttled_ns;     /* Total time this open file spent throttled */
+    __u64 throttled_ops;    /* Operations that had to wait for tokens */
+    __u64 rejected_ops;     /* Operations failed with EAGAIN */
+};
+
+#define SIMPLECHAR_IOC_SET_QOS       _IOW(SIMPLECHAR_IOC_MAGIC, 2, struct simplechar_qos)
+#define SIMPLECHAR_IOC_GET_QOS       _IOR(SIMPLECHAR_IOC_MAGIC, 3, struct simplechar_qos)
+#define SIMPLECHAR_IOC_GET_QOS_STATS _IOR(SIMPLECHAR_IOC_MAGIC, 4, struct simplechar_qos_stats)
+
+/*
+ * Per-uid quotas
+ *
+ * Backing pages are allocated on first write and charged both to the
+ * writer's memory cgroup and to its uid. Writes that would push a uid past
+ * the uid_quota module parameter fail with EDQUOT.
+ */
+#define SIMPLECHAR_UID_SELF ((__u32)-1)
+
+struct simplechar_uid_usage_info {
+    __u32 uid;              /* in:  uid to query, SIMPLECHAR_UID_SELF = caller */
+    __u32 reserved;
+    __u64 bytes;            /* out: backing store bytes charged to uid */
+    __u64 quota;            /* out: per-uid quota in bytes, 0 = unlimited */
+};
+
+#define SIMPLECHAR_IOC_GET_UID_USAGE _IOWR(SIMPLECHAR_IOC_MAGIC, 5, struct simplechar_uid_usage_info)
+
+/*
+ * Adaptive sizing
+ *
+ * With the autosize module parameter set, a write that does not fit is
+ * still refused or cut short, and only counted in writer_full. A sample
+ * every autosize_interval_ms that saw such writes grows the store in
+ * doubling steps up to autosize_max, until the largest of them fits.
+ * fill_pct is a high-water mark of the offsets read and written, which
+ * loses a quarter per sample. After a run of low-fill samples with no
+ * writer out of space the store is halved, never below the initial
+ * buffer_size, the high-water mark or the data length, so a shrink never
+ * discards data. The most recent resizes are kept in a history.
+ */
+#define SIMPLECHAR_RESIZE_HISTORY 16
+
+#define SIMPLECHAR_RESIZE_GROW   1  /* Writers ran out of space */
+#define SIMPLECHAR_RESIZE_SHRINK 2  /* Sustained low fill */
+
+struct simplechar_resize_event {
+    __u64 time_ns;          /* CLOCK_MONOTONIC time of the resize */
+    __u32 old_size;         /* Store size before, in bytes */
+    __u32 new_size;         /* Store size after, in bytes */
+    __u32 reason;           /* SIMPLECHAR_RESIZE_* */
+    __u32 fill_pct;         /* Fill level when the decision was made */
+};
+
+struct simplechar_autosize_info {
+    __u32 enabled;          /* Non-zero when autosize is active */
+    __u32 size;             /* Current store size in bytes */
+    __u32 min_size;         /* Floor: the initial buffer_size */
+    __u32 max_size;         /* Ceiling: autosize_max */
+    __u64 writer_full;      /* Writes refused or cut short for lack of space */
+    __u64 reader_empty;     /* Reads that found no data */
+    __u32 writer_full_rate; /* writer_full per second, last sample */
+    __u32 reader_empty_rate;/* reader_empty per second, last sample */
+    __u32 fill_pct;         /* Fill level at the last sample */
+    __u32 nr_events;        /* Valid entries in events, oldest first */
+    __u64 nr_resizes;       /* Total resizes since load */
+    struct simplechar_resize_event events[SIMPLECHAR_RESIZE_HISTORY];
+};
+
+#define SIMPLECHAR_IOC_GET_AUTOSIZE _IOR(SIMPLECHAR_IOC_MAGIC, 6, struct simplechar_autosize_info)
+
+/*
+ * Lock statistics
+ *
+ * Cumulative counters of the two FIFO gates: the I/O gate that reads,
+ * writes and the ioctls that touch the store serialize on, and the open
+ * gate enforcing max_opens.
+ * Wait time runs from queueing until the slot is handed over; hold time
+ * is only tracked for the exclusive I/O gate. Sample twice and subtract.
+ */
+struct simplechar_lock_stats {
+    __u64 acquisitions;     /* Times the gate was entered */
+    __u64 contended;        /* Entries that had to queue */
+    __u64 wait_ns;          /* Total time spent queued */
+    __u64 max_wait_ns;      /* Longest single wait */
+    __u64 hold_ns;          /* Total time held, exclusive gates only */
+    __u32 holders;          /* Current holders */
+    __u32 waiting;          /* Current queue length */
+};
+
+struct simplechar_lock_info {
+    struct simplechar_lock_stats io;
+    struct simplechar_lock_stats open;
+};
+
+#define SIMPLECHAR_IOC_GET_LOCK_STATS _IOR(SIMPLECHAR_IOC_MAGIC, 7, struct simplechar_lock_info)
+
+/*
+ * Operation trace
+ *
+ * Loading with trace_events=N keeps the last N (rounded up to a power of
+ * two) opens, closes, reads and writes in a ring while the trace module
+ * parameter is set. Every open file gets an open_id so a replay can map
+ * operations back to separate descriptors. SIMPLECHAR_IOC_READ_TRACE
+ * copies events starting at sequence number seq; events overwritten
+ * before they were read are counted in dropped. Fails with ENODEV when
+ * the module was loaded without a ring.
+ */
+#define SIMPLECHAR_TRACE_OPEN   1
+#define SIMPLECHAR_TRACE_CLOSE  2
+#define SIMPLECHAR_TRACE_READ   3
+#define SIMPLECHAR_TRACE_WRITE  4
+
+#define SIMPLECHAR_TRACE_NONBLOCK 0x1   /* Opened with O_NONBLOCK */
+
+#define SIMPLECHAR_TRACE_BATCH  256     /* Most events returned per call */
+
+struct simplechar_trace_event {
+    __u64 time_ns;          /* CLOCK_MONOTONIC time the call entered */
+    __u64 offset;           /* File position of a read or write */
+    __u32 size;             /* Requested length */
+    __s32 result;           /* Bytes transferred or negative errno */
+    __u32 duration_ns;      /* Time spent in the driver, saturating */
+    __u32 gap_ns;           /* Time since the previous event, saturating */
+    __u32 open_id;          /* Identifies the open file */
+    __u32 pid;              /* Thread group of the caller */
+    __u16 op;               /* SIMPLECHAR_TRACE_* */
+    __u16 flags;            /* SIMPLECHAR_TRACE_NONBLOCK */
+    __u32 reserved;
+};
+
+struct simplechar_trace_read {
+    __u64 seq;              /* in:  first event wanted
+                               out: sequence number after the last returned */
+    __u64 events;           /* in:  user pointer to max_events entries */
+    __u32 max_events;       /* in:  capacity of events */
+    __u32 nr_events;        /* out: entries filled */
+    __u64 head;             /* out: sequence number of the next event */
+    __u64 dropped;          /* out: events lost before seq could be read */
+};
+
+#define SIMPLECHAR_IOC_READ_TRACE _IOWR(SIMPLECHAR_IOC_MAGIC, 8, struct simplechar_trace_read)
+
+/*
+ * Shared record ring
+ *
+ * Loading with ring_size=N sets up a ring of N bytes (rounded up to a
+ * power of two of at least a page) that user space maps with mmap() at
+ * offset 0: a header page followed by the data. One producer and one
+ * consumer move records through it without system calls. The producer
+ * writes records at tail and publishes them with a release store of
+ * tail; the consumer reads up to an acquire load of tail and frees the
+ * space with a release store of head. Both indices run freely and are
+ * taken modulo size.
+ *
+ * Records start 8-byte aligned with a struct simplechar_ring_record and
+ * never wrap: a producer that would cross the end fills the rest with a
+ * SIMPLECHAR_RING_PAD record and starts over at offset 0.
+ *
+ * A side that runs out of work sets its *_waiting flag, re-checks the
+ * indices and sleeps in poll(): POLLIN while the ring holds records,
+ * POLLOUT while at least half of it is free. A record, padding
+ * included, therefore always fits once POLLOUT is reported as long as it
+ * is no larger than SIMPLECHAR_RING_RECORD_MAX(size). The other side,
+ * after publishing, calls SIMPLECHAR_IOC_RING_NOTIFY if the flag is set.
+ * Without a ring, mmap() and the ring ioctls fail with ENODEV.
+ *
+ * The driver leaves schema at 0. The first end that opens the ring with
+ * a record schema stores its hash there, and ends with another schema
+ * refuse the ring.
+ */
+#define SIMPLECHAR_RING_MAGIC   0x53435247  /* "SCRG" */
+#define SIMPLECHAR_RING_VERSION 1
+#define SIMPLECHAR_RING_ALIGN   8
+
+#define SIMPLECHAR_RING_PAD     0x1         /* Skip to the start of the ring */
+
+/* Largest record, header included, that a ring of size bytes takes */
+#define SIMPLECHAR_RING_RECORD_MAX(size) ((size) / 4)
+
+struct simplechar_ring_header {
+    __u32 magic;            /* SIMPLECHAR_RING_MAGIC */
+    __u32 version;          /* SIMPLECHAR_RING_VERSION */
+    __u64 size;             /* Data bytes, a power of two */
+    __u64 data_offset;      /* Start of the data within the mapping */
+    __u64 schema;           /* Record schema hash, 0 = untyped; user space's */
+    __u64 reserved0[4];
+
+    /* Written by the producer, on its own cache line */
+    __u64 tail;             /* Bytes published since load */
+    __u32 producer_waiting; /* Producer sleeps until there is space */
+    __u32 reserved1[13];
+
+    /* Written by the consumer, on its own cache line */
+    __u64 head;             /* Bytes consumed since load */
+    __u32 consumer_waiting; /* Consumer sleeps until there are records */
+    __u32 reserved2[13];
+};
+
+struct simplechar_ring_record {
+    __u32 len;              /* Payload bytes following the header */
+    __u32 flags;            /* SIMPLECHAR_RING_PAD */
+};
+
+struct simplechar_ring_info {
+    __u64 size;             /* Data bytes */
+    __u64 data_offset;      /* Start of the data within the mapping */
+    __u64 map_size;         /* Bytes to mmap(): data_offset + size */
+    __u64 notifies;         /* SIMPLECHAR_IOC_RING_NOTIFY calls since load */
+};
+
+#define SIMPLECHAR_IOC_RING_INFO   _IOR(SIMPLECHAR_IOC_MAGIC, 9, struct simplechar_ring_info)
+#define SIMPLECHAR_IOC_RING_NOTIFY _IO(SIMPLECHAR_IOC_MAGIC, 10)
+
+#endif /* SIMPLECHAR_IOCTL_H */
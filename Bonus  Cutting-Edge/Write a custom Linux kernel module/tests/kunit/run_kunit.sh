@@ -0,0 +1,43 @@
+#!/bin/bash
+#
+# run_kunit.sh - Run the SimpleChar KUnit suites with kunit.py
+#
+# KUnit builds a whole kernel, so the driver is linked into a kernel
+# source tree as drivers/char/simplechar (symlinks to this project) and
+# wired into drivers/char/Kconfig and Makefile. Both edits are idempotent.
+# Everything after the tree is passed to kunit.py, e.g. --arch=x86_64 to
+# run under QEMU instead of UML, or a suite filter like 'simplechar_io'.
+#
+# Usage: tests/kunit/run_kunit.sh [KERNEL_SRC] [kunit.py options...]
+#
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_DIR="$(dirname "$(dirname "$SCRIPT_DIR")")"
+KERNEL_SRC="${1:-${KERNEL_SRC:-/usr/src/linux}}"
+[[ $# -gt 0 ]] && shift
+
+if [[ ! -x "$KERNEL_SRC/tools/testing/kunit/kunit.py" ]]; then
+    echo "Error: $KERNEL_SRC is not a kernel source tree with KUnit" >&2
+    echo "Usage: $0 [KERNEL_SRC] [kunit.py options...]" >&2
+    exit 2
+fi
+
+DRIVER_DIR="$KERNEL_SRC/drivers/char/simplechar"
+mkdir -p "$DRIVER_DIR"
+for f in "$PROJECT_DIR"/src/simplechar.c "$PROJECT_DIR"/src/simplechar_*.h \
+         "$SCRIPT_DIR"/simplechar_kunit.c "$SCRIPT_DIR"/Kconfig \
+         "$SCRIPT_DIR"/Kbuild "$SCRIPT_DIR"/.kunitconfig; do
+    ln -sf "$f" "$DRIVER_DIR/"
+done
+
+if ! grep -q 'drivers/char/simplechar/Kconfig' "$KERNEL_SRC/drivers/char/Kconfig"; then
+    echo 'source "drivers/char/simplechar/Kconfig"' >> "$KERNEL_SRC/drivers/char/Kconfig"
+fi
+if ! grep -q 'simplechar/' "$KERNEL_SRC/drivers/char/Makefile"; then
+    echo 'obj-y += simplechar/' >> "$KERNEL_SRC/drivers/char/Makefile"
+fi
+
+cd "$KERNEL_SRC"
+exec ./tools/testing/kunit/kunit.py run --kunitconfig=drivers/char/simplechar "$@"
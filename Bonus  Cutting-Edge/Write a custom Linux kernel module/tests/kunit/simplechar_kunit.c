@@ -0,0 +1,835 @@
+/*
+ * simplechar_kunit.c - KUnit suites for the SimpleChar store
+ *
+ * Included at the end of simplechar.c when CONFIG_SIMPLECHAR_KUNIT_TEST
+ * is set, so the static read, write and offset logic can be called
+ * directly. Every case runs against a private device swapped in for
+ * simple_dev, and user buffers come from kunit_vm_mmap(), so no root,
+ * device node or hardware is needed. tests/kunit/run_kunit.sh runs the
+ * suites with kunit.py in UML or QEMU.
+ *
+ * The performance cases assert generous per-operation budgets that only
+ * a gross regression, like a scan or an allocation on the fast path,
+ * should break even under QEMU without KVM. They are marked slow.
+ *
+ * License: MIT
+ */
+
+#include <kunit/test.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/mman.h>
+#include <linux/string.h>
+
+#define SIMPLECHAR_TEST_SIZE   (4 * PAGE_SIZE)  /* Default test store */
+#define SIMPLECHAR_TEST_UBUF   (4 * PAGE_SIZE)  /* User buffer of a case */
+#define SIMPLECHAR_TEST_THREADS 4
+
+/* Per-operation budgets of the performance cases */
+#define SIMPLECHAR_TEST_IO_BUDGET_NS     50000
+#define SIMPLECHAR_TEST_GATE_BUDGET_NS   5000
+#define SIMPLECHAR_TEST_LOOKUP_BUDGET_NS 100000
+
+struct simplechar_test_ctx {
+    struct simplechar_dev *saved;   /* simple_dev outside the test */
+    bool saved_autosize;
+    struct simplechar_dev *dev;     /* Device under test */
+    struct simplechar_file sf;      /* No rate limits */
+    struct file file;
+    char __user *ubuf;
+};
+
+struct simplechar_test_worker {
+    struct completion done;
+    int id;
+    bool reader;
+    unsigned long torn;             /* Reads mixing two writers' bytes */
+    unsigned long errors;           /* Failed or short operations */
+};
+
+/*
+ * Replace the device under test with a fresh one of size bytes that
+ * autosize may grow to size_max
+ */
+static struct simplechar_dev *simplechar_test_use(struct kunit *test,
+                                                  size_t size,
+                                                  size_t size_max)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+
+    if (ctx->dev) {
+        simple_dev = ctx->saved;
+        simplechar_dev_destroy(ctx->dev);
+    }
+    ctx->dev = simplechar_dev_create(size, size_max, 0);
+    KUNIT_ASSERT_NOT_NULL(test, ctx->dev);
+    simple_dev = ctx->dev;
+    return ctx->dev;
+}
+
+/* device_write() of len bytes from src, staged through user memory */
+static ssize_t simplechar_test_write(struct kunit *test, const void *src,
+                                     size_t len, loff_t *pos)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+
+    KUNIT_ASSERT_LE(test, len, (size_t)SIMPLECHAR_TEST_UBUF);
+    KUNIT_ASSERT_EQ(test, copy_to_user(ctx->ubuf, src, len), 0UL);
+    return device_write(&ctx->file, ctx->ubuf, len, pos);
+}
+
+/* device_read() of up to len bytes into dst, staged through user memory */
+static ssize_t simplechar_test_read(struct kunit *test, void *dst,
+                                    size_t len, loff_t *pos)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    ssize_t ret;
+
+    KUNIT_ASSERT_LE(test, len, (size_t)SIMPLECHAR_TEST_UBUF);
+    ret = device_read(&ctx->file, ctx->ubuf, len, pos);
+    if (ret > 0) {
+        KUNIT_ASSERT_EQ(test, copy_from_user(dst, ctx->ubuf, ret), 0UL);
+    }
+    return ret;
+}
+
+/* Run fn on n kthreads and wait for all of them */
+static void simplechar_test_run_workers(struct kunit *test,
+                                        int (*fn)(void *),
+                                        struct simplechar_test_worker *w,
+                                        int n)
+{
+    struct task_struct *task;
+    int i, started;
+
+    for (started = 0; started < n; started++) {
+        init_completion(&w[started].done);
+        w[started].id = started;
+        task = kthread_run(fn, &w[started], "simplechar_test/%d", started);
+        if (IS_ERR(task)) {
+            break;
+        }
+    }
+    for (i = 0; i < started; i++) {
+        wait_for_completion(&w[i].done);
+    }
+    KUNIT_ASSERT_EQ(test, started, n);
+}
+
+static int simplechar_test_init(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx;
+    unsigned long addr;
+
+    ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+    if (!ctx) {
+        return -ENOMEM;
+    }
+    test->priv = ctx;
+    ctx->saved = simple_dev;
+    ctx->saved_autosize = autosize;
+    ctx->file.private_data = &ctx->sf;
+
+    addr = kunit_vm_mmap(test, NULL, 0, SIMPLECHAR_TEST_UBUF,
+                         PROT_READ | PROT_WRITE,
+                         MAP_ANONYMOUS | MAP_PRIVATE, 0);
+    if (!addr || IS_ERR_VALUE(addr)) {
+        return -ENOMEM;
+    }
+    ctx->ubuf = (char __user *)addr;
+
+    ctx->dev = simplechar_dev_create(SIMPLECHAR_TEST_SIZE,
+                                     SIMPLECHAR_TEST_SIZE, 0);
+    if (!ctx->dev) {
+        return -ENOMEM;
+    }
+    simple_dev = ctx->dev;
+    return 0;
+}
+
+static void simplechar_test_exit(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+
+    simple_dev = ctx->saved;
+    autosize = ctx->saved_autosize;
+    if (ctx->dev) {
+        simplechar_dev_destroy(ctx->dev);
+    }
+}
+
+/*
+ * Boundaries of device_read() and device_write()
+ */
+static void simplechar_test_write_read_roundtrip(struct kunit *test)
+{
+    static const char msg[] = "hello, simplechar";
+    struct simplechar_test_ctx *ctx = test->priv;
+    char out[sizeof(msg)] = {};
+    loff_t pos = 0;
+
+    KUNIT_EXPECT_EQ(test, simplechar_test_write(test, msg, sizeof(msg), &pos),
+                    (ssize_t)sizeof(msg));
+    KUNIT_EXPECT_EQ(test, pos, (loff_t)sizeof(msg));
+    KUNIT_EXPECT_EQ(test, ctx->dev->buffer_len, sizeof(msg));
+    KUNIT_EXPECT_EQ(test, ctx->dev->write_count, 1UL);
+
+    pos = 0;
+    KUNIT_EXPECT_EQ(test, simplechar_test_read(test, out, sizeof(out), &pos),
+                    (ssize_t)sizeof(msg));
+    KUNIT_EXPECT_EQ(test, pos, (loff_t)sizeof(msg));
+    KUNIT_EXPECT_MEMEQ(test, out, msg, sizeof(msg));
+    KUNIT_EXPECT_EQ(test, ctx->dev->read_count, 1UL);
+}
+
+static void simplechar_test_read_empty_is_eof(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    char out[8];
+    loff_t pos = 0;
+
+    KUNIT_EXPECT_EQ(test, simplechar_test_read(test, out, sizeof(out), &pos),
+                    (ssize_t)0);
+    KUNIT_EXPECT_EQ(test, pos, (loff_t)0);
+    KUNIT_EXPECT_EQ(test, ctx->dev->reader_empty, 1ULL);
+    KUNIT_EXPECT_EQ(test, ctx->dev->read_count, 0UL);
+}
+
+static void simplechar_test_read_clamped_to_data(struct kunit *test)
+{
+    static const char msg[] = "0123456789";
+    char out[100];
+    loff_t pos = 0;
+
+    simplechar_test_write(test, msg, 10, &pos);
+
+    pos = 4;
+    KUNIT_EXPECT_EQ(test, simplechar_test_read(test, out, sizeof(out), &pos),
+                    (ssize_t)6);
+    KUNIT_EXPECT_MEMEQ(test, out, msg + 4, 6);
+    KUNIT_EXPECT_EQ(test, pos, (loff_t)10);
+
+    /* At and past the end of the data */
+    KUNIT_EXPECT_EQ(test, simplechar_test_read(test, out, sizeof(out), &pos),
+                    (ssize_t)0);
+    pos = SIMPLECHAR_TEST_SIZE + 1;
+    KUNIT_EXPECT_EQ(test, simplechar_test_read(test, out, sizeof(out), &pos),
+                    (ssize_t)0);
+}
+
+static void simplechar_test_write_at_end_is_enospc(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    loff_t pos = SIMPLECHAR_TEST_SIZE;
+
+    KUNIT_EXPECT_EQ(test, simplechar_test_write(test, "x", 1, &pos),
+                    (ssize_t)-ENOSPC);
+    KUNIT_EXPECT_EQ(test, pos, (loff_t)SIMPLECHAR_TEST_SIZE);
+    KUNIT_EXPECT_EQ(test, ctx->dev->writer_full, 1ULL);
+    KUNIT_EXPECT_EQ(test, ctx->dev->buffer_len, (size_t)0);
+}
+
+static void simplechar_test_write_cut_at_end(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    loff_t pos = SIMPLECHAR_TEST_SIZE - 3;
+
+    KUNIT_EXPECT_EQ(test, simplechar_test_write(test, "abcdefghij", 10, &pos),
+                    (ssize_t)3);
+    KUNIT_EXPECT_EQ(test, pos, (loff_t)SIMPLECHAR_TEST_SIZE);
+    KUNIT_EXPECT_EQ(test, ctx->dev->buffer_len, (size_t)SIMPLECHAR_TEST_SIZE);
+    KUNIT_EXPECT_EQ(test, ctx->dev->writer_full, 1ULL);
+}
+
+static void simplechar_test_write_zero_length(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    loff_t pos = 100;
+
+    KUNIT_EXPECT_EQ(test, simplechar_test_write(test, "", 0, &pos),
+                    (ssize_t)0);
+    KUNIT_EXPECT_EQ(test, pos, (loff_t)100);
+    KUNIT_EXPECT_EQ(test, ctx->dev->generation, 0ULL);
+    KUNIT_EXPECT_NULL(test, ctx->dev->pages[0]);
+}
+
+static void simplechar_test_write_across_pages(struct kunit *test)
+{
+    char *in = kunit_kmalloc(test, 200, GFP_KERNEL);
+    char *out = kunit_kzalloc(test, 200, GFP_KERNEL);
+    loff_t pos = PAGE_SIZE - 100;
+    int i;
+
+    KUNIT_ASSERT_NOT_NULL(test, in);
+    KUNIT_ASSERT_NOT_NULL(test, out);
+    for (i = 0; i < 200; i++) {
+        in[i] = i;
+    }
+
+    KUNIT_EXPECT_EQ(test, simplechar_test_write(test, in, 200, &pos),
+                    (ssize_t)200);
+    pos = PAGE_SIZE - 100;
+    KUNIT_EXPECT_EQ(test, simplechar_test_read(test, out, 200, &pos),
+                    (ssize_t)200);
+    KUNIT_EXPECT_MEMEQ(test, out, in, 200);
+}
+
+/* Pages never written stay unallocated and read back as zeros */
+static void simplechar_test_sparse_reads_zero(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    size_t len = 2 * PAGE_SIZE + 14;
+    char *out = kunit_kmalloc(test, len, GFP_KERNEL);
+    loff_t pos = 2 * PAGE_SIZE + 10;
+
+    KUNIT_ASSERT_NOT_NULL(test, out);
+    memset(out, 0xff, len);
+
+    KUNIT_EXPECT_EQ(test, simplechar_test_write(test, "data", 4, &pos),
+                    (ssize_t)4);
+    KUNIT_EXPECT_NULL(test, ctx->dev->pages[0]);
+    KUNIT_EXPECT_NULL(test, ctx->dev->pages[1]);
+    KUNIT_EXPECT_NOT_NULL(test, ctx->dev->pages[2]);
+
+    pos = 0;
+    KUNIT_EXPECT_EQ(test, simplechar_test_read(test, out, len, &pos),
+                    (ssize_t)len);
+    KUNIT_EXPECT_NULL(test, memchr_inv(out, 0, len - 4));
+    KUNIT_EXPECT_MEMEQ(test, out + len - 4, "data", 4);
+}
+
+/* Rewriting populated pages allocates and charges nothing more */
+static void simplechar_test_overwrite_keeps_pages(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    struct simplechar_uid_usage *usage;
+    char *page;
+    loff_t pos = 0;
+
+    simplechar_test_write(test, "first", 5, &pos);
+    page = ctx->dev->pages[0];
+    usage = ctx->dev->page_owner[0];
+    KUNIT_ASSERT_NOT_NULL(test, usage);
+    KUNIT_EXPECT_EQ(test, usage->bytes, (u64)PAGE_SIZE);
+
+    pos = 1;
+    simplechar_test_write(test, "second", 6, &pos);
+    KUNIT_EXPECT_PTR_EQ(test, ctx->dev->pages[0], page);
+    KUNIT_EXPECT_EQ(test, usage->bytes, (u64)PAGE_SIZE);
+    KUNIT_EXPECT_EQ(test, ctx->dev->buffer_len, (size_t)7);
+}
+
+static void simplechar_test_bad_user_buffer(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    loff_t pos = 0;
+
+    /* Nothing is mapped at address zero */
+    KUNIT_EXPECT_EQ(test, device_write(&ctx->file, NULL, 16, &pos),
+                    (ssize_t)-EFAULT);
+    KUNIT_EXPECT_EQ(test, pos, (loff_t)0);
+    KUNIT_EXPECT_EQ(test, ctx->dev->buffer_len, (size_t)0);
+
+    simplechar_test_write(test, "data", 4, &pos);
+    pos = 0;
+    KUNIT_EXPECT_EQ(test, device_read(&ctx->file, NULL, 4, &pos),
+                    (ssize_t)-EFAULT);
+    KUNIT_EXPECT_EQ(test, pos, (loff_t)0);
+}
+
+/* A whole vector lands in one write, at the end of the data with append */
+static void simplechar_test_write_iter_append(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    struct iovec iov[2];
+    struct iov_iter iter;
+    struct kiocb kiocb;
+    char out[12] = {};
+    loff_t pos = 0;
+
+    KUNIT_ASSERT_EQ(test, simplechar_test_write(test, "head", 4, &pos),
+                    (ssize_t)4);
+
+    KUNIT_ASSERT_EQ(test, copy_to_user(ctx->ubuf, "-aa-bbbb", 8), 0UL);
+    iov[0] = (struct iovec){ .iov_base = ctx->ubuf, .iov_len = 3 };
+    iov[1] = (struct iovec){ .iov_base = ctx->ubuf + 3, .iov_len = 5 };
+    iov_iter_init(&iter, ITER_SOURCE, iov, ARRAY_SIZE(iov), 8);
+    init_sync_kiocb(&kiocb, &ctx->file);
+    kiocb.ki_flags |= IOCB_APPEND;
+
+    KUNIT_EXPECT_EQ(test, device_write_iter(&kiocb, &iter), (ssize_t)8);
+    KUNIT_EXPECT_EQ(test, kiocb.ki_pos, (loff_t)12);
+    KUNIT_EXPECT_EQ(test, ctx->dev->write_count, 2UL);
+
+    pos = 0;
+    KUNIT_EXPECT_EQ(test, simplechar_test_read(test, out, sizeof(out), &pos),
+                    (ssize_t)12);
+    KUNIT_EXPECT_MEMEQ(test, out, "head-aa-bbbb", 12);
+}
+
+/* poll() reflects the indices user space moves in the ring header */
+static void simplechar_test_ring_poll(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    struct simplechar_ring_header *hdr;
+
+    KUNIT_EXPECT_EQ(test, device_poll(&ctx->file, NULL), DEFAULT_POLLMASK);
+
+    KUNIT_ASSERT_EQ(test, simplechar_ring_create(ctx->dev, 100), 0);
+    hdr = ctx->dev->ring.hdr;
+    KUNIT_EXPECT_EQ(test, ctx->dev->ring.size, (u64)PAGE_SIZE);
+    KUNIT_EXPECT_EQ(test, hdr->magic, (u32)SIMPLECHAR_RING_MAGIC);
+    KUNIT_EXPECT_EQ(test, device_poll(&ctx->file, NULL),
+                    (__poll_t)(EPOLLOUT | EPOLLWRNORM));
+
+    hdr->tail = PAGE_SIZE / 2;
+    KUNIT_EXPECT_EQ(test, device_poll(&ctx->file, NULL),
+                    (__poll_t)(EPOLLIN | EPOLLRDNORM | EPOLLOUT | EPOLLWRNORM));
+
+    hdr->tail = PAGE_SIZE / 2 + 8;
+    KUNIT_EXPECT_EQ(test, device_poll(&ctx->file, NULL),
+                    (__poll_t)(EPOLLIN | EPOLLRDNORM));
+
+    /* Indices run freely past the ring size */
+    hdr->head = 3 * PAGE_SIZE;
+    hdr->tail = 3 * PAGE_SIZE;
+    KUNIT_EXPECT_EQ(test, device_poll(&ctx->file, NULL),
+                    (__poll_t)(EPOLLOUT | EPOLLWRNORM));
+}
+
+/* One autosize sample, as the periodic work takes it */
+static void simplechar_test_sample(struct kunit *test,
+                                   struct simplechar_dev *dev)
+{
+    KUNIT_ASSERT_EQ(test, simplechar_gate_enter(&dev->io_gate, false), 0);
+    simplechar_autosize_sample(dev, 1000);
+    simplechar_gate_leave(&dev->io_gate);
+}
+
+static void simplechar_test_autosize_grows(struct kunit *test)
+{
+    struct simplechar_dev *dev;
+    loff_t pos = 2 * PAGE_SIZE;
+
+    autosize = true;
+    dev = simplechar_test_use(test, PAGE_SIZE, 4 * PAGE_SIZE);
+
+    /* A write that does not fit is refused, then grown for */
+    KUNIT_EXPECT_EQ(test, simplechar_test_write(test, "grow", 4, &pos),
+                    (ssize_t)-ENOSPC);
+    KUNIT_EXPECT_EQ(test, dev->buffer_size, (size_t)PAGE_SIZE);
+    simplechar_test_sample(test, dev);
+    KUNIT_EXPECT_EQ(test, dev->buffer_size, (size_t)(4 * PAGE_SIZE));
+    KUNIT_EXPECT_EQ(test, dev->nr_resizes, 1ULL);
+    KUNIT_EXPECT_EQ(test, simplechar_test_write(test, "grow", 4, &pos),
+                    (ssize_t)4);
+
+    /* The ceiling still holds */
+    pos = 4 * PAGE_SIZE;
+    KUNIT_EXPECT_EQ(test, simplechar_test_write(test, "x", 1, &pos),
+                    (ssize_t)-ENOSPC);
+    simplechar_test_sample(test, dev);
+    KUNIT_EXPECT_EQ(test, dev->buffer_size, (size_t)(4 * PAGE_SIZE));
+}
+
+/* Grow dev from one page to four, as a refused write at 3 pages asks */
+static void simplechar_test_grow_to_four(struct kunit *test,
+                                         struct simplechar_dev *dev)
+{
+    loff_t pos = 3 * PAGE_SIZE;
+
+    KUNIT_EXPECT_EQ(test, simplechar_test_write(test, "x", 1, &pos),
+                    (ssize_t)-ENOSPC);
+    simplechar_test_sample(test, dev);
+    KUNIT_ASSERT_EQ(test, dev->buffer_size, (size_t)(4 * PAGE_SIZE));
+}
+
+static void simplechar_test_autosize_shrinks(struct kunit *test)
+{
+    struct simplechar_dev *dev;
+    loff_t pos = PAGE_SIZE;
+    char out[4];
+    int i;
+
+    autosize = true;
+    dev = simplechar_test_use(test, PAGE_SIZE, 4 * PAGE_SIZE);
+    simplechar_test_grow_to_four(test, dev);
+    KUNIT_ASSERT_EQ(test, simplechar_test_write(test, "keep", 4, &pos),
+                    (ssize_t)4);
+
+    /* The high-water mark decays while idle; the data bounds the shrink */
+    for (i = 0; i < 20 && dev->nr_resizes < 2; i++) {
+        simplechar_test_sample(test, dev);
+    }
+    KUNIT_ASSERT_EQ(test, dev->nr_resizes, 2ULL);
+    KUNIT_EXPECT_EQ(test, dev->resize_history[1].reason,
+                    (u32)SIMPLECHAR_RESIZE_SHRINK);
+    KUNIT_EXPECT_EQ(test, dev->buffer_size, (size_t)(2 * PAGE_SIZE));
+    KUNIT_EXPECT_EQ(test, dev->buffer_len, (size_t)(PAGE_SIZE + 4));
+
+    /* Halving again would cut into the data, so it stops here */
+    for (i = 0; i < 20; i++) {
+        simplechar_test_sample(test, dev);
+    }
+    KUNIT_EXPECT_EQ(test, dev->nr_resizes, 2ULL);
+
+    pos = PAGE_SIZE;
+    KUNIT_ASSERT_EQ(test, simplechar_test_read(test, out, 4, &pos),
+                    (ssize_t)4);
+    KUNIT_EXPECT_MEMEQ(test, out, "keep", 4);
+}
+
+static void simplechar_test_autosize_keeps_data(struct kunit *test)
+{
+    struct simplechar_dev *dev;
+    loff_t pos = 3 * PAGE_SIZE;
+    char out;
+    int i;
+
+    autosize = true;
+    dev = simplechar_test_use(test, PAGE_SIZE, 4 * PAGE_SIZE);
+    simplechar_test_grow_to_four(test, dev);
+    KUNIT_ASSERT_EQ(test, simplechar_test_write(test, "x", 1, &pos),
+                    (ssize_t)1);
+
+    /* Fill stays low while nobody touches it, but the last page holds data */
+    for (i = 0; i < 20; i++) {
+        simplechar_test_sample(test, dev);
+    }
+    KUNIT_EXPECT_LT(test, dev->fill_pct, (u32)AUTOSIZE_SHRINK_PCT);
+    KUNIT_EXPECT_EQ(test, dev->nr_resizes, 1ULL);
+    KUNIT_EXPECT_EQ(test, dev->buffer_size, (size_t)(4 * PAGE_SIZE));
+    KUNIT_EXPECT_EQ(test, dev->buffer_len, (size_t)(3 * PAGE_SIZE + 1));
+    KUNIT_EXPECT_NOT_NULL(test, dev->pages[3]);
+
+    pos = 3 * PAGE_SIZE;
+    KUNIT_ASSERT_EQ(test, simplechar_test_read(test, &out, 1, &pos),
+                    (ssize_t)1);
+    KUNIT_EXPECT_EQ(test, out, 'x');
+}
+
+/*
+ * Offsets and generations through the engine entry points
+ */
+static void simplechar_test_dirty_lookup(struct kunit *test)
+{
+    loff_t start;
+    size_t len;
+
+    simplechar_engine_write("0123456789", 10, 100);
+    KUNIT_EXPECT_EQ(test, simplechar_engine_lookup(0, 0, &start, &len), 0);
+    KUNIT_EXPECT_EQ(test, start, (loff_t)64);
+    KUNIT_EXPECT_EQ(test, len, (size_t)SIMPLECHAR_DIRTY_BLOCK_SIZE);
+
+    /* Only the newer write, cut at the end of the data */
+    simplechar_engine_write("abcdefghij", 10, 1000);
+    KUNIT_EXPECT_EQ(test, simplechar_engine_lookup(1, 0, &start, &len), 0);
+    KUNIT_EXPECT_EQ(test, start, (loff_t)960);
+    KUNIT_EXPECT_EQ(test, len, (size_t)50);
+
+    /* Scanning starts at the block holding pos */
+    KUNIT_EXPECT_EQ(test, simplechar_engine_lookup(0, 200, &start, &len), 0);
+    KUNIT_EXPECT_EQ(test, start, (loff_t)960);
+    KUNIT_EXPECT_EQ(test, simplechar_engine_lookup(2, 0, &start, &len),
+                    -ENOENT);
+}
+
+static void simplechar_test_append_truncate(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    char out[8] = {};
+    loff_t pos = 0;
+
+    KUNIT_EXPECT_EQ(test, simplechar_engine_append("abc", 3, &pos),
+                    (ssize_t)3);
+    KUNIT_EXPECT_EQ(test, pos, (loff_t)3);
+    KUNIT_EXPECT_EQ(test, simplechar_engine_append("def", 3, &pos),
+                    (ssize_t)3);
+    KUNIT_EXPECT_EQ(test, pos, (loff_t)6);
+
+    KUNIT_EXPECT_EQ(test, simplechar_engine_truncate(2), 0);
+    KUNIT_EXPECT_EQ(test, ctx->dev->buffer_len, (size_t)2);
+    KUNIT_EXPECT_EQ(test, simplechar_engine_append("XY", 2, &pos),
+                    (ssize_t)2);
+    KUNIT_EXPECT_EQ(test, pos, (loff_t)4);
+
+    KUNIT_EXPECT_EQ(test, simplechar_engine_read(out, sizeof(out), 0),
+                    (ssize_t)4);
+    KUNIT_EXPECT_MEMEQ(test, out, "abXY", 4);
+}
+
+static void simplechar_test_reserve_commit(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    struct simplechar_reservation res;
+    char out[16];
+
+    KUNIT_ASSERT_EQ(test, simplechar_engine_reserve(16, 8, &res), 0);
+    KUNIT_EXPECT_EQ(test, res.len, (size_t)16);
+    memset(res.data, 'r', res.len);
+    simplechar_engine_commit(&res);
+
+    KUNIT_EXPECT_EQ(test, ctx->dev->buffer_len, (size_t)24);
+    KUNIT_EXPECT_EQ(test, ctx->dev->generation, 1ULL);
+    KUNIT_EXPECT_EQ(test, simplechar_engine_read(out, 16, 8), (ssize_t)16);
+    KUNIT_EXPECT_NULL(test, memchr_inv(out, 'r', 16));
+
+    /* Refused reservations leave the gate free for the next write */
+    KUNIT_EXPECT_EQ(test, simplechar_engine_reserve(16, PAGE_SIZE - 8, &res),
+                    -EINVAL);
+    KUNIT_EXPECT_EQ(test, simplechar_engine_reserve(0, 0, &res), -EINVAL);
+    KUNIT_EXPECT_EQ(test, simplechar_engine_reserve(16, SIMPLECHAR_TEST_SIZE,
+                                                    &res), -ENOSPC);
+    KUNIT_EXPECT_EQ(test, simplechar_engine_write("ok", 2, 0), (ssize_t)2);
+    KUNIT_EXPECT_EQ(test, ctx->dev->io_gate.held, 0U);
+}
+
+/*
+ * Concurrency
+ */
+#define SIMPLECHAR_TEST_BLOCK   512
+#define SIMPLECHAR_TEST_ROUNDS  2000
+
+static int simplechar_test_overwriter(void *data)
+{
+    struct simplechar_test_worker *w = data;
+    char block[SIMPLECHAR_TEST_BLOCK];
+    ssize_t ret;
+    int i;
+
+    memset(block, 'A' + w->id, sizeof(block));
+    for (i = 0; i < SIMPLECHAR_TEST_ROUNDS; i++) {
+        if (w->reader) {
+            ret = simplechar_engine_read(block, sizeof(block), 0);
+            if (memchr_inv(block, block[0], sizeof(block))) {
+                w->torn++;
+            }
+        } else {
+            ret = simplechar_engine_write(block, sizeof(block), 0);
+        }
+        if (ret != sizeof(block)) {
+            w->errors++;
+        }
+    }
+    complete(&w->done);
+    return 0;
+}
+
+/* Readers never see a block half overwritten by another writer */
+static void simplechar_test_concurrent_writers(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    struct simplechar_test_worker w[2 * SIMPLECHAR_TEST_THREADS] = {};
+    char block[SIMPLECHAR_TEST_BLOCK];
+    int i;
+
+    memset(block, 'A', sizeof(block));
+    simplechar_engine_write(block, sizeof(block), 0);
+
+    for (i = SIMPLECHAR_TEST_THREADS; i < ARRAY_SIZE(w); i++) {
+        w[i].reader = true;
+    }
+    simplechar_test_run_workers(test, simplechar_test_overwriter, w,
+                                ARRAY_SIZE(w));
+
+    for (i = 0; i < ARRAY_SIZE(w); i++) {
+        KUNIT_EXPECT_EQ(test, w[i].errors, 0UL);
+        KUNIT_EXPECT_EQ(test, w[i].torn, 0UL);
+    }
+    KUNIT_EXPECT_EQ(test, ctx->dev->write_count,
+                    1UL + SIMPLECHAR_TEST_THREADS * SIMPLECHAR_TEST_ROUNDS);
+    KUNIT_EXPECT_EQ(test, ctx->dev->read_count,
+                    (unsigned long)SIMPLECHAR_TEST_THREADS *
+                    SIMPLECHAR_TEST_ROUNDS);
+}
+
+#define SIMPLECHAR_TEST_RECORD  16
+#define SIMPLECHAR_TEST_RECORDS (SIMPLECHAR_TEST_SIZE / SIMPLECHAR_TEST_RECORD / \
+                                 SIMPLECHAR_TEST_THREADS)
+
+static int simplechar_test_appender(void *data)
+{
+    struct simplechar_test_worker *w = data;
+    char record[SIMPLECHAR_TEST_RECORD];
+    loff_t pos;
+    int i;
+
+    memset(record, 'a' + w->id, sizeof(record));
+    for (i = 0; i < SIMPLECHAR_TEST_RECORDS; i++) {
+        if (simplechar_engine_append(record, sizeof(record), &pos) !=
+            sizeof(record)) {
+            w->errors++;
+        }
+    }
+    complete(&w->done);
+    return 0;
+}
+
+/* Concurrent appends fill the store exactly, each record whole */
+static void simplechar_test_concurrent_appends(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    struct simplechar_test_worker w[SIMPLECHAR_TEST_THREADS] = {};
+    int counts[SIMPLECHAR_TEST_THREADS] = {};
+    char *data = kunit_kmalloc(test, SIMPLECHAR_TEST_SIZE, GFP_KERNEL);
+    char *rec;
+    int i, id;
+
+    KUNIT_ASSERT_NOT_NULL(test, data);
+    simplechar_test_run_workers(test, simplechar_test_appender, w,
+                                ARRAY_SIZE(w));
+    for (i = 0; i < ARRAY_SIZE(w); i++) {
+        KUNIT_EXPECT_EQ(test, w[i].errors, 0UL);
+    }
+    KUNIT_ASSERT_EQ(test, ctx->dev->buffer_len, (size_t)SIMPLECHAR_TEST_SIZE);
+
+    KUNIT_ASSERT_EQ(test, simplechar_engine_read(data, SIMPLECHAR_TEST_SIZE, 0),
+                    (ssize_t)SIMPLECHAR_TEST_SIZE);
+    for (rec = data; rec < data + SIMPLECHAR_TEST_SIZE;
+         rec += SIMPLECHAR_TEST_RECORD) {
+        KUNIT_EXPECT_NULL(test, memchr_inv(rec, rec[0], SIMPLECHAR_TEST_RECORD));
+        id = rec[0] - 'a';
+        KUNIT_ASSERT_TRUE(test, id >= 0 && id < SIMPLECHAR_TEST_THREADS);
+        counts[id]++;
+    }
+    for (i = 0; i < SIMPLECHAR_TEST_THREADS; i++) {
+        KUNIT_EXPECT_EQ(test, counts[i], SIMPLECHAR_TEST_RECORDS);
+    }
+}
+
+/*
+ * Performance assertions
+ */
+#define SIMPLECHAR_TEST_PERF_OPS 10000
+
+/* 64-byte device_write() + device_read() pairs through user memory */
+static void simplechar_test_perf_read_write(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    loff_t pos;
+    u64 start, ns;
+    int i;
+
+    start = ktime_get_ns();
+    for (i = 0; i < SIMPLECHAR_TEST_PERF_OPS; i++) {
+        pos = (i * 64) % SIMPLECHAR_TEST_SIZE;
+        device_write(&ctx->file, ctx->ubuf, 64, &pos);
+        pos -= 64;
+        device_read(&ctx->file, ctx->ubuf, 64, &pos);
+    }
+    ns = div_u64(ktime_get_ns() - start, 2 * SIMPLECHAR_TEST_PERF_OPS);
+
+    kunit_info(test, "read/write: %llu ns/op\n", ns);
+    KUNIT_EXPECT_LT(test, ns, (u64)SIMPLECHAR_TEST_IO_BUDGET_NS);
+}
+
+static void simplechar_test_perf_gate(struct kunit *test)
+{
+    struct simplechar_test_ctx *ctx = test->priv;
+    u64 start, ns;
+    int i;
+
+    start = ktime_get_ns();
+    for (i = 0; i < 10 * SIMPLECHAR_TEST_PERF_OPS; i++) {
+        simplechar_gate_enter(&ctx->dev->io_gate, false);
+        simplechar_gate_leave(&ctx->dev->io_gate);
+    }
+    ns = div_u64(ktime_get_ns() - start, 10 * SIMPLECHAR_TEST_PERF_OPS);
+
+    kunit_info(test, "uncontended gate: %llu ns/op\n", ns);
+    KUNIT_EXPECT_LT(test, ns, (u64)SIMPLECHAR_TEST_GATE_BUDGET_NS);
+    KUNIT_EXPECT_EQ(test, ctx->dev->io_gate.contended, 0ULL);
+}
+
+/* Finding the newest write at the end of a 64 KiB store scans it all */
+static void simplechar_test_perf_lookup(struct kunit *test)
+{
+    size_t size = 16 * PAGE_SIZE;
+    char *page = kunit_kzalloc(test, PAGE_SIZE, GFP_KERNEL);
+    struct simplechar_dev *dev;
+    loff_t start;
+    size_t len, off;
+    u64 t0, ns, since;
+    int i;
+
+    KUNIT_ASSERT_NOT_NULL(test, page);
+    dev = simplechar_test_use(test, size, size);
+    for (off = 0; off < size; off += PAGE_SIZE) {
+        simplechar_engine_write(page, PAGE_SIZE, off);
+    }
+    since = dev->generation;
+    simplechar_engine_write(page, 8, size - 8);
+
+    t0 = ktime_get_ns();
+    for (i = 0; i < SIMPLECHAR_TEST_PERF_OPS; i++) {
+        if (simplechar_engine_lookup(since, 0, &start, &len)) {
+            break;
+        }
+    }
+    ns = div_u64(ktime_get_ns() - t0, SIMPLECHAR_TEST_PERF_OPS);
+
+    KUNIT_EXPECT_EQ(test, i, SIMPLECHAR_TEST_PERF_OPS);
+    KUNIT_EXPECT_EQ(test, start, (loff_t)(size - SIMPLECHAR_DIRTY_BLOCK_SIZE));
+    kunit_info(test, "lookup over %zu blocks: %llu ns/op\n",
+               size / SIMPLECHAR_DIRTY_BLOCK_SIZE, ns);
+    KUNIT_EXPECT_LT(test, ns, (u64)SIMPLECHAR_TEST_LOOKUP_BUDGET_NS);
+}
+
+static struct kunit_case simplechar_io_cases[] = {
+    KUNIT_CASE(simplechar_test_write_read_roundtrip),
+    KUNIT_CASE(simplechar_test_read_empty_is_eof),
+    KUNIT_CASE(simplechar_test_read_clamped_to_data),
+    KUNIT_CASE(simplechar_test_write_at_end_is_enospc),
+    KUNIT_CASE(simplechar_test_write_cut_at_end),
+    KUNIT_CASE(simplechar_test_write_zero_length),
+    KUNIT_CASE(simplechar_test_write_across_pages),
+    KUNIT_CASE(simplechar_test_sparse_reads_zero),
+    KUNIT_CASE(simplechar_test_overwrite_keeps_pages),
+    KUNIT_CASE(simplechar_test_bad_user_buffer),
+    KUNIT_CASE(simplechar_test_write_iter_append),
+    KUNIT_CASE(simplechar_test_ring_poll),
+    KUNIT_CASE(simplechar_test_autosize_grows),
+    KUNIT_CASE(simplechar_test_autosize_shrinks),
+    KUNIT_CASE(simplechar_test_autosize_keeps_data),
+    {}
+};
+
+static struct kunit_case simplechar_engine_cases[] = {
+    KUNIT_CASE(simplechar_test_dirty_lookup),
+    KUNIT_CASE(simplechar_test_append_truncate),
+    KUNIT_CASE(simplechar_test_reserve_commit),
+    KUNIT_CASE(simplechar_test_concurrent_writers),
+    KUNIT_CASE(simplechar_test_concurrent_appends),
+    {}
+};
+
+static struct kunit_case simplechar_perf_cases[] = {
+    KUNIT_CASE_SLOW(simplechar_test_perf_read_write),
+    KUNIT_CASE_SLOW(simplechar_test_perf_gate),
+    KUNIT_CASE_SLOW(simplechar_test_perf_lookup),
+    {}
+};
+
+static struct kunit_suite simplechar_io_suite = {
+    .name = "simplechar_io",
+    .init = simplechar_test_init,
+    .exit = simplechar_test_exit,
+    .test_cases = simplechar_io_cases,
+};
+
+static struct kunit_suite simplechar_engine_suite = {
+    .name = "simplechar_engine",
+    .init = simplechar_test_init,
+    .exit = simplechar_test_exit,
+    .test_cases = simplechar_engine_cases,
+};
+
+static struct kunit_suite simplechar_perf_suite = {
+    .name = "simplechar_perf",
+    .init = simplechar_test_init,
+    .exit = simplechar_test_exit,
+    .test_cases = simplechar_perf_cases,
+};
+
+kunit_test_suites(&simplechar_io_suite, &simplechar_engine_suite,
+                  &simplechar_perf_suite);
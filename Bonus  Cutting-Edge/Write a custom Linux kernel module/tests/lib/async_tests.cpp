@@ -0,0 +1,175 @@
+/*
+ * async_tests.cpp - Behavior tests for the libsimplechar coroutine API
+ *
+ * Runs scheduler tasks against a regular file standing in for the
+ * device. Built as C++20, apart from lib_tests.cpp, because async.h
+ * needs coroutines.
+ *
+ * Usage: simplechar-async-tests [test name ...]
+ *
+ * License: MIT
+ */
+
+#include "test_util.h"
+
+#include "async.h"
+#include "simplechar.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace simplechar::testing;
+
+/* Block i of a test file, tagged with its index */
+std::string block(size_t i, size_t len)
+{
+    std::string b(len, char('A' + i % 26));
+
+    std::memcpy(&b[0], &i, sizeof(uint32_t));
+    return b;
+}
+
+/* Write blocks [first, first + n) one op at a time, then read them back */
+simplechar::task<> write_then_verify(simplechar::async_device &adev,
+                                     size_t first, size_t n, size_t len,
+                                     int &verified)
+{
+    for (size_t i = first; i < first + n; i++) {
+        std::string b = block(i, len);
+        simplechar::io_result r = co_await adev.write(b, i * len);
+        CHECK(r && r.bytes == len);
+    }
+    for (size_t i = first; i < first + n; i++) {
+        std::string got(len, '\0');
+        simplechar::io_result r = co_await adev.read(got, i * len);
+        CHECK(r && r.bytes == len);
+        CHECK(got == block(i, len));
+        verified++;
+    }
+}
+
+/* More ops in flight than the ring has entries, from many tasks at once */
+void test_async_full_ring()
+{
+    stand_in file("async");
+    simplechar::scheduler_options opts;
+    opts.ring_entries = 4;
+    simplechar::scheduler sched(opts);
+    simplechar::device dev = simplechar::device::open(file.path());
+    simplechar::async_device adev(dev);
+    const size_t tasks = 12, per_task = 4, len = 512;
+    int verified = 0;
+
+    for (size_t t = 0; t < tasks; t++) {
+        sched.spawn(write_then_verify(adev, t * per_task, per_task, len,
+                                      verified));
+    }
+    /* A lambda handed over whole keeps its captures alive for its task */
+    sched.spawn([&, extra = tasks * per_task]() -> simplechar::task<> {
+        co_await write_then_verify(adev, extra, 1, len, verified);
+    });
+    sched.run();
+
+    const simplechar::scheduler_stats &st = sched.stats();
+    CHECK(verified == int(tasks * per_task + 1));
+    CHECK(st.ops >= 2 * (tasks * per_task + 1));
+    CHECK(st.ticks > 1);
+    CHECK(file.contents().size() == (tasks * per_task + 1) * len);
+}
+
+/* A write from a leased buffer goes out with the fixed-buffer opcode */
+void test_async_fixed_buffer()
+{
+    stand_in file("async");
+    simplechar::scheduler_options opts;
+    opts.buffers = 2;
+    opts.buffer_size = 4096;
+    simplechar::scheduler sched(opts);
+    simplechar::device dev = simplechar::device::open(file.path());
+    simplechar::async_device adev(dev);
+    simplechar::fixed_buffer buf = sched.lease_buffer();
+    simplechar::io_result result;
+
+    /* Registration fails under a tight RLIMIT_MEMLOCK; then none lease */
+    CHECK(buf);
+    CHECK(buf.size() == 4096);
+    std::memset(buf.data(), 'f', 100);
+
+    sched.spawn([&]() -> simplechar::task<> {
+        result = co_await adev.write(
+            simplechar::const_buffer(buf.data(), 100), 0);
+    });
+    sched.run();
+
+    CHECK(result && result.bytes == 100);
+    CHECK(sched.stats().fixed_buffer_ops == 1);
+    CHECK(file.contents() == std::string(100, 'f'));
+
+    /* Both buffers lease, and a returned one leases again */
+    simplechar::fixed_buffer second = sched.lease_buffer();
+    CHECK(second);
+    CHECK(!sched.lease_buffer());
+    buf = simplechar::fixed_buffer();
+    CHECK(sched.lease_buffer());
+}
+
+simplechar::task<> fail_after_io(simplechar::async_device &adev)
+{
+    char c;
+
+    co_await adev.read(simplechar::mutable_buffer(&c, 1), 0);
+    throw std::runtime_error("task failed");
+}
+
+simplechar::task<> count_io(simplechar::async_device &adev, int &done)
+{
+    char c[4];
+
+    for (int i = 0; i < 4; i++) {
+        co_await adev.read(c, 0);
+        done++;
+    }
+}
+
+/* run() finishes the other tasks, then rethrows what escaped one */
+void test_async_exception()
+{
+    stand_in file("async");
+    simplechar::scheduler sched;
+    simplechar::device dev = simplechar::device::open(file.path());
+    simplechar::async_device adev(dev);
+    int done = 0;
+    bool thrown = false;
+
+    sched.spawn(count_io(adev, done));
+    sched.spawn(fail_after_io(adev));
+    try {
+        sched.run();
+    } catch (const std::runtime_error &e) {
+        thrown = std::string(e.what()) == "task failed";
+    }
+    CHECK(thrown);
+    CHECK(done == 4);
+
+    /* The error is handed out once; the scheduler runs on afterwards */
+    sched.spawn(count_io(adev, done));
+    sched.run();
+    CHECK(done == 8);
+}
+
+const test_case tests[] = {
+    {"async_full_ring", test_async_full_ring},
+    {"async_fixed_buffer", test_async_fixed_buffer},
+    {"async_exception", test_async_exception},
+};
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+    return run_tests(argc, argv, tests);
+}
@@ -0,0 +1,685 @@
+/*
+ * lib_tests.cpp - Behavior tests for the libsimplechar client library
+ *
+ * Runs the library against regular files standing in for the device, so
+ * it needs neither the module nor root: a plain file takes the reads and
+ * writes, and one preformatted with a ring header stands in for the
+ * record ring, as the benchmarks' stand-ins do.
+ *
+ * Usage: simplechar-lib-tests [test name ...]
+ *
+ * License: MIT
+ */
+
+#include "test_util.h"
+
+#include "combiner.h"
+#include "fanin.h"
+#include "frame.h"
+#include "pool.h"
+#include "ring.h"
+#include "schema.h"
+#include "simplechar.h"
+#include "simplechar_ioctl.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+using namespace simplechar::testing;
+
+/* Payload i of a test stream: its index, then a pattern of varying length */
+std::string payload(size_t i, size_t max_len)
+{
+    size_t len = sizeof(uint32_t) + (i * 37) % (max_len - sizeof(uint32_t) + 1);
+    std::string p(len, '\0');
+
+    std::memcpy(&p[0], &i, sizeof(uint32_t));
+    for (size_t k = sizeof(uint32_t); k < len; k++) {
+        p[k] = char('a' + (i + k) % 26);
+    }
+    return p;
+}
+
+/*
+ * Ring
+ */
+
+/* Records keep their order and bytes while the ring wraps many times */
+void test_ring_wraparound()
+{
+    stand_in file("ring");
+    const uint64_t size = uint64_t(::sysconf(_SC_PAGESIZE));
+
+    file.format_ring(size);
+    simplechar::device dev = simplechar::device::open(file.path());
+    simplechar::ring_producer rp(dev);
+    simplechar::ring_consumer rc(dev);
+    size_t pushed = 0, consumed = 0;
+    const size_t total = 2000;
+
+    CHECK(rp.max_record() > sizeof(uint32_t));
+    while (consumed < total) {
+        /* Fill until the ring refuses, so the tail keeps hitting the end */
+        while (pushed < total && rp.try_push(payload(pushed, rp.max_record()))) {
+            pushed++;
+        }
+        rp.publish();
+        CHECK(rc.backlog() <= rc.capacity());
+
+        size_t n = rc.consume([&](simplechar::const_buffer rec) {
+            std::string want = payload(consumed, rp.max_record());
+            CHECK(rec.size() == want.size());
+            CHECK(std::memcmp(rec.data(), want.data(), want.size()) == 0);
+            consumed++;
+        });
+        CHECK(n > 0);
+    }
+    CHECK(pushed == total);
+    CHECK(rc.backlog() == 0);
+    CHECK(rc.stats().bytes > 8 * size);
+}
+
+/* A record too large for the ring is refused without disturbing it */
+void test_ring_rejects_oversize()
+{
+    stand_in file("ring");
+    const uint64_t size = uint64_t(::sysconf(_SC_PAGESIZE));
+
+    file.format_ring(size);
+    simplechar::device dev = simplechar::device::open(file.path());
+    simplechar::ring_producer rp(dev);
+    simplechar::ring_consumer rc(dev);
+    std::string big(rp.max_record() + 1, 'x');
+
+    CHECK(!rp.try_push(big));
+    CHECK(rp.try_write(std::string("small")));
+    CHECK(rc.consume([](simplechar::const_buffer rec) {
+        CHECK(std::string(rec.data(), rec.size()) == "small");
+    }) == 1);
+}
+
+/*
+ * Combiner
+ */
+
+/* Per-thread order holds and no message is torn or interleaved */
+void test_combiner_ordering()
+{
+    stand_in file("combiner");
+    const int threads = 8;
+    const int messages = 2000;
+
+    {
+        simplechar::open_options opts;
+        opts.read = false;
+        opts.append = true;
+        simplechar::device dev = simplechar::device::open(file.path(), opts);
+        simplechar::combiner_options copts;
+        copts.stage_size = 4096;
+        copts.flush_bytes = 1024;
+        simplechar::write_combiner wc(dev, copts);
+        std::vector<std::thread> workers;
+        std::atomic<int> refused{0};
+
+        /* CHECK cannot throw out of a thread; count refusals instead */
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                for (int i = 0; i < messages; i++) {
+                    std::string msg = std::to_string(t) + " " +
+                                      std::to_string(i) + "\n";
+                    refused += !wc.write(msg);
+                }
+            });
+        }
+        for (std::thread &w : workers) {
+            w.join();
+        }
+        wc.flush();
+        CHECK(refused == 0);
+        CHECK(!wc.error());
+        CHECK(wc.stats().messages == uint64_t(threads * messages));
+        CHECK(wc.stats().syscalls < uint64_t(threads * messages));
+    }
+
+    std::string log = file.contents();
+    std::vector<int> next(threads, 0);
+    size_t pos = 0;
+
+    while (pos < log.size()) {
+        size_t end = log.find('\n', pos);
+        int t, i;
+        char extra;
+
+        CHECK(end != std::string::npos);
+        std::string line = log.substr(pos, end - pos);
+        CHECK(std::sscanf(line.c_str(), "%d %d%c", &t, &i, &extra) == 2);
+        CHECK(t >= 0 && t < threads);
+        CHECK(i == next[t]);
+        next[t]++;
+        pos = end + 1;
+    }
+    for (int t = 0; t < threads; t++) {
+        CHECK(next[t] == messages);
+    }
+}
+
+/* What a thread staged before exiting is still written, in order */
+void test_combiner_exited_threads()
+{
+    stand_in file("combiner");
+    const int rounds = 64;
+
+    {
+        simplechar::open_options opts;
+        opts.read = false;
+        opts.append = true;
+        simplechar::device dev = simplechar::device::open(file.path(), opts);
+        simplechar::combiner_options copts;
+        copts.flush_interval = std::chrono::seconds(10);
+        simplechar::write_combiner wc(dev, copts);
+        bool refused = false;
+
+        /* One short-lived thread after another, each leaving data staged */
+        for (int r = 0; r < rounds; r++) {
+            std::thread t([&] {
+                refused |= !wc.write(std::to_string(r) + "\n");
+            });
+            t.join();
+        }
+        wc.flush();
+        CHECK(!refused);
+        CHECK(wc.stats().messages == uint64_t(rounds));
+    }
+
+    std::string want;
+    for (int r = 0; r < rounds; r++) {
+        want += std::to_string(r) + "\n";
+    }
+    CHECK(file.contents() == want);
+}
+
+/*
+ * Frames
+ */
+
+/* Frames cut by the end of a read are completed by the next one */
+void test_frame_carry_over()
+{
+    stand_in file("frame");
+    simplechar::device dev = simplechar::device::open(file.path());
+    const size_t count = 500;
+    std::string stream;
+
+    for (size_t i = 0; i < count; i++) {
+        std::string p = payload(i, 300);
+        std::string f(sizeof(simplechar::frame_header) + p.size(), '\0');
+        CHECK(simplechar::frame_encode(f, p) == f.size());
+        stream += f;
+    }
+    CHECK(dev.write(stream, 0).bytes == stream.size());
+
+    for (int path = 0; path < 3; path++) {
+        auto isa = simplechar::frame_scanner::isa(path);
+        if (!simplechar::frame_scanner::supported(isa)) {
+            continue;
+        }
+        simplechar::frame_scanner scanner(isa);
+        std::vector<simplechar::frame_ref> frames(16);
+        std::vector<char> buf(1024);
+        size_t held = 0, next = 0;
+        uint64_t off = 0;
+
+        /* Odd read sizes, so frames and headers straddle reads */
+        for (;;) {
+            size_t want = std::min<size_t>(97 + (off % 251), buf.size() - held);
+            simplechar::io_result r =
+                dev.read(simplechar::mutable_buffer(buf.data() + held, want), off);
+            CHECK(r);
+            off += r.bytes;
+            held += r.bytes;
+
+            simplechar::scan_result s;
+            do {
+                s = scanner.scan(simplechar::const_buffer(buf.data(), held),
+                                 frames.data(), frames.size());
+                CHECK(!s.corrupt);
+                CHECK(s.bad == 0);
+                for (size_t k = 0; k < s.frames; k++) {
+                    std::string p = payload(next++, 300);
+                    CHECK(frames[k].valid);
+                    CHECK(frames[k].length == p.size());
+                    CHECK(std::memcmp(buf.data() + frames[k].offset,
+                                      p.data(), p.size()) == 0);
+                }
+                std::memmove(buf.data(), buf.data() + s.consumed,
+                             held - s.consumed);
+                held -= s.consumed;
+            } while (s.frames == frames.size());
+
+            if (r.bytes == 0) {
+                break;
+            }
+        }
+        CHECK(next == count);
+        CHECK(held == 0);
+    }
+}
+
+/* A flipped payload bit is caught, and the scan goes on past it */
+void test_frame_bad_crc()
+{
+    std::string p = payload(7, 64);
+    std::string f(sizeof(simplechar::frame_header) + p.size(), '\0');
+    simplechar::frame_scanner scanner;
+    simplechar::frame_ref frames[2];
+
+    CHECK(simplechar::frame_encode(f, p) == f.size());
+    std::string stream = f + f;
+    stream[sizeof(simplechar::frame_header) + 1] ^= 0x10;
+
+    simplechar::scan_result s = scanner.scan(stream, frames, 2);
+    CHECK(s.frames == 2);
+    CHECK(s.bad == 1);
+    CHECK(!frames[0].valid);
+    CHECK(frames[1].valid);
+    CHECK(s.consumed == stream.size());
+}
+
+/*
+ * Pool
+ */
+
+/* Leases released on another thread come back without new buffers */
+void test_pool_cross_thread_return()
+{
+    simplechar::pool_options opts;
+    opts.buffer_size = 4096;
+    opts.arena_size = 64 * 4096;
+    opts.cache_buffers = 4;
+    simplechar::buffer_pool pool(opts);
+    const size_t n = 32;
+
+    for (int round = 0; round < 4; round++) {
+        std::vector<simplechar::lease> leases;
+
+        for (size_t i = 0; i < n; i++) {
+            leases.push_back(pool.acquire());
+            CHECK(leases.back());
+            std::memset(leases.back().data(), int(i), leases.back().capacity());
+        }
+        CHECK(pool.stats().outstanding == n);
+
+        /* A thread that never acquired, and so has no cache, releases them */
+        std::thread releaser([&] {
+            leases.clear();
+        });
+        releaser.join();
+        CHECK(pool.stats().outstanding == 0);
+    }
+
+    simplechar::pool_stats st = pool.stats();
+    CHECK(st.acquires == 4 * n);
+    CHECK(st.misses == n);
+    CHECK(st.arenas == 1);
+    CHECK(st.hit_rate() > 0.7);
+}
+
+/* A thread with a cache keeps what it releases for itself */
+void test_pool_local_cache()
+{
+    simplechar::pool_options opts;
+    opts.buffer_size = 4096;
+    opts.cache_buffers = 8;
+    simplechar::buffer_pool pool(opts);
+    std::vector<simplechar::lease> handed;
+
+    for (int i = 0; i < 4; i++) {
+        handed.push_back(pool.acquire());
+    }
+    std::thread worker([&] {
+        simplechar::lease own = pool.acquire();
+        own.release();
+        handed.clear();
+        for (int i = 0; i < 4; i++) {
+            handed.push_back(pool.acquire());
+        }
+        handed.clear();
+    });
+    worker.join();
+
+    simplechar::pool_stats st = pool.stats();
+    CHECK(st.outstanding == 0);
+    CHECK(st.local_hits >= 4);
+    CHECK(st.misses == 5);
+}
+
+/* read() fills a pooled buffer and gives back the one the lease held */
+void test_pool_read()
+{
+    stand_in file("pool");
+    simplechar::device dev = simplechar::device::open(file.path());
+    simplechar::pool_options opts;
+    opts.buffer_size = 4096;
+    simplechar::buffer_pool pool(opts);
+    simplechar::lease buf;
+
+    CHECK(dev.write(std::string("pooled bytes"), 0));
+    CHECK(pool.read(dev, 0, buf));
+    CHECK(std::string(buf.bytes().data(), buf.size()) == "pooled bytes");
+    CHECK(pool.read(dev, 7, buf));
+    CHECK(std::string(buf.bytes().data(), buf.size()) == "bytes");
+    CHECK(pool.stats().outstanding == 1);
+    buf.release();
+    CHECK(pool.stats().outstanding == 0);
+}
+
+/*
+ * Fan-in
+ */
+
+/* A flooded ring gets one budget per pass, like every other ring */
+void test_fanin_fairness()
+{
+    const uint64_t size = 64 * 1024;
+    const size_t budget = 8;
+    const size_t flood = 1000, trickle = 20;
+    stand_in files[3] = {stand_in("fanin"), stand_in("fanin"), stand_in("fanin")};
+    std::vector<simplechar::device> devs;
+    std::vector<simplechar::ring_producer> producers;
+    simplechar::fanin_options opts;
+
+    opts.batch_budget = budget;
+    simplechar::fanin_reader fan(opts);
+    for (stand_in &f : files) {
+        f.format_ring(size);
+        devs.push_back(simplechar::device::open(f.path()));
+    }
+    for (simplechar::device &d : devs) {
+        producers.emplace_back(d);
+        CHECK(fan.add(d) == producers.size() - 1);
+    }
+
+    for (size_t i = 0; i < flood; i++) {
+        CHECK(producers[0].try_push(payload(i, 16)));
+    }
+    for (size_t p = 1; p < 3; p++) {
+        for (size_t i = 0; i < trickle; i++) {
+            CHECK(producers[p].try_push(payload(i, 16)));
+        }
+    }
+    for (simplechar::ring_producer &p : producers) {
+        p.publish();
+    }
+
+    std::vector<size_t> got(3, 0);
+    size_t passes = 0;
+    while (got[1] < trickle || got[2] < trickle) {
+        std::vector<size_t> pass(3, 0);
+
+        fan.poll([&](size_t id, simplechar::const_buffer rec) {
+            std::string want = payload(got[id], 16);
+            CHECK(rec.size() == want.size());
+            CHECK(std::memcmp(rec.data(), want.data(), want.size()) == 0);
+            got[id]++;
+            pass[id]++;
+        }, std::chrono::milliseconds(100));
+        for (size_t id = 0; id < 3; id++) {
+            CHECK(pass[id] <= budget);
+        }
+        CHECK(++passes <= (trickle + budget - 1) / budget + 1);
+    }
+    /* The quiet rings drained while the flooded one was still far behind */
+    CHECK(got[0] <= passes * budget);
+    CHECK(fan.lag(0).backlog > 0);
+    CHECK(fan.lag(0).budget_hits == passes);
+
+    while (got[0] < flood) {
+        CHECK(fan.poll([&](size_t id, simplechar::const_buffer) {
+            CHECK(id == 0);
+            got[0]++;
+        }, std::chrono::milliseconds(100)) > 0);
+    }
+    CHECK(fan.lag(0).backlog == 0);
+    CHECK(fan.stats().records == flood + 2 * trickle);
+}
+
+/*
+ * Schema
+ */
+
+SIMPLECHAR_FIELD(ts, uint64_t);
+SIMPLECHAR_FIELD(qty, uint32_t);
+SIMPLECHAR_FIELD(side, uint8_t);
+SIMPLECHAR_TEXT_FIELD(symbol);
+SIMPLECHAR_BYTES_FIELD(blob);
+using trade = simplechar::schema<side, ts, symbol, qty, blob>;
+
+/* Look-alikes of trade's fields, one change each */
+SIMPLECHAR_FIELD(amount, uint32_t);
+namespace retyped {
+SIMPLECHAR_FIELD(qty, uint64_t);
+SIMPLECHAR_BYTES_FIELD(symbol);
+} /* namespace retyped */
+
+/* Mixed fields survive a round trip, each where the layout puts it */
+void test_schema_round_trip()
+{
+    const std::string payload_bytes("\0\1\2\3", 4);
+    char buf[128];
+
+    static_assert(trade::offset_of<side>() == 0);
+    static_assert(trade::offset_of<ts>() == 8);
+    static_assert(trade::offset_of<qty>() == 16);
+    static_assert(trade::fixed_size == 28);
+
+    size_t n = trade::encode(buf, uint8_t(1), uint64_t(1234567890123ULL),
+                             std::string_view("ACME"), uint32_t(100),
+                             simplechar::const_buffer(payload_bytes));
+    CHECK(n == trade::fixed_size + 4 + payload_bytes.size());
+    CHECK(n == trade::encoded_size(uint8_t(1), uint64_t(1234567890123ULL),
+                                   std::string_view("ACME"), uint32_t(100),
+                                   simplechar::const_buffer(payload_bytes)));
+
+    auto t = trade::decode(simplechar::const_buffer(buf, n));
+    CHECK(t);
+    CHECK(t->get<side>() == 1);
+    CHECK(t->get<ts>() == 1234567890123ULL);
+    CHECK(t->get<qty>() == 100);
+    CHECK(t->get<symbol>() == "ACME");
+    simplechar::const_buffer b = t->get<blob>();
+    CHECK(std::string(b.data(), b.size()) == payload_bytes);
+    CHECK(t->bytes().size() == n);
+
+    /* Empty variable-size fields, and a buffer one byte short */
+    n = trade::encode(buf, uint8_t(0), uint64_t(0), std::string_view(),
+                      uint32_t(0), simplechar::const_buffer());
+    CHECK(n == trade::fixed_size);
+    t = trade::decode(simplechar::const_buffer(buf, n));
+    CHECK(t && t->get<symbol>().empty() && t->get<blob>().size() == 0);
+    CHECK(trade::encode(simplechar::mutable_buffer(buf, trade::fixed_size - 1),
+                        uint8_t(0), uint64_t(0), std::string_view(),
+                        uint32_t(0), simplechar::const_buffer()) == 0);
+}
+
+/* Truncated records and corrupt end offsets are refused */
+void test_schema_decode_rejects()
+{
+    char buf[128];
+    size_t n = trade::encode(buf, uint8_t(1), uint64_t(2),
+                             std::string_view("ACME"), uint32_t(3),
+                             simplechar::const_buffer("xyz", 3));
+    const size_t table = trade::fixed_size - 2 * sizeof(uint32_t);
+    uint32_t end;
+
+    CHECK(n == trade::fixed_size + 7);
+    CHECK(!trade::decode(simplechar::const_buffer(buf, trade::fixed_size - 1)));
+    CHECK(!trade::decode(simplechar::const_buffer(buf, n - 1)));
+    CHECK(trade::decode(simplechar::const_buffer(buf, n)));
+
+    /* The second end offset before the first */
+    std::memcpy(&end, buf + table + sizeof(end), sizeof(end));
+    CHECK(end == 7);
+    end = 2;
+    std::memcpy(buf + table + sizeof(end), &end, sizeof(end));
+    CHECK(!trade::decode(simplechar::const_buffer(buf, n)));
+
+    /* An end offset past the record */
+    end = 0xffffff00;
+    std::memcpy(buf + table + sizeof(end), &end, sizeof(end));
+    CHECK(!trade::decode(simplechar::const_buffer(buf, n)));
+}
+
+/* The hash follows the names, order, kinds and sizes of the fields */
+void test_schema_hash()
+{
+    using same = simplechar::schema<side, ts, symbol, qty, blob>;
+    using renamed = simplechar::schema<side, ts, symbol, amount, blob>;
+    using reordered = simplechar::schema<ts, side, symbol, qty, blob>;
+    using resized = simplechar::schema<side, ts, symbol, retyped::qty, blob>;
+    using rekinded = simplechar::schema<side, ts, retyped::symbol, qty, blob>;
+    using shorter = simplechar::schema<side, ts, symbol, qty>;
+
+    static_assert(same::hash == trade::hash);
+    CHECK(renamed::hash != trade::hash);
+    CHECK(reordered::hash != trade::hash);
+    CHECK(resized::hash != trade::hash);
+    CHECK(rekinded::hash != trade::hash);
+    CHECK(shorter::hash != trade::hash);
+    CHECK(trade::hash != 0);
+}
+
+/* Records pushed through a ring decode on the other end */
+void test_schema_ring()
+{
+    stand_in file("schema");
+    const uint64_t size = uint64_t(::sysconf(_SC_PAGESIZE));
+
+    file.format_ring(size);
+    simplechar::device dev = simplechar::device::open(file.path());
+    simplechar::ring_producer rp(dev, trade::hash);
+    simplechar::ring_consumer rc(dev, trade::hash);
+    std::vector<uint32_t> seen;
+
+    for (uint32_t i = 0; i < 5; i++) {
+        CHECK(simplechar::try_push<trade>(rp, uint8_t(i & 1), uint64_t(i),
+                                          std::string_view("SYM"), i,
+                                          simplechar::const_buffer()));
+    }
+    CHECK(simplechar::push<trade>(rp, uint8_t(0), uint64_t(5),
+                                  std::string_view("SYM"), uint32_t(5),
+                                  simplechar::const_buffer()));
+    rp.publish();
+
+    /* Too large for any slot: refused, nothing pushed */
+    std::string big(rp.max_record(), 'x');
+    CHECK(!simplechar::push<trade>(rp, uint8_t(0), uint64_t(0),
+                                   std::string_view(big), uint32_t(0),
+                                   simplechar::const_buffer()));
+
+    CHECK(rc.consume([&](simplechar::const_buffer rec) {
+        auto t = trade::decode(rec);
+        CHECK(t);
+        CHECK(t->get<symbol>() == "SYM");
+        CHECK(t->get<ts>() == t->get<qty>());
+        seen.push_back(t->get<qty>());
+    }) == 6);
+    CHECK((seen == std::vector<uint32_t>{0, 1, 2, 3, 4, 5}));
+}
+
+/* An end speaking another schema is refused at open with EPROTO */
+void test_schema_mismatch()
+{
+    using other = simplechar::schema<side, ts, symbol, amount, blob>;
+    stand_in file("schema");
+    const uint64_t size = uint64_t(::sysconf(_SC_PAGESIZE));
+    int err = 0;
+
+    file.format_ring(size);
+    simplechar::device dev = simplechar::device::open(file.path());
+    simplechar::ring_producer rp(dev, trade::hash);
+
+    try {
+        simplechar::ring_consumer rc(dev, other::hash);
+    } catch (const std::system_error &e) {
+        err = e.code().value();
+    }
+    CHECK(err == EPROTO);
+
+    /* The claim stands for later opens too */
+    err = 0;
+    try {
+        simplechar::ring_producer again(dev, other::hash);
+    } catch (const std::system_error &e) {
+        err = e.code().value();
+    }
+    CHECK(err == EPROTO);
+    simplechar::ring_consumer rc(dev, trade::hash);
+}
+
+/*
+ * Device
+ */
+
+/* at_position reads and writes follow the file position, in batches too */
+void test_device_at_position()
+{
+    stand_in file("device");
+    simplechar::device dev = simplechar::device::open(file.path());
+    const uint64_t at = simplechar::device::at_position;
+    char buf[16] = {};
+
+    CHECK(dev.write(std::string("abc"), at).bytes == 3);
+    CHECK(dev.write(std::string("def"), at).bytes == 3);
+    CHECK(::lseek(dev.fd(), 0, SEEK_CUR) == 6);
+
+    simplechar::open_options opts;
+    opts.use_io_uring = false;
+    simplechar::device plain = simplechar::device::open(file.path(), opts);
+    simplechar::batch b(plain);
+    const std::string gh = "gh", ij = "ij";     /* Batches hold views */
+    CHECK(b.write(gh, at));
+    CHECK(b.write(ij, at));
+    CHECK(b.submit().bytes == 4);
+    CHECK(::lseek(plain.fd(), 0, SEEK_SET) == 0);
+    CHECK(plain.read(simplechar::mutable_buffer(buf, 4), at).bytes == 4);
+    CHECK(std::string(buf, 4) == "ghij");
+    CHECK(file.contents() == "ghijef");
+}
+
+const test_case tests[] = {
+    {"ring_wraparound", test_ring_wraparound},
+    {"ring_rejects_oversize", test_ring_rejects_oversize},
+    {"combiner_ordering", test_combiner_ordering},
+    {"combiner_exited_threads", test_combiner_exited_threads},
+    {"frame_carry_over", test_frame_carry_over},
+    {"frame_bad_crc", test_frame_bad_crc},
+    {"pool_cross_thread_return", test_pool_cross_thread_return},
+    {"pool_local_cache", test_pool_local_cache},
+    {"pool_read", test_pool_read},
+    {"fanin_fairness", test_fanin_fairness},
+    {"schema_round_trip", test_schema_round_trip},
+    {"schema_decode_rejects", test_schema_decode_rejects},
+    {"schema_hash", test_schema_hash},
+    {"schema_ring", test_schema_ring},
+    {"schema_mismatch", test_schema_mismatch},
+    {"device_at_position", test_device_at_position},
+};
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+    return run_tests(argc, argv, tests);
+}
@@ -0,0 +1,162 @@
+/*
+ * test_util.h - Shared helpers of the libsimplechar tests
+ *
+ * CHECK() throws on failure, so a test is a plain function that returns
+ * when it passes. Failures print in the format of unit_tests.sh.
+ *
+ * License: MIT
+ */
+
+#ifndef SIMPLECHAR_TEST_UTIL_H
+#define SIMPLECHAR_TEST_UTIL_H
+
+#include "simplechar_ioctl.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace simplechar::testing {
+
+/* Colors, as in unit_tests.sh */
+inline const char *const red = "\033[0;31m";
+inline const char *const green = "\033[0;32m";
+inline const char *const blue = "\033[0;34m";
+inline const char *const nc = "\033[0m";
+
+struct test_failure : std::runtime_error {
+    test_failure(const char *file, int line, const char *what)
+        : std::runtime_error(std::string(file) + ":" + std::to_string(line) +
+                             ": " + what) {}
+};
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            throw simplechar::testing::test_failure(__FILE__, __LINE__, \
+                                                    #cond);             \
+        }                                                               \
+    } while (0)
+
+/* A file in TMPDIR that stands in for the device, removed afterwards */
+class stand_in {
+public:
+    explicit stand_in(const char *tag)
+    {
+        const char *dir = std::getenv("TMPDIR");
+        std::string tmpl = std::string(dir ? dir : "/tmp") +
+                           "/simplechar-" + tag + "-XXXXXX";
+        std::vector<char> name(tmpl.begin(), tmpl.end());
+
+        name.push_back('\0');
+        int fd = ::mkstemp(name.data());
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "cannot create " + tmpl);
+        }
+        ::close(fd);
+        path_ = name.data();
+    }
+
+    ~stand_in() { ::unlink(path_.c_str()); }
+
+    stand_in(const stand_in &) = delete;
+    stand_in &operator=(const stand_in &) = delete;
+
+    const std::string &path() const noexcept { return path_; }
+
+    /* Lay the file out like the driver's ring of size data bytes */
+    void format_ring(uint64_t size)
+    {
+        uint64_t page = uint64_t(::sysconf(_SC_PAGESIZE));
+        simplechar_ring_header hdr{};
+        int fd = ::open(path_.c_str(), O_RDWR | O_CLOEXEC);
+
+        hdr.magic = SIMPLECHAR_RING_MAGIC;
+        hdr.version = SIMPLECHAR_RING_VERSION;
+        hdr.size = size;
+        hdr.data_offset = page;
+        bool ok = fd >= 0 && ::ftruncate(fd, off_t(page + size)) == 0 &&
+                  ::pwrite(fd, &hdr, sizeof(hdr), 0) == ssize_t(sizeof(hdr));
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        if (!ok) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "cannot format " + path_);
+        }
+    }
+
+    std::string contents() const
+    {
+        std::string out;
+        char buf[4096];
+        int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+        ssize_t n;
+
+        while (fd >= 0 && (n = ::read(fd, buf, sizeof(buf))) > 0) {
+            out.append(buf, size_t(n));
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return out;
+    }
+
+private:
+    std::string path_;
+};
+
+struct test_case {
+    const char *name;
+    void (*fn)();
+};
+
+inline bool run_test(const test_case &t)
+{
+    std::printf("%s[TEST]%s %s\n", blue, nc, t.name);
+    try {
+        t.fn();
+    } catch (const std::exception &e) {
+        std::printf("%s[FAIL]%s %s: %s\n", red, nc, t.name, e.what());
+        return false;
+    }
+    std::printf("%s[PASS]%s %s\n", green, nc, t.name);
+    return true;
+}
+
+/* Run the tests named on the command line, or all of them; the exit status */
+template <size_t N>
+int run_tests(int argc, char **argv, const test_case (&tests)[N])
+{
+    int total = 0, failed = 0;
+
+    for (const test_case &t : tests) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; i++) {
+            selected = selected || !std::strcmp(argv[i], t.name);
+        }
+        if (!selected) {
+            continue;
+        }
+        total++;
+        failed += !run_test(t);
+    }
+
+    std::printf("\n%d tests, %d passed, %d failed\n", total, total - failed,
+                failed);
+    return failed ? 1 : 0;
+}
+
+} /* namespace simplechar::testing */
+
+#endif /* SIMPLECHAR_TEST_UTIL_H */
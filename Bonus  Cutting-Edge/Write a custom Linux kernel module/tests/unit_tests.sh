@@ -210,6 +210,49 @@ test_module_info() {
     fi
 }
 
+# Dirty-range tracking: every write must advance the generation
+test_generation_advances() {
+    local proc_file="/proc/$MODULE_NAME"
+
+    [[ -f "$proc_file" ]] || return 0
+
+    local before=$(awk '/Generation:/ {print $2}' "$proc_file")
+    echo "Generation test" > "$DEVICE_FILE"
+    local after=$(awk '/Generation:/ {print $2}' "$proc_file")
+    (( after > before ))
+}
+
+test_io_lock_counts_acquisitions() {
+    local proc_file="/proc/$MODULE_NAME"
+
+    [[ -f "$proc_file" ]] || return 0
+
+    local before=$(awk '/I\/O Lock:/ {print $3}' "$proc_file")
+    echo "Lock test" > "$DEVICE_FILE"
+    cat "$DEVICE_FILE" > /dev/null
+    local after=$(awk '/I\/O Lock:/ {print $3}' "$proc_file")
+    (( after >= before + 2 ))
+}
+
+test_trace_records_operations() {
+    local proc_file="/proc/$MODULE_NAME"
+    local param="/sys/module/$MODULE_NAME/parameters/trace"
+
+    # Only when loaded with trace_events=N
+    grep -q "Trace:" "$proc_file" 2>/dev/null || return 0
+
+    local saved=$(cat "$param")
+    echo 1 > "$param"
+    local before=$(awk '/Trace:/ {print $3}' "$proc_file")
+    echo "Trace test" > "$DEVICE_FILE"
+    cat "$DEVICE_FILE" > /dev/null
+    local after=$(awk '/Trace:/ {print $3}' "$proc_file")
+    echo "$saved" > "$param"
+
+    # open, write, close, open, read(s), close
+    (( after >= before + 6 ))
+}
+
 # Stress test
 test_stress_operations() {
     local operations=100
@@ -275,6 +318,9 @@ run_test_suite() {
     # Module information
     echo "Module information tests..."
     run_test "Module info access" test_module_info
+    run_test "Generation advances on write" test_generation_advances
+    run_test "I/O lock counts acquisitions" test_io_lock_counts_acquisitions
+    run_test "Trace records operations" test_trace_records_operations
     echo
     
     # Stress tests